@@ -2,8 +2,18 @@
 #define __ZORAGA_RVVM_RV32_H__
 
 #include "ZoraGA/RVdefs.h"
+#include "ZoraGA/RVCoverage.h"
+#include "ZoraGA/RVElf.h"
+#include "ZoraGA/RVFlat.h"
+#include "ZoraGA/RV32Mmu.h"
+#include "ZoraGA/RV32Sbi.h"
+#include "ZoraGA/RV32Linux.h"
+#include "ZoraGA/RV32Semihost.h"
+#include "ZoraGA/RV32Htif.h"
 #include "ZoraGA/defs/RVCSRFmt.h"
 #include "ZoraGA/defs/RVCSRAddr.h"
+#include <atomic>
+#include <set>
 
 namespace ZoraGA::RVVM::RV32
 {
@@ -52,6 +62,15 @@ class rv32
          */
         bool set_start_addr(uint32_t addr);
 
+        /**
+         * @brief Set the privilege mode the VM starts in
+         * 
+         * @param priv 3 for M-Mode, 1 for S-Mode, 0 for U-Mode
+         * @return true 
+         * @return false If the VM is running, or the mode isn't supported
+         */
+        bool set_start_priv(uint8_t priv);
+
         /**
          * @brief Set the compress mode
          * 
@@ -94,12 +113,258 @@ class rv32
          * @return false 
          */
         bool wait_for_stop(uint32_t timeout_ms = 0);
+
+        /**
+         * @brief Fork the VM
+         * 
+         * Registers and CSRs are copied, memories are cloned by rv32_mem::clone, instruction
+         * sets and the SBI are shared with the new VM. The VM must be stopped.
+         * 
+         * @return rv32* New VM owned by the caller, nullptr if the VM is running, a memory can't be
+         *               cloned, or a Linux, semihosting or HTIF handler is set, these hold guest state
+         */
+        rv32 *clone();
+
+        /**
+         * @brief Save registers, CSRs, memories and device states to a snapshot file
+         * 
+         * Memory images are page aligned in the file, so restore can map them.
+         * The VM must be stopped.
+         * 
+         * @param path 
+         * @return true 
+         * @return false 
+         */
+        bool save(std::string path);
+
+        /**
+         * @brief Restore a snapshot saved by save
+         * 
+         * The VM must have the same memory layout as the saved one. Memory images are
+         * mapped MAP_PRIVATE when the memory supports it, so restore only costs the
+         * pages touched afterwards. The VM must be stopped.
+         * 
+         * A snapshot that is bad or doesn't match the VM leaves it as it was. If mapping an
+         * image fails, the host being out of memory, the memories are undefined and the hart
+         * is reset: registers and pc 0, M-Mode, mstatus 0, device states as before.
+         * 
+         * @param path 
+         * @return true 
+         * @return false 
+         */
+        bool restore(std::string path);
+
+        /**
+         * @brief Fetch and clear the dirty pages of all memories
+         * 
+         * @param addrs Output, guest address of each dirty page is appended
+         * @return size_t Number of dirty pages
+         */
+        size_t fetch_dirty(std::vector<uint32_t> &addrs);
+
+        /**
+         * @brief Run the VM in the calling thread
+         * 
+         * Stops before executing an instruction at a breakpoint, except the first one,
+         * so a stopped VM can be resumed. The VM must not be started.
+         * 
+         * @param count Max instructions to execute, 0 for no limit
+         * @return rv_stop 
+         */
+        rv_stop step(uint64_t count = 0);
+
+        /**
+         * @brief Add a breakpoint, the VM stops before executing the instruction at addr
+         * 
+         * @param addr 
+         * @return true 
+         * @return false If the breakpoint already exists
+         */
+        bool add_breakpoint(uint32_t addr);
+
+        /**
+         * @brief Delete a breakpoint
+         * 
+         * @param addr 
+         * @return true 
+         * @return false If the breakpoint doesn't exist
+         */
+        bool del_breakpoint(uint32_t addr);
+
+        /**
+         * @brief Set the branch edge hit-count map
+         * 
+         * Every branch and jump increments map[hash(from) ^ hash(to)], saturated at 255.
+         * 
+         * @param map nullptr to disable
+         * @param size Power of 2
+         * @return true 
+         * @return false 
+         */
+        bool set_edge_map(uint8_t *map, size_t size);
+
+        /**
+         * @brief Set the code coverage collector, counted per block rather than per instruction
+         * 
+         * @param cov nullptr to disable
+         * @return true 
+         * @return false 
+         */
+        bool set_coverage(rv_coverage *cov);
+
+        /**
+         * @brief Set the ELF whose symbols name the PCs in the log
+         * 
+         * @param elf nullptr to disable
+         * @return true 
+         * @return false 
+         */
+        bool set_symbols(rv_elf *elf);
+
+        /**
+         * @brief Run loads and stores through a flat 4 GiB host mapping of the guest space
+         * 
+         * Page aligned regions whose memory supports rv32_mem::map_at are mapped into the
+         * mapping, accesses to other regions go through the region table. Regions added later
+         * are mapped in too, and clones get a flat space of their own. The memories must
+         * outlive the VM, or the flat space, which hands their ranges back with unmap_at.
+         * 
+         * @param enable 
+         * @return true 
+         * @return false If the VM is running, or the space can't be reserved
+         */
+        bool set_flat(bool enable);
+
+        /**
+         * @brief Serve ecall from S-Mode with the SBI in the VM, so a S-Mode kernel runs without firmware
+         * 
+         * M-Mode is set up by RV32Sbi::regist, call it after the instruction sets are added,
+         * and start the VM in S-Mode by set_start_priv. time counts retired instructions,
+         * and sip.STIP is raised when it reaches stimecmp.
+         * 
+         * @param sbi nullptr to disable
+         * @return true 
+         * @return false If the VM is running, or S-Mode isn't enabled
+         */
+        bool set_sbi(RV32Sbi *sbi);
+
+        /**
+         * @brief Run a program loaded by RV32Linux::load, ecall is translated into host syscalls
+         * 
+         * The user space is added at 0, pc and sp are set to the entry and the initial stack.
+         * The VM stops when the program exits.
+         * 
+         * @param user 
+         * @return true 
+         * @return false If the VM is running, or the user space overlaps a memory
+         */
+        bool set_linux(RV32Linux *user);
+
+        /**
+         * @brief Serve semihosting requests, ebreak between slli x0, x0, 0x1f and srai x0, x0, 7
+         * 
+         * Other ebreaks keep their behavior. The VM stops on SYS_EXIT.
+         * 
+         * @param semihost nullptr to disable
+         * @return true 
+         * @return false If the VM is running
+         */
+        bool set_semihost(RV32Semihost *semihost);
+
+        /**
+         * @brief Watch stores to the HTIF tohost mailbox, the VM stops when the guest exits
+         * 
+         * @param htif nullptr to disable, its addresses are set by RV32Htif::set_addr
+         * @return true 
+         * @return false If the VM is running
+         */
+        bool set_htif(RV32Htif *htif);
+
+        /**
+         * @brief Drive an external interrupt line, the lines are ORed into mip.MEIP,
+         * or mip.SEIP with the SBI in the VM
+         * 
+         * Can be called from any thread, device I/O threads included, the hart
+         * takes the change before its next instruction.
+         * 
+         * @param line 0-31
+         * @param level 
+         */
+        void set_ext_irq(uint32_t line, bool level);
+
+        /**
+         * @brief Save registers, CSRs, device states and memory contents as the baseline of revert
+         * 
+         * Memories tracking dirty pages must support rv32_mem::set_baseline.
+         * The VM must be stopped.
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool set_baseline();
+
+        /**
+         * @brief Revert the VM to the baseline
+         * 
+         * Only pages dirtied since the baseline are reverted, so the dirty pages
+         * must not be fetched by others in between. The VM must be stopped.
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool revert();
+
+        /**
+         * @brief Base registers, only to be accessed while the VM is stopped
+         * 
+         * @return rv32_regs_base* 
+         */
+        rv32_regs_base *regs();
+
+        /**
+         * @brief Read guest memory
+         * 
+         * @param addr 
+         * @param p 
+         * @param len 
+         * @return true 
+         * @return false 
+         */
+        bool read_mem(uint32_t addr, void *p, uint32_t len);
+
+        /**
+         * @brief Write guest memory
+         * 
+         * @param addr 
+         * @param p 
+         * @param len 
+         * @return true 
+         * @return false 
+         */
+        bool write_mem(uint32_t addr, void *p, uint32_t len);
     
     private:
         void run();
+        rv_stop loop(uint64_t count);
+        rv_stop loop_run(uint64_t count);
+        bool inst_step();
+        bool flat_map();
+        void flat_sync();
+        void log_symbol(uint32_t pc, bool err);
         // bool mem_isRange(rv32_mem_info &info, uint32_t addr);
-        bool inst_fetch(uint32_t addr, rv32_inst_fmt &out, bool &is_compress);
-        bool inst_exec(rv32_inst_fmt inst);
+        rv_err inst_fetch(uint32_t addr, rv32_inst_fmt &out, bool &is_compress);
+        rv_err inst_exec(rv32_inst_fmt inst);
+        bool semihost_at(uint32_t pc);
+        bool exception(rv_err err, uint32_t epc, uint32_t inst);
+        void trap_enter(uint32_t cause, uint32_t tval, uint32_t epc);
+        void irq_take();
+        void ext_irq_refresh();
+        void mode_refresh();
+        void pmp_refresh();
+        void time_load();
+        void time_store();
+        uint32_t csr_get(uint16_t addr);
+        void csr_set(uint16_t addr, uint32_t val);
         void regs_dump();
 
     private:
@@ -108,10 +373,52 @@ class rv32
         rv32_regs      m_regs;
         rv32_insts_map m_insts;
         rv32_mem_infos m_mems;
+        rv_flat        m_flat;
+        RV32Mmu        m_mmu;
+        /* instruction fetches are translated */
+        bool           m_fetch_xlate = false;
+        /* there is a trap vector, exceptions trap instead of stopping the VM */
+        bool           m_traps = false;
+        /* pending interrupts enabled in the current mode */
+        uint32_t       m_irq   = 0;
+        /* external interrupt lines, and a change not taken by the hart yet */
+        std::atomic<uint32_t> m_ext_lines{0};
+        std::atomic<bool>     m_ext_changed{false};
+        RV32Sbi       *m_sbi   = nullptr;
+        RV32Linux     *m_linux = nullptr;
+        RV32Semihost  *m_semihost = nullptr;
+        RV32Htif      *m_htif  = nullptr;
+        /* time, kept in the time/timeh CSRs while the VM is stopped */
+        uint64_t       m_time    = 0;
+        /* stimecmp, UINT64_MAX once reached */
+        uint64_t       m_timecmp = UINT64_MAX;
         rv32_event     m_event;
         rv32_comprs   *m_comprs = nullptr;
         rvlog         *m_log = nullptr;
 
+        /* memories cloned from the parent VM */
+        std::vector<rv32_mem*> m_clones;
+
+        std::set<uint32_t> m_breakpoints;
+
+        uint8_t *m_edges     = nullptr;
+        uint32_t m_edge_mask = 0;
+        uint32_t m_edge_prev = 0;
+
+        rv_coverage *m_cov   = nullptr;
+        rv_elf      *m_syms  = nullptr;
+        bool m_block_entry   = true;
+
+        /* instructions executed by loop */
+        uint64_t m_steps = 0;
+
+        /* baseline of revert */
+        bool m_has_base = false;
+        rv32_regs_base m_base_reg;
+        rv32_regs_fp   m_base_fp;
+        rv32_regs_ctrl m_base_ctl;
+        std::vector<std::vector<uint8_t>> m_base_states;
+
         std::mutex m_mutex;
         std::thread *m_thread = nullptr;
 
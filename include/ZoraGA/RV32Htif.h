@@ -0,0 +1,76 @@
+#ifndef __ZORAGA_RVVM_RV32HTIF_H__
+#define __ZORAGA_RVVM_RV32HTIF_H__
+
+#include "ZoraGA/RVdefs.h"
+#include <stdio.h>
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief HTIF tohost/fromhost mailbox, as riscv-tests and their benchmarks use it
+ *
+ * The guest stores a 64-bit command to tohost. An odd value with device 0 is an exit,
+ * the code is value >> 1, 0 for a pass and the failing test number otherwise. An even
+ * value is the address of a syscall block, 8 64-bit words: which, then the arguments,
+ * the result goes back to the first word and fromhost is set to 1. Only write (64) to
+ * stdout/stderr and exit (93) are served. tohost is cleared once a command is done.
+ * The blocking character device isn't emulated.
+ */
+class RV32Htif
+{
+    public:
+        /**
+         * @brief Set the mailbox addresses, physical
+         *
+         * @param tohost
+         * @param fromhost 0 if there is none, syscalls are then not acknowledged
+         */
+        void set_addr(uint32_t tohost, uint32_t fromhost);
+
+        /**
+         * @brief Set the output of the write syscall
+         *
+         * @param out stdout by default, nullptr to drop it
+         */
+        void set_console(FILE *out);
+
+        /**
+         * @brief Check a store hits tohost
+         *
+         * @param addr Physical address of the store
+         * @param len
+         * @return true If tohost must be read by written()
+         */
+        bool hit(uint32_t addr, uint32_t len);
+
+        /**
+         * @brief Serve the command stored to tohost, if there is one
+         *
+         * @param mems Physical memories
+         * @return true
+         * @return false If the guest exited, the VM should stop
+         */
+        bool written(rv32_mem_infos &mems);
+
+        /**
+         * @brief Exit code of the guest
+         *
+         * @return int
+         */
+        int exit_code();
+
+    private:
+        void syscall(uint32_t addr, rv32_mem_infos &mems, bool &exit);
+        void write64(uint32_t addr, uint64_t val, rv32_mem_infos &mems);
+
+    private:
+        uint32_t m_tohost   = 0;
+        uint32_t m_fromhost = 0;
+        FILE    *m_out  = stdout;
+        int      m_exit = 0;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32HTIF_H__
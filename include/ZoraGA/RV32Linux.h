@@ -0,0 +1,124 @@
+#ifndef __ZORAGA_RVVM_RV32LINUX_H__
+#define __ZORAGA_RVVM_RV32LINUX_H__
+
+#include "ZoraGA/RVdefs.h"
+#include "ZoraGA/RVElf.h"
+#include <map>
+#include <set>
+
+/* user space of the guest, [0, RV32_LINUX_SPACE) */
+#define RV32_LINUX_SPACE      0xC0000000U
+#define RV32_LINUX_STACK_SIZE (8U * 1024 * 1024)
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief Linux user-mode emulation, ecall is translated into host syscalls
+ *
+ * The whole user space is one demand-zero host mapping added to the VM at 0, so
+ * guest pointers are host pointers plus an offset, and the VM's flat space can map it.
+ * brk and mmap hand out ranges of it, munmap releases the pages. Memory protection
+ * isn't enforced, and file mappings are private copies. File descriptors are the
+ * host ones, flags and structures of the asm-generic ABI are passed through when the
+ * host layout is the same. A syscall not translated returns -ENOSYS.
+ */
+class RV32Linux
+{
+    public:
+        RV32Linux();
+        ~RV32Linux();
+
+        /**
+         * @brief Load a static ELF and build the initial stack
+         *
+         * @param path
+         * @param argv argv[0] is usually path
+         * @param envp
+         * @return true
+         * @return false If the ELF can't be loaded, or isn't static
+         */
+        bool load(std::string path, const std::vector<std::string> &argv, const std::vector<std::string> &envp);
+
+        /**
+         * @brief User space of the guest, to be added to the VM at 0 with RV32_LINUX_SPACE bytes
+         *
+         * @return rv32_mem*
+         */
+        rv32_mem *space();
+
+        uint32_t entry();
+
+        /**
+         * @brief Initial sp, pointing at argc
+         *
+         * @return uint32_t
+         */
+        uint32_t stack();
+
+        /**
+         * @brief Serve an ecall, a7 is the syscall number, a0-a5 the arguments, a0 the result
+         *
+         * @param regs
+         * @return true
+         * @return false If the program exited
+         */
+        bool call(rv32_regs &regs);
+
+        /**
+         * @brief Exit status of the program
+         *
+         * @return int
+         */
+        int exit_code();
+
+    private:
+        class user_space:public rv32_mem
+        {
+            public:
+                ~user_space();
+                bool reserve(uint32_t len);
+                uint8_t *base();
+                rv_err read(uint32_t addr, void *data, uint32_t len);
+                rv_err write(uint32_t addr, void *data, uint32_t len);
+                void *host(uint32_t &len);
+                rv_err map_at(void *addr, uint32_t len);
+                void unmap_at(void *addr, uint32_t len);
+
+            private:
+                uint8_t *m_base = nullptr;
+                uint32_t m_len  = 0;
+        };
+
+        template<typename V> V *ptr(uint32_t addr, uint32_t len = sizeof(V));
+        const char *str(uint32_t addr);
+        bool push(uint32_t &sp, const void *data, uint32_t len);
+        uint32_t sys_brk(uint32_t addr);
+        int32_t sys_mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags, int32_t fd, uint32_t pgoff);
+        int32_t sys_munmap(uint32_t addr, uint32_t len);
+        int32_t sys_iov(bool wr, int32_t fd, uint32_t iov, uint32_t cnt);
+        int32_t sys_uname(uint32_t addr);
+        uint32_t map_find(uint32_t len);
+        void release(uint32_t addr, uint32_t len);
+        int64_t fd_add(int64_t fd);
+        bool guest_fd(int32_t fd);
+        bool fd_args(uint32_t nr, const uint32_t *a);
+        void fd_close_all();
+
+    private:
+        rv_elf     m_elf;
+        user_space m_space;
+        uint32_t   m_entry = 0;
+        uint32_t   m_sp    = 0;
+        uint32_t   m_brk_start = 0;
+        uint32_t   m_brk   = 0;
+        /* mmap ranges, start -> end */
+        std::map<uint32_t, uint32_t> m_maps;
+        /* host fds opened by the program, the only ones it can close */
+        std::set<int32_t> m_fds;
+        int        m_exit  = 0;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32LINUX_H__
@@ -0,0 +1,159 @@
+#ifndef __ZORAGA_RVVM_RV32MMU_H__
+#define __ZORAGA_RVVM_RV32MMU_H__
+
+#include "ZoraGA/RVdefs.h"
+
+/* entries of the TLB, power of 2 */
+#define RV32_TLB_SIZE 256
+
+/* PMP entries enforced, pmpcfg0-3 and pmpaddr0-15 */
+#define RV32_PMP_COUNT 16
+
+/* entries of the PMP page permission cache, power of 2 */
+#define RV32_PMP_CACHE_SIZE 64
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief Sv32 page table walker with a direct-mapped software TLB, and PMP checker
+ *
+ * Entries are tagged by ASID, global mappings match any ASID, so writing satp
+ * doesn't flush anything. Megapages are cached as 4 KiB entries, flushing one
+ * address flushes the whole megapage. A and D bits are set by the walker, an
+ * entry without D is walked again on the first store.
+ *
+ * PMP applies to S-Mode and U-Mode accesses, page table walks included, and to
+ * M-Mode accesses matching a locked entry. The permissions of a physical page
+ * are cached when one PMP entry decides the whole page, and copied into the TLB
+ * entries mapping it, so a TLB hit checks nothing else.
+ */
+class RV32Mmu:public rv32_mmu
+{
+    public:
+        RV32Mmu();
+
+        /**
+         * @brief Memories the page tables are read from
+         *
+         * @param mems Physical accesses only, mems->xlate is not used
+         */
+        void set_mems(rv32_mem_infos *mems);
+
+        /**
+         * @brief Set the translation context
+         *
+         * @param satp
+         * @param priv Privilege of instruction fetches
+         * @param data_priv Privilege of loads and stores, MPP if mstatus.MPRV is set in M-Mode
+         * @param mstatus For SUM and MXR
+         */
+        void set_context(uint32_t satp, uint8_t priv, uint8_t data_priv, uint32_t mstatus);
+
+        /**
+         * @brief Set the PMP entries, drops the cached permissions
+         *
+         * @param cfg pmpcfg0-3
+         * @param addr pmpaddr0-15
+         */
+        void set_pmp(const uint32_t cfg[RV32_PMP_COUNT / 4], const uint32_t addr[RV32_PMP_COUNT]);
+
+        /**
+         * @brief Are accesses of the type translated or checked, in the current context
+         *
+         * @param acc
+         * @return true
+         * @return false M-Mode without locked PMP entries, addresses are physical and not checked
+         */
+        bool active(rv_access acc);
+
+        using rv32_mmu::translate;
+        rv_err translate(uint32_t addr, uint32_t len, rv_access acc, uint32_t &paddr);
+
+        /**
+         * @brief sfence.vma
+         *
+         * @param fence Page and address space to flush, everything if neither is given
+         */
+        void fence(const rv_sfence<uint32_t> &fence);
+
+        /**
+         * @brief Flush the whole TLB, after page tables are changed behind the guest
+         */
+        void flush();
+
+        /**
+         * @brief Take the fault of the last failed translate
+         *
+         * @param addr Output, virtual address
+         * @param acc Output, access type
+         * @return rv_err RV_EPAGE or RV_EACCESS, RV_EOK if there is no fault since the last call
+         */
+        rv_err fault(uint32_t &addr, rv_access &acc);
+
+    private:
+        typedef struct tlb_entry
+        {
+            /* virtual page number, UINT32_MAX if invalid */
+            uint32_t vpn;
+            /* physical page number of the 4 KiB page */
+            uint32_t ppn;
+            uint16_t asid;
+            /* PTE bits V R W X U G A D */
+            uint8_t  pte;
+            /* part of a megapage */
+            bool     mega;
+            /* PMP permissions of the whole page, 1 << rv_access */
+            uint8_t  pmp;
+        }tlb_entry;
+
+        typedef struct pmp_rule
+        {
+            /* [lo, hi) physical */
+            uint64_t lo;
+            uint64_t hi;
+            uint8_t  perm;
+            /* L, the entry applies to M-Mode too */
+            bool     lock;
+        }pmp_rule;
+
+        typedef struct pmp_page
+        {
+            /* physical page number, UINT32_MAX if invalid */
+            uint32_t ppn;
+            uint8_t  perm;
+        }pmp_page;
+
+        rv_err walk(uint32_t addr, rv_access acc, uint8_t priv, tlb_entry &e);
+        bool allowed(uint8_t pte, rv_access acc, uint8_t priv);
+        uint8_t pmp_perm(uint32_t ppn);
+        bool pmp_allowed(uint32_t paddr, uint32_t len, rv_access acc, uint8_t priv);
+
+    private:
+        rv32_mem_infos *m_mems = nullptr;
+        tlb_entry m_tlb[RV32_TLB_SIZE];
+        /* megapage entries may be cached */
+        bool     m_mega      = false;
+
+        bool     m_on        = false;
+        uint16_t m_asid      = 0;
+        uint32_t m_root      = 0;
+        uint8_t  m_priv      = 3;
+        uint8_t  m_data_priv = 3;
+        bool     m_sum       = false;
+        bool     m_mxr       = false;
+
+        /* enabled PMP entries, by priority */
+        std::vector<pmp_rule> m_pmp;
+        /* an entry is locked, M-Mode accesses are checked */
+        bool     m_pmp_lock  = false;
+        pmp_page m_pmp_cache[RV32_PMP_CACHE_SIZE];
+
+        uint32_t  m_fault_addr = 0;
+        rv_access m_fault_acc  = RV_ACC_R;
+        rv_err    m_fault      = RV_EOK;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32MMU_H__
@@ -15,8 +15,20 @@ class RV32Privileged:public rv32_inst
         rv_err regist(rv32_regs &regs, std::vector<std::string> &isas);
 
     public:
+        /**
+         * @brief Enable S-Mode, before the instruction set is added to a VM
+         * 
+         * @param ena 
+         */
         void s_mode(bool ena);
 
+        /**
+         * @brief Enable U-Mode, implied by S-Mode
+         * 
+         * @param ena 
+         */
+        void u_mode(bool ena);
+
     private:
         rv_err sret(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos);
         rv_err mret(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos);
@@ -28,6 +40,8 @@ class RV32Privileged:public rv32_inst
         rv_err sfence_inval_ir(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos);
 
     private:
+        uint32_t csr_get(rv32_regs &regs, uint16_t addr);
+        void csr_set(rv32_regs &regs, uint16_t addr, uint32_t val);
         bool op_aa_match(rv32_inst_fmt inst);
         bool op_bbb_match(rv32_inst_fmt inst);
         bool op_cc_match(rv32_inst_fmt inst);
@@ -35,6 +49,7 @@ class RV32Privileged:public rv32_inst
     private:
         rvlog *m_log = nullptr;
         bool m_smode = false;
+        bool m_umode = false;
 };
 
 }
@@ -0,0 +1,74 @@
+#ifndef __ZORAGA_RVVM_RV32SBI_H__
+#define __ZORAGA_RVVM_RV32SBI_H__
+
+#include "ZoraGA/RVdefs.h"
+#include "ZoraGA/defs/RVCSRAddr.h"
+#include <stdio.h>
+
+/* nominal frequency of time, which counts retired instructions, as timebase-frequency of a device tree */
+#define RV32_SBI_TIMEBASE 10000000
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief SBI served by the VM, in place of M-Mode firmware
+ *
+ * ecall from S-Mode is handled natively for the single hart of the VM: Base,
+ * TIME, sPI, RFNC, DBCN and SRST extensions, and the legacy calls. The timer
+ * compare value is kept in stimecmp/stimecmph, time counts retired instructions,
+ * and the VM raises sip.STIP when time reaches it, so the timer costs no
+ * emulated M-Mode code. There is no console input.
+ */
+class RV32Sbi
+{
+    public:
+        /**
+         * @brief Set the console output
+         *
+         * @param out stdout by default, nullptr to drop console output
+         */
+        void set_console(FILE *out);
+
+        /**
+         * @brief Set up M-Mode as firmware would before jumping to a S-Mode kernel
+         *
+         * There is no M-Mode trap handler, so every exception S-Mode can handle and the
+         * S-Mode interrupts are delegated, and PMP opens the whole space to S-Mode and U-Mode.
+         * stimecmp/stimecmph are added. Called by rv32::set_sbi.
+         *
+         * @param regs
+         * @return rv_err RV_EMISSING if S-Mode isn't enabled
+         */
+        rv_err regist(rv32_regs &regs);
+
+        /**
+         * @brief Serve an ecall from S-Mode
+         *
+         * a7 is the extension, a6 the function, a0/a1 return the error and the value.
+         * CSRs written are flagged by csr_changed, TLB flushes by sfence.
+         *
+         * @param regs
+         * @param mems Physical memories, for the debug console
+         * @return true
+         * @return false System reset or shutdown requested, the VM should stop
+         */
+        bool call(rv32_regs &regs, rv32_mem_infos &mems);
+
+    private:
+        int32_t base(uint32_t fid, uint32_t *a, uint32_t &val, rv32_regs &regs);
+        int32_t timer(uint32_t lo, uint32_t hi, rv32_regs &regs);
+        int32_t ipi(uint32_t mask, uint32_t mask_base, rv32_regs &regs);
+        int32_t rfence(uint32_t fid, uint32_t *a, rv32_regs &regs);
+        int32_t dbcn(uint32_t fid, uint32_t *a, uint32_t &val, rv32_mem_infos &mems);
+        int32_t hart_mask(uint32_t mask, uint32_t mask_base, bool &self);
+        uint32_t csr_get(rv32_regs &regs, uint16_t addr);
+        void csr_set(rv32_regs &regs, uint16_t addr, uint32_t val);
+
+    private:
+        FILE *m_out = stdout;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32SBI_H__
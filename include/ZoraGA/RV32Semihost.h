@@ -0,0 +1,77 @@
+#ifndef __ZORAGA_RVVM_RV32SEMIHOST_H__
+#define __ZORAGA_RVVM_RV32SEMIHOST_H__
+
+#include "ZoraGA/RVdefs.h"
+#include <chrono>
+#include <stdio.h>
+
+/* slli x0, x0, 0x1f / ebreak / srai x0, x0, 7 */
+#define RV32_SEMIHOST_ENTRY 0x01f01013
+#define RV32_SEMIHOST_EXIT  0x40705013
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief RISC-V semihosting, the host serves I/O requests of the guest
+ *
+ * An ebreak between slli x0, x0, 0x1f and srai x0, x0, 7 is a request, a0 is the
+ * operation, a1 points at the parameter block, a0 returns the result. Buffers are
+ * moved whole between guest physical memory and the host, so a write costs one host
+ * call whatever its length. The console is ":tt", other names are host files.
+ */
+class RV32Semihost
+{
+    public:
+        RV32Semihost();
+        ~RV32Semihost();
+
+        /**
+         * @brief Set the console
+         *
+         * @param in stdin by default, nullptr for no input
+         * @param out stdout by default, nullptr to drop console output
+         */
+        void set_console(FILE *in, FILE *out);
+
+        /**
+         * @brief Serve a request
+         *
+         * @param regs
+         * @param mems Physical memories, pointers of the guest are physical addresses
+         * @return true
+         * @return false If the guest called SYS_EXIT, the VM should stop
+         */
+        bool call(rv32_regs &regs, rv32_mem_infos &mems);
+
+        /**
+         * @brief Exit code of SYS_EXIT, 0 for ADP_Stopped_ApplicationExit, 1 for other reasons
+         *
+         * @return int
+         */
+        int exit_code();
+
+    private:
+        int32_t sys_open(uint32_t *arg, rv32_mem_infos &mems);
+        int32_t sys_close(uint32_t handle);
+        int32_t sys_write(uint32_t *arg, rv32_mem_infos &mems);
+        int32_t sys_read(uint32_t *arg, rv32_mem_infos &mems);
+        int32_t sys_seek(uint32_t *arg);
+        int32_t sys_flen(uint32_t handle);
+        void    sys_exit(uint32_t reason, uint32_t code);
+        bool args(uint32_t addr, uint32_t *arg, uint32_t cnt, rv32_mem_infos &mems);
+        int  host_fd(uint32_t handle);
+
+    private:
+        FILE *m_in  = stdin;
+        FILE *m_out = stdout;
+        /* host fd of each handle, -1 for a closed one; handles start at 1 */
+        std::vector<int> m_files;
+        int   m_errno = 0;
+        int   m_exit  = 0;
+        std::chrono::steady_clock::time_point m_start;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32SEMIHOST_H__
@@ -0,0 +1,80 @@
+#ifndef __ZORAGA_RVVM_RV32Zb_H__
+#define __ZORAGA_RVVM_RV32Zb_H__
+
+#include "ZoraGA/RVdefs.h"
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief Bit manipulation, Zba, Zbb, Zbc and Zbs of RV32
+ *
+ * clz/ctz/cpop are a single lzcnt/tzcnt/popcnt and clmul* a single pclmulqdq
+ * on x86 hosts having them, rev8 a bswap, builtins are used on other hosts.
+ */
+class RV32Zb:public rv32_inst
+{
+    public:
+        rv_err isValid(rv32_inst_fmt inst);
+        rv_err exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos);
+        rv_err set_log(rvlog *log);
+        rv_err regist(rv32_regs &regs, std::vector<std::string> &isas);
+
+    private:
+        typedef struct inst_arg
+        {
+            rv32_inst_fmt inst;
+            rv32_regs *regs;
+            rv32_mem_infos *mems;
+        }inst_args;
+
+        typedef rv_err (RV32Zb::*inst_fn)(inst_args args);
+        inst_fn decode(rv32_inst_fmt inst);
+
+        /* Zba */
+        rv_err sh1add(inst_args args);
+        rv_err sh2add(inst_args args);
+        rv_err sh3add(inst_args args);
+
+        /* Zbb */
+        rv_err andn(inst_args args);
+        rv_err orn(inst_args args);
+        rv_err xnor(inst_args args);
+        rv_err clz(inst_args args);
+        rv_err ctz(inst_args args);
+        rv_err cpop(inst_args args);
+        rv_err max(inst_args args);
+        rv_err maxu(inst_args args);
+        rv_err min(inst_args args);
+        rv_err minu(inst_args args);
+        rv_err sext_b(inst_args args);
+        rv_err sext_h(inst_args args);
+        rv_err zext_h(inst_args args);
+        rv_err rol(inst_args args);
+        rv_err ror(inst_args args);
+        rv_err rori(inst_args args);
+        rv_err orc_b(inst_args args);
+        rv_err rev8(inst_args args);
+
+        /* Zbc */
+        rv_err clmul(inst_args args);
+        rv_err clmulh(inst_args args);
+        rv_err clmulr(inst_args args);
+
+        /* Zbs */
+        rv_err bclr(inst_args args);
+        rv_err bclri(inst_args args);
+        rv_err bext(inst_args args);
+        rv_err bexti(inst_args args);
+        rv_err binv(inst_args args);
+        rv_err binvi(inst_args args);
+        rv_err bset(inst_args args);
+        rv_err bseti(inst_args args);
+
+    private:
+        rvlog *m_log = nullptr;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32Zb_H__
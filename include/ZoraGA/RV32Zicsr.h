@@ -22,6 +22,14 @@ class RV32Zicsr:public rv32_inst
         rv_err csrrwi(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mems);
         rv_err csrrsi(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mems);
         rv_err csrrci(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mems);
+        rv_err csr_read(rv32_regs &regs, rv_csr_addr_fmt addr, uint32_t &val);
+        rv_err csr_write(rv32_regs &regs, rv_csr_addr_fmt addr, uint32_t val);
+        void csr_written(rv32_regs &regs, rv_csr_addr_fmt addr);
+        uint32_t csr_get(rv32_regs &regs, uint16_t addr);
+        void csr_set(rv32_regs &regs, uint16_t addr, uint32_t val);
+        uint8_t pmp_cfg(rv32_regs &regs, uint32_t i);
+        bool satp_trapped(rv32_regs &regs, rv_csr_addr_fmt addr);
+        bool counter_trapped(rv32_regs &regs, rv_csr_addr_fmt addr);
 
     private:
         bool op_aa_match(rv32_inst_fmt inst);
@@ -0,0 +1,56 @@
+#ifndef __ZORAGA_RVVM_RV32Zkn_H__
+#define __ZORAGA_RVVM_RV32Zkn_H__
+
+#include "ZoraGA/RVdefs.h"
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief Scalar cryptography, Zkne/Zknd (AES) and Zknh (SHA-2) of RV32
+ *
+ * The AES byte lanes go through AES-NI on x86 hosts, one aesenc(last) or
+ * aesdec(last) per instruction, tables are used on other hosts. The SHA-2
+ * sigma and sum functions are host rotates and shifts.
+ */
+class RV32Zkn:public rv32_inst
+{
+    public:
+        rv_err isValid(rv32_inst_fmt inst);
+        rv_err exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos);
+        rv_err set_log(rvlog *log);
+        rv_err regist(rv32_regs &regs, std::vector<std::string> &isas);
+
+    private:
+        typedef struct inst_arg
+        {
+            rv32_inst_fmt inst;
+            rv32_regs *regs;
+            rv32_mem_infos *mems;
+        }inst_args;
+
+        typedef rv_err (RV32Zkn::*inst_fn)(inst_args args);
+        inst_fn decode(rv32_inst_fmt inst);
+
+        rv_err aes32esi(inst_args args);
+        rv_err aes32esmi(inst_args args);
+        rv_err aes32dsi(inst_args args);
+        rv_err aes32dsmi(inst_args args);
+        rv_err sha256sig0(inst_args args);
+        rv_err sha256sig1(inst_args args);
+        rv_err sha256sum0(inst_args args);
+        rv_err sha256sum1(inst_args args);
+        rv_err sha512sig0l(inst_args args);
+        rv_err sha512sig0h(inst_args args);
+        rv_err sha512sig1l(inst_args args);
+        rv_err sha512sig1h(inst_args args);
+        rv_err sha512sum0r(inst_args args);
+        rv_err sha512sum1r(inst_args args);
+
+    private:
+        rvlog *m_log = nullptr;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RV32Zkn_H__
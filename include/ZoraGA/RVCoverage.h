@@ -0,0 +1,87 @@
+#ifndef __ZORAGA_RVVM_RVCOVERAGE_H__
+#define __ZORAGA_RVVM_RVCOVERAGE_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ZoraGA::RVVM
+{
+
+/**
+ * @brief Guest code coverage, hit counts per 2-byte code slot in [base, base+len)
+ *
+ * The VM counts block entries and the taken/not-taken outcome of conditional branches.
+ * Instruction counts are derived when dumping, by walking each block to its end.
+ *
+ * Raw map layout, little-endian:
+ *   "RVCOV\0\0\0", uint32_t base, uint32_t len,
+ *   uint32_t blocks[len/2], uint32_t taken[len/2], uint32_t not_taken[len/2]
+ */
+class rv_coverage
+{
+    public:
+        /**
+         * @brief Set the code range and clear the counts
+         *
+         * @param base
+         * @param len
+         * @return true
+         * @return false
+         */
+        bool set_range(uint32_t base, uint32_t len);
+
+        void reset();
+
+        /**
+         * @brief Count a block entry
+         *
+         * @param pc First instruction of the block
+         */
+        void block(uint32_t pc)
+        {
+            uint32_t i = (pc - m_base) >> 1;
+            if (i < m_blocks.size()) m_blocks[i]++;
+        }
+
+        /**
+         * @brief Count a conditional branch outcome
+         *
+         * @param pc Branch instruction
+         * @param taken
+         */
+        void branch(uint32_t pc, bool taken)
+        {
+            uint32_t i = (pc - m_base) >> 1;
+            if (i < m_blocks.size()) (taken ? m_taken : m_not_taken)[i]++;
+        }
+
+        /**
+         * @brief Dump the raw hit-count map
+         *
+         * @param path
+         * @return true
+         * @return false
+         */
+        bool dump_raw(std::string path);
+
+        /**
+         * @brief Dump lcov tracefile, lines from the DWARF line table of elf
+         *
+         * @param path
+         * @param elf ELF file the guest code is built from
+         * @return true
+         * @return false If the ELF has no line table
+         */
+        bool dump_lcov(std::string path, std::string elf);
+
+    private:
+        uint32_t m_base = 0;
+        std::vector<uint32_t> m_blocks;
+        std::vector<uint32_t> m_taken;
+        std::vector<uint32_t> m_not_taken;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RVCOVERAGE_H__
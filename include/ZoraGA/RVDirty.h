@@ -0,0 +1,104 @@
+#ifndef __ZORAGA_RVVM_RVDIRTY_H__
+#define __ZORAGA_RVVM_RVDIRTY_H__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#define RV_PAGE_SHIFT 12
+#define RV_PAGE_SIZE  (1UL << RV_PAGE_SHIFT)
+
+namespace ZoraGA::RVVM
+{
+
+/**
+ * @brief Dirty page bitmap of a memory region, one bit per 4KiB page
+ *
+ * mark() is called by the store path, fetch_clear() may be called from any thread.
+ */
+class rv_dirty
+{
+    public:
+        /**
+         * @brief Resize the bitmap and clear it
+         *
+         * @param len Length of the region in bytes
+         */
+        void resize(size_t len)
+        {
+            m_pages = (len + RV_PAGE_SIZE - 1) >> RV_PAGE_SHIFT;
+            m_words = (m_pages + 63) / 64;
+            m_bits.reset(m_words ? new std::atomic<uint64_t>[m_words] : nullptr);
+            clear();
+        }
+
+        /**
+         * @brief Mark the pages covering [off, off+len) dirty
+         *
+         * @param off Offset in the region
+         * @param len
+         */
+        void mark(size_t off, size_t len)
+        {
+            size_t first = off >> RV_PAGE_SHIFT;
+            size_t last  = (off + (len ? len - 1 : 0)) >> RV_PAGE_SHIFT;
+            for (size_t pg = first; pg <= last && pg < m_pages; pg++) {
+                std::atomic<uint64_t> &w = m_bits[pg >> 6];
+                uint64_t bit = 1ULL << (pg & 63);
+                /* plain load first, a clean page is the rare case */
+                if (!(w.load(std::memory_order_relaxed) & bit)) {
+                    w.fetch_or(bit, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool test(size_t page) const
+        {
+            if (page >= m_pages) return false;
+            return m_bits[page >> 6].load(std::memory_order_relaxed) & (1ULL << (page & 63));
+        }
+
+        /**
+         * @brief Collect dirty pages and clear them atomically
+         *
+         * @param pages Output, page indexes are appended
+         * @return size_t Number of dirty pages found
+         */
+        size_t fetch_clear(std::vector<uint32_t> &pages)
+        {
+            size_t n = 0;
+            for (size_t i=0; i<m_words; i++) {
+                if (m_bits[i].load(std::memory_order_relaxed) == 0) continue;
+                uint64_t w = m_bits[i].exchange(0, std::memory_order_acq_rel);
+                while (w) {
+                    pages.push_back(i * 64 + __builtin_ctzll(w));
+                    w &= w - 1;
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        void clear()
+        {
+            for (size_t i=0; i<m_words; i++) {
+                m_bits[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        size_t pages() const
+        {
+            return m_pages;
+        }
+
+    private:
+        std::unique_ptr<std::atomic<uint64_t>[]> m_bits;
+        size_t m_words = 0;
+        size_t m_pages = 0;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RVDIRTY_H__
@@ -0,0 +1,161 @@
+#ifndef __ZORAGA_RVVM_RVELF_H__
+#define __ZORAGA_RVVM_RVELF_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ZoraGA::RVVM
+{
+
+typedef struct rv_elf_section
+{
+    std::string name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t size;
+}rv_elf_section;
+
+typedef struct rv_elf_segment
+{
+    uint32_t type;
+    uint32_t flags;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t align;
+}rv_elf_segment;
+
+typedef struct rv_elf_symbol
+{
+    std::string name;
+    uint32_t value;
+    uint32_t size;
+    uint8_t  type;
+    uint8_t  bind;
+    uint16_t shndx;
+}rv_elf_symbol;
+
+/**
+ * @brief Row of the DWARF line table, a row covers [addr, next row addr)
+ *
+ */
+typedef struct rv_elf_line
+{
+    uint32_t addr;
+    /* index of files, UINT32_MAX if unknown */
+    uint32_t file;
+    uint32_t line;
+    /* first address after a sequence, file and line are not valid */
+    bool end;
+}rv_elf_line;
+
+/**
+ * @brief ELF32 RISC-V little-endian file reader, the file is mapped read-only
+ *
+ */
+class rv_elf
+{
+    public:
+        rv_elf();
+        ~rv_elf();
+
+        /**
+         * @brief Load and parse an ELF file
+         *
+         * @param path
+         * @return true
+         * @return false If the file is not an ELF32 RISC-V executable
+         */
+        bool load(std::string path);
+
+        uint32_t entry();
+
+        /**
+         * @brief File descriptor of the loaded file, for mapping segments
+         *
+         * @return int -1 if not loaded
+         */
+        int fd();
+
+        const std::vector<rv_elf_section> &sections();
+        const std::vector<rv_elf_segment> &segments();
+        const std::vector<rv_elf_symbol>  &symbols();
+
+        /**
+         * @brief Find section by name
+         *
+         * @param name
+         * @return const rv_elf_section* nullptr if not found
+         */
+        const rv_elf_section *section(std::string name);
+
+        /**
+         * @brief File content
+         *
+         * @param offset
+         * @param len
+         * @return const uint8_t* nullptr if out of the file
+         */
+        const uint8_t *data(uint32_t offset, uint32_t len);
+
+        /**
+         * @brief File content of allocated PROGBITS sections at a runtime address
+         *
+         * @param addr
+         * @param len Bytes available from addr
+         * @return const uint8_t* nullptr if no section holds addr
+         */
+        const uint8_t *code(uint32_t addr, uint32_t &len);
+
+        /**
+         * @brief Find symbol value by name
+         *
+         * @param name
+         * @param value
+         * @return true
+         * @return false
+         */
+        bool symbol(std::string name, uint32_t &value);
+
+        /**
+         * @brief Find the function or object symbol containing addr
+         *
+         * @param addr
+         * @return const rv_elf_symbol* nullptr if not found
+         */
+        const rv_elf_symbol *symbol_at(uint32_t addr);
+
+        /**
+         * @brief Decode the DWARF line table in .debug_line, version 2 to 5
+         *
+         * @param rows Rows sorted by address within each sequence
+         * @param files File paths, indexed by rv_elf_line::file
+         * @return true
+         * @return false If there is no line table or it is broken
+         */
+        bool lines(std::vector<rv_elf_line> &rows, std::vector<std::string> &files);
+
+    private:
+        void unload();
+        const char *str(const rv_elf_section *sec, uint32_t offset);
+
+    private:
+        int            m_fd   = -1;
+        const uint8_t *m_data = nullptr;
+        size_t         m_size = 0;
+        uint32_t       m_entry = 0;
+        std::vector<rv_elf_section> m_sections;
+        std::vector<rv_elf_segment> m_segments;
+        std::vector<rv_elf_symbol>  m_symbols;
+        /* indexes of function and object symbols, sorted by value */
+        std::vector<uint32_t>       m_by_addr;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RVELF_H__
@@ -0,0 +1,83 @@
+#ifndef __ZORAGA_RVVM_RVFLAT_H__
+#define __ZORAGA_RVVM_RVFLAT_H__
+
+#include "ZoraGA/RVdefs.h"
+
+namespace ZoraGA::RVVM
+{
+
+/**
+ * @brief Flat host mapping of the 4 GiB RV32 guest physical address space
+ *
+ * Memories supporting map_at live at base + guest address, everything else is
+ * PROT_NONE. A page table holds the access bits of each guest page, loads and
+ * stores of pages with the bits go to base + addr without any region lookup,
+ * the others go through the regions, nothing in the space ever faults.
+ *
+ * The space owns the whole reservation, memories mapped in hold their ranges
+ * until release hands them back with unmap_at, so they must outlive it.
+ */
+class rv_flat
+{
+    public:
+        rv_flat();
+        ~rv_flat();
+
+        /**
+         * @brief Reserve the address space
+         *
+         * @return true
+         * @return false
+         */
+        bool reserve();
+
+        /**
+         * @brief Take the memories out with unmap_at, and unmap the reservation
+         */
+        void release();
+
+        /**
+         * @brief Map a memory region in
+         *
+         * @param addr Page aligned guest address
+         * @param len Page aligned length
+         * @param mem
+         * @return true
+         * @return false If mem can't be mapped, its accesses go through the regions
+         */
+        bool map(uint32_t addr, uint32_t len, rv32_mem *mem);
+
+        /**
+         * @brief Guest address 0
+         *
+         * @return uint8_t* nullptr if not reserved
+         */
+        uint8_t *base();
+
+        /**
+         * @brief Access bits of the guest pages, RV_FLAT_R and RV_FLAT_W
+         *
+         * One more entry than pages, always zero, for accesses crossing 4 GiB.
+         *
+         * @return const uint8_t*
+         */
+        const uint8_t *pages();
+
+        /**
+         * @brief Pages written through base, the VM forwards them to mem::host_written
+         *
+         * @return rv_dirty*
+         */
+        rv_dirty *dirty();
+
+    private:
+        uint8_t *m_base = nullptr;
+        std::vector<uint8_t> m_pages;
+        rv_dirty m_dirty;
+        /* memories mapped in */
+        std::vector<rv32_mem_info> m_maps;
+};
+
+}
+
+#endif // __ZORAGA_RVVM_RVFLAT_H__
@@ -0,0 +1,53 @@
+#ifndef __ZORAGA_RVVM_RVHOST_H__
+#define __ZORAGA_RVVM_RVHOST_H__
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RV_HOST_X86 1
+#endif
+
+/* host instructions taken by the instruction sets when present */
+#define RV_HOST_AES    (1U << 0)
+#define RV_HOST_LZCNT  (1U << 1)
+#define RV_HOST_BMI    (1U << 2)
+#define RV_HOST_POPCNT (1U << 3)
+#define RV_HOST_PCLMUL (1U << 4)
+/* SSE4.2, and the SSE4.1 it implies */
+#define RV_HOST_SSE42  (1U << 5)
+#define RV_HOST_ALL    (RV_HOST_AES | RV_HOST_LZCNT | RV_HOST_BMI | RV_HOST_POPCNT | RV_HOST_PCLMUL | RV_HOST_SSE42)
+
+namespace ZoraGA::RVVM
+{
+
+/**
+ * @brief Features of the host CPU, detected once at startup, 0 on hosts other than x86
+ */
+extern uint32_t rv_host_features;
+
+static inline bool rv_host_has(uint32_t feature)
+{
+    return (rv_host_features & feature) != 0;
+}
+
+/**
+ * @brief Keep only some of the features detected, so the portable paths run, for tests
+ *
+ * @param mask Features kept, RV_HOST_ALL for all of them
+ * @return uint32_t The features before
+ */
+uint32_t rv_host_mask(uint32_t mask);
+
+static inline uint32_t ror32(uint32_t x, uint32_t n)
+{
+    return (x >> n) | (x << ((32 - n) & 31));
+}
+
+static inline uint32_t rol32(uint32_t x, uint32_t n)
+{
+    return (x << n) | (x >> ((32 - n) & 31));
+}
+
+}
+
+#endif // __ZORAGA_RVVM_RVHOST_H__
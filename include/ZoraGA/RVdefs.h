@@ -13,6 +13,7 @@
 #include <functional>
 #include "ZoraGA/RVLog.h"
 #include "ZoraGA/RVEvent.h"
+#include "ZoraGA/RVDirty.h"
 #include "ZoraGA/defs/RV32InstFmt.h"
 #include "ZoraGA/defs/RV64InstFmt.h"
 #include "ZoraGA/defs/RVCInstFmt.h"
@@ -36,8 +37,19 @@ typedef enum rv_err
     RV_EININST,     // Invalid instruction
     RV_EACCESS,     // Access error
     RV_EFAULT,
+    RV_EPAGE,       // Page fault
+    RV_ECALL,       // Environment call, ecall
+    RV_EBREAK,      // Breakpoint, ebreak
 }rv_err;
 
+typedef enum rv_stop
+{
+    RV_STOP_REQ = 0,    // stop requested
+    RV_STOP_BREAK,      // breakpoint reached
+    RV_STOP_BUDGET,     // instruction budget exhausted
+    RV_STOP_ERROR,      // fetch or execute error
+}rv_stop;
+
 /**
  * @brief Base register template
  * 
@@ -58,13 +70,40 @@ struct regs
 typedef struct regs<uint32_t, 32> rv32_regs_base;
 typedef struct regs<uint64_t, 32> rv64_regs_base;
 
+/**
+ * @brief sfence.vma request of an instruction, carried out by the VM owning the TLB
+ * 
+ * @tparam T uint32_t or uint64_t, for RV32 or RV64
+ */
+template<typename T>
+struct rv_sfence
+{
+    bool pending  = false;
+    /* rs1 != x0, only the page of addr */
+    bool has_addr = false;
+    /* rs2 != x0, only the address space asid */
+    bool has_asid = false;
+    T addr        = 0;
+    T asid        = 0;
+};
+
 template<typename T, size_t W>
 struct rv_regs_ctrl
 {
     rv_regs_ctrl() {
-        pc_changed = false;
+        pc_changed  = false;
+        csr_changed = false;
+        pmp_changed = false;
+        priv        = 3;
     }
     bool pc_changed;
+    /* a CSR has been written, translation and protection are recomputed */
+    bool csr_changed;
+    /* a pmpcfg or pmpaddr CSR has been written */
+    bool pmp_changed;
+    /* privilege mode, 0 U-Mode, 1 S-Mode, 3 M-Mode */
+    uint8_t priv;
+    rv_sfence<T> sfence;
     std::map<rv_csr_addr_fmt, std::bitset<W>> csrs;
 };
 
@@ -114,13 +153,178 @@ template<typename T>
 class mem
 {
     public:
+        virtual ~mem() {}
         virtual rv_err read(T addr, void *data, T len)  = 0;
         virtual rv_err write(T addr, void *data, T len) = 0;
+
+        /**
+         * @brief Width specialized accesses, for loads and stores of the guest
+         * 
+         * Default to read() and write(), RAM can override them with single host accesses,
+         * devices to decode registers by width.
+         * 
+         * @param addr Offset in the memory
+         * @param data 
+         * @return rv_err 
+         */
+        virtual rv_err read8(T addr, uint8_t &data)   { return read(addr, &data, 1); }
+        virtual rv_err read16(T addr, uint16_t &data) { return read(addr, &data, 2); }
+        virtual rv_err read32(T addr, uint32_t &data) { return read(addr, &data, 4); }
+        virtual rv_err write8(T addr, uint8_t data)   { return write(addr, &data, 1); }
+        virtual rv_err write16(T addr, uint16_t data) { return write(addr, &data, 2); }
+        virtual rv_err write32(T addr, uint32_t data) { return write(addr, &data, 4); }
+
+        /**
+         * @brief Clone the memory for a forked VM
+         * 
+         * The clone must hold the same content as this memory at the time of the call,
+         * and the two must not see each other's writes afterwards. Read-only memories, and
+         * memories meant to be shared between VMs, return themselves.
+         * 
+         * @return mem* New memory owned by the caller, this if the memory is shared between the VMs,
+         *              nullptr if it can't be cloned, the fork then fails
+         */
+        virtual mem *clone() { return nullptr; }
+
+        /**
+         * @brief Host memory backing the whole memory, for snapshots
+         * 
+         * @param len Length of the host memory
+         * @return void* nullptr if the memory is not backed by plain host memory
+         */
+        virtual void *host(T &len) { len = 0; return nullptr; }
+
+        /**
+         * @brief Replace the content by a MAP_PRIVATE mapping of a snapshot image
+         * 
+         * @param fd Snapshot file
+         * @param off Page aligned offset of the image in the file
+         * @param len Length of the image
+         * @return rv_err RV_EMISSING if not supported, the image is read into host() instead
+         */
+        virtual rv_err map_image(int fd, uint64_t off, T len) { return RV_EMISSING; }
+
+        /**
+         * @brief Is map_image supported
+         * 
+         * map_image of a page aligned range of a regular file must then fail only when the
+         * host is out of memory, restore reads the images of other memories up front.
+         */
+        virtual bool can_map_image() { return false; }
+
+        /**
+         * @brief Save the device state, for snapshots
+         * 
+         * @param state Output
+         * @return rv_err 
+         */
+        virtual rv_err save_state(std::vector<uint8_t> &state) { return RV_EOK; }
+
+        /**
+         * @brief Load the device state saved by save_state
+         * 
+         * @param state 
+         * @return rv_err 
+         */
+        virtual rv_err load_state(const std::vector<uint8_t> &state) { return RV_EOK; }
+
+        /**
+         * @brief Dirty page bitmap, maintained by write()
+         * 
+         * @return rv_dirty* nullptr if the memory doesn't track dirty pages
+         */
+        virtual rv_dirty *dirty() { return nullptr; }
+
+        /**
+         * @brief Make the current content the baseline of revert_pages
+         * 
+         * @return rv_err RV_EMISSING if not supported
+         */
+        virtual rv_err set_baseline() { return RV_EMISSING; }
+
+        /**
+         * @brief Revert pages to the baseline
+         * 
+         * @param pages Page indexes, as reported by dirty()
+         * @return rv_err RV_EMISSING if not supported
+         */
+        virtual rv_err revert_pages(const std::vector<uint32_t> &pages) { return RV_EMISSING; }
+
+        /**
+         * @brief Map the content at host address addr, for flat address spaces
+         * 
+         * Afterwards the content at addr and the one seen by read() and write() must be the
+         * same. The range belongs to the memory until unmap_at, the memory must not be
+         * resized before.
+         * 
+         * @param addr Page aligned
+         * @param len Page aligned length of the region
+         * @return rv_err RV_EMISSING if not supported, accesses go through read() and write()
+         */
+        virtual rv_err map_at(void *addr, T len) { return RV_EMISSING; }
+
+        /**
+         * @brief Take the content out of addr, mapped by map_at
+         * 
+         * The range is left PROT_NONE, never unmapped, it is still part of the flat space.
+         * 
+         * @param addr 
+         * @param len 
+         */
+        virtual void unmap_at(void *addr, T len) {}
+
+        /**
+         * @brief Is write() always refused, flat spaces then send writes to write()
+         */
+        virtual bool read_only() { return false; }
+
+        /**
+         * @brief Notify that the memory mapped by map_at has been written directly
+         * 
+         * @param off 
+         * @param len 
+         */
+        virtual void host_written(T off, T len) {}
 };
 
 typedef mem<uint32_t> rv32_mem;
 typedef mem<uint64_t> rv64_mem;
 
+typedef enum rv_access
+{
+    RV_ACC_R = 0,   // load
+    RV_ACC_W,       // store
+    RV_ACC_X,       // instruction fetch
+}rv_access;
+
+/**
+ * @brief Address translation interface
+ * 
+ * @tparam T uint32_t or uint64_t, for RV32 or RV64
+ */
+template<typename T>
+class mmu
+{
+    public:
+        virtual ~mmu() {}
+
+        /**
+         * @brief Translate a guest virtual address to a physical one
+         * 
+         * @param addr Virtual address
+         * @param len Bytes accessed, in the page of addr, all are checked by PMP
+         * @param acc Access type
+         * @param paddr Output, physical address
+         * @return rv_err RV_EPAGE on page fault, RV_EACCESS on access fault
+         */
+        virtual rv_err translate(T addr, T len, rv_access acc, T &paddr) = 0;
+
+        rv_err translate(T addr, rv_access acc, T &paddr) { return translate(addr, 1, acc, paddr); }
+};
+
+typedef mmu<uint32_t> rv32_mmu;
+typedef mmu<uint64_t> rv64_mmu;
+
 /**
  * @brief Memory information
  * 
@@ -138,8 +342,27 @@ struct mem_info
 typedef struct mem_info<uint32_t, rv32_mem> rv32_mem_info;
 typedef struct mem_info<uint64_t, rv64_mem> rv64_mem_info;
 
-typedef std::vector<rv32_mem_info> rv32_mem_infos;
-typedef std::vector<rv64_mem_info> rv64_mem_infos;
+/**
+ * @brief Memory regions of a VM
+ * 
+ * @tparam T uint32_t or uint64_t, for RV32 or RV64
+ * @tparam M rv32_mem or rv64_mem
+ */
+template<typename T, typename M>
+struct mem_infos:public std::vector<mem_info<T, M>>
+{
+    /* flat address space, guest address addr is at flat + addr, nullptr if not used */
+    uint8_t  *flat = nullptr;
+    /* RV_FLAT_R and RV_FLAT_W of the pages of flat, pages without them go through the regions */
+    const uint8_t *flat_pages = nullptr;
+    /* pages written through flat */
+    rv_dirty *flat_dirty = nullptr;
+    /* translation of loads and stores, nullptr if addresses are physical */
+    mmu<T>   *xlate = nullptr;
+};
+
+typedef struct mem_infos<uint32_t, rv32_mem> rv32_mem_infos;
+typedef struct mem_infos<uint64_t, rv64_mem> rv64_mem_infos;
 
 template<typename T, typename TM>
 bool mem_is_range(T addr, TM info) {
@@ -147,7 +370,7 @@ bool mem_is_range(T addr, TM info) {
 }
 
 template<typename T, typename TM, typename TI>
-rv_err mem_read(T addr, void *p, T len, TI &info) {
+rv_err mem_read_region(T addr, void *p, T len, TI &info) {
     rv_err err = RV_EFAULT;
     for (auto it:info) {
         if ( mem_is_range<T, TM>(addr, it) ) {
@@ -159,7 +382,7 @@ rv_err mem_read(T addr, void *p, T len, TI &info) {
 }
 
 template<typename T, typename TM, typename TI>
-rv_err mem_write(T addr, void *p, T len, TI &info) {
+rv_err mem_write_region(T addr, void *p, T len, TI &info) {
     rv_err err = RV_EFAULT;
     for (auto it:info) {
         if ( mem_is_range<T, TM>(addr, it) ) {
@@ -170,6 +393,175 @@ rv_err mem_write(T addr, void *p, T len, TI &info) {
     return err;
 }
 
+#define RV_FLAT_R 1
+#define RV_FLAT_W 2
+
+/**
+ * @brief Can the len bytes at guest physical address addr be accessed through the flat space
+ * 
+ * @param bits RV_FLAT_R or RV_FLAT_W, needed by the first and last pages
+ */
+template<typename T, typename TI>
+bool mem_is_flat(T addr, T len, uint8_t bits, TI &info) {
+    if (info.flat == nullptr) return false;
+    uint64_t last = (uint64_t)addr + (len ? len - 1 : 0);
+    return (info.flat_pages[addr >> RV_PAGE_SHIFT] & info.flat_pages[last >> RV_PAGE_SHIFT] & bits) != 0;
+}
+
+/**
+ * @brief Read guest physical memory, through the flat address space if the pages are in it
+ */
+template<typename T, typename TM, typename TI>
+rv_err mem_read_phys(T addr, void *p, T len, TI &info) {
+    if (mem_is_flat<T, TI>(addr, len, RV_FLAT_R, info)) {
+        memcpy(p, info.flat + addr, len);
+        return RV_EOK;
+    }
+    return mem_read_region<T, TM, TI>(addr, p, len, info);
+}
+
+template<typename T, typename TM, typename TI>
+rv_err mem_write_phys(T addr, void *p, T len, TI &info) {
+    if (mem_is_flat<T, TI>(addr, len, RV_FLAT_W, info)) {
+        memcpy(info.flat + addr, p, len);
+        info.flat_dirty->mark(addr, len);
+        return RV_EOK;
+    }
+    return mem_write_region<T, TM, TI>(addr, p, len, info);
+}
+
+/**
+ * @brief Does an access of len bytes at addr cross a page
+ */
+template<typename T>
+bool mem_is_split(T addr, T len) {
+    return ((addr & (RV_PAGE_SIZE - 1)) + len) > RV_PAGE_SIZE;
+}
+
+/**
+ * @brief Translate addr of an access of len bytes, if translation is on
+ * 
+ * @return rv_err RV_EDALIGN if the access crosses a page, it could map to two frames
+ */
+template<typename T, typename TI>
+rv_err mem_translate(T &addr, T len, rv_access acc, TI &info) {
+    if (mem_is_split<T>(addr, len)) return RV_EDALIGN;
+    return info.xlate->translate(addr, len, acc, addr);
+}
+
+/**
+ * @brief Read guest memory at a virtual address, page by page if translation is on
+ */
+template<typename T, typename TM, typename TI>
+rv_err mem_read(T addr, void *p, T len, TI &info) {
+    if (info.xlate == nullptr) return mem_read_phys<T, TM, TI>(addr, p, len, info);
+    uint8_t *d = (uint8_t*)p;
+    while (len) {
+        T n  = RV_PAGE_SIZE - (addr & (RV_PAGE_SIZE - 1));
+        T pa = 0;
+        if (n > len) n = len;
+        rv_err err = info.xlate->translate(addr, n, RV_ACC_R, pa);
+        if (err == RV_EOK) err = mem_read_phys<T, TM, TI>(pa, d, n, info);
+        if (err != RV_EOK) return err;
+        addr += n;
+        d    += n;
+        len  -= n;
+    }
+    return RV_EOK;
+}
+
+/**
+ * @brief Write guest memory at a virtual address, all pages are translated before any is written
+ */
+template<typename T, typename TM, typename TI>
+rv_err mem_write(T addr, void *p, T len, TI &info) {
+    if (info.xlate == nullptr) return mem_write_phys<T, TM, TI>(addr, p, len, info);
+    for (T pos = 0; pos < len; ) {
+        T n  = RV_PAGE_SIZE - ((addr + pos) & (RV_PAGE_SIZE - 1));
+        T pa = 0;
+        if (n > len - pos) n = len - pos;
+        rv_err err = info.xlate->translate(addr + pos, n, RV_ACC_W, pa);
+        if (err != RV_EOK) return err;
+        pos += n;
+    }
+    uint8_t *d = (uint8_t*)p;
+    while (len) {
+        T n  = RV_PAGE_SIZE - (addr & (RV_PAGE_SIZE - 1));
+        T pa = 0;
+        if (n > len) n = len;
+        rv_err err = info.xlate->translate(addr, n, RV_ACC_W, pa);
+        if (err == RV_EOK) err = mem_write_phys<T, TM, TI>(pa, d, n, info);
+        if (err != RV_EOK) return err;
+        addr += n;
+        d    += n;
+        len  -= n;
+    }
+    return RV_EOK;
+}
+
+template<typename M, typename T> rv_err mem_read_as(M *m, T addr, uint8_t &v)  { return m->read8(addr, v); }
+template<typename M, typename T> rv_err mem_read_as(M *m, T addr, uint16_t &v) { return m->read16(addr, v); }
+template<typename M, typename T> rv_err mem_read_as(M *m, T addr, uint32_t &v) { return m->read32(addr, v); }
+template<typename M, typename T> rv_err mem_write_as(M *m, T addr, uint8_t v)  { return m->write8(addr, v); }
+template<typename M, typename T> rv_err mem_write_as(M *m, T addr, uint16_t v) { return m->write16(addr, v); }
+template<typename M, typename T> rv_err mem_write_as(M *m, T addr, uint32_t v) { return m->write32(addr, v); }
+
+/**
+ * @brief Width specialized guest physical read, V is uint8_t, uint16_t or uint32_t
+ */
+template<typename T, typename V, typename TI>
+rv_err mem_read_pv(T addr, V &v, TI &info) {
+    if (mem_is_flat<T, TI>(addr, sizeof(V), RV_FLAT_R, info)) {
+        memcpy(&v, info.flat + addr, sizeof(V));
+        return RV_EOK;
+    }
+    for (auto &it:info) {
+        if (addr - it.addr < it.len) return mem_read_as(it.mem, addr - it.addr, v);
+    }
+    return RV_EFAULT;
+}
+
+template<typename T, typename V, typename TI>
+rv_err mem_write_pv(T addr, V v, TI &info) {
+    if (mem_is_flat<T, TI>(addr, sizeof(V), RV_FLAT_W, info)) {
+        memcpy(info.flat + addr, &v, sizeof(V));
+        info.flat_dirty->mark(addr, sizeof(V));
+        return RV_EOK;
+    }
+    for (auto &it:info) {
+        if (addr - it.addr < it.len) return mem_write_as(it.mem, addr - it.addr, v);
+    }
+    return RV_EFAULT;
+}
+
+/**
+ * @brief Width specialized guest read at a virtual address
+ */
+template<typename T, typename V, typename TI>
+rv_err mem_read_v(T addr, V &v, TI &info) {
+    if (info.xlate && mem_is_split<T>(addr, sizeof(V))) {
+        /* misaligned across a page, the two halves may be in different frames */
+        return mem_read<T, typename TI::value_type, TI>(addr, &v, sizeof(V), info);
+    }
+    if (info.xlate) {
+        rv_err err = mem_translate<T, TI>(addr, sizeof(V), RV_ACC_R, info);
+        if (err != RV_EOK) return err;
+    }
+    return mem_read_pv<T, V, TI>(addr, v, info);
+}
+
+template<typename T, typename V, typename TI>
+rv_err mem_write_v(T addr, V v, TI &info) {
+    if (info.xlate && mem_is_split<T>(addr, sizeof(V))) {
+        return mem_write<T, typename TI::value_type, TI>(addr, &v, sizeof(V), info);
+    }
+    if (info.xlate) {
+        rv_err err = mem_translate<T, TI>(addr, sizeof(V), RV_ACC_W, info);
+        if (err != RV_EOK) return err;
+    }
+    return mem_write_pv<T, V, TI>(addr, v, info);
+}
+
 #define rv32_mem_range(addr, info) mem_is_range<uint32_t, rv32_mem_info>(addr, info)
 #define rv64_mem_range(addr, info) mem_is_range<uint64_t, rv64_mem_info>(addr, info)
 
@@ -179,6 +571,13 @@ rv_err mem_write(T addr, void *p, T len, TI &info) {
 #define rv32_mem_write(addr, p, len, infos) mem_write<uint32_t, rv32_mem_info, rv32_mem_infos>(addr, p, len, infos)
 #define rv64_mem_write(addr, p, len, infos) mem_write<uint64_t, rv64_mem_info, rv64_mem_infos>(addr, p, len, infos)
 
+#define rv32_mem_read8(addr, v, infos)   mem_read_v<uint32_t, uint8_t, rv32_mem_infos>(addr, v, infos)
+#define rv32_mem_read16(addr, v, infos)  mem_read_v<uint32_t, uint16_t, rv32_mem_infos>(addr, v, infos)
+#define rv32_mem_read32(addr, v, infos)  mem_read_v<uint32_t, uint32_t, rv32_mem_infos>(addr, v, infos)
+#define rv32_mem_write8(addr, v, infos)  mem_write_v<uint32_t, uint8_t, rv32_mem_infos>(addr, v, infos)
+#define rv32_mem_write16(addr, v, infos) mem_write_v<uint32_t, uint16_t, rv32_mem_infos>(addr, v, infos)
+#define rv32_mem_write32(addr, v, infos) mem_write_v<uint32_t, uint32_t, rv32_mem_infos>(addr, v, infos)
+
 /**
  * @brief Cache interface template
  * 
@@ -223,6 +622,9 @@ typedef comprs<uint32_t, uint64_t> rv64_comprs;
 /**
  * @brief Instruction template
  * 
+ * Instruction sets are shared by the VMs forked with rv32::clone, the guest state must
+ * be kept in the registers and memories, the set itself holds configuration only.
+ * 
  * @tparam T uint32_t or uint64_t, for RV32 or RV64
  * @tparam RT Base register type, rv32_regs_base or rv64_regs_base
  * @tparam MT Memory vector reference, rv32_mem_infos or rv64_mem_infos
@@ -257,7 +659,7 @@ class instruction
          */
         virtual rv_err set_log(rvlog *log) = 0;
 
-        virtual rv_err regist(RT &regs, std::vector<std::string> &isas);
+        virtual rv_err regist(RT &regs, std::vector<std::string> &isas) = 0;
 };
 
 typedef instruction<rv32_inst_fmt, rv32_regs, rv32_mem_infos> rv32_inst;
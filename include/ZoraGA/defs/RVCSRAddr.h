@@ -60,7 +60,7 @@ typedef enum CSR_S
 {
     /* Supervisor Trap Setup */
     CSR_sstatus = 0x100,
-    CSR_sie,
+    CSR_sie     = 0x104,
     CSR_stvec,
     CSR_scounteren,
 
@@ -74,6 +74,10 @@ typedef enum CSR_S
     CSR_stval,
     CSR_sip,
 
+    /* Supervisor Timer Compare, Sstc */
+    CSR_stimecmp  = 0x14D,
+    CSR_stimecmph = 0x15D,
+
     /* Supervisor Protection and Translation */
     CSR_satp = 0x180,
 
@@ -52,6 +52,11 @@ typedef union rv_csr_addr_fmt
 }rv_csr_addr_fmt;
 #pragma pack(pop)
 
+inline bool operator<(const rv_csr_addr_fmt &a, const rv_csr_addr_fmt &b)
+{
+    return a.addr < b.addr;
+}
+
 typedef uint32_t rv32_csr_misa_t;
 typedef uint64_t rv64_csr_misa_t;
 
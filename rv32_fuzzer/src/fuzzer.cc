@@ -0,0 +1,107 @@
+/**
+ * libFuzzer entry of RV32 firmware, in persistent mode.
+ *
+ * The firmware calls a harness function `void fuzz_one(uint8_t *buf, uint32_t cap)`,
+ * with a buffer for the input. The VM boots once and stops at its entry, that state
+ * is the baseline. For every input, the input is written to buf, a1 is set to the
+ * input length and the VM runs until fuzz_one returns, then only the pages dirtied
+ * are reverted. Guest branch edges are reported to libFuzzer as extra counters.
+ *
+ * Configured by environment:
+ *   RVVM_FUZZ_IMAGE     raw binary image, required
+ *   RVVM_FUZZ_ENTRY     address of fuzz_one, required
+ *   RVVM_FUZZ_ROM_ADDR  image address, default 0x80000000
+ *   RVVM_FUZZ_RAM_ADDR  RAM address, default 0x00000000
+ *   RVVM_FUZZ_RAM_SIZE  RAM size, default 64K
+ *   RVVM_FUZZ_BUDGET    max instructions per input, default 1000000
+ */
+#include "ZoraGA/RVVM.h"
+#include "ZoraGA/RV32I.h"
+#include "mem_ram.h"
+#include <fstream>
+#include <iterator>
+
+using namespace ZoraGA::RVVM;
+
+#define FUZZ_EDGES (64 * 1024)
+
+__attribute__((used, section("__libfuzzer_extra_counters")))
+static uint8_t s_edges[FUZZ_EDGES];
+
+static RV32::rv32  *s_vm;
+static RV32::RV32I  s_rv32i;
+static mem_ram      s_rom;
+static mem_ram      s_ram;
+static uint32_t     s_buf;
+static uint32_t     s_cap;
+static uint32_t     s_ret;
+static uint64_t     s_budget;
+
+static uint32_t env_u32(const char *name, uint32_t def)
+{
+    const char *v = getenv(name);
+    return v ? std::stoul(v, nullptr, 0) : def;
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "rv32_fuzzer: %s\n", msg);
+    exit(1);
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    const char *image = getenv("RVVM_FUZZ_IMAGE");
+    if (image == nullptr || getenv("RVVM_FUZZ_ENTRY") == nullptr) {
+        die("RVVM_FUZZ_IMAGE and RVVM_FUZZ_ENTRY are required");
+    }
+    uint32_t entry    = env_u32("RVVM_FUZZ_ENTRY", 0);
+    uint32_t rom_addr = env_u32("RVVM_FUZZ_ROM_ADDR", 0x80000000);
+    uint32_t ram_addr = env_u32("RVVM_FUZZ_RAM_ADDR", 0x00000000);
+    uint32_t ram_size = env_u32("RVVM_FUZZ_RAM_SIZE", 64 * 1024);
+    s_budget = env_u32("RVVM_FUZZ_BUDGET", 1000000);
+
+    /* image is kept in RAM, fetching from mem_rom seeks the file */
+    std::ifstream file(image, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.empty()) die("empty image");
+    if (!s_rom.set_size(data.size()) || s_rom.write(0, data.data(), data.size()) != RV_EOK) die("load image failed");
+    if (!s_ram.set_size(ram_size)) die("alloc RAM failed");
+
+    s_vm = new RV32::rv32;
+    s_vm->add_mem(rom_addr, data.size(), &s_rom);
+    s_vm->add_mem(ram_addr, ram_size, &s_ram);
+    s_vm->add_inst("I", &s_rv32i);
+    s_vm->set_start_addr(rom_addr);
+
+    /* boot to the harness */
+    s_vm->add_breakpoint(entry);
+    if (s_vm->step(0) != RV_STOP_BREAK) die("harness entry not reached");
+    s_vm->del_breakpoint(entry);
+
+    s_buf = s_vm->regs()->x[10];
+    s_cap = s_vm->regs()->x[11];
+    s_ret = s_vm->regs()->x[1];
+    s_vm->add_breakpoint(s_ret);
+    s_vm->set_edge_map(s_edges, FUZZ_EDGES);
+    if (!s_vm->set_baseline()) die("set baseline failed");
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size > s_cap) return 0;
+
+    if (size && !s_vm->write_mem(s_buf, (void*)data, size)) die("inject input failed");
+    s_vm->regs()->x[11] = size;
+
+    rv_stop stop = s_vm->step(s_budget);
+    if (stop == RV_STOP_ERROR) {
+        /* guest fault, let libFuzzer keep the input */
+        fprintf(stderr, "rv32_fuzzer: guest fault at pc %08x\n", s_vm->regs()->pc);
+        abort();
+    }
+
+    if (!s_vm->revert()) die("revert failed");
+    return 0;
+}
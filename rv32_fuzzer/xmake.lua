@@ -0,0 +1,12 @@
+target("rv32_fuzzer")
+    set_default(false)
+    set_kind("binary")
+    set_targetdir("dist")
+    set_toolchains("clang")
+    set_languages("c++17")
+    add_deps("rvvm")
+    add_files("src/*.cc")
+    add_files("../rv32_loader/src/mem_ram.cc")
+    add_includedirs("../rv32_loader/include")
+    add_cxflags("-fsanitize=fuzzer")
+    add_ldflags("-fsanitize=fuzzer")
@@ -0,0 +1,74 @@
+#ifndef __RVVM_LOADER_CRC_UNIT_H__
+#define __RVVM_LOADER_CRC_UNIT_H__
+
+#include "ZoraGA/RVdefs.h"
+
+#define CRC_UNIT_SIZE 0x100
+
+/**
+ * @brief CRC calculation unit, CRC-32 (IEEE 802.3) or CRC-32C (Castagnoli)
+ *
+ * RESULT holds the CRC of the bytes fed so far, as zlib crc32() returns it,
+ * write 0 to start a new one. Setting CTRL.START feeds LEN bytes from ADDR,
+ * before the write returns, STATUS.ERROR is set if they are outside the
+ * regions added. Writing DATA feeds the 1, 2 or 4 bytes written. CTRL.CRC32C
+ * selects the polynomial. On x86 hosts the bytes are folded with PCLMULQDQ
+ * for CRC-32 and the SSE4.2 crc32 instruction for CRC-32C, with a table
+ * fallback on other hosts.
+ *
+ * Registers: ADDR 0x00, LEN 0x04, CTRL 0x08 (START 1, CRC32C 2),
+ * STATUS 0x0c (ERROR 1, W1C), DATA (WO) 0x10, RESULT 0x14.
+ */
+class crc_unit:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        crc_unit();
+        ~crc_unit();
+
+        /**
+         * @brief Make a memory of the VM readable by the unit
+         *
+         * @param addr Physical address, as given to add_mem
+         * @param len
+         * @param mem
+         */
+        void add_region(uint32_t addr, uint32_t len, ZoraGA::RVVM::rv32_mem *mem);
+
+        /**
+         * @brief Continue a CRC over a buffer
+         *
+         * @param crc The CRC so far, 0 for none
+         * @param castagnoli CRC-32C if true, CRC-32 otherwise
+         * @param p
+         * @param len
+         * @return uint32_t The CRC with the buffer
+         */
+        static uint32_t update(uint32_t crc, bool castagnoli, const void *p, size_t len);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err save_state(std::vector<uint8_t> &state);
+        ZoraGA::RVVM::rv_err load_state(const std::vector<uint8_t> &state);
+
+    private:
+        typedef struct region
+        {
+            uint32_t addr;
+            uint32_t len;
+            ZoraGA::RVVM::rv32_mem *mem;
+        }region;
+
+        const region *find(uint32_t addr);
+        bool feed();
+
+    private:
+        std::vector<region> m_regions;
+
+        uint32_t m_addr   = 0;
+        uint32_t m_len    = 0;
+        uint32_t m_ctrl   = 0;
+        uint32_t m_status = 0;
+        uint32_t m_result = 0;
+};
+
+#endif
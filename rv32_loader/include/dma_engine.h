@@ -0,0 +1,79 @@
+#ifndef __RVVM_LOADER_DMA_ENGINE_H__
+#define __RVVM_LOADER_DMA_ENGINE_H__
+
+#include "ZoraGA/RVdefs.h"
+#include <functional>
+
+#define DMA_ENGINE_SIZE 0x100
+
+/**
+ * @brief Memory to memory DMA controller, 32-bit registers
+ *
+ * Setting CTRL.START copies LEN bytes from SRC to DST, or fills them with
+ * PATTERN repeated from DST when CTRL.FILL is set. The transfer is done before
+ * the write returns, with the host memmove and memset on memory with host(),
+ * so STATUS.BUSY is never seen set. STATUS.DONE, or STATUS.ERROR if an address
+ * is outside the regions added, is set at the end, and raises the interrupt
+ * while CTRL.IRQ_EN is set. COUNT holds the bytes moved.
+ *
+ * Registers: SRC 0x00, DST 0x04, LEN 0x08, PATTERN 0x0c,
+ * CTRL 0x10 (START 1, FILL 2, IRQ_EN 4), STATUS 0x14 (BUSY 1, DONE 2, ERROR 4, W1C),
+ * COUNT (RO) 0x18.
+ */
+class dma_engine:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        dma_engine();
+        ~dma_engine();
+
+        /**
+         * @brief Make a memory of the VM reachable by transfers
+         *
+         * @param addr Physical address, as given to add_mem
+         * @param len
+         * @param mem
+         */
+        void add_region(uint32_t addr, uint32_t len, ZoraGA::RVVM::rv32_mem *mem);
+
+        /**
+         * @brief Set the interrupt output, the current level if raised, and then each change
+         *
+         * @param irq
+         */
+        void set_irq(std::function<void(bool level)> irq);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err save_state(std::vector<uint8_t> &state);
+        ZoraGA::RVVM::rv_err load_state(const std::vector<uint8_t> &state);
+
+    private:
+        typedef struct region
+        {
+            uint32_t addr;
+            uint32_t len;
+            ZoraGA::RVVM::rv32_mem *mem;
+        }region;
+
+        const region *find(uint32_t addr);
+        bool copy();
+        bool fill();
+        void irq_update();
+
+    private:
+        std::vector<region> m_regions;
+        /* set_irq from the loader, irq_update from the hart */
+        std::mutex m_irq_mutex;
+        bool       m_irq_level = false;
+        std::function<void(bool)> m_irq;
+
+        uint32_t m_src     = 0;
+        uint32_t m_dst     = 0;
+        uint32_t m_len     = 0;
+        uint32_t m_pattern = 0;
+        uint32_t m_ctrl    = 0;
+        uint32_t m_status  = 0;
+        uint32_t m_count   = 0;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __RVVM_LOADER_ELF_LOADER_H__
+#define __RVVM_LOADER_ELF_LOADER_H__
+
+#include "ZoraGA/RVVM.h"
+#include "ZoraGA/RVElf.h"
+#include "mem_ram.h"
+#include "mem_file.h"
+#include <memory>
+
+/**
+ * @brief Map the PT_LOAD segments of an ELF into a VM
+ * 
+ * Read-only segments are file-backed and paged in on demand. Writable segments
+ * are copied into RAM, their .bss part is left zero. Segments whose load address
+ * differs from their runtime address are also mapped read-only at the load address,
+ * so startup code that still copies .data keeps working.
+ */
+class elf_loader
+{
+    public:
+        bool load(std::string path);
+
+        /**
+         * @brief Add the segments to the VM
+         * 
+         * @param vm 
+         * @param ram RAM already added to the VM at ram_addr, writable segments inside it are
+         *            copied into it, others get a RAM of their own. nullptr if none.
+         * @param ram_addr 
+         * @param ram_size 
+         * @return true 
+         * @return false 
+         */
+        bool map(ZoraGA::RVVM::RV32::rv32 &vm, mem_ram *ram, uint32_t ram_addr, uint32_t ram_size);
+
+        uint32_t entry();
+
+        /**
+         * @brief Range covering the executable segments
+         * 
+         * @param base 
+         * @param len 
+         * @return true 
+         * @return false If there is no executable segment
+         */
+        bool code_range(uint32_t &base, uint32_t &len);
+
+        ZoraGA::RVVM::rv_elf *elf();
+
+    private:
+        ZoraGA::RVVM::rv_elf m_elf;
+        std::vector<std::unique_ptr<mem_file>> m_files;
+        std::vector<std::unique_ptr<mem_ram>>  m_rams;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __RVVM_LOADER_FDT_BUILDER_H__
+#define __RVVM_LOADER_FDT_BUILDER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * @brief Flattened device tree writer, nodes and properties are emitted in order
+ * 
+ * Values are converted to big-endian, the blob is version 17 with an empty
+ * memory reservation map.
+ */
+class fdt_builder
+{
+    public:
+        fdt_builder();
+
+        /**
+         * @brief Open a node, the root node is ""
+         * 
+         * @param name 
+         */
+        void begin_node(const std::string &name);
+        void end_node();
+
+        void prop(const std::string &name, const void *data, size_t len);
+        void prop_empty(const std::string &name);
+        void prop_u32(const std::string &name, uint32_t val);
+        void prop_cells(const std::string &name, const std::vector<uint32_t> &cells);
+        void prop_str(const std::string &name, const std::string &str);
+        void prop_strs(const std::string &name, const std::vector<std::string> &strs);
+
+        /**
+         * @brief Close the tree and return the blob
+         * 
+         * @return std::vector<uint8_t> Empty if a node is still open
+         */
+        std::vector<uint8_t> finish();
+
+    private:
+        void put32(uint32_t val);
+        void pad();
+        uint32_t name_off(const std::string &name);
+
+    private:
+        std::vector<uint8_t> m_struct;
+        std::string m_strings;
+        std::map<std::string, uint32_t> m_names;
+        int m_depth = 0;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef __RVVM_LOADER_KERNEL_LOADER_H__
+#define __RVVM_LOADER_KERNEL_LOADER_H__
+
+#include "ZoraGA/RVVM.h"
+#include "fdt_builder.h"
+#include "mem_ram.h"
+#include <functional>
+
+/* phandle of the CPU interrupt controller */
+#define PHANDLE_INTC 1
+/* phandle of the PLIC, added as a device */
+#define PHANDLE_PLIC 2
+
+/**
+ * @brief Boot a S-Mode kernel directly, without a bootloader in the guest
+ * 
+ * The kernel image is copied to the start of RAM, at the text_offset of its header
+ * if it has a RISC-V Image header. The device tree is generated from the memory map
+ * and the devices added, and placed at the end of RAM with the initrd right below it.
+ * The VM starts at the kernel with a0 = hart ID 0 and a1 = device tree address.
+ */
+class kernel_loader
+{
+    public:
+        /**
+         * @brief Read the kernel image and the initrd
+         * 
+         * @param kernel 
+         * @param initrd Empty for none
+         * @return true 
+         * @return false 
+         */
+        bool load(std::string kernel, std::string initrd);
+
+        /**
+         * @brief Set the kernel command line, /chosen/bootargs
+         * 
+         * @param bootargs 
+         */
+        void set_bootargs(std::string bootargs);
+
+        /**
+         * @brief Set /chosen/stdout-path
+         * 
+         * @param path 
+         */
+        void set_stdout(std::string path);
+
+        /**
+         * @brief Add a device node under /soc
+         * 
+         * @param node Writes the node, interrupts go to the PLIC, PHANDLE_PLIC, which goes to the CPU one, PHANDLE_INTC
+         */
+        void add_device(std::function<void(fdt_builder &fdt)> node);
+
+        /**
+         * @brief Place the images and the device tree in RAM, and set pc, a0 and a1
+         * 
+         * @param vm 
+         * @param ram RAM already added to the VM at ram_addr
+         * @param ram_addr 
+         * @param ram_size 
+         * @param isa riscv,isa of the CPU, like "rv32i_zicsr"
+         * @return true 
+         * @return false If the images don't fit in RAM
+         */
+        bool boot(ZoraGA::RVVM::RV32::rv32 &vm, mem_ram &ram, uint32_t ram_addr, uint32_t ram_size, std::string isa);
+
+        /**
+         * @brief The device tree of the last boot
+         * 
+         * @return const std::vector<uint8_t>& 
+         */
+        const std::vector<uint8_t> &dtb();
+
+    private:
+        bool read_file(std::string path, std::vector<uint8_t> &out);
+        void build(uint32_t ram_addr, uint32_t ram_size, std::string isa, uint32_t initrd_start, uint32_t initrd_end);
+
+    private:
+        std::vector<uint8_t> m_kernel;
+        std::vector<uint8_t> m_initrd;
+        std::vector<uint8_t> m_dtb;
+        std::string m_bootargs;
+        std::string m_stdout;
+        std::vector<std::function<void(fdt_builder &fdt)>> m_devices;
+};
+
+#endif
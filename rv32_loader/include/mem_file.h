@@ -0,0 +1,53 @@
+#ifndef __RVVM_LOADER_MEM_FILE_H__
+#define __RVVM_LOADER_MEM_FILE_H__
+
+#include "ZoraGA/RVdefs.h"
+
+/**
+ * @brief Read-only memory mapped from a file range, pages are read on demand
+ * 
+ */
+class mem_file:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        mem_file();
+        ~mem_file();
+
+        /**
+         * @brief Map [off, off+filesz) of fd, bytes from filesz to len read as zero
+         * 
+         * @param fd 
+         * @param off 
+         * @param filesz 
+         * @param len 
+         * @return true 
+         * @return false 
+         */
+        bool map(int fd, uint64_t off, uint32_t filesz, uint32_t len);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv32_mem *clone() { return this; }
+        /**
+         * @brief Map a read-only copy at addr, the file offset must be page aligned
+         */
+        ZoraGA::RVVM::rv_err map_at(void *addr, uint32_t len);
+        void unmap_at(void *addr, uint32_t len);
+        bool read_only() { return true; }
+
+    private:
+        void unmap();
+
+    private:
+        int      m_fd     = -1;
+        uint64_t m_off    = 0;
+        uint8_t *m_map    = nullptr;
+        size_t   m_maplen = 0;
+        uint8_t *m_mem    = nullptr;
+        uint32_t m_filesz = 0;
+        uint32_t m_len    = 0;
+        /* copies made by map_at, one per flat space */
+        std::vector<std::pair<void*, uint32_t>> m_views;
+};
+
+#endif
@@ -4,19 +4,93 @@
 #include "ZoraGA/RVdefs.h"
 #include <vector>
 
+/**
+ * @brief Guest RAM, a shared mapping of a sparse memfd until it is cloned or frozen as
+ *        a baseline, then a private mapping of the same memfd
+ * 
+ */
 class mem_ram:public ZoraGA::RVVM::rv32_mem
 {
     public:
         mem_ram();
         ~mem_ram();
 
+        /**
+         * @brief Reserve sz bytes of zeroed RAM, no page is allocated before it is written
+         * 
+         * @param sz 
+         * @return true 
+         * @return false 
+         */
         bool set_size(size_t sz);
 
+        /**
+         * @brief Zero the RAM and release all its pages, the baseline of revert is dropped
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool reset();
+
         ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
         ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err read8(uint32_t addr, uint8_t &data);
+        ZoraGA::RVVM::rv_err read16(uint32_t addr, uint16_t &data);
+        ZoraGA::RVVM::rv_err read32(uint32_t addr, uint32_t &data);
+        ZoraGA::RVVM::rv_err write8(uint32_t addr, uint8_t data);
+        ZoraGA::RVVM::rv_err write16(uint32_t addr, uint16_t data);
+        ZoraGA::RVVM::rv_err write32(uint32_t addr, uint32_t data);
+
+        /**
+         * @brief Clone the RAM copy-on-write
+         * 
+         * Both RAMs map the same memfd privately, so pages are only copied when written.
+         * The first clone just remaps this RAM privately, following clones are free as long
+         * as this RAM is not written in between, else its written pages are copied.
+         * 
+         * @return ZoraGA::RVVM::rv32_mem* 
+         */
+        ZoraGA::RVVM::rv32_mem *clone();
+
+        void *host(uint32_t &len);
+        ZoraGA::RVVM::rv_err map_image(int fd, uint64_t off, uint32_t len);
+        bool can_map_image() { return true; }
+        ZoraGA::RVVM::rv_dirty *dirty();
+
+        /**
+         * @brief Freeze the content in the memfd and map it privately, written pages
+         *        are reverted by dropping their private copies
+         */
+        ZoraGA::RVVM::rv_err set_baseline();
+        ZoraGA::RVVM::rv_err revert_pages(const std::vector<uint32_t> &pages);
+
+        /**
+         * @brief Move the mapping to addr, keeping its content, and out again by unmap_at
+         */
+        ZoraGA::RVVM::rv_err map_at(void *addr, uint32_t len);
+        void unmap_at(void *addr, uint32_t len);
+        void host_written(uint32_t off, uint32_t len);
+
+    private:
+        template<typename V> ZoraGA::RVVM::rv_err load(uint32_t addr, V &data);
+        template<typename V> ZoraGA::RVVM::rv_err store(uint32_t addr, V data);
+        bool map(int fd, uint64_t off, size_t sz, bool shared);
+        void unmap();
+        bool freeze();
+        bool copy_sparse(int fd);
 
     private:
-        std::vector<uint8_t> m_mem;
+        int      m_fd   = -1;
+        uint64_t m_off  = 0;
+        uint8_t *m_mem  = nullptr;
+        size_t   m_size = 0;
+        /* the mapping is MAP_SHARED, writes go to m_fd, else MAP_PRIVATE over it */
+        bool m_shared   = false;
+        /* the mapping has been written since it was mapped */
+        bool m_diverged = false;
+        ZoraGA::RVVM::rv_dirty m_dirty;
+        /* pages written since m_fd was mapped */
+        ZoraGA::RVVM::rv_dirty m_cow;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -14,6 +14,7 @@ class mem_rom:public ZoraGA::RVVM::rv32_mem
 
         ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
         ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv32_mem *clone() { return this; }
     private:
         std::mutex m_mutex;
         std::ifstream m_file;
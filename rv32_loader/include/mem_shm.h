@@ -0,0 +1,98 @@
+#ifndef __RVVM_LOADER_MEM_SHM_H__
+#define __RVVM_LOADER_MEM_SHM_H__
+
+#include "ZoraGA/RVdefs.h"
+
+#define SHM_PEERS_MAX 32
+/* control page before the data, not seen by the guests */
+#define SHM_CTL_SIZE  4096
+
+/**
+ * @brief Control page of a shared memory, for the doorbells
+ */
+typedef struct shm_ctl
+{
+    uint32_t magic;
+    uint32_t peers;
+    uint32_t size;
+    uint32_t rsvd;
+    struct {
+        /* doorbells rung, a bit per sender */
+        alignas(64) uint32_t pending;
+        /* futex word, bumped on each ring */
+        uint32_t seq;
+    } peer[SHM_PEERS_MAX];
+}shm_ctl;
+
+/**
+ * @brief Memory shared by several VMs, in this process or others
+ *
+ * The same object is added to each VM of a process, by add_mem, a VM of another
+ * process opens the same name. Guests access the host buffer itself, in flat
+ * address spaces it is mapped once per VM, all views of the same pages.
+ * Shared with the VMs forked by clone, not saved in snapshots.
+ */
+class mem_shm:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        mem_shm();
+        ~mem_shm();
+
+        /**
+         * @brief Create the shared memory, for VMs of this process
+         *
+         * @param size Rounded up to pages
+         * @param peers VMs with a doorbell, up to SHM_PEERS_MAX
+         * @return true
+         * @return false
+         */
+        bool create(uint32_t size, uint32_t peers);
+
+        /**
+         * @brief Open a POSIX shared memory object, created by the first process
+         *
+         * The object stays after the processes exit, until shm_unlink.
+         *
+         * @param name Name of shm_open
+         * @param size Rounded up to pages, the same in all processes
+         * @param peers The same in all processes
+         * @return true
+         * @return false
+         */
+        bool open(std::string name, uint32_t size, uint32_t peers);
+
+        uint32_t size();
+        shm_ctl *ctl();
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err read8(uint32_t addr, uint8_t &data);
+        ZoraGA::RVVM::rv_err read16(uint32_t addr, uint16_t &data);
+        ZoraGA::RVVM::rv_err read32(uint32_t addr, uint32_t &data);
+        ZoraGA::RVVM::rv_err write8(uint32_t addr, uint8_t data);
+        ZoraGA::RVVM::rv_err write16(uint32_t addr, uint16_t data);
+        ZoraGA::RVVM::rv_err write32(uint32_t addr, uint32_t data);
+        ZoraGA::RVVM::rv32_mem *clone() { return this; }
+
+        /**
+         * @brief Map the shared pages at addr, for any number of flat address spaces
+         */
+        ZoraGA::RVVM::rv_err map_at(void *addr, uint32_t len);
+        void unmap_at(void *addr, uint32_t len);
+
+    private:
+        template<typename V> ZoraGA::RVVM::rv_err load(uint32_t addr, V &data);
+        template<typename V> ZoraGA::RVVM::rv_err store(uint32_t addr, V data);
+        bool map(int fd, uint32_t size);
+        void close();
+
+    private:
+        int      m_fd   = -1;
+        uint8_t *m_map  = nullptr;
+        uint8_t *m_mem  = nullptr;
+        uint32_t m_size = 0;
+        /* mappings made by map_at */
+        std::vector<std::pair<void*, uint32_t>> m_views;
+};
+
+#endif
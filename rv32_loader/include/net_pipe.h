@@ -0,0 +1,152 @@
+#ifndef __RVVM_LOADER_NET_PIPE_H__
+#define __RVVM_LOADER_NET_PIPE_H__
+
+#include <atomic>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* largest frame a pipe carries */
+#define NET_FRAME_MAX 2044
+
+/**
+ * @brief Point to point packet link between two emulated NICs, no real network
+ *
+ * Packets go in batches, as the scatter lists of mmsghdr, so a device passes
+ * its guest buffers straight through. send and recv never block, a sender
+ * without room waits in wait_send, so the peer paces it instead of dropping.
+ */
+class net_pipe
+{
+    public:
+        virtual ~net_pipe() {}
+
+        /**
+         * @brief Send packets
+         *
+         * @param pkts msg_iov of each packet
+         * @param cnt
+         * @return int Packets sent, the first ones, the peer has no room for the rest
+         */
+        virtual int send(struct mmsghdr *pkts, int cnt) = 0;
+
+        /**
+         * @brief Receive packets into the buffers given
+         *
+         * @param pkts msg_iov of each buffer, msg_len is set to the packet length
+         * @param cnt
+         * @return int Packets received
+         */
+        virtual int recv(struct mmsghdr *pkts, int cnt) = 0;
+
+        /**
+         * @brief Block until a packet may be received, or the pipe is stopped
+         */
+        virtual void wait_recv() = 0;
+
+        /**
+         * @brief Block until the peer may have room, or the pipe is stopped
+         */
+        virtual void wait_send() = 0;
+
+        /**
+         * @brief Wake up the threads waiting, waits return at once from then on
+         */
+        virtual void stop() = 0;
+};
+
+/**
+ * @brief Unix datagram socket, one datagram per packet
+ *
+ * Both sides connect to each other, so the room is the socket buffer, not the
+ * short datagram queue of an unconnected receiver.
+ */
+class net_socket:public net_pipe
+{
+    public:
+        net_socket();
+        ~net_socket();
+
+        /**
+         * @brief Bind a socket to a path, and send to the socket bound to another
+         *
+         * @param local Path bound, replaced if it exists
+         * @param peer Path of the other side, it may be bound later
+         * @return true
+         * @return false
+         */
+        bool open(std::string local, std::string peer);
+
+        /**
+         * @brief Connect two sockets of this process with a socketpair
+         */
+        static bool pair(net_socket &a, net_socket &b);
+
+        int send(struct mmsghdr *pkts, int cnt);
+        int recv(struct mmsghdr *pkts, int cnt);
+        void wait_recv();
+        void wait_send();
+        void stop();
+
+    private:
+        bool adopt(int fd);
+        void peer_connect();
+        void close();
+
+    private:
+        int m_fd   = -1;
+        int m_wake = -1;
+        struct sockaddr_un m_peer;
+        socklen_t m_peer_len = 0;
+        /* connected to the peer path, by the send or the receive thread */
+        std::atomic<bool> m_connected{false};
+        std::string m_local;
+};
+
+/**
+ * @brief Two packet rings in shared memory, one per direction
+ *
+ * Packets are copied into fixed slots, a side sleeping in a wait is woken by
+ * a futex on the ring, so the peer may be a thread or another process.
+ */
+class net_shm:public net_pipe
+{
+    public:
+        net_shm();
+        ~net_shm();
+
+        /**
+         * @brief Map a POSIX shared memory object, created by the first side
+         *
+         * @param name Name of shm_open
+         * @param side 0 or 1, the peer takes the other
+         * @return true
+         * @return false
+         */
+        bool open(std::string name, int side);
+
+        /**
+         * @brief Connect two rings of this process through an anonymous mapping
+         */
+        static bool pair(net_shm &a, net_shm &b);
+
+        int send(struct mmsghdr *pkts, int cnt);
+        int recv(struct mmsghdr *pkts, int cnt);
+        void wait_recv();
+        void wait_send();
+        void stop();
+
+    private:
+        struct shm_ring;
+
+        bool map(int fd, int side);
+        void close();
+
+    private:
+        void     *m_map = nullptr;
+        shm_ring *m_tx  = nullptr;
+        shm_ring *m_rx  = nullptr;
+        std::atomic<bool> m_stopped{false};
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef __RVVM_LOADER_RING_BUFFER_H__
+#define __RVVM_LOADER_RING_BUFFER_H__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Lock-free ring of bytes between one producer thread and one consumer thread
+ *
+ * @tparam N Capacity, a power of 2
+ */
+template<size_t N>
+class ring_buffer
+{
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of 2");
+
+    public:
+        /**
+         * @brief Producer side, append as many bytes as there is room for
+         *
+         * @return size_t Bytes appended
+         */
+        size_t push(const uint8_t *data, size_t len)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t head = m_head.load(std::memory_order_acquire);
+            size_t n = N - (tail - head);
+            if (n > len) n = len;
+            for (size_t i=0; i<n; i++) {
+                m_buf[(tail + i) & (N - 1)] = data[i];
+            }
+            m_tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        /**
+         * @brief Consumer side, take up to len bytes
+         *
+         * @return size_t Bytes taken
+         */
+        size_t pop(uint8_t *data, size_t len)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t tail = m_tail.load(std::memory_order_acquire);
+            size_t n = tail - head;
+            if (n > len) n = len;
+            for (size_t i=0; i<n; i++) {
+                data[i] = m_buf[(head + i) & (N - 1)];
+            }
+            m_head.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        /**
+         * @brief Bytes in the ring, the other side may change it right after
+         */
+        size_t size()
+        {
+            size_t head = m_head.load(std::memory_order_acquire);
+            return m_tail.load(std::memory_order_acquire) - head;
+        }
+
+        size_t space()
+        {
+            return N - size();
+        }
+
+        /**
+         * @brief Consumer side, drop everything
+         */
+        void clear()
+        {
+            m_head.store(m_tail.load());
+        }
+
+    private:
+        uint8_t m_buf[N];
+        /* free running, the index is masked */
+        std::atomic<size_t> m_head{0};
+        std::atomic<size_t> m_tail{0};
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __RVVM_LOADER_RISCV_PLIC_H__
+#define __RVVM_LOADER_RISCV_PLIC_H__
+
+#include "ZoraGA/RVdefs.h"
+#include <functional>
+#include <mutex>
+
+#define PLIC_SIZE    0x4000000
+/* interrupt sources, 0 is reserved */
+#define PLIC_SOURCES 32
+
+/**
+ * @brief Platform-level interrupt controller, one context, 32-bit registers
+ *
+ * Sources 1-31 are level triggered: a source is pending while its line is high
+ * and it is not claimed. Reading CLAIM returns the pending and enabled source of
+ * highest priority above THRESHOLD, the lowest ID among equals, or 0, and stops
+ * it from being pending until its ID is written back to CLAIM. The output is
+ * raised while such a source exists. The layout is the one of the SiFive PLIC,
+ * "riscv,plic0", with context 0 only.
+ *
+ * Registers: PRIORITY 0x000000 + 4 * source (0-7), PENDING (RO) 0x001000,
+ * ENABLE 0x002000, THRESHOLD 0x200000, CLAIM 0x200004, reset value 0.
+ */
+class riscv_plic:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        riscv_plic();
+        ~riscv_plic();
+
+        /**
+         * @brief Set the interrupt output, the current level if raised, and then each change
+         *
+         * @param irq
+         */
+        void set_irq(std::function<void(bool level)> irq);
+
+        /**
+         * @brief Set the line of a source, from any thread
+         *
+         * @param source 1 to PLIC_SOURCES - 1, others are ignored
+         * @param level
+         */
+        void set_line(uint32_t source, bool level);
+
+        /**
+         * @brief The line of a source, as the interrupt output of a device
+         *
+         * @param source
+         * @return std::function<void(bool level)>
+         */
+        std::function<void(bool level)> line(uint32_t source);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err save_state(std::vector<uint8_t> &state);
+        ZoraGA::RVVM::rv_err load_state(const std::vector<uint8_t> &state);
+
+    private:
+        uint32_t claim();
+        void irq_update();
+
+    private:
+        /* the registers, from the hart and the device threads */
+        std::mutex m_mutex;
+        uint32_t m_priority[PLIC_SOURCES] = {0};
+        uint32_t m_enable    = 0;
+        uint32_t m_threshold = 0;
+        uint32_t m_pending   = 0;
+        uint32_t m_claimed   = 0;
+        /* lines of the sources */
+        uint32_t m_level     = 0;
+        bool     m_irq_level = false;
+        std::function<void(bool)> m_irq;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __RVVM_LOADER_SHM_DOORBELL_H__
+#define __RVVM_LOADER_SHM_DOORBELL_H__
+
+#include "mem_shm.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#define SHM_DOORBELL_SIZE 0x100
+
+/**
+ * @brief Doorbell of one VM on a mem_shm, 32-bit registers
+ *
+ * A VM rings a peer by writing its ID to DOORBELL, the peer sees the bit of the
+ * ringing VM in STATUS, and its interrupt is raised while STATUS & MASK is not
+ * zero. Writing STATUS clears the bits written. The state is in the control page
+ * of the shared memory, a thread per doorbell sleeps on it for rings from peers.
+ *
+ * Registers: ID (RO) 0x00, PEERS (RO) 0x04, DOORBELL (WO) 0x08,
+ * STATUS (W1C) 0x0c, MASK 0x10, reset value 0.
+ */
+class shm_doorbell:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        shm_doorbell();
+        ~shm_doorbell();
+
+        /**
+         * @brief Attach to a shared memory as a peer, and start waiting for rings
+         *
+         * @param shm Kept by the caller while the doorbell lives
+         * @param id Peer ID, below the peers of the shared memory, one doorbell each
+         * @return true
+         * @return false
+         */
+        bool attach(mem_shm *shm, uint32_t id);
+
+        /**
+         * @brief Set the interrupt output, the current level if raised, and then each change
+         *
+         * @param irq
+         */
+        void set_irq(std::function<void(bool level)> irq);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+
+    private:
+        void ring(uint32_t peer);
+        void irq_update();
+        void wait_run();
+        void close();
+
+    private:
+        shm_ctl *m_ctl = nullptr;
+        uint32_t m_id  = 0;
+        std::atomic<uint32_t> m_mask{0};
+        std::atomic<bool> m_quit{false};
+        std::thread m_thread;
+
+        /* irq_update from the hart and the waiting thread */
+        std::mutex m_irq_mutex;
+        bool       m_irq_level = false;
+        std::function<void(bool)> m_irq;
+};
+
+#endif
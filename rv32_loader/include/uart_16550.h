@@ -0,0 +1,95 @@
+#ifndef __RVVM_LOADER_UART_16550_H__
+#define __RVVM_LOADER_UART_16550_H__
+
+#include "ZoraGA/RVdefs.h"
+#include "ring_buffer.h"
+#include <functional>
+#include <thread>
+
+#define UART_16550_SIZE  0x100
+/* input clock, as clock-frequency of a device tree */
+#define UART_16550_CLOCK 3686400
+
+/**
+ * @brief 16550A UART, byte registers, the host side is served by an I/O thread
+ *
+ * The hart only moves bytes through lock-free rings, host reads and writes happen
+ * in the I/O thread, so console output never blocks the hart. The FIFOs appear as
+ * deep as the rings, LSR.THRE is clear only while the TX ring is full.
+ * The interrupt output is level, driven through the callback from either thread.
+ */
+class uart_16550:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        uart_16550();
+        ~uart_16550();
+
+        /**
+         * @brief Bind to the host and start the I/O thread
+         *
+         * @param host "stdio", "pty" for a new pseudo terminal, or a file for output only
+         * @return true
+         * @return false
+         */
+        bool open(std::string host);
+
+        /**
+         * @brief Name of the pseudo terminal opened for "pty"
+         *
+         * @return std::string
+         */
+        std::string pty_name();
+
+        /**
+         * @brief Set the interrupt output, the current level if raised, and then each change
+         *
+         * @param irq
+         */
+        void set_irq(std::function<void(bool level)> irq);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err save_state(std::vector<uint8_t> &state);
+        ZoraGA::RVVM::rv_err load_state(const std::vector<uint8_t> &state);
+
+    private:
+        uint8_t reg_read(uint32_t reg);
+        void reg_write(uint32_t reg, uint8_t val);
+        uint8_t iir();
+        void irq_update();
+        void io_run();
+        void io_wake();
+        void close();
+
+    private:
+        ring_buffer<65536> m_tx;
+        ring_buffer<4096>  m_rx;
+        std::function<void(bool)> m_irq;
+        /* irq_update from the hart and the I/O thread */
+        std::mutex m_irq_mutex;
+        bool       m_irq_level = false;
+
+        /* registers, IER and the THRE interrupt are read by the I/O thread too */
+        std::atomic<uint8_t> m_ier{0};
+        std::atomic<bool>    m_thre_ip{false};
+        uint8_t m_lcr = 0x03;
+        uint8_t m_mcr = 0;
+        uint8_t m_scr = 0;
+        uint8_t m_fcr = 0;
+        uint8_t m_dll = 0x0c;
+        uint8_t m_dlm = 0;
+
+        int m_in  = -1;
+        int m_out = -1;
+        int m_wake = -1;
+        bool m_own_in  = false;
+        bool m_own_out = false;
+        bool m_raw     = false;
+        std::string m_pty;
+        std::thread m_thread;
+        std::atomic<bool> m_quit{false};
+        /* the I/O thread waits in poll, bytes pushed to TX must wake it */
+        std::atomic<bool> m_sleeping{false};
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __RVVM_LOADER_VIRTIO_BLK_H__
+#define __RVVM_LOADER_VIRTIO_BLK_H__
+
+#include "virtio_mmio.h"
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <sys/uio.h>
+
+/**
+ * @brief virtio-blk over virtio-mmio, backed by a host disk image
+ *
+ * Data descriptors become iovecs into guest RAM, requests go straight from the
+ * guest buffers to the image. All requests of a notify are submitted to io_uring
+ * with one system call, and completed by its reaper thread. Where io_uring isn't
+ * available, a pool of threads runs preadv/pwritev instead. Either way the hart
+ * never waits on the disk.
+ */
+class virtio_blk:public virtio_mmio
+{
+    public:
+        virtio_blk();
+        ~virtio_blk();
+
+        /**
+         * @brief Open the disk image
+         *
+         * @param path
+         * @param readonly Opened read-only, and VIRTIO_BLK_F_RO offered
+         * @return true
+         * @return false
+         */
+        bool open(std::string path, bool readonly);
+
+        /**
+         * @brief Requests go through io_uring, not the thread pool
+         */
+        bool uring();
+
+    protected:
+        uint64_t dev_features();
+        void config_read(uint32_t off, void *p, uint32_t len);
+        void queue_notify(uint32_t q);
+        void dev_reset();
+
+    private:
+        typedef struct blk_req
+        {
+            uint16_t head;
+            uint32_t type;
+            uint64_t off;
+            std::vector<struct iovec> iov;
+            /* guest address and length of each iovec, for dma_written */
+            std::vector<std::pair<uint64_t, uint32_t>> gpa;
+            uint64_t status;
+            uint32_t len;
+        }blk_req;
+
+        blk_req *parse(uint16_t head, std::vector<vq_desc> &chain);
+        void complete(blk_req *req, int64_t res);
+        bool uring_setup(uint32_t entries);
+        void uring_submit(std::vector<blk_req*> &reqs);
+        void uring_run();
+        void pool_run();
+        void close();
+
+    private:
+        int      m_fd = -1;
+        bool     m_readonly = false;
+        uint64_t m_sectors  = 0;
+        std::atomic<uint32_t> m_inflight{0};
+
+        /* io_uring, rings mapped from the kernel */
+        int       m_ring = -1;
+        void     *m_sq_map = nullptr;
+        size_t    m_sq_len = 0;
+        void     *m_cq_map = nullptr;
+        size_t    m_cq_len = 0;
+        void     *m_sqes   = nullptr;
+        size_t    m_sqes_len = 0;
+        uint32_t *m_sq_head = nullptr;
+        uint32_t *m_sq_tail = nullptr;
+        uint32_t *m_sq_mask = nullptr;
+        uint32_t *m_sq_array = nullptr;
+        uint32_t *m_cq_head = nullptr;
+        uint32_t *m_cq_tail = nullptr;
+        uint32_t *m_cq_mask = nullptr;
+        void     *m_cqes = nullptr;
+
+        /* thread pool fallback */
+        std::mutex m_pool_mutex;
+        std::condition_variable m_pool_cond;
+        std::deque<blk_req*> m_pool_queue;
+        bool m_quit = false;
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_done_mutex;
+        std::condition_variable m_done_cond;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef __RVVM_LOADER_VIRTIO_MMIO_H__
+#define __RVVM_LOADER_VIRTIO_MMIO_H__
+
+#include "ZoraGA/RVdefs.h"
+#include <atomic>
+#include <functional>
+
+#define VIRTIO_MMIO_SIZE 0x200
+
+#define VIRTIO_RING_F_EVENT_IDX 29
+#define VIRTIO_F_VERSION_1 32
+
+/* descriptor flags */
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2
+
+/**
+ * @brief virtio-mmio transport, version 2, split virtqueues
+ *
+ * Devices derive from it and serve their queues and config space. Buffers are
+ * host pointers into the guest RAM given by set_ram, so devices move data
+ * without copies. vq_push can be called from any thread, to complete buffers
+ * from I/O threads, and raises the level interrupt through the callback.
+ * When the driver takes VIRTIO_RING_F_EVENT_IDX, which a device offers in its
+ * features, notifications and interrupts are suppressed in both directions
+ * through the event indexes.
+ */
+class virtio_mmio:public ZoraGA::RVVM::rv32_mem
+{
+    public:
+        /**
+         * @param device_id virtio device ID
+         * @param queues Number of virtqueues
+         * @param queue_max Largest queue size
+         */
+        virtio_mmio(uint32_t device_id, uint32_t queues, uint16_t queue_max);
+        virtual ~virtio_mmio();
+
+        /**
+         * @brief Set the guest RAM buffers are in, it must have host()
+         *
+         * @param ram
+         * @param addr Physical address of the RAM
+         */
+        void set_ram(ZoraGA::RVVM::rv32_mem *ram, uint32_t addr);
+
+        /**
+         * @brief Set the interrupt output, the current level if raised, and then each change
+         *
+         * @param irq
+         */
+        void set_irq(std::function<void(bool level)> irq);
+
+        ZoraGA::RVVM::rv_err read(uint32_t addr, void *p, uint32_t len);
+        ZoraGA::RVVM::rv_err write(uint32_t addr, void *p, uint32_t len);
+
+    protected:
+        typedef struct vq_desc
+        {
+            uint64_t addr;
+            uint32_t len;
+            uint16_t flags;
+            uint16_t next;
+        }vq_desc;
+
+        /**
+         * @brief Device features, VIRTIO_F_VERSION_1 is added
+         */
+        virtual uint64_t dev_features() = 0;
+        virtual void config_read(uint32_t off, void *p, uint32_t len) = 0;
+        virtual void config_write(uint32_t off, void *p, uint32_t len) {}
+
+        /**
+         * @brief The driver notified queue q, on the hart thread
+         */
+        virtual void queue_notify(uint32_t q) = 0;
+
+        /**
+         * @brief The driver reset the device, buffers in flight must be done before returning
+         */
+        virtual void dev_reset() {}
+
+        /**
+         * @brief The driver set DRIVER_OK, features are negotiated and queues set up
+         */
+        virtual void driver_ok() {}
+
+        /**
+         * @brief Take the next available chain of queue q
+         *
+         * @param q
+         * @param head Output, head descriptor index, for vq_push
+         * @param chain Output, descriptors of the chain
+         * @return true
+         * @return false If no chain is available, or the queue or the chain is malformed
+         */
+        bool vq_pop(uint32_t q, uint16_t &head, std::vector<vq_desc> &chain);
+
+        /**
+         * @brief Avail index of the next chain vq_pop takes
+         *
+         * @param q
+         * @return uint16_t
+         */
+        uint16_t vq_next(uint32_t q);
+
+        /**
+         * @brief Give back the chains taken by vq_pop from an avail index on, unused
+         *
+         * @param q
+         * @param idx Avail index of the first chain given back, from vq_next
+         */
+        void vq_rewind(uint32_t q, uint16_t idx);
+
+        /**
+         * @brief Return a chain to the driver, and interrupt it
+         *
+         * @param q
+         * @param head
+         * @param len Bytes written to the chain
+         */
+        void vq_push(uint32_t q, uint16_t head, uint32_t len);
+
+        /**
+         * @brief Put a chain in the used ring, not yet seen by the driver
+         *
+         * @param q
+         * @param head
+         * @param len Bytes written to the chain
+         */
+        void vq_fill(uint32_t q, uint16_t head, uint32_t len);
+
+        /**
+         * @brief Make the filled chains seen by the driver, and interrupt it unless suppressed
+         *
+         * @param q
+         */
+        void vq_flush(uint32_t q);
+
+        /**
+         * @brief Host pointer of a guest buffer
+         *
+         * @return uint8_t* nullptr if the buffer isn't all in the RAM
+         */
+        uint8_t *dma(uint64_t addr, uint32_t len);
+
+        /**
+         * @brief Tell the RAM a buffer has been written through its host pointer
+         */
+        void dma_written(uint64_t addr, uint32_t len);
+
+        /**
+         * @brief Negotiated features
+         */
+        uint64_t features();
+
+        /**
+         * @brief Device status has DRIVER_OK and not NEEDS_RESET
+         */
+        bool running();
+
+        /**
+         * @brief Set DEVICE_NEEDS_RESET, on a malformed queue
+         */
+        void needs_reset();
+
+    private:
+        typedef struct virtq
+        {
+            uint16_t num        = 0;
+            bool     ready      = false;
+            uint64_t desc       = 0;
+            uint64_t avail      = 0;
+            uint64_t used       = 0;
+            uint16_t last_avail = 0;
+            uint16_t used_idx   = 0;
+            /* used index seen by the driver, the rest is filled */
+            uint16_t used_pub   = 0;
+        }virtq;
+
+        uint32_t reg_read(uint32_t reg);
+        void reg_write(uint32_t reg, uint32_t val);
+        void reset();
+        void irq_update();
+        bool event_idx();
+
+    private:
+        uint32_t m_device_id;
+        uint16_t m_queue_max;
+        std::vector<virtq> m_queues;
+        ZoraGA::RVVM::rv32_mem *m_ram = nullptr;
+        uint32_t m_ram_addr = 0;
+
+        uint32_t m_dev_feat_sel = 0;
+        uint32_t m_drv_feat_sel = 0;
+        uint64_t m_drv_features = 0;
+        uint32_t m_queue_sel    = 0;
+        std::atomic<uint32_t> m_status{0};
+        uint32_t m_config_gen   = 0;
+
+        /* vq_push from I/O threads, the interrupt status with it */
+        std::mutex m_used_mutex;
+        uint32_t   m_int_status = 0;
+        bool       m_irq_level  = false;
+        std::function<void(bool)> m_irq;
+};
+
+#endif
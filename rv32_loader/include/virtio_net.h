@@ -0,0 +1,88 @@
+#ifndef __RVVM_LOADER_VIRTIO_NET_H__
+#define __RVVM_LOADER_VIRTIO_NET_H__
+
+#include "virtio_mmio.h"
+#include "net_pipe.h"
+#include <condition_variable>
+#include <thread>
+#include <sys/uio.h>
+
+/**
+ * @brief virtio-net over virtio-mmio, its wire is a net_pipe
+ *
+ * A send and a receive thread move chains between the queues and the pipe, a
+ * batch at a time, the hart only wakes them. The guest buffers are passed to
+ * the pipe as they are. Each batch is made seen by the driver at once, with one
+ * interrupt, and VIRTIO_RING_F_EVENT_IDX is offered to suppress the rest.
+ * TX chains the peer has no room for wait in the queue, the guest is paced by
+ * the peer rather than losing packets.
+ */
+class virtio_net:public virtio_mmio
+{
+    public:
+        virtio_net();
+        ~virtio_net();
+
+        /**
+         * @brief Set the pipe and start receiving from it
+         *
+         * @param pipe Kept by the caller while the device lives
+         */
+        void set_pipe(net_pipe *pipe);
+
+        /**
+         * @brief Set the MAC address offered to the driver
+         *
+         * @param mac
+         */
+        void set_mac(const uint8_t mac[6]);
+
+    protected:
+        uint64_t dev_features();
+        void config_read(uint32_t off, void *p, uint32_t len);
+        void queue_notify(uint32_t q);
+        void dev_reset();
+        void driver_ok();
+
+    private:
+        typedef enum batch_state
+        {
+            BATCH_DONE,
+            /* no chains in the queue, wait for a notify */
+            BATCH_NO_BUFS,
+            /* no packet or no room in the pipe, wait on it */
+            BATCH_PIPE,
+        }batch_state;
+
+        bool chain_iov(std::vector<vq_desc> &chain, bool write, std::vector<struct iovec> &iov);
+        batch_state rx_batch();
+        batch_state tx_batch();
+        void batch_rewind(uint32_t q, uint16_t start, uint16_t end, std::vector<std::pair<uint16_t, uint16_t>> &bad);
+        void run(bool tx);
+        void kick(bool tx);
+        void close();
+
+    private:
+        net_pipe *m_pipe = nullptr;
+        uint8_t   m_mac[6] = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+
+        std::thread m_rx_thread, m_tx_thread;
+        /* held by a batch, a reset waits for it */
+        std::mutex  m_rx_mutex, m_tx_mutex;
+        /* chains may have been added */
+        std::mutex  m_kick_mutex;
+        std::condition_variable m_kick_cond;
+        bool m_kicked[2] = {false, false};
+        std::atomic<bool> m_quit{false};
+
+        /* batches, reused */
+        std::vector<uint16_t> m_rx_heads, m_tx_heads;
+        /* avail index of each chain, and of the malformed ones with their head */
+        std::vector<uint16_t> m_rx_pos, m_tx_pos;
+        std::vector<std::pair<uint16_t, uint16_t>> m_rx_bad, m_tx_bad;
+        std::vector<std::vector<vq_desc>> m_rx_chains;
+        std::vector<std::vector<struct iovec>> m_rx_iov, m_tx_iov;
+        std::vector<struct mmsghdr> m_rx_msgs, m_tx_msgs;
+};
+
+#endif
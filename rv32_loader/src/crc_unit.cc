@@ -0,0 +1,308 @@
+#include "crc_unit.h"
+#include "ZoraGA/RVHost.h"
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC_X86 1
+#endif
+
+/* registers */
+#define REG_ADDR   0x00
+#define REG_LEN    0x04
+#define REG_CTRL   0x08
+#define REG_STATUS 0x0c
+#define REG_DATA   0x10
+#define REG_RESULT 0x14
+
+#define CTRL_START  0x01
+#define CTRL_CRC32C 0x02
+
+#define STATUS_ERROR 0x01
+
+/* reflected polynomials */
+#define POLY_CRC32  0xedb88320
+#define POLY_CRC32C 0x82f63b78
+
+/* bounce buffer, for memories without host() */
+#define BOUNCE_SIZE 4096
+
+using namespace ZoraGA::RVVM;
+
+/**
+ * @brief Slicing-by-8 tables of both polynomials
+ */
+static struct crc_tables
+{
+    uint32_t t[2][8][256];
+
+    crc_tables()
+    {
+        const uint32_t poly[2] = {POLY_CRC32, POLY_CRC32C};
+        for (int k=0; k<2; k++) {
+            for (uint32_t i=0; i<256; i++) {
+                uint32_t c = i;
+                for (int j=0; j<8; j++) c = (c >> 1) ^ (poly[k] & (0u - (c & 1)));
+                t[k][0][i] = c;
+            }
+            for (uint32_t i=0; i<256; i++) {
+                for (int j=1; j<8; j++) t[k][j][i] = (t[k][j-1][i] >> 8) ^ t[k][0][t[k][j-1][i] & 0xff];
+            }
+        }
+    }
+}tables;
+
+/**
+ * @brief Table fallback, on the inverted CRC
+ */
+static uint32_t crc_sw(uint32_t state, int k, const uint8_t *p, size_t len)
+{
+    const uint32_t (*t)[256] = tables.t[k];
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= state;
+        state = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+              ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p   += 8;
+        len -= 8;
+    }
+    while (len--) state = (state >> 8) ^ t[0][(state ^ *p++) & 0xff];
+    return state;
+}
+
+#ifdef CRC_X86
+/**
+ * @brief CRC-32C with the SSE4.2 crc32 instruction, on the inverted CRC
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t state, const uint8_t *p, size_t len)
+{
+#ifdef __x86_64__
+    uint64_t state64 = state;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        state64 = _mm_crc32_u64(state64, v);
+        p   += 8;
+        len -= 8;
+    }
+    state = (uint32_t)state64;
+#endif
+    while (len >= 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        state = _mm_crc32_u32(state, v);
+        p   += 4;
+        len -= 4;
+    }
+    while (len--) state = _mm_crc32_u8(state, *p++);
+    return state;
+}
+
+/**
+ * @brief CRC-32 folded 64 bytes a round with PCLMULQDQ, on the inverted CRC
+ *
+ * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ",
+ * constants of the bit reflected domain, len at least 64 and a multiple of 16.
+ */
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32_pclmul(uint32_t state, const uint8_t *p, size_t len)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(state));
+    p   += 64;
+    len -= 64;
+
+    /* four lanes of 128 bits */
+    while (len >= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+        p   += 64;
+        len -= 64;
+    }
+
+    /* into one lane, then the rest 16 bytes a round */
+    __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)p));
+        p   += 16;
+        len -= 16;
+    }
+
+    /* 128 to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+    /* Barrett reduction to 32 bits */
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32_t crc_unit::update(uint32_t crc, bool castagnoli, const void *p, size_t len)
+{
+    const uint8_t *b = (const uint8_t*)p;
+    uint32_t state = ~crc;
+#ifdef CRC_X86
+    if (castagnoli && rv_host_has(RV_HOST_SSE42)) {
+        return ~crc32c_sse42(state, b, len);
+    }
+    /* the folding takes SSE4.1 too */
+    if (!castagnoli && rv_host_has(RV_HOST_PCLMUL) && rv_host_has(RV_HOST_SSE42) && len >= 64) {
+        size_t n = len & ~(size_t)15;
+        state = crc32_pclmul(state, b, n);
+        b   += n;
+        len -= n;
+    }
+#endif
+    return ~crc_sw(state, castagnoli ? 1 : 0, b, len);
+}
+
+crc_unit::crc_unit()
+{}
+
+crc_unit::~crc_unit()
+{}
+
+void crc_unit::add_region(uint32_t addr, uint32_t len, rv32_mem *mem)
+{
+    m_regions.push_back(region{addr, len, mem});
+}
+
+rv_err crc_unit::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > CRC_UNIT_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val = 0;
+    switch(addr) {
+        case REG_ADDR:   val = m_addr;   break;
+        case REG_LEN:    val = m_len;    break;
+        case REG_CTRL:   val = m_ctrl;   break;
+        case REG_STATUS: val = m_status; break;
+        case REG_RESULT: val = m_result; break;
+        default:         break;
+    }
+    memcpy(p, &val, 4);
+    return RV_EOK;
+}
+
+rv_err crc_unit::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > CRC_UNIT_SIZE) return RV_ERANGE;
+    /* DATA takes bytes and halves too, the other registers words */
+    if ((len != 1 && len != 2 && len != 4) || (addr & (len - 1))) return RV_EDALIGN;
+    if (addr == REG_DATA) {
+        m_result = update(m_result, m_ctrl & CTRL_CRC32C, p, len);
+        return RV_EOK;
+    }
+    if (len != 4) return RV_EDALIGN;
+    uint32_t val;
+    memcpy(&val, p, 4);
+    switch(addr) {
+        case REG_ADDR:   m_addr   = val; break;
+        case REG_LEN:    m_len    = val; break;
+        case REG_RESULT: m_result = val; break;
+        case REG_STATUS: m_status &= ~val; break;
+        case REG_CTRL:
+            m_ctrl = val & CTRL_CRC32C;
+            if ((val & CTRL_START) && !feed()) m_status |= STATUS_ERROR;
+            break;
+        default:
+            break;
+    }
+    return RV_EOK;
+}
+
+rv_err crc_unit::save_state(std::vector<uint8_t> &state)
+{
+    uint32_t regs[] = {m_addr, m_len, m_ctrl, m_status, m_result};
+    state.assign((uint8_t*)regs, (uint8_t*)regs + sizeof(regs));
+    return RV_EOK;
+}
+
+rv_err crc_unit::load_state(const std::vector<uint8_t> &state)
+{
+    uint32_t regs[5];
+    if (state.size() != sizeof(regs)) return RV_ERANGE;
+    memcpy(regs, state.data(), sizeof(regs));
+    m_addr   = regs[0];
+    m_len    = regs[1];
+    m_ctrl   = regs[2];
+    m_status = regs[3];
+    m_result = regs[4];
+    return RV_EOK;
+}
+
+const crc_unit::region *crc_unit::find(uint32_t addr)
+{
+    for (auto &it:m_regions) {
+        if (addr >= it.addr && addr - it.addr < it.len) return &it;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Feed [ADDR, ADDR+LEN) in one host call per region, RESULT keeps the bytes fed before an error
+ */
+bool crc_unit::feed()
+{
+    if ((uint64_t)m_addr + m_len > 0x100000000ULL) return false;
+    bool castagnoli = m_ctrl & CTRL_CRC32C;
+    uint32_t done = 0;
+    while (done < m_len) {
+        const region *r = find(m_addr + done);
+        if (r == nullptr) return false;
+        uint32_t off = m_addr + done - r->addr;
+        uint32_t n   = std::min(m_len - done, r->len - off);
+
+        uint32_t hlen = 0;
+        uint8_t *host = (uint8_t*)r->mem->host(hlen);
+        if (host && (uint64_t)off + n <= hlen) {
+            m_result = update(m_result, castagnoli, host + off, n);
+        } else {
+            uint8_t buf[BOUNCE_SIZE];
+            for (uint32_t i=0; i<n; ) {
+                uint32_t m = std::min<uint32_t>(n - i, BOUNCE_SIZE);
+                if (r->mem->read(off + i, buf, m) != RV_EOK) return false;
+                m_result = update(m_result, castagnoli, buf, m);
+                i += m;
+            }
+        }
+        done += n;
+    }
+    return true;
+}
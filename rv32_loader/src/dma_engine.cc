@@ -0,0 +1,251 @@
+#include "dma_engine.h"
+#include <algorithm>
+
+/* registers */
+#define REG_SRC     0x00
+#define REG_DST     0x04
+#define REG_LEN     0x08
+#define REG_PATTERN 0x0c
+#define REG_CTRL    0x10
+#define REG_STATUS  0x14
+#define REG_COUNT   0x18
+
+#define CTRL_START  0x01
+#define CTRL_FILL   0x02
+#define CTRL_IRQ_EN 0x04
+#define CTRL_MASK   (CTRL_FILL | CTRL_IRQ_EN)
+
+#define STATUS_DONE  0x02
+#define STATUS_ERROR 0x04
+
+/* bounce buffer, between memories without host() */
+#define BOUNCE_SIZE 4096
+
+using namespace ZoraGA::RVVM;
+
+/**
+ * @brief Host memory of [off, off+n) of a memory, nullptr if it has none
+ */
+static uint8_t *host_at(rv32_mem *mem, uint32_t off, uint32_t n)
+{
+    uint32_t len = 0;
+    uint8_t *host = (uint8_t*)mem->host(len);
+    if (host == nullptr || (uint64_t)off + n > len) return nullptr;
+    return host + off;
+}
+
+/**
+ * @brief The pattern as seen from a byte phase of it
+ */
+static uint32_t pattern_at(uint32_t pattern, uint32_t phase)
+{
+    phase = (phase & 3) * 8;
+    return phase ? (pattern >> phase) | (pattern << (32 - phase)) : pattern;
+}
+
+/**
+ * @brief Fill host memory with a 32-bit pattern, memset or doubling memcpy
+ */
+static void fill_host(uint8_t *p, uint32_t n, uint32_t pattern)
+{
+    if (pattern == (pattern & 0xff) * 0x01010101u) {
+        memset(p, pattern & 0xff, n);
+        return;
+    }
+    uint32_t done = std::min<uint32_t>(n, 4);
+    memcpy(p, &pattern, done);
+    while (done < n) {
+        uint32_t m = std::min(done, n - done);
+        memcpy(p + done, p, m);
+        done += m;
+    }
+}
+
+dma_engine::dma_engine()
+{}
+
+dma_engine::~dma_engine()
+{}
+
+void dma_engine::add_region(uint32_t addr, uint32_t len, rv32_mem *mem)
+{
+    m_regions.push_back(region{addr, len, mem});
+}
+
+void dma_engine::set_irq(std::function<void(bool level)> irq)
+{
+    std::lock_guard<std::mutex> lock(m_irq_mutex);
+    m_irq = irq;
+    if (m_irq && m_irq_level) m_irq(true);
+}
+
+rv_err dma_engine::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > DMA_ENGINE_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val = 0;
+    switch(addr) {
+        case REG_SRC:     val = m_src;     break;
+        case REG_DST:     val = m_dst;     break;
+        case REG_LEN:     val = m_len;     break;
+        case REG_PATTERN: val = m_pattern; break;
+        case REG_CTRL:    val = m_ctrl;    break;
+        case REG_STATUS:  val = m_status;  break;
+        case REG_COUNT:   val = m_count;   break;
+        default:          break;
+    }
+    memcpy(p, &val, 4);
+    return RV_EOK;
+}
+
+rv_err dma_engine::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > DMA_ENGINE_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val;
+    memcpy(&val, p, 4);
+    switch(addr) {
+        case REG_SRC:     m_src     = val; break;
+        case REG_DST:     m_dst     = val; break;
+        case REG_LEN:     m_len     = val; break;
+        case REG_PATTERN: m_pattern = val; break;
+        case REG_CTRL:
+            m_ctrl = val & CTRL_MASK;
+            if (val & CTRL_START) {
+                m_count  = 0;
+                m_status &= ~(STATUS_DONE | STATUS_ERROR);
+                bool ok  = (m_ctrl & CTRL_FILL) ? fill() : copy();
+                m_status |= ok ? STATUS_DONE : STATUS_ERROR;
+            }
+            irq_update();
+            break;
+        case REG_STATUS:
+            m_status &= ~val;
+            irq_update();
+            break;
+        default:
+            break;
+    }
+    return RV_EOK;
+}
+
+rv_err dma_engine::save_state(std::vector<uint8_t> &state)
+{
+    uint32_t regs[] = {m_src, m_dst, m_len, m_pattern, m_ctrl, m_status, m_count};
+    state.assign((uint8_t*)regs, (uint8_t*)regs + sizeof(regs));
+    return RV_EOK;
+}
+
+rv_err dma_engine::load_state(const std::vector<uint8_t> &state)
+{
+    uint32_t regs[7];
+    if (state.size() != sizeof(regs)) return RV_ERANGE;
+    memcpy(regs, state.data(), sizeof(regs));
+    m_src     = regs[0];
+    m_dst     = regs[1];
+    m_len     = regs[2];
+    m_pattern = regs[3];
+    m_ctrl    = regs[4];
+    m_status  = regs[5];
+    m_count   = regs[6];
+    irq_update();
+    return RV_EOK;
+}
+
+const dma_engine::region *dma_engine::find(uint32_t addr)
+{
+    for (auto &it:m_regions) {
+        if (addr >= it.addr && addr - it.addr < it.len) return &it;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Copy in chunks within one source and one destination region each
+ *
+ * A destination above an overlapping source is copied from the end, as memmove.
+ */
+bool dma_engine::copy()
+{
+    if ((uint64_t)m_src + m_len > 0x100000000ULL || (uint64_t)m_dst + m_len > 0x100000000ULL) return false;
+    bool back = m_dst > m_src && m_dst - m_src < m_len;
+    while (m_count < m_len) {
+        uint32_t left = m_len - m_count;
+        /* the last byte of the chunk when going back, the first otherwise */
+        uint32_t pos = back ? left - 1 : m_count;
+        const region *sr = find(m_src + pos);
+        const region *dr = find(m_dst + pos);
+        if (sr == nullptr || dr == nullptr) return false;
+        uint32_t soff = m_src + pos - sr->addr;
+        uint32_t doff = m_dst + pos - dr->addr;
+        uint32_t n;
+        if (back) {
+            n = std::min({left, soff + 1, doff + 1});
+            soff -= n - 1;
+            doff -= n - 1;
+        } else {
+            n = std::min({left, sr->len - soff, dr->len - doff});
+        }
+
+        uint8_t *sp = host_at(sr->mem, soff, n);
+        uint8_t *dp = host_at(dr->mem, doff, n);
+        if (sp && dp) {
+            memmove(dp, sp, n);
+            dr->mem->host_written(doff, n);
+        } else if (dp) {
+            if (sr->mem->read(soff, dp, n) != RV_EOK) return false;
+            dr->mem->host_written(doff, n);
+        } else if (sp) {
+            if (dr->mem->write(doff, sp, n) != RV_EOK) return false;
+        } else {
+            uint8_t buf[BOUNCE_SIZE];
+            for (uint32_t i=0; i<n; ) {
+                uint32_t m = std::min<uint32_t>(n - i, BOUNCE_SIZE);
+                uint32_t at = back ? n - i - m : i;
+                if (sr->mem->read(soff + at, buf, m) != RV_EOK || dr->mem->write(doff + at, buf, m) != RV_EOK) {
+                    return false;
+                }
+                i += m;
+            }
+        }
+        m_count += n;
+    }
+    return true;
+}
+
+bool dma_engine::fill()
+{
+    if ((uint64_t)m_dst + m_len > 0x100000000ULL) return false;
+    while (m_count < m_len) {
+        const region *dr = find(m_dst + m_count);
+        if (dr == nullptr) return false;
+        uint32_t doff    = m_dst + m_count - dr->addr;
+        uint32_t n       = std::min(m_len - m_count, dr->len - doff);
+        uint32_t pattern = pattern_at(m_pattern, m_count);
+
+        uint8_t *dp = host_at(dr->mem, doff, n);
+        if (dp) {
+            fill_host(dp, n, pattern);
+            dr->mem->host_written(doff, n);
+        } else {
+            uint8_t buf[BOUNCE_SIZE];
+            fill_host(buf, BOUNCE_SIZE, pattern);
+            for (uint32_t i=0; i<n; ) {
+                uint32_t m = std::min<uint32_t>(n - i, BOUNCE_SIZE);
+                if (dr->mem->write(doff + i, buf, m) != RV_EOK) return false;
+                i += m;
+            }
+        }
+        m_count += n;
+    }
+    return true;
+}
+
+void dma_engine::irq_update()
+{
+    std::lock_guard<std::mutex> lock(m_irq_mutex);
+    bool level = (m_ctrl & CTRL_IRQ_EN) && (m_status & (STATUS_DONE | STATUS_ERROR));
+    if (level == m_irq_level) return;
+    m_irq_level = level;
+    if (m_irq) m_irq(level);
+}
@@ -0,0 +1,65 @@
+#include "elf_loader.h"
+#include <elf.h>
+
+using namespace ZoraGA::RVVM;
+
+bool elf_loader::load(std::string path)
+{
+    return m_elf.load(path);
+}
+
+bool elf_loader::map(RV32::rv32 &vm, mem_ram *ram, uint32_t ram_addr, uint32_t ram_size)
+{
+    for (auto &seg:m_elf.segments()) {
+        if (seg.type != PT_LOAD || seg.memsz == 0) continue;
+        if (seg.filesz > seg.memsz || m_elf.data(seg.offset, seg.filesz) == nullptr) return false;
+
+        if (!(seg.flags & PF_W)) {
+            std::unique_ptr<mem_file> mem(new mem_file);
+            if (!mem->map(m_elf.fd(), seg.offset, seg.filesz, seg.memsz)) return false;
+            if (!vm.add_mem(seg.vaddr, seg.memsz, mem.get())) return false;
+            m_files.push_back(std::move(mem));
+        } else if (ram && seg.vaddr >= ram_addr && (uint64_t)seg.vaddr + seg.memsz <= (uint64_t)ram_addr + ram_size) {
+            if (ram->write(seg.vaddr - ram_addr, (void*)m_elf.data(seg.offset, seg.filesz), seg.filesz) != RV_EOK) return false;
+        } else {
+            std::unique_ptr<mem_ram> mem(new mem_ram);
+            if (!mem->set_size(seg.memsz)) return false;
+            if (mem->write(0, (void*)m_elf.data(seg.offset, seg.filesz), seg.filesz) != RV_EOK) return false;
+            if (!vm.add_mem(seg.vaddr, seg.memsz, mem.get())) return false;
+            m_rams.push_back(std::move(mem));
+        }
+
+        /* load image, for startup code copying .data from it */
+        if (seg.paddr != seg.vaddr && seg.filesz) {
+            std::unique_ptr<mem_file> mem(new mem_file);
+            if (!mem->map(m_elf.fd(), seg.offset, seg.filesz, seg.filesz)) return false;
+            if (!vm.add_mem(seg.paddr, seg.filesz, mem.get())) return false;
+            m_files.push_back(std::move(mem));
+        }
+    }
+    return true;
+}
+
+uint32_t elf_loader::entry()
+{
+    return m_elf.entry();
+}
+
+bool elf_loader::code_range(uint32_t &base, uint32_t &len)
+{
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (auto &seg:m_elf.segments()) {
+        if (seg.type != PT_LOAD || !(seg.flags & PF_X)) continue;
+        lo = std::min<uint64_t>(lo, seg.vaddr);
+        hi = std::max<uint64_t>(hi, (uint64_t)seg.vaddr + seg.memsz);
+    }
+    if (lo >= hi) return false;
+    base = lo;
+    len  = hi - lo;
+    return true;
+}
+
+rv_elf *elf_loader::elf()
+{
+    return &m_elf;
+}
@@ -0,0 +1,134 @@
+#include "fdt_builder.h"
+#include <string.h>
+
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 0x1
+#define FDT_END_NODE   0x2
+#define FDT_PROP       0x3
+#define FDT_END        0x9
+
+#define FDT_VERSION      17
+#define FDT_COMP_VERSION 16
+#define FDT_HEADER_SIZE  40
+/* one empty entry ends the reservation map */
+#define FDT_RSVMAP_SIZE  16
+
+static void be32(std::vector<uint8_t> &out, size_t off, uint32_t val)
+{
+    out[off + 0] = val >> 24;
+    out[off + 1] = val >> 16;
+    out[off + 2] = val >> 8;
+    out[off + 3] = val;
+}
+
+fdt_builder::fdt_builder()
+{}
+
+void fdt_builder::begin_node(const std::string &name)
+{
+    put32(FDT_BEGIN_NODE);
+    m_struct.insert(m_struct.end(), name.begin(), name.end());
+    m_struct.push_back(0);
+    pad();
+    m_depth++;
+}
+
+void fdt_builder::end_node()
+{
+    put32(FDT_END_NODE);
+    m_depth--;
+}
+
+void fdt_builder::prop(const std::string &name, const void *data, size_t len)
+{
+    put32(FDT_PROP);
+    put32(len);
+    put32(name_off(name));
+    const uint8_t *p = (const uint8_t*)data;
+    m_struct.insert(m_struct.end(), p, p + len);
+    pad();
+}
+
+void fdt_builder::prop_empty(const std::string &name)
+{
+    prop(name, nullptr, 0);
+}
+
+void fdt_builder::prop_u32(const std::string &name, uint32_t val)
+{
+    prop_cells(name, {val});
+}
+
+void fdt_builder::prop_cells(const std::string &name, const std::vector<uint32_t> &cells)
+{
+    std::vector<uint8_t> data(cells.size() * 4);
+    for (size_t i=0; i<cells.size(); i++) {
+        be32(data, i * 4, cells[i]);
+    }
+    prop(name, data.data(), data.size());
+}
+
+void fdt_builder::prop_str(const std::string &name, const std::string &str)
+{
+    prop(name, str.c_str(), str.size() + 1);
+}
+
+void fdt_builder::prop_strs(const std::string &name, const std::vector<std::string> &strs)
+{
+    std::string data;
+    for (auto &it:strs) {
+        data += it;
+        data.push_back(0);
+    }
+    prop(name, data.data(), data.size());
+}
+
+std::vector<uint8_t> fdt_builder::finish()
+{
+    std::vector<uint8_t> blob;
+    if (m_depth != 0) return blob;
+    put32(FDT_END);
+
+    uint32_t off_struct  = FDT_HEADER_SIZE + FDT_RSVMAP_SIZE;
+    uint32_t off_strings = off_struct + m_struct.size();
+    uint32_t total       = off_strings + m_strings.size();
+    blob.resize(total, 0);
+    be32(blob, 0,  FDT_MAGIC);
+    be32(blob, 4,  total);
+    be32(blob, 8,  off_struct);
+    be32(blob, 12, off_strings);
+    be32(blob, 16, FDT_HEADER_SIZE);
+    be32(blob, 20, FDT_VERSION);
+    be32(blob, 24, FDT_COMP_VERSION);
+    be32(blob, 28, 0);
+    be32(blob, 32, m_strings.size());
+    be32(blob, 36, m_struct.size());
+    memcpy(&blob[off_struct], m_struct.data(), m_struct.size());
+    memcpy(&blob[off_strings], m_strings.data(), m_strings.size());
+    return blob;
+}
+
+void fdt_builder::put32(uint32_t val)
+{
+    m_struct.resize(m_struct.size() + 4);
+    be32(m_struct, m_struct.size() - 4, val);
+}
+
+void fdt_builder::pad()
+{
+    while (m_struct.size() % 4) m_struct.push_back(0);
+}
+
+/**
+ * @brief Offset of a property name in the strings block, names are stored once
+ */
+uint32_t fdt_builder::name_off(const std::string &name)
+{
+    auto it = m_names.find(name);
+    if (it != m_names.end()) return it->second;
+    uint32_t off = m_strings.size();
+    m_strings += name;
+    m_strings.push_back(0);
+    m_names[name] = off;
+    return off;
+}
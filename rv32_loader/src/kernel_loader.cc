@@ -0,0 +1,153 @@
+#include "kernel_loader.h"
+#include <algorithm>
+#include <fstream>
+
+/* "RSC\x05" at offset 56 of a RISC-V Image header */
+#define IMAGE_MAGIC2     0x05435352
+#define IMAGE_HEADER_LEN 64
+
+#define PAGE_ALIGN_DOWN(x) ((x) & ~0xfffULL)
+
+using namespace ZoraGA::RVVM;
+
+static uint64_t le64(const std::vector<uint8_t> &buf, size_t off)
+{
+    uint64_t val = 0;
+    for (size_t i=0; i<8; i++) {
+        val |= (uint64_t)buf[off + i] << (i * 8);
+    }
+    return val;
+}
+
+bool kernel_loader::load(std::string kernel, std::string initrd)
+{
+    if (!read_file(kernel, m_kernel) || m_kernel.empty()) return false;
+    m_initrd.clear();
+    if (!initrd.empty() && !read_file(initrd, m_initrd)) return false;
+    return true;
+}
+
+void kernel_loader::set_bootargs(std::string bootargs)
+{
+    m_bootargs = bootargs;
+}
+
+void kernel_loader::set_stdout(std::string path)
+{
+    m_stdout = path;
+}
+
+void kernel_loader::add_device(std::function<void(fdt_builder &fdt)> node)
+{
+    m_devices.push_back(node);
+}
+
+bool kernel_loader::boot(RV32::rv32 &vm, mem_ram &ram, uint32_t ram_addr, uint32_t ram_size, std::string isa)
+{
+    /* an Image header gives the load offset and the size with .bss */
+    uint64_t offset = 0, size = m_kernel.size();
+    if (m_kernel.size() >= IMAGE_HEADER_LEN && (le64(m_kernel, 56) & 0xffffffff) == IMAGE_MAGIC2) {
+        offset = le64(m_kernel, 8);
+        size   = std::max<uint64_t>(size, le64(m_kernel, 16));
+    }
+    uint64_t kernel_end = offset + size;
+
+    /* the size of the tree doesn't depend on the initrd addresses */
+    build(ram_addr, ram_size, isa, 0, 0);
+    if (m_dtb.size() > ram_size) return false;
+    uint64_t dtb_off    = PAGE_ALIGN_DOWN(ram_size - m_dtb.size());
+    uint64_t initrd_off = dtb_off;
+    if (!m_initrd.empty()) {
+        if (m_initrd.size() > dtb_off) return false;
+        initrd_off = PAGE_ALIGN_DOWN(dtb_off - m_initrd.size());
+        build(ram_addr, ram_size, isa, ram_addr + initrd_off, ram_addr + initrd_off + m_initrd.size());
+    }
+    if (kernel_end > initrd_off) return false;
+
+    if (ram.write(offset, m_kernel.data(), m_kernel.size()) != RV_EOK) return false;
+    if (!m_initrd.empty() && ram.write(initrd_off, m_initrd.data(), m_initrd.size()) != RV_EOK) return false;
+    if (ram.write(dtb_off, m_dtb.data(), m_dtb.size()) != RV_EOK) return false;
+
+    if (!vm.set_start_addr(ram_addr + offset)) return false;
+    vm.regs()->x[10] = 0;
+    vm.regs()->x[11] = ram_addr + dtb_off;
+    return true;
+}
+
+const std::vector<uint8_t> &kernel_loader::dtb()
+{
+    return m_dtb;
+}
+
+bool kernel_loader::read_file(std::string path, std::vector<uint8_t> &out)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    out.resize(file.tellg());
+    file.seekg(0, std::ifstream::beg);
+    file.read(reinterpret_cast<char*>(out.data()), out.size());
+    return file.good();
+}
+
+/**
+ * @brief Generate the device tree, one hart, the RAM and the devices under /soc
+ */
+void kernel_loader::build(uint32_t ram_addr, uint32_t ram_size, std::string isa, uint32_t initrd_start, uint32_t initrd_end)
+{
+    fdt_builder fdt;
+    char name[32];
+
+    fdt.begin_node("");
+    fdt.prop_u32("#address-cells", 1);
+    fdt.prop_u32("#size-cells", 1);
+    fdt.prop_str("compatible", "zoraga,rvvm");
+    fdt.prop_str("model", "ZoraGA RVVM");
+
+    fdt.begin_node("chosen");
+    if (!m_bootargs.empty()) fdt.prop_str("bootargs", m_bootargs);
+    if (!m_stdout.empty()) fdt.prop_str("stdout-path", m_stdout);
+    if (!m_initrd.empty()) {
+        fdt.prop_u32("linux,initrd-start", initrd_start);
+        fdt.prop_u32("linux,initrd-end", initrd_end);
+    }
+    fdt.end_node();
+
+    fdt.begin_node("cpus");
+    fdt.prop_u32("#address-cells", 1);
+    fdt.prop_u32("#size-cells", 0);
+    fdt.prop_u32("timebase-frequency", RV32_SBI_TIMEBASE);
+    fdt.begin_node("cpu@0");
+    fdt.prop_str("device_type", "cpu");
+    fdt.prop_u32("reg", 0);
+    fdt.prop_str("status", "okay");
+    fdt.prop_str("compatible", "riscv");
+    fdt.prop_str("riscv,isa", isa);
+    fdt.prop_str("mmu-type", "riscv,sv32");
+    fdt.begin_node("interrupt-controller");
+    fdt.prop_u32("#interrupt-cells", 1);
+    fdt.prop_empty("interrupt-controller");
+    fdt.prop_str("compatible", "riscv,cpu-intc");
+    fdt.prop_u32("phandle", PHANDLE_INTC);
+    fdt.end_node();
+    fdt.end_node();
+    fdt.end_node();
+
+    snprintf(name, sizeof(name), "memory@%x", ram_addr);
+    fdt.begin_node(name);
+    fdt.prop_str("device_type", "memory");
+    fdt.prop_cells("reg", {ram_addr, ram_size});
+    fdt.end_node();
+
+    fdt.begin_node("soc");
+    fdt.prop_u32("#address-cells", 1);
+    fdt.prop_u32("#size-cells", 1);
+    fdt.prop_str("compatible", "simple-bus");
+    fdt.prop_empty("ranges");
+    for (auto &it:m_devices) {
+        it(fdt);
+    }
+    fdt.end_node();
+
+    fdt.end_node();
+    m_dtb = fdt.finish();
+}
@@ -1,32 +1,147 @@
 #include "ZoraGA/RVVM.h"
 #include "ZoraGA/RV32I.h"
+#include "ZoraGA/RV32Zicsr.h"
+#include "ZoraGA/RV32Privileged.h"
+#include "ZoraGA/RV32Zkn.h"
+#include "ZoraGA/RV32Zb.h"
 #include "mem_ram.h"
 #include "mem_rom.h"
+#include "elf_loader.h"
+#include "kernel_loader.h"
+#include "uart_16550.h"
+#include "virtio_blk.h"
+#include "virtio_net.h"
+#include "shm_doorbell.h"
+#include "dma_engine.h"
+#include "crc_unit.h"
+#include "riscv_plic.h"
 #include <CLI/CLI.hpp>
 
+/* supervisor external interrupt of the CPU interrupt controller, the PLIC output */
+#define IRQ_S_EXT 9
+
 bool endswith(std::string str, std::string end);
 bool startswith(std::string str, std::string start);
+bool net_open(std::string spec, net_socket &sock, net_shm &shm, net_pipe *&pipe);
+bool parse_mac(std::string str, uint8_t mac[6]);
+void virtio_fdt(kernel_loader &kernel, uint32_t addr, uint32_t irq);
 
 using namespace ZoraGA::RVVM;
 
 int main(int argc, char **argv)
 {
-    RV32::rv32 vm;
     RV32::RV32I rv32i;
+    RV32::RV32Zicsr zicsr;
+    RV32::RV32Privileged privileged;
+    RV32::RV32Zkn zkn;
+    RV32::RV32Zb zb;
+    RV32::RV32Sbi sbi;
+    RV32::RV32Linux user;
+    RV32::RV32Semihost semihost;
+    RV32::RV32Htif htif;
     mem_rom rom;
     mem_ram ram;
+    mem_shm shm;
+    elf_loader elf;
+    kernel_loader kernel;
+    /* after the memories of its flat space, and before the devices interrupting it */
+    RV32::rv32 vm;
+    /* before the devices interrupting through it */
+    riscv_plic plic;
+    uart_16550 uart;
+    /* after the RAM and the pipes they use, so destroyed first */
+    virtio_blk blk;
+    net_socket net_sock;
+    net_shm net_ring;
+    net_pipe *net_link = nullptr;
+    virtio_net net;
+    shm_doorbell shm_bell;
+    dma_engine dma;
+    crc_unit crc;
     rvlog rvlog;
     CLI::App app{"RV32I Loader"};
     std::string rom_file = "test.bin";
+    std::string elf_file;
+    std::string kernel_file, initrd_file, bootargs;
+    std::string user_file;
+    std::vector<std::string> user_args;
     std::string rom_szstr, ram_szstr;
+    std::string save_file, restore_file;
+    std::string cov_raw, cov_lcov, cov_elf;
+    rv_coverage cov;
+    bool flat = false;
+    bool verbose = false;
+    bool priv = false;
+    bool use_sbi = false;
+    bool use_semihost = false;
+    bool use_zkn = false;
+    bool use_zb = false;
     uint32_t rom_addr = 0x80000000, rom_size = 128 * 1024;
     uint32_t ram_addr = 0x00000000, ram_size = 64 * 1024;
+    uint32_t tohost = 0, fromhost = 0;
+    std::string uart_host;
+    uint32_t uart_addr = 0x10000000;
+    std::string blk_file;
+    uint32_t blk_addr = 0x10001000;
+    bool blk_ro = false;
+    std::string net_spec, net_mac;
+    uint32_t net_addr = 0x10002000;
+    std::string shm_name, shm_szstr;
+    uint32_t shm_addr = 0x20000000, shm_size = 64 * 1024;
+    uint32_t shm_bell_addr = 0x10003000;
+    uint32_t shm_id = 0, shm_peers = 2;
+    bool use_dma = false;
+    uint32_t dma_addr = 0x10004000;
+    bool use_crc = false;
+    uint32_t crc_addr = 0x10005000;
+    bool use_plic = false;
+    uint32_t plic_addr = 0x0c000000;
 
     app.add_option("-f,--rom", rom_file, "ROM file");
+    app.add_option("-e,--elf", elf_file, "ELF file, replaces --rom, RAM is added only if --ram_addr or --ram_size is given");
+    app.add_option("-k,--kernel", kernel_file, "S-Mode kernel image booted directly from the start of RAM, replaces --rom, implies --sbi");
+    app.add_option("--initrd", initrd_file, "Initrd of --kernel");
+    app.add_option("--bootargs", bootargs, "Kernel command line of --kernel");
+    app.add_option("-u,--user", user_file, "Static Linux ELF run in user-mode emulation, replaces --rom and RAM, the exit code is returned");
+    app.add_option("--user_args", user_args, "Arguments of --user");
     app.add_option("--rom_addr", rom_addr, "ROM address");
     app.add_option("--rom_size", rom_szstr, "ROM size");
     app.add_option("--ram_addr", ram_addr, "RAM address");
     app.add_option("--ram_size", ram_szstr, "RAM size");
+    app.add_flag("--flat", flat, "Access RAM through a flat 4G host mapping");
+    app.add_flag("--priv", priv, "Add Zicsr and privileged instructions, with S-Mode and U-Mode");
+    app.add_flag("--zkn", use_zkn, "Add the scalar crypto instructions, Zkne, Zknd and Zknh");
+    app.add_flag("--zb", use_zb, "Add the bit manipulation instructions, Zba, Zbb, Zbc and Zbs");
+    app.add_flag("--sbi", use_sbi, "Serve SBI calls in the VM and start in S-Mode, implies --priv");
+    app.add_flag("--semihost", use_semihost, "Serve semihosting requests on the host console and files, the exit code is returned");
+    app.add_option("--tohost", tohost, "HTIF tohost address, default the tohost symbol of --elf; the VM stops on exit and its code is returned");
+    app.add_option("--fromhost", fromhost, "HTIF fromhost address, default the fromhost symbol of --elf");
+    app.add_option("--uart", uart_host, "Add a 16550 UART bound to the host: stdio, pty, or an output file");
+    app.add_option("--uart_addr", uart_addr, "UART address");
+    app.add_option("--blk", blk_file, "Add a virtio-mmio block device backed by a disk image, needs RAM");
+    app.add_option("--blk_addr", blk_addr, "virtio-mmio block device address");
+    app.add_flag("--blk_ro", blk_ro, "Open the disk image of --blk read-only");
+    app.add_option("--net", net_spec, "Add a virtio-mmio network device linked to another VM: unix:<local socket>,<peer socket> or shm:<name>,<side 0|1>, needs RAM");
+    app.add_option("--net_addr", net_addr, "virtio-mmio network device address");
+    app.add_option("--net_mac", net_mac, "MAC address of --net, default 52:54:00:12:34:56");
+    app.add_option("--shm", shm_name, "Add memory shared with the VMs of other loaders opening the same POSIX shm name, with a doorbell");
+    app.add_option("--shm_addr", shm_addr, "Shared memory address");
+    app.add_option("--shm_size", shm_szstr, "Shared memory size, the same for all VMs");
+    app.add_option("--shm_id", shm_id, "Doorbell ID of this VM, below --shm_peers");
+    app.add_option("--shm_peers", shm_peers, "VMs sharing --shm, the same for all VMs");
+    app.add_option("--shm_bell_addr", shm_bell_addr, "Doorbell address of --shm");
+    app.add_flag("--dma", use_dma, "Add a DMA engine copying and filling the RAM, ROM and --shm");
+    app.add_option("--dma_addr", dma_addr, "DMA engine address");
+    app.add_flag("--crc", use_crc, "Add a CRC-32/CRC-32C unit reading the RAM, ROM and --shm");
+    app.add_option("--crc_addr", crc_addr, "CRC unit address");
+    app.add_flag("--plic", use_plic, "Route the device interrupts through a PLIC, sources from 1 in the order UART, blk, net, shm doorbell, DMA, implied by --kernel");
+    app.add_option("--plic_addr", plic_addr, "PLIC address");
+    app.add_option("--save", save_file, "Save a snapshot when VM stop");
+    app.add_option("--restore", restore_file, "Restore a snapshot before VM start");
+    app.add_option("--cov_raw", cov_raw, "Dump ROM code coverage hit counts when VM stop");
+    app.add_option("--cov_lcov", cov_lcov, "Dump ROM code coverage as lcov when VM stop, needs --cov_elf");
+    app.add_option("--cov_elf", cov_elf, "ELF with DWARF line info of the ROM, default --elf");
+    app.add_flag("-v,--verbose", verbose, "Log every instruction and register to rvvm_loader.log, and to stdout unless the guest uses it");
 
     CLI11_PARSE(app, argc, argv);
 
@@ -44,7 +159,7 @@ int main(int argc, char **argv)
             }
         }
 
-        if (app.count("--ram-size")) {
+        if (app.count("--ram_size")) {
             if (endswith(ram_szstr, "K")) {
                 ram_size = std::stoul(ram_szstr.substr(0, ram_szstr.size()-1), nullptr, 0) * 1024;
             }
@@ -55,44 +170,294 @@ int main(int argc, char **argv)
                 ram_size = std::stoul(ram_szstr, nullptr, 0);
             }
         }
+
+        if (app.count("--shm_size")) {
+            if (endswith(shm_szstr, "K")) {
+                shm_size = std::stoul(shm_szstr.substr(0, shm_szstr.size()-1), nullptr, 0) * 1024;
+            }
+            else if (endswith(shm_szstr, "M")) {
+                shm_size = std::stoul(shm_szstr.substr(0, shm_szstr.size()-1), nullptr, 0) * 1024 * 1024;
+            }
+            else {
+                shm_size = std::stoul(shm_szstr, nullptr, 0);
+            }
+        }
     }
     catch(const std::exception& e)
     {
         std::cout << e.what() << '\n';
     }
 
-    if (!rom.load(rom_file)) {
+    bool use_user = !user_file.empty();
+    bool use_kernel = !use_user && !kernel_file.empty();
+    bool use_elf = !use_user && !use_kernel && !elf_file.empty();
+    bool use_ram = !use_user && (!use_elf || app.count("--ram_addr") || app.count("--ram_size"));
+    use_sbi = !use_user && (use_sbi || use_kernel);
+    use_plic = !use_user && (use_plic || use_kernel);
+    if (use_user) {
+        user_args.insert(user_args.begin(), user_file);
+        if (!user.load(user_file, user_args, {})) {
+            return -1;
+        }
+    }
+    else if (use_kernel) {
+        if (!kernel.load(kernel_file, initrd_file)) {
+            return -1;
+        }
+        kernel.set_bootargs(bootargs);
+    }
+    else if (use_elf) {
+        if (!elf.load(elf_file)) {
+            return -1;
+        }
+        if (cov_elf.empty()) cov_elf = elf_file;
+        if (!app.count("--tohost")) elf.elf()->symbol("tohost", tohost);
+        if (!app.count("--fromhost")) elf.elf()->symbol("fromhost", fromhost);
+        if (!elf.code_range(rom_addr, rom_size)) {
+            rom_size = 0;
+        }
+    }
+    else if (!rom.load(rom_file)) {
         return -1;
     }
 
-    if (!ram.set_size(ram_size)) {
+    if (use_ram && !ram.set_size(ram_size)) {
         return -2;
     }
 
-    printf("set logger\n");
-    rvlog.set_log_file("rvvm_loader.log");
-    rvlog.set_log_level(rvlog::LV_VERBOSE);
-    rvlog.set_log_stdout(true);
-    rvlog.set_log_inst(true);
-    rvlog.set_log_regs(true);
+    /* the guest's output and exit code are on stdout, the loader's go to stderr then */
+    FILE *msg = (use_user || use_semihost || tohost) ? stderr : stdout;
+    if (verbose) {
+        fprintf(msg, "set logger\n");
+        rvlog.set_log_file("rvvm_loader.log");
+        rvlog.set_log_level(rvlog::LV_VERBOSE);
+        rvlog.set_log_stdout(msg == stdout);
+        rvlog.set_log_inst(true);
+        rvlog.set_log_regs(true);
+    }
 
-    printf("set mem_rom\n");
-    vm.add_mem(rom_addr, rom_size, &rom);
-    printf("set mem_ram\n");
-    vm.add_mem(ram_addr, ram_size, &ram);
-    printf("add RV32I instruction collect\n");
+    if (use_ram) {
+        fprintf(msg, "set mem_ram\n");
+        vm.add_mem(ram_addr, ram_size, &ram);
+    }
+    if (use_elf) {
+        fprintf(msg, "map elf segments\n");
+        if (!elf.map(vm, use_ram ? &ram : nullptr, ram_addr, ram_size)) {
+            return -1;
+        }
+        vm.set_symbols(elf.elf());
+    }
+    else if (!use_kernel && !use_user) {
+        fprintf(msg, "set mem_rom\n");
+        vm.add_mem(rom_addr, rom_size, &rom);
+    }
+    if (flat) {
+        fprintf(msg, "set flat address space\n");
+        vm.set_flat(true);
+    }
+    fprintf(msg, "add RV32I instruction collect\n");
     vm.add_inst("I", &rv32i);
-    printf("set log\n");
-    vm.set_log(&rvlog);
-    printf("set start addr: %08x\n", rom_addr);
-    vm.set_start_addr(rom_addr);
-    printf("start VM\n");
+    if (priv || use_sbi) {
+        fprintf(msg, "add Zicsr and privileged instruction collect\n");
+        privileged.s_mode(true);
+        vm.add_inst("Zicsr", &zicsr);
+        vm.add_inst("Privileged", &privileged);
+    }
+    if (use_zkn) {
+        fprintf(msg, "add Zkn instruction collect\n");
+        vm.add_inst("Zkn", &zkn);
+    }
+    if (use_zb) {
+        fprintf(msg, "add Zb instruction collect\n");
+        vm.add_inst("Zb", &zb);
+    }
+    if (verbose) {
+        fprintf(msg, "set log\n");
+        vm.set_log(&rvlog);
+    }
+    uint32_t start_addr = use_elf ? elf.entry() : rom_addr;
+    fprintf(msg, "set start addr: %08x\n", start_addr);
+    vm.set_start_addr(start_addr);
+    if (use_sbi) {
+        fprintf(msg, "set SBI, start in S-Mode\n");
+        vm.set_sbi(&sbi);
+        vm.set_start_priv(1);
+    }
+    if (use_semihost) {
+        fprintf(msg, "set semihosting\n");
+        vm.set_semihost(&semihost);
+    }
+    if (use_plic) {
+        fprintf(msg, "set riscv_plic: %08x\n", plic_addr);
+        if (!vm.add_mem(plic_addr, PLIC_SIZE, &plic)) {
+            return -1;
+        }
+        plic.set_irq([&vm](bool level) { vm.set_ext_irq(0, level); });
+        if (use_kernel) {
+            kernel.add_device([plic_addr](fdt_builder &fdt) {
+                char name[40];
+                snprintf(name, sizeof(name), "interrupt-controller@%x", plic_addr);
+                fdt.begin_node(name);
+                fdt.prop_strs("compatible", {"sifive,plic-1.0.0", "riscv,plic0"});
+                fdt.prop_cells("reg", {plic_addr, PLIC_SIZE});
+                fdt.prop_u32("#address-cells", 0);
+                fdt.prop_u32("#interrupt-cells", 1);
+                fdt.prop_empty("interrupt-controller");
+                fdt.prop_u32("riscv,ndev", PLIC_SOURCES - 1);
+                fdt.prop_cells("interrupts-extended", {PHANDLE_INTC, IRQ_S_EXT});
+                fdt.prop_u32("phandle", PHANDLE_PLIC);
+                fdt.end_node();
+            });
+        }
+    }
+    /* interrupt line n of a device is PLIC source n + 1, or external interrupt line n of the VM */
+    auto irq_line = [&vm, &plic, use_plic](uint32_t line) -> std::function<void(bool)> {
+        if (use_plic) return plic.line(line + 1);
+        return [&vm, line](bool level) { vm.set_ext_irq(line, level); };
+    };
+    if (!uart_host.empty()) {
+        fprintf(msg, "set uart_16550: %08x\n", uart_addr);
+        if (!uart.open(uart_host) || !vm.add_mem(uart_addr, UART_16550_SIZE, &uart)) {
+            return -1;
+        }
+        if (!uart.pty_name().empty()) {
+            fprintf(msg, "UART on %s\n", uart.pty_name().c_str());
+        }
+        uart.set_irq(irq_line(0));
+        if (use_kernel) {
+            char name[32];
+            snprintf(name, sizeof(name), "serial@%x", uart_addr);
+            kernel.set_stdout(std::string("/soc/") + name);
+            kernel.add_device([uart_addr](fdt_builder &fdt) {
+                char name[32];
+                snprintf(name, sizeof(name), "serial@%x", uart_addr);
+                fdt.begin_node(name);
+                fdt.prop_str("compatible", "ns16550a");
+                fdt.prop_cells("reg", {uart_addr, UART_16550_SIZE});
+                fdt.prop_u32("clock-frequency", UART_16550_CLOCK);
+                fdt.prop_cells("interrupts-extended", {PHANDLE_PLIC, 1});
+                fdt.end_node();
+            });
+        }
+    }
+    if (!blk_file.empty()) {
+        fprintf(msg, "set virtio_blk: %08x\n", blk_addr);
+        if (!use_ram || !blk.open(blk_file, blk_ro) || !vm.add_mem(blk_addr, VIRTIO_MMIO_SIZE, &blk)) {
+            return -1;
+        }
+        fprintf(msg, "virtio_blk requests through %s\n", blk.uring() ? "io_uring" : "thread pool");
+        blk.set_ram(&ram, ram_addr);
+        blk.set_irq(irq_line(1));
+        if (use_kernel) {
+            virtio_fdt(kernel, blk_addr, 2);
+        }
+    }
+    if (!net_spec.empty()) {
+        fprintf(msg, "set virtio_net: %08x\n", net_addr);
+        uint8_t mac[6];
+        if (!net_mac.empty()) {
+            if (!parse_mac(net_mac, mac)) {
+                return -1;
+            }
+            net.set_mac(mac);
+        }
+        if (!use_ram || !net_open(net_spec, net_sock, net_ring, net_link) || !vm.add_mem(net_addr, VIRTIO_MMIO_SIZE, &net)) {
+            return -1;
+        }
+        net.set_ram(&ram, ram_addr);
+        net.set_irq(irq_line(2));
+        net.set_pipe(net_link);
+        if (use_kernel) {
+            virtio_fdt(kernel, net_addr, 3);
+        }
+    }
+    if (!shm_name.empty()) {
+        fprintf(msg, "set mem_shm: %08x, doorbell %u of %u: %08x\n", shm_addr, shm_id, shm_peers, shm_bell_addr);
+        if (!shm.open(shm_name, shm_size, shm_peers) || !shm_bell.attach(&shm, shm_id)
+            || !vm.add_mem(shm_addr, shm.size(), &shm) || !vm.add_mem(shm_bell_addr, SHM_DOORBELL_SIZE, &shm_bell)) {
+            return -1;
+        }
+        shm_bell.set_irq(irq_line(3));
+    }
+    if (use_dma) {
+        fprintf(msg, "set dma_engine: %08x\n", dma_addr);
+        if (!vm.add_mem(dma_addr, DMA_ENGINE_SIZE, &dma)) {
+            return -1;
+        }
+        if (use_ram) dma.add_region(ram_addr, ram_size, &ram);
+        if (!use_elf && !use_kernel && !use_user) dma.add_region(rom_addr, rom_size, &rom);
+        if (!shm_name.empty()) dma.add_region(shm_addr, shm.size(), &shm);
+        dma.set_irq(irq_line(4));
+    }
+    if (use_crc) {
+        fprintf(msg, "set crc_unit: %08x\n", crc_addr);
+        if (!vm.add_mem(crc_addr, CRC_UNIT_SIZE, &crc)) {
+            return -1;
+        }
+        if (use_ram) crc.add_region(ram_addr, ram_size, &ram);
+        if (!use_elf && !use_kernel && !use_user) crc.add_region(rom_addr, rom_size, &rom);
+        if (!shm_name.empty()) crc.add_region(shm_addr, shm.size(), &shm);
+    }
+    if (tohost) {
+        fprintf(msg, "set HTIF tohost: %08x, fromhost: %08x\n", tohost, fromhost);
+        htif.set_addr(tohost, fromhost);
+        vm.set_htif(&htif);
+    }
+    if (use_user) {
+        fprintf(msg, "set user space, ecall is a Linux syscall\n");
+        if (!vm.set_linux(&user)) {
+            return -1;
+        }
+    }
+    if (use_kernel) {
+        fprintf(msg, "boot kernel, device tree at the end of RAM\n");
+        if (!kernel.boot(vm, ram, ram_addr, ram_size, "rv32i_zicsr")) {
+            return -1;
+        }
+    }
+    if (!restore_file.empty()) {
+        fprintf(msg, "restore snapshot: %s\n", restore_file.c_str());
+        if (!vm.restore(restore_file)) {
+            return -3;
+        }
+    }
+    if (!cov_raw.empty() || !cov_lcov.empty()) {
+        fprintf(msg, "enable coverage\n");
+        cov.set_range(rom_addr, rom_size);
+        vm.set_coverage(&cov);
+    }
+    fprintf(msg, "start VM\n");
     vm.start();
     if (vm.wait_for_start(1000)) {
-        printf("VM start\n");
+        fprintf(msg, "VM start\n");
     }
     if (vm.wait_for_stop(0)) {
-        printf("VM stop\n");
+        fprintf(msg, "VM stop\n");
+    }
+    vm.stop();
+    if (!cov_raw.empty() && !cov.dump_raw(cov_raw)) {
+        fprintf(msg, "dump coverage %s failed\n", cov_raw.c_str());
+    }
+    if (!cov_lcov.empty() && !cov.dump_lcov(cov_lcov, cov_elf)) {
+        fprintf(msg, "dump coverage %s failed\n", cov_lcov.c_str());
+    }
+    if (!save_file.empty()) {
+        fprintf(msg, "save snapshot: %s\n", save_file.c_str());
+        if (!vm.save(save_file)) {
+            return -4;
+        }
+    }
+    if (use_user) {
+        fprintf(stderr, "exit code: %d\n", user.exit_code());
+        return user.exit_code();
+    }
+    if (tohost) {
+        fprintf(stderr, "exit code: %d\n", htif.exit_code());
+        return htif.exit_code();
+    }
+    if (use_semihost) {
+        fprintf(stderr, "exit code: %d\n", semihost.exit_code());
+        return semihost.exit_code();
     }
     return 0;
 }
@@ -110,3 +475,53 @@ bool startswith(std::string str, std::string start)
         return false;
     return str.substr(0, start.length()) == start;
 }
+
+/**
+ * @brief Open the pipe of --net
+ *
+ * @param spec unix:<local>,<peer> or shm:<name>,<side>
+ * @param pipe Output, sock or shm, as opened
+ */
+bool net_open(std::string spec, net_socket &sock, net_shm &shm, net_pipe *&pipe)
+{
+    size_t comma = spec.find(',');
+    if (comma == std::string::npos) return false;
+    std::string second = spec.substr(comma + 1);
+    if (startswith(spec, "unix:")) {
+        pipe = &sock;
+        return sock.open(spec.substr(5, comma - 5), second);
+    }
+    if (startswith(spec, "shm:") && (second == "0" || second == "1")) {
+        pipe = &shm;
+        return shm.open(spec.substr(4, comma - 4), second == "1");
+    }
+    return false;
+}
+
+bool parse_mac(std::string str, uint8_t mac[6])
+{
+    unsigned int b[6];
+    char end;
+    if (sscanf(str.c_str(), "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &end) != 6) return false;
+    for (int i=0; i<6; i++) {
+        if (b[i] > 0xff) return false;
+        mac[i] = b[i];
+    }
+    return true;
+}
+
+/**
+ * @brief Device tree node of a virtio-mmio device, on a PLIC source
+ */
+void virtio_fdt(kernel_loader &kernel, uint32_t addr, uint32_t irq)
+{
+    kernel.add_device([addr, irq](fdt_builder &fdt) {
+        char name[32];
+        snprintf(name, sizeof(name), "virtio_mmio@%x", addr);
+        fdt.begin_node(name);
+        fdt.prop_str("compatible", "virtio,mmio");
+        fdt.prop_cells("reg", {addr, VIRTIO_MMIO_SIZE});
+        fdt.prop_cells("interrupts-extended", {PHANDLE_PLIC, irq});
+        fdt.end_node();
+    });
+}
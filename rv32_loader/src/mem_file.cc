@@ -0,0 +1,109 @@
+#include "mem_file.h"
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace ZoraGA::RVVM;
+
+/* a range of a flat space given back, still reserved */
+static void flat_hole(void *addr, size_t len)
+{
+    mmap(addr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+}
+
+mem_file::mem_file()
+{}
+
+mem_file::~mem_file()
+{
+    unmap();
+}
+
+bool mem_file::map(int fd, uint64_t off, uint32_t filesz, uint32_t len)
+{
+    unmap();
+    if (filesz > len) return false;
+    m_fd     = fd;
+    m_off    = off;
+    m_len    = len;
+    m_filesz = filesz;
+    if (filesz == 0) return true;
+
+    /* mmap offset must be page aligned */
+    uint64_t delta = off & (sysconf(_SC_PAGESIZE) - 1);
+    void *p = mmap(nullptr, filesz + delta, PROT_READ, MAP_PRIVATE, fd, off - delta);
+    if (p == MAP_FAILED) return false;
+    m_map    = (uint8_t*)p;
+    m_maplen = filesz + delta;
+    m_mem    = m_map + delta;
+    return true;
+}
+
+void mem_file::unmap()
+{
+    for (auto &it:m_views) {
+        flat_hole(it.first, it.second);
+    }
+    m_views.clear();
+    if (m_map) munmap(m_map, m_maplen);
+    m_fd     = -1;
+    m_off    = 0;
+    m_map    = nullptr;
+    m_maplen = 0;
+    m_mem    = nullptr;
+    m_filesz = 0;
+    m_len    = 0;
+}
+
+rv_err mem_file::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > m_len)
+        return RV_ERANGE;
+    uint32_t n = 0;
+    if (addr < m_filesz) {
+        n = std::min(len, m_filesz - addr);
+        memcpy(p, m_mem + addr, n);
+    }
+    memset((uint8_t*)p + n, 0, len - n);
+    return RV_EOK;
+}
+
+rv_err mem_file::write(uint32_t addr, void *p, uint32_t len)
+{
+    return RV_EACCESS;
+}
+
+rv_err mem_file::map_at(void *addr, uint32_t len)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (m_fd < 0 || len != m_len || (m_off & (page - 1)) || (m_len & (page - 1))) return RV_EMISSING;
+
+    /* whole file pages are mapped from the file, the partial one is copied, the rest is zero */
+    uint8_t *dst  = (uint8_t*)addr;
+    size_t   full = m_filesz & ~(page - 1);
+    bool     ok   = true;
+    if (m_len > full) {
+        void *p = mmap(dst + full, m_len - full, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        ok = (p != MAP_FAILED);
+        if (ok && m_filesz > full) memcpy(dst + full, m_mem + full, m_filesz - full);
+        ok = ok && (mprotect(dst + full, m_len - full, PROT_READ) == 0);
+    }
+    if (ok && full) {
+        ok = (mmap(dst, full, PROT_READ, MAP_PRIVATE | MAP_FIXED, m_fd, m_off) != MAP_FAILED);
+    }
+    if (!ok) {
+        flat_hole(addr, len);
+        return RV_EFAULT;
+    }
+    m_views.push_back({addr, len});
+    return RV_EOK;
+}
+
+void mem_file::unmap_at(void *addr, uint32_t len)
+{
+    for (auto it = m_views.begin(); it != m_views.end(); it++) {
+        if (it->first != addr) continue;
+        flat_hole(addr, len);
+        m_views.erase(it);
+        break;
+    }
+}
@@ -1,4 +1,11 @@
 #include "mem_ram.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* guest RAM is mostly untouched, never reserve swap for all of it */
+#define RAM_MMAP_FLAGS (MAP_PRIVATE | MAP_NORESERVE)
 
 using namespace ZoraGA::RVVM;
 
@@ -6,17 +13,56 @@ mem_ram::mem_ram()
 {}
 
 mem_ram::~mem_ram()
-{}
+{
+    unmap();
+}
 
 bool mem_ram::set_size(size_t sz)
 {
-    m_mem.resize(sz);
+    unmap();
+    if (sz == 0) return true;
+
+    /* a sparse memfd, pages are allocated on first write */
+    int fd = memfd_create("rvvm_ram", MFD_CLOEXEC);
+    if (fd < 0) return false;
+    if (ftruncate(fd, sz) != 0 || !map(fd, 0, sz, true)) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+bool mem_ram::reset()
+{
+    if (m_mem == nullptr) return false;
+    if (m_shared) {
+        if (fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, m_size) != 0) return false;
+    } else {
+        /* the file is a baseline or a clone source, back to a new one at the same address */
+        int fd = memfd_create("rvvm_ram", MFD_CLOEXEC);
+        if (fd < 0) return false;
+        void *p = MAP_FAILED;
+        if (ftruncate(fd, m_size) == 0) {
+            p = mmap(m_mem, m_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        }
+        if (p == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        close(m_fd);
+        m_fd     = fd;
+        m_off    = 0;
+        m_shared = true;
+    }
+    m_diverged = false;
+    m_cow.clear();
+    m_dirty.mark(0, m_size);
     return true;
 }
 
 rv_err mem_ram::read(uint32_t addr, void *p, uint32_t len)
 {
-    if (addr + len > m_mem.size())
+    if ((size_t)addr + len > m_size)
         return RV_ERANGE;
     memcpy(p, &m_mem[addr], len);
     return RV_EOK;
@@ -24,8 +70,239 @@ rv_err mem_ram::read(uint32_t addr, void *p, uint32_t len)
 
 rv_err mem_ram::write(uint32_t addr, void *p, uint32_t len)
 {
-    if (addr + len > m_mem.size())
+    if ((size_t)addr + len > m_size)
         return RV_ERANGE;
     memcpy(&m_mem[addr], p, len);
+    m_dirty.mark(addr, len);
+    m_cow.mark(addr, len);
+    m_diverged = true;
+    return RV_EOK;
+}
+
+template<typename V>
+rv_err mem_ram::load(uint32_t addr, V &data)
+{
+    if ((size_t)addr + sizeof(V) > m_size)
+        return RV_ERANGE;
+    memcpy(&data, &m_mem[addr], sizeof(V));
+    return RV_EOK;
+}
+
+template<typename V>
+rv_err mem_ram::store(uint32_t addr, V data)
+{
+    if ((size_t)addr + sizeof(V) > m_size)
+        return RV_ERANGE;
+    memcpy(&m_mem[addr], &data, sizeof(V));
+    m_dirty.mark(addr, sizeof(V));
+    m_cow.mark(addr, sizeof(V));
+    m_diverged = true;
+    return RV_EOK;
+}
+
+rv_err mem_ram::read8(uint32_t addr, uint8_t &data)   { return load(addr, data); }
+rv_err mem_ram::read16(uint32_t addr, uint16_t &data) { return load(addr, data); }
+rv_err mem_ram::read32(uint32_t addr, uint32_t &data) { return load(addr, data); }
+rv_err mem_ram::write8(uint32_t addr, uint8_t data)   { return store(addr, data); }
+rv_err mem_ram::write16(uint32_t addr, uint16_t data) { return store(addr, data); }
+rv_err mem_ram::write32(uint32_t addr, uint32_t data) { return store(addr, data); }
+
+rv32_mem *mem_ram::clone()
+{
+    if (m_mem == nullptr || !freeze()) return nullptr;
+
+    int fd = dup(m_fd);
+    if (fd < 0) return nullptr;
+
+    mem_ram *ram = new mem_ram;
+    if (!ram->map(fd, m_off, m_size, false)) {
+        close(fd);
+        delete ram;
+        return nullptr;
+    }
+    return ram;
+}
+
+void *mem_ram::host(uint32_t &len)
+{
+    len = m_size;
+    return m_mem;
+}
+
+rv_err mem_ram::map_image(int fd, uint64_t off, uint32_t len)
+{
+    if (m_mem == nullptr || len != m_size) return RV_ERANGE;
+    int dfd = dup(fd);
+    if (dfd < 0) return RV_EFAULT;
+    void *p = mmap(m_mem, m_size, PROT_READ | PROT_WRITE, RAM_MMAP_FLAGS | MAP_FIXED, dfd, off);
+    if (p == MAP_FAILED) {
+        close(dfd);
+        return RV_EFAULT;
+    }
+    close(m_fd);
+    m_fd       = dfd;
+    m_off      = off;
+    m_shared   = false;
+    m_diverged = false;
+    m_dirty.clear();
+    m_cow.clear();
+    return RV_EOK;
+}
+
+rv_dirty *mem_ram::dirty()
+{
+    return &m_dirty;
+}
+
+rv_err mem_ram::set_baseline()
+{
+    if (m_mem == nullptr) return RV_EFAULT;
+    return freeze() ? RV_EOK : RV_EFAULT;
+}
+
+rv_err mem_ram::revert_pages(const std::vector<uint32_t> &pages)
+{
+    if (m_mem == nullptr || m_shared) return RV_EMISSING;
+    /* drop private copies in runs of contiguous pages, they fault back in from m_fd */
+    for (size_t i=0; i<pages.size(); ) {
+        size_t j = i + 1;
+        while (j < pages.size() && pages[j] == pages[j-1] + 1) j++;
+        size_t off = (size_t)pages[i] << RV_PAGE_SHIFT;
+        size_t len = (size_t)(j - i) << RV_PAGE_SHIFT;
+        if (off >= m_size) break;
+        if (off + len > m_size) len = m_size - off;
+        if (madvise(m_mem + off, len, MADV_DONTNEED) != 0) return RV_EFAULT;
+        i = j;
+    }
+    return RV_EOK;
+}
+
+rv_err mem_ram::map_at(void *addr, uint32_t len)
+{
+    if (m_mem == nullptr || len != m_size || (m_size & (RV_PAGE_SIZE - 1))) return RV_EMISSING;
+    if (addr == m_mem) return RV_EOK;
+    void *p = mremap(m_mem, m_size, m_size, MREMAP_MAYMOVE | MREMAP_FIXED, addr);
+    if (p == MAP_FAILED) return RV_EFAULT;
+    m_mem = (uint8_t*)p;
     return RV_EOK;
 }
+
+void mem_ram::unmap_at(void *addr, uint32_t len)
+{
+    if (addr != m_mem || len != m_size) return;
+    /* move out to a new place, and keep the range reserved */
+    void *p = mmap(nullptr, m_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return;
+    if (mremap(m_mem, m_size, m_size, MREMAP_MAYMOVE | MREMAP_FIXED, p) == MAP_FAILED) {
+        munmap(p, m_size);
+        return;
+    }
+    mmap(m_mem, m_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    m_mem = (uint8_t*)p;
+}
+
+void mem_ram::host_written(uint32_t off, uint32_t len)
+{
+    m_dirty.mark(off, len);
+    m_cow.mark(off, len);
+    m_diverged = true;
+}
+
+bool mem_ram::map(int fd, uint64_t off, size_t sz, bool shared)
+{
+    void *p = mmap(nullptr, sz, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : RAM_MMAP_FLAGS, fd, off);
+    if (p == MAP_FAILED) return false;
+    m_fd       = fd;
+    m_off      = off;
+    m_mem      = (uint8_t*)p;
+    m_size     = sz;
+    m_shared   = shared;
+    m_diverged = false;
+    m_dirty.resize(sz);
+    m_cow.resize(sz);
+    return true;
+}
+
+void mem_ram::unmap()
+{
+    if (m_mem) munmap(m_mem, m_size);
+    if (m_fd >= 0) close(m_fd);
+    m_fd       = -1;
+    m_off      = 0;
+    m_mem      = nullptr;
+    m_size     = 0;
+    m_shared   = false;
+    m_diverged = false;
+}
+
+/**
+ * @brief Make m_fd hold the current content and nobody write to it anymore
+ * 
+ * RAM writing m_fd through a shared mapping just maps it privately instead. RAM
+ * written since m_fd was mapped privately gets a new memfd, with the data extents
+ * of m_fd and the pages written since.
+ */
+bool mem_ram::freeze()
+{
+    if (!m_shared && !m_diverged) return true;
+
+    int fd = m_fd;
+    if (!m_shared) {
+        fd = memfd_create("rvvm_ram", MFD_CLOEXEC);
+        if (fd < 0) return false;
+        if (ftruncate(fd, m_size) != 0 || !copy_sparse(fd)) {
+            close(fd);
+            return false;
+        }
+    }
+
+    /* remap in place, so the address of the RAM doesn't change */
+    void *p = mmap(m_mem, m_size, PROT_READ | PROT_WRITE, RAM_MMAP_FLAGS | MAP_FIXED, fd, fd == m_fd ? m_off : 0);
+    if (p == MAP_FAILED) {
+        if (fd != m_fd) close(fd);
+        return false;
+    }
+    if (fd != m_fd) {
+        close(m_fd);
+        m_fd  = fd;
+        m_off = 0;
+    }
+    m_shared   = false;
+    m_diverged = false;
+    m_cow.clear();
+    return true;
+}
+
+/**
+ * @brief Copy the data extents of m_fd to fd, then the pages written since it was mapped
+ * 
+ * Holes of m_fd are left holes, extents are copied in the kernel.
+ */
+bool mem_ram::copy_sparse(int fd)
+{
+    off_t end = m_off + m_size;
+    for (off_t pos = m_off; pos < end; ) {
+        off_t data = lseek(m_fd, pos, SEEK_DATA);
+        if (data < 0 || data >= end) break;
+        off_t hole = lseek(m_fd, data, SEEK_HOLE);
+        if (hole < 0 || hole > end) hole = end;
+        loff_t in = data, out = data - m_off;
+        while (in < hole) {
+            ssize_t n = copy_file_range(m_fd, &in, fd, &out, hole - in, 0);
+            if (n <= 0) {
+                /* no kernel copy between these files, through the mapping then */
+                if (pwrite(fd, m_mem + out, hole - in, out) != (ssize_t)(hole - in)) return false;
+                break;
+            }
+        }
+        pos = hole;
+    }
+
+    for (size_t pg = 0; pg < m_cow.pages(); pg++) {
+        if (!m_cow.test(pg)) continue;
+        size_t off = pg << RV_PAGE_SHIFT;
+        size_t len = std::min<size_t>(RV_PAGE_SIZE, m_size - off);
+        if (pwrite(fd, m_mem + off, len, off) != (ssize_t)len) return false;
+    }
+    return true;
+}
@@ -0,0 +1,201 @@
+#include "mem_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC 0x4d485352
+
+/* time for the creator to set up the control page */
+#define SHM_OPEN_WAIT_MS 1000
+
+static_assert(sizeof(shm_ctl) <= SHM_CTL_SIZE, "control page overflow");
+
+using namespace ZoraGA::RVVM;
+
+/**
+ * @brief Replace a view by inaccessible pages, the range stays reserved in its flat space
+ */
+static void view_reserve(void *addr, uint32_t len)
+{
+    mmap(addr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+}
+
+mem_shm::mem_shm()
+{}
+
+mem_shm::~mem_shm()
+{
+    close();
+}
+
+bool mem_shm::create(uint32_t size, uint32_t peers)
+{
+    close();
+    size = (size + RV_PAGE_SIZE - 1) & ~(RV_PAGE_SIZE - 1);
+    if (size == 0 || peers == 0 || peers > SHM_PEERS_MAX) return false;
+    int fd = memfd_create("mem_shm", MFD_CLOEXEC);
+    if (fd < 0) return false;
+    if (ftruncate(fd, (off_t)SHM_CTL_SIZE + size) != 0 || !map(fd, size)) {
+        ::close(fd);
+        return false;
+    }
+    shm_ctl *ctl = (shm_ctl*)m_map;
+    ctl->peers = peers;
+    ctl->size  = size;
+    ctl->magic = SHM_MAGIC;
+    return true;
+}
+
+bool mem_shm::open(std::string name, uint32_t size, uint32_t peers)
+{
+    close();
+    size = (size + RV_PAGE_SIZE - 1) & ~(RV_PAGE_SIZE - 1);
+    if (size == 0 || peers == 0 || peers > SHM_PEERS_MAX) return false;
+
+    /* the creator sets the size and the control page, the others wait for its magic */
+    bool creator = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        creator = false;
+        fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0600);
+    }
+    if (fd < 0) return false;
+
+    if (creator) {
+        if (ftruncate(fd, (off_t)SHM_CTL_SIZE + size) != 0 || !map(fd, size)) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        shm_ctl *ctl = (shm_ctl*)m_map;
+        ctl->peers = peers;
+        ctl->size  = size;
+        __atomic_store_n(&ctl->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    struct stat st = {};
+    for (int i=0; i<SHM_OPEN_WAIT_MS; i++) {
+        if (fstat(fd, &st) == 0 && st.st_size == (off_t)SHM_CTL_SIZE + size) break;
+        usleep(1000);
+    }
+    if (st.st_size != (off_t)SHM_CTL_SIZE + size || !map(fd, size)) {
+        ::close(fd);
+        return false;
+    }
+    shm_ctl *ctl = (shm_ctl*)m_map;
+    for (int i=0; i<SHM_OPEN_WAIT_MS && __atomic_load_n(&ctl->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC; i++) {
+        usleep(1000);
+    }
+    if (__atomic_load_n(&ctl->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || ctl->peers != peers || ctl->size != size) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+uint32_t mem_shm::size()
+{
+    return m_size;
+}
+
+shm_ctl *mem_shm::ctl()
+{
+    return (shm_ctl*)m_map;
+}
+
+rv_err mem_shm::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > m_size)
+        return RV_ERANGE;
+    memcpy(p, &m_mem[addr], len);
+    return RV_EOK;
+}
+
+rv_err mem_shm::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > m_size)
+        return RV_ERANGE;
+    memcpy(&m_mem[addr], p, len);
+    return RV_EOK;
+}
+
+/* a naturally aligned access is a single host access, never torn for the other VMs */
+template<typename V>
+rv_err mem_shm::load(uint32_t addr, V &data)
+{
+    if ((size_t)addr + sizeof(V) > m_size)
+        return RV_ERANGE;
+    if (addr & (sizeof(V) - 1)) {
+        memcpy(&data, &m_mem[addr], sizeof(V));
+    } else {
+        data = __atomic_load_n((V*)&m_mem[addr], __ATOMIC_RELAXED);
+    }
+    return RV_EOK;
+}
+
+template<typename V>
+rv_err mem_shm::store(uint32_t addr, V data)
+{
+    if ((size_t)addr + sizeof(V) > m_size)
+        return RV_ERANGE;
+    if (addr & (sizeof(V) - 1)) {
+        memcpy(&m_mem[addr], &data, sizeof(V));
+    } else {
+        __atomic_store_n((V*)&m_mem[addr], data, __ATOMIC_RELAXED);
+    }
+    return RV_EOK;
+}
+
+rv_err mem_shm::read8(uint32_t addr, uint8_t &data)   { return load(addr, data); }
+rv_err mem_shm::read16(uint32_t addr, uint16_t &data) { return load(addr, data); }
+rv_err mem_shm::read32(uint32_t addr, uint32_t &data) { return load(addr, data); }
+rv_err mem_shm::write8(uint32_t addr, uint8_t data)   { return store(addr, data); }
+rv_err mem_shm::write16(uint32_t addr, uint16_t data) { return store(addr, data); }
+rv_err mem_shm::write32(uint32_t addr, uint32_t data) { return store(addr, data); }
+
+rv_err mem_shm::map_at(void *addr, uint32_t len)
+{
+    if (m_fd < 0 || len != m_size) return RV_EMISSING;
+    void *p = mmap(addr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_fd, SHM_CTL_SIZE);
+    if (p == MAP_FAILED) return RV_EFAULT;
+    m_views.push_back({p, len});
+    return RV_EOK;
+}
+
+void mem_shm::unmap_at(void *addr, uint32_t len)
+{
+    for (auto it = m_views.begin(); it != m_views.end(); it++) {
+        if (it->first != addr) continue;
+        view_reserve(addr, len);
+        m_views.erase(it);
+        break;
+    }
+}
+
+bool mem_shm::map(int fd, uint32_t size)
+{
+    void *p = mmap(nullptr, (size_t)SHM_CTL_SIZE + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return false;
+    m_fd   = fd;
+    m_map  = (uint8_t*)p;
+    m_mem  = m_map + SHM_CTL_SIZE;
+    m_size = size;
+    return true;
+}
+
+void mem_shm::close()
+{
+    /* a flat space may still hold a view, it must not see other mappings there */
+    for (auto &it:m_views) {
+        view_reserve(it.first, it.second);
+    }
+    m_views.clear();
+    if (m_map) munmap(m_map, (size_t)SHM_CTL_SIZE + m_size);
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd   = -1;
+    m_map  = m_mem = nullptr;
+    m_size = 0;
+}
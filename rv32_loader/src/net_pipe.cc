@@ -0,0 +1,344 @@
+#include "net_pipe.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* socket buffers for a burst of full frames, capped by the host limits */
+#define SOCKET_BUF (4 * 1024 * 1024)
+
+#define SHM_SLOTS     512
+
+/**
+ * @brief One direction, a single producer and a single consumer
+ *
+ * Indexes are free running, each on its own cache line.
+ */
+struct net_shm::shm_ring
+{
+    alignas(64) uint32_t head;
+    alignas(64) uint32_t tail;
+    /* futex words, bumped to wake the consumer for packets and the producer for room */
+    alignas(64) uint32_t seq;
+    uint32_t waiting;
+    alignas(64) uint32_t room_seq;
+    uint32_t room_waiting;
+    struct {
+        uint32_t len;
+        uint8_t  data[NET_FRAME_MAX];
+    } slots[SHM_SLOTS];
+};
+
+static void futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+static void futex_wait(uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, nullptr, nullptr, 0);
+}
+
+/**
+ * @brief Wake the other side if it waits, after the ring has been moved
+ */
+static void futex_signal(uint32_t *seq, uint32_t *waiting)
+{
+    /* pairs with the fence of the waiter, either it sees the ring moved or we see it waiting */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(seq);
+    }
+}
+
+/**
+ * @brief Sleep on a futex word unless the ring has moved
+ *
+ * @param seq Futex word, loaded before the stop flag is checked
+ * @param ready Checked after announcing the wait
+ */
+static void futex_sleep(uint32_t *seq, uint32_t *waiting, std::atomic<bool> &stopped, std::function<bool()> ready)
+{
+    uint32_t val = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    if (stopped.load()) return;
+    __atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    /* returns at once if the word moved since loaded */
+    if (!ready()) futex_wait(seq, val);
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+}
+
+net_socket::net_socket()
+{}
+
+net_socket::~net_socket()
+{
+    close();
+}
+
+bool net_socket::open(std::string local, std::string peer)
+{
+    struct sockaddr_un addr;
+    close();
+    if (local.size() >= sizeof(addr.sun_path) || peer.size() >= sizeof(addr.sun_path)) return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, local.c_str());
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    unlink(local.c_str());
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || !adopt(fd)) {
+        ::close(fd);
+        return false;
+    }
+    m_local = local;
+
+    memset(&m_peer, 0, sizeof(m_peer));
+    m_peer.sun_family = AF_UNIX;
+    strcpy(m_peer.sun_path, peer.c_str());
+    m_peer_len = sizeof(m_peer);
+    peer_connect();
+    return true;
+}
+
+bool net_socket::pair(net_socket &a, net_socket &b)
+{
+    int fds[2];
+    a.close();
+    b.close();
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds) != 0) return false;
+    if (!a.adopt(fds[0]) || !b.adopt(fds[1])) {
+        a.close();
+        b.close();
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+    a.m_connected = b.m_connected = true;
+    return true;
+}
+
+int net_socket::send(struct mmsghdr *pkts, int cnt)
+{
+    peer_connect();
+    bool named = !m_connected.load();
+    for (int i=0; i<cnt; i++) {
+        pkts[i].msg_hdr.msg_name    = named ? &m_peer : nullptr;
+        pkts[i].msg_hdr.msg_namelen = named ? m_peer_len : 0;
+    }
+    int sent = 0;
+    while (sent < cnt) {
+        int ret = sendmmsg(m_fd, pkts + sent, cnt - sent, MSG_DONTWAIT);
+        if (ret < 0 && errno == EINTR) continue;
+        /* no room, sent again after wait_send */
+        if (ret < 0 && errno == EAGAIN) break;
+        if (ret < 0 && m_peer_len && (errno == ECONNREFUSED || errno == ENOTCONN)) {
+            /* the peer is gone, connect to the next one bound */
+            m_connected = false;
+        }
+        /* no peer or a bad packet, drop it and go on */
+        sent += (ret < 0) ? 1 : ret;
+    }
+    return sent;
+}
+
+int net_socket::recv(struct mmsghdr *pkts, int cnt)
+{
+    peer_connect();
+    for (int i=0; i<cnt; i++) {
+        pkts[i].msg_hdr.msg_name    = nullptr;
+        pkts[i].msg_hdr.msg_namelen = 0;
+    }
+    int ret = recvmmsg(m_fd, pkts, cnt, MSG_DONTWAIT, nullptr);
+    return ret < 0 ? 0 : ret;
+}
+
+void net_socket::wait_recv()
+{
+    /* the eventfd is never read, it stays readable once stopped */
+    struct pollfd fds[2] = {
+        {m_fd, POLLIN, 0},
+        {m_wake, POLLIN, 0},
+    };
+    poll(fds, 2, -1);
+}
+
+void net_socket::wait_send()
+{
+    /* a peer not connected back is writable while its queue has room */
+    struct pollfd fds[2] = {
+        {m_fd, POLLOUT, 0},
+        {m_wake, POLLIN, 0},
+    };
+    poll(fds, 2, -1);
+}
+
+void net_socket::stop()
+{
+    uint64_t val = 1;
+    ::write(m_wake, &val, sizeof(val));
+}
+
+bool net_socket::adopt(int fd)
+{
+    int size = SOCKET_BUF;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wake < 0) return false;
+    m_fd = fd;
+    return true;
+}
+
+/**
+ * @brief Connect to the peer path once it is bound, datagrams then skip its queue limit
+ */
+void net_socket::peer_connect()
+{
+    if (m_peer_len == 0 || m_connected.load()) return;
+    if (connect(m_fd, (struct sockaddr*)&m_peer, m_peer_len) == 0) m_connected = true;
+}
+
+void net_socket::close()
+{
+    if (m_fd >= 0) ::close(m_fd);
+    if (m_wake >= 0) ::close(m_wake);
+    if (!m_local.empty()) unlink(m_local.c_str());
+    m_fd = m_wake = -1;
+    m_peer_len  = 0;
+    m_connected = false;
+    m_local.clear();
+}
+
+net_shm::net_shm()
+{}
+
+net_shm::~net_shm()
+{
+    close();
+}
+
+bool net_shm::open(std::string name, int side)
+{
+    close();
+    if (side != 0 && side != 1) return false;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    /* zero filled when created, the size is already right for the second side */
+    bool ok = ftruncate(fd, 2 * sizeof(shm_ring)) == 0 && map(fd, side);
+    ::close(fd);
+    return ok;
+}
+
+bool net_shm::pair(net_shm &a, net_shm &b)
+{
+    a.close();
+    b.close();
+    int fd = memfd_create("net_shm", MFD_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ftruncate(fd, 2 * sizeof(shm_ring)) == 0 && a.map(fd, 0) && b.map(fd, 1);
+    ::close(fd);
+    if (!ok) {
+        a.close();
+        b.close();
+    }
+    return ok;
+}
+
+int net_shm::send(struct mmsghdr *pkts, int cnt)
+{
+    uint32_t tail = __atomic_load_n(&m_tx->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&m_tx->head, __ATOMIC_ACQUIRE);
+    int n = 0;
+    for (; n<cnt && tail - head < SHM_SLOTS; n++, tail++) {
+        auto &slot = m_tx->slots[tail % SHM_SLOTS];
+        struct msghdr &msg = pkts[n].msg_hdr;
+        uint32_t len = 0;
+        for (size_t i=0; i<msg.msg_iovlen && len < NET_FRAME_MAX; i++) {
+            size_t m = std::min(msg.msg_iov[i].iov_len, (size_t)(NET_FRAME_MAX - len));
+            memcpy(slot.data + len, msg.msg_iov[i].iov_base, m);
+            len += m;
+        }
+        slot.len = len;
+    }
+    if (n == 0) return 0;
+    __atomic_store_n(&m_tx->tail, tail, __ATOMIC_RELEASE);
+    futex_signal(&m_tx->seq, &m_tx->waiting);
+    return n;
+}
+
+int net_shm::recv(struct mmsghdr *pkts, int cnt)
+{
+    uint32_t head = __atomic_load_n(&m_rx->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&m_rx->tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    for (; n<cnt && head != tail; n++, head++) {
+        auto &slot = m_rx->slots[head % SHM_SLOTS];
+        struct msghdr &msg = pkts[n].msg_hdr;
+        uint32_t len = 0;
+        for (size_t i=0; i<msg.msg_iovlen && len < slot.len; i++) {
+            size_t m = std::min(msg.msg_iov[i].iov_len, (size_t)(slot.len - len));
+            memcpy(msg.msg_iov[i].iov_base, slot.data + len, m);
+            len += m;
+        }
+        pkts[n].msg_len = len;
+    }
+    if (n == 0) return 0;
+    __atomic_store_n(&m_rx->head, head, __ATOMIC_RELEASE);
+    futex_signal(&m_rx->room_seq, &m_rx->room_waiting);
+    return n;
+}
+
+void net_shm::wait_recv()
+{
+    shm_ring *ring = m_rx;
+    futex_sleep(&ring->seq, &ring->waiting, m_stopped, [ring]{
+        return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    });
+}
+
+void net_shm::wait_send()
+{
+    shm_ring *ring = m_tx;
+    futex_sleep(&ring->room_seq, &ring->room_waiting, m_stopped, [ring]{
+        return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) < SHM_SLOTS;
+    });
+}
+
+void net_shm::stop()
+{
+    m_stopped.store(true);
+    __atomic_fetch_add(&m_rx->seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&m_rx->seq);
+    __atomic_fetch_add(&m_tx->room_seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&m_tx->room_seq);
+}
+
+bool net_shm::map(int fd, int side)
+{
+    void *map = mmap(nullptr, 2 * sizeof(shm_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return false;
+    shm_ring *rings = (shm_ring*)map;
+    m_map = map;
+    m_tx  = &rings[side];
+    m_rx  = &rings[side ^ 1];
+    m_stopped.store(false);
+    return true;
+}
+
+void net_shm::close()
+{
+    if (m_map) munmap(m_map, 2 * sizeof(shm_ring));
+    m_map = nullptr;
+    m_tx  = m_rx = nullptr;
+}
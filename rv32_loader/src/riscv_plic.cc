@@ -0,0 +1,162 @@
+#include "riscv_plic.h"
+
+/* registers */
+#define REG_PRIORITY  0x000000
+#define REG_PENDING   0x001000
+#define REG_ENABLE    0x002000
+#define REG_THRESHOLD 0x200000
+#define REG_CLAIM     0x200004
+
+#define PRIORITY_MASK 0x7
+/* source 0 doesn't exist */
+#define SOURCE_MASK   0xfffffffeU
+
+using namespace ZoraGA::RVVM;
+
+riscv_plic::riscv_plic()
+{}
+
+riscv_plic::~riscv_plic()
+{}
+
+void riscv_plic::set_irq(std::function<void(bool level)> irq)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_irq = irq;
+    if (m_irq && m_irq_level) m_irq(true);
+}
+
+void riscv_plic::set_line(uint32_t source, bool level)
+{
+    if (source == 0 || source >= PLIC_SOURCES) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t bit = 1U << source;
+    if (level) {
+        m_level |= bit;
+        if (!(m_claimed & bit)) m_pending |= bit;
+    } else {
+        m_level   &= ~bit;
+        m_pending &= ~bit;
+    }
+    irq_update();
+}
+
+std::function<void(bool level)> riscv_plic::line(uint32_t source)
+{
+    return [this, source](bool level) { set_line(source, level); };
+}
+
+rv_err riscv_plic::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > PLIC_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t val = 0;
+    if (addr < REG_PRIORITY + PLIC_SOURCES * 4) {
+        val = m_priority[addr / 4];
+    } else if (addr == REG_PENDING) {
+        val = m_pending;
+    } else if (addr == REG_ENABLE) {
+        val = m_enable;
+    } else if (addr == REG_THRESHOLD) {
+        val = m_threshold;
+    } else if (addr == REG_CLAIM) {
+        val = claim();
+    }
+    memcpy(p, &val, 4);
+    return RV_EOK;
+}
+
+rv_err riscv_plic::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > PLIC_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t val;
+    memcpy(&val, p, 4);
+    if (addr < REG_PRIORITY + PLIC_SOURCES * 4) {
+        if (addr) m_priority[addr / 4] = val & PRIORITY_MASK;
+    } else if (addr == REG_ENABLE) {
+        m_enable = val & SOURCE_MASK;
+    } else if (addr == REG_THRESHOLD) {
+        m_threshold = val & PRIORITY_MASK;
+    } else if (addr == REG_CLAIM) {
+        /* completion, the source is pending again if its line is still high */
+        if (val == 0 || val >= PLIC_SOURCES) return RV_EOK;
+        m_claimed &= ~(1U << val);
+        if (m_level & (1U << val)) m_pending |= 1U << val;
+    }
+    irq_update();
+    return RV_EOK;
+}
+
+rv_err riscv_plic::save_state(std::vector<uint8_t> &state)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t regs[PLIC_SOURCES + 3];
+    memcpy(regs, m_priority, sizeof(m_priority));
+    regs[PLIC_SOURCES]     = m_enable;
+    regs[PLIC_SOURCES + 1] = m_threshold;
+    regs[PLIC_SOURCES + 2] = m_claimed;
+    state.assign((uint8_t*)regs, (uint8_t*)regs + sizeof(regs));
+    return RV_EOK;
+}
+
+/**
+ * @brief Load the registers, the sources pending are the ones with a high line, not claimed
+ */
+rv_err riscv_plic::load_state(const std::vector<uint8_t> &state)
+{
+    uint32_t regs[PLIC_SOURCES + 3];
+    if (state.size() != sizeof(regs)) return RV_ERANGE;
+    memcpy(regs, state.data(), sizeof(regs));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i=0; i<PLIC_SOURCES; i++) {
+        m_priority[i] = regs[i] & PRIORITY_MASK;
+    }
+    m_priority[0] = 0;
+    m_enable    = regs[PLIC_SOURCES] & SOURCE_MASK;
+    m_threshold = regs[PLIC_SOURCES + 1] & PRIORITY_MASK;
+    m_claimed   = regs[PLIC_SOURCES + 2] & SOURCE_MASK;
+    m_pending   = m_level & ~m_claimed;
+    irq_update();
+    return RV_EOK;
+}
+
+/**
+ * @brief Claim the source to serve, m_mutex held
+ *
+ * @return uint32_t 0 if there is none
+ */
+uint32_t riscv_plic::claim()
+{
+    uint32_t best = 0, prio = m_threshold;
+    uint32_t ready = m_pending & m_enable;
+    for (uint32_t i=1; i<PLIC_SOURCES; i++) {
+        if ((ready & (1U << i)) && m_priority[i] > prio) {
+            best = i;
+            prio = m_priority[i];
+        }
+    }
+    if (best) {
+        m_pending &= ~(1U << best);
+        m_claimed |= 1U << best;
+        irq_update();
+    }
+    return best;
+}
+
+/**
+ * @brief Level of the output from the sources ready, m_mutex held
+ */
+void riscv_plic::irq_update()
+{
+    bool level = false;
+    uint32_t ready = m_pending & m_enable;
+    for (uint32_t i=1; i<PLIC_SOURCES && !level; i++) {
+        level = (ready & (1U << i)) && m_priority[i] > m_threshold;
+    }
+    if (level == m_irq_level) return;
+    m_irq_level = level;
+    if (m_irq) m_irq(level);
+}
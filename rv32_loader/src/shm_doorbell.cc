@@ -0,0 +1,136 @@
+#include "shm_doorbell.h"
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* registers */
+#define REG_ID       0x00
+#define REG_PEERS    0x04
+#define REG_DOORBELL 0x08
+#define REG_STATUS   0x0c
+#define REG_MASK     0x10
+
+using namespace ZoraGA::RVVM;
+
+static void futex_wake_all(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void futex_wait(uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, nullptr, nullptr, 0);
+}
+
+shm_doorbell::shm_doorbell()
+{}
+
+shm_doorbell::~shm_doorbell()
+{
+    close();
+}
+
+bool shm_doorbell::attach(mem_shm *shm, uint32_t id)
+{
+    close();
+    if (shm == nullptr || shm->ctl() == nullptr || id >= shm->ctl()->peers) return false;
+    m_ctl = shm->ctl();
+    m_id  = id;
+    m_quit.store(false);
+    m_thread = std::thread(&shm_doorbell::wait_run, this);
+    return true;
+}
+
+void shm_doorbell::set_irq(std::function<void(bool level)> irq)
+{
+    std::lock_guard<std::mutex> lock(m_irq_mutex);
+    m_irq = irq;
+    if (m_irq && m_irq_level) m_irq(true);
+}
+
+rv_err shm_doorbell::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > SHM_DOORBELL_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val = 0;
+    switch(addr) {
+        case REG_ID:     val = m_id; break;
+        case REG_PEERS:  val = m_ctl ? m_ctl->peers : 0; break;
+        case REG_STATUS: val = m_ctl ? __atomic_load_n(&m_ctl->peer[m_id].pending, __ATOMIC_ACQUIRE) : 0; break;
+        case REG_MASK:   val = m_mask.load(); break;
+        default:         break;
+    }
+    memcpy(p, &val, 4);
+    return RV_EOK;
+}
+
+rv_err shm_doorbell::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > SHM_DOORBELL_SIZE) return RV_ERANGE;
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val;
+    memcpy(&val, p, 4);
+    if (m_ctl == nullptr) return RV_EOK;
+    switch(addr) {
+        case REG_DOORBELL:
+            ring(val);
+            break;
+        case REG_STATUS:
+            __atomic_fetch_and(&m_ctl->peer[m_id].pending, ~val, __ATOMIC_ACQ_REL);
+            irq_update();
+            break;
+        case REG_MASK:
+            m_mask.store(val);
+            irq_update();
+            break;
+        default:
+            break;
+    }
+    return RV_EOK;
+}
+
+/**
+ * @brief Set our bit at the peer, and wake its waiting thread, a peer out of range is ignored
+ */
+void shm_doorbell::ring(uint32_t peer)
+{
+    if (peer >= m_ctl->peers) return;
+    __atomic_fetch_or(&m_ctl->peer[peer].pending, 1u << m_id, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&m_ctl->peer[peer].seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake_all(&m_ctl->peer[peer].seq);
+}
+
+void shm_doorbell::irq_update()
+{
+    std::lock_guard<std::mutex> lock(m_irq_mutex);
+    bool level = (__atomic_load_n(&m_ctl->peer[m_id].pending, __ATOMIC_ACQUIRE) & m_mask.load()) != 0;
+    if (level == m_irq_level) return;
+    m_irq_level = level;
+    if (m_irq) m_irq(level);
+}
+
+/**
+ * @brief Waiting thread, the seq is loaded before the pending bits, so no ring is missed
+ */
+void shm_doorbell::wait_run()
+{
+    uint32_t *seq = &m_ctl->peer[m_id].seq;
+    for (;;) {
+        uint32_t val = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (m_quit.load()) break;
+        irq_update();
+        futex_wait(seq, val);
+    }
+}
+
+void shm_doorbell::close()
+{
+    if (m_thread.joinable()) {
+        m_quit.store(true);
+        __atomic_fetch_add(&m_ctl->peer[m_id].seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake_all(&m_ctl->peer[m_id].seq);
+        m_thread.join();
+    }
+    m_ctl = nullptr;
+}
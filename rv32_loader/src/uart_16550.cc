@@ -0,0 +1,350 @@
+#include "uart_16550.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/* registers, DLL/DLM replace RBR/THR and IER when LCR.DLAB is set */
+#define REG_RBR 0
+#define REG_IER 1
+#define REG_IIR 2
+#define REG_LCR 3
+#define REG_MCR 4
+#define REG_LSR 5
+#define REG_MSR 6
+#define REG_SCR 7
+
+#define IER_ERBFI 0x01
+#define IER_ETBEI 0x02
+#define IER_MASK  0x0f
+
+#define IIR_NONE  0x01
+#define IIR_THRE  0x02
+#define IIR_RDA   0x04
+#define IIR_FIFO  0xc0
+
+#define FCR_ENABLE   0x01
+#define FCR_RX_RESET 0x02
+
+#define LCR_DLAB 0x80
+
+#define LSR_DR   0x01
+#define LSR_THRE 0x20
+#define LSR_TEMT 0x40
+
+/* CTS, DSR, DCD */
+#define MSR_IDLE 0xb0
+
+/* a FIFO load of the guest driver, THRE is signaled while there is room for it */
+#define TX_LOAD 16
+
+using namespace ZoraGA::RVVM;
+
+static struct termios s_stdin_tios;
+
+static void stdin_restore()
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &s_stdin_tios);
+}
+
+uart_16550::uart_16550()
+{}
+
+uart_16550::~uart_16550()
+{
+    close();
+}
+
+bool uart_16550::open(std::string host)
+{
+    close();
+    if (host == "stdio") {
+        m_in  = STDIN_FILENO;
+        m_out = STDOUT_FILENO;
+        /* bytes as typed, signals still kill the loader */
+        if (isatty(m_in) && tcgetattr(m_in, &s_stdin_tios) == 0) {
+            struct termios tios = s_stdin_tios;
+            tios.c_lflag &= ~(ICANON | ECHO);
+            tcsetattr(m_in, TCSANOW, &tios);
+            if (!m_raw) atexit(stdin_restore);
+            m_raw = true;
+        }
+    }
+    else if (host == "pty") {
+        int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct termios tios;
+        if (grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname(fd) == nullptr || tcgetattr(fd, &tios) != 0) {
+            ::close(fd);
+            return false;
+        }
+        cfmakeraw(&tios);
+        tcsetattr(fd, TCSANOW, &tios);
+        m_pty = ptsname(fd);
+        m_in  = m_out = fd;
+        m_own_in = true;
+    }
+    else {
+        m_out = ::open(host.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_out < 0) return false;
+        m_own_out = true;
+    }
+
+    m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wake < 0) {
+        close();
+        return false;
+    }
+    m_quit.store(false);
+    m_thread = std::thread(&uart_16550::io_run, this);
+    return true;
+}
+
+std::string uart_16550::pty_name()
+{
+    return m_pty;
+}
+
+void uart_16550::set_irq(std::function<void(bool level)> irq)
+{
+    std::lock_guard<std::mutex> lock(m_irq_mutex);
+    m_irq = irq;
+    if (m_irq && m_irq_level) m_irq(true);
+}
+
+rv_err uart_16550::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > UART_16550_SIZE) return RV_ERANGE;
+    /* wider accesses read the register zero extended */
+    memset(p, 0, len);
+    *(uint8_t*)p = reg_read(addr);
+    return RV_EOK;
+}
+
+rv_err uart_16550::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > UART_16550_SIZE) return RV_ERANGE;
+    reg_write(addr, *(uint8_t*)p);
+    return RV_EOK;
+}
+
+rv_err uart_16550::save_state(std::vector<uint8_t> &state)
+{
+    state = {m_ier.load(), m_lcr, m_mcr, m_scr, m_fcr, m_dll, m_dlm};
+    return RV_EOK;
+}
+
+rv_err uart_16550::load_state(const std::vector<uint8_t> &state)
+{
+    if (state.size() != 7) return RV_ERANGE;
+    m_ier.store(state[0]);
+    m_lcr = state[1];
+    m_mcr = state[2];
+    m_scr = state[3];
+    m_fcr = state[4];
+    m_dll = state[5];
+    m_dlm = state[6];
+    m_thre_ip.store((m_ier.load() & IER_ETBEI) != 0);
+    irq_update();
+    return RV_EOK;
+}
+
+uint8_t uart_16550::reg_read(uint32_t reg)
+{
+    bool dlab = (m_lcr & LCR_DLAB) != 0;
+    uint8_t val = 0;
+    switch(reg) {
+        case REG_RBR:
+            if (dlab) {
+                val = m_dll;
+                break;
+            }
+            if (m_rx.pop(&val, 1) == 1 && m_rx.size() == 0) irq_update();
+            break;
+        case REG_IER:
+            val = dlab ? m_dlm : m_ier.load();
+            break;
+        case REG_IIR:
+            val = iir() | ((m_fcr & FCR_ENABLE) ? IIR_FIFO : 0);
+            /* reading IIR acknowledges THRE */
+            if ((val & 0x0f) == IIR_THRE) {
+                m_thre_ip.store(false);
+                irq_update();
+            }
+            break;
+        case REG_LCR:
+            val = m_lcr;
+            break;
+        case REG_MCR:
+            val = m_mcr;
+            break;
+        case REG_LSR:
+            val = (m_rx.size() ? LSR_DR : 0) | (m_tx.space() ? LSR_THRE : 0) | (m_tx.size() ? 0 : LSR_TEMT);
+            break;
+        case REG_MSR:
+            val = MSR_IDLE;
+            break;
+        case REG_SCR:
+            val = m_scr;
+            break;
+        default:
+            break;
+    }
+    return val;
+}
+
+void uart_16550::reg_write(uint32_t reg, uint8_t val)
+{
+    bool dlab = (m_lcr & LCR_DLAB) != 0;
+    switch(reg) {
+        case REG_RBR:
+            if (dlab) {
+                m_dll = val;
+                break;
+            }
+            /* the guest checks LSR.THRE, a byte written to a full ring is lost as on hardware */
+            m_tx.push(&val, 1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            io_wake();
+            m_thre_ip.store(m_tx.space() >= TX_LOAD);
+            irq_update();
+            break;
+        case REG_IER: {
+            if (dlab) {
+                m_dlm = val;
+                break;
+            }
+            uint8_t old = m_ier.exchange(val & IER_MASK);
+            if ((val & IER_ETBEI) && !(old & IER_ETBEI) && m_tx.space() >= TX_LOAD) {
+                m_thre_ip.store(true);
+            }
+            irq_update();
+            break;
+        }
+        case REG_IIR:
+            /* FCR */
+            if (val & FCR_RX_RESET) m_rx.clear();
+            m_fcr = val & FCR_ENABLE;
+            irq_update();
+            break;
+        case REG_LCR:
+            m_lcr = val;
+            break;
+        case REG_MCR:
+            m_mcr = val & 0x1f;
+            break;
+        case REG_SCR:
+            m_scr = val;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Interrupt identification, received data first, then THRE
+ */
+uint8_t uart_16550::iir()
+{
+    uint8_t ier = m_ier.load();
+    if ((ier & IER_ERBFI) && m_rx.size()) return IIR_RDA;
+    if ((ier & IER_ETBEI) && m_thre_ip.load()) return IIR_THRE;
+    return IIR_NONE;
+}
+
+void uart_16550::irq_update()
+{
+    std::lock_guard<std::mutex> lock(m_irq_mutex);
+    bool level = iir() != IIR_NONE;
+    if (level == m_irq_level) return;
+    m_irq_level = level;
+    if (m_irq) m_irq(level);
+}
+
+/**
+ * @brief I/O thread, drains TX to the host and fills RX from it
+ */
+void uart_16550::io_run()
+{
+    uint8_t buf[4096];
+    bool in_eof = false;
+
+    for (;;) {
+        bool drained = false;
+        size_t n;
+        while ((n = m_tx.pop(buf, sizeof(buf))) > 0) {
+            drained = true;
+            for (size_t done = 0; m_out >= 0 && done < n; ) {
+                ssize_t ret = ::write(m_out, buf + done, n - done);
+                if (ret < 0 && errno == EINTR) continue;
+                if (ret <= 0) break;
+                done += ret;
+            }
+        }
+        /* room again after the ring was full, the guest waits for THRE */
+        if (drained && !m_thre_ip.load() && m_tx.space() >= TX_LOAD) {
+            m_thre_ip.store(true);
+            irq_update();
+        }
+        if (m_quit.load()) break;
+
+        /* an input without room waits for the guest to read, a hung up pty for a reopen */
+        bool in_poll = m_in >= 0 && !in_eof && m_rx.space() > 0;
+        struct pollfd fds[2] = {
+            {m_wake, POLLIN, 0},
+            {in_poll ? m_in : -1, POLLIN, 0},
+        };
+        int timeout = (m_in >= 0 && !in_eof && !in_poll) ? 10 : -1;
+        m_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_tx.size() == 0 && !m_quit.load()) {
+            poll(fds, 2, timeout);
+        }
+        m_sleeping.store(false);
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t val;
+            ::read(m_wake, &val, sizeof(val));
+        }
+        if (fds[1].revents & POLLIN) {
+            ssize_t ret = ::read(m_in, buf, std::min(sizeof(buf), m_rx.space()));
+            if (ret > 0) {
+                m_rx.push(buf, ret);
+                irq_update();
+            } else if (ret == 0) {
+                in_eof = true;
+            }
+        } else if (fds[1].revents & (POLLHUP | POLLERR)) {
+            /* no pty slave yet, poll again later */
+            usleep(100 * 1000);
+        }
+    }
+}
+
+void uart_16550::io_wake()
+{
+    if (m_sleeping.exchange(false)) {
+        uint64_t val = 1;
+        ::write(m_wake, &val, sizeof(val));
+    }
+}
+
+void uart_16550::close()
+{
+    if (m_thread.joinable()) {
+        m_quit.store(true);
+        uint64_t val = 1;
+        ::write(m_wake, &val, sizeof(val));
+        m_thread.join();
+    }
+    if (m_wake >= 0) ::close(m_wake);
+    if (m_own_in) ::close(m_in);
+    if (m_own_out) ::close(m_out);
+    m_wake = m_in = m_out = -1;
+    m_own_in = m_own_out = false;
+    m_pty.clear();
+}
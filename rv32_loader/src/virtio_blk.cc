@@ -0,0 +1,404 @@
+#include "virtio_blk.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define VIRTIO_ID_BLOCK 2
+
+/* features */
+#define VIRTIO_BLK_F_SEG_MAX 2
+#define VIRTIO_BLK_F_RO      5
+#define VIRTIO_BLK_F_FLUSH   9
+
+/* request types */
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_T_FLUSH  4
+#define VIRTIO_BLK_T_GET_ID 8
+
+#define VIRTIO_BLK_S_OK     0
+#define VIRTIO_BLK_S_IOERR  1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+#define VIRTIO_BLK_ID_BYTES 20
+
+#define SECTOR_SIZE 512
+#define QUEUE_MAX   256
+/* a chain holds the header and the status besides the data */
+#define SEG_MAX     (QUEUE_MAX - 2)
+#define POOL_THREADS 4
+
+using namespace ZoraGA::RVVM;
+
+virtio_blk::virtio_blk()
+    : virtio_mmio(VIRTIO_ID_BLOCK, 1, QUEUE_MAX)
+{}
+
+virtio_blk::~virtio_blk()
+{
+    close();
+}
+
+bool virtio_blk::open(std::string path, bool readonly)
+{
+    struct stat st;
+    close();
+    m_fd = ::open(path.c_str(), (readonly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+    if (m_fd < 0 || fstat(m_fd, &st) != 0) {
+        close();
+        return false;
+    }
+    m_readonly = readonly;
+    m_sectors  = st.st_size / SECTOR_SIZE;
+    m_quit     = false;
+
+    if (uring_setup(QUEUE_MAX)) {
+        m_threads.emplace_back(&virtio_blk::uring_run, this);
+    } else {
+        for (int i=0; i<POOL_THREADS; i++) {
+            m_threads.emplace_back(&virtio_blk::pool_run, this);
+        }
+    }
+    return true;
+}
+
+bool virtio_blk::uring()
+{
+    return m_ring >= 0;
+}
+
+uint64_t virtio_blk::dev_features()
+{
+    return (1ULL << VIRTIO_BLK_F_SEG_MAX) | (1ULL << VIRTIO_BLK_F_FLUSH) | (m_readonly ? (1ULL << VIRTIO_BLK_F_RO) : 0);
+}
+
+void virtio_blk::config_read(uint32_t off, void *p, uint32_t len)
+{
+    /* capacity, size_max, seg_max */
+    uint8_t cfg[16] = {0};
+    uint32_t seg_max = SEG_MAX;
+    memcpy(&cfg[0], &m_sectors, 8);
+    memcpy(&cfg[12], &seg_max, 4);
+    memset(p, 0, len);
+    if (off < sizeof(cfg)) memcpy(p, &cfg[off], std::min<uint32_t>(len, sizeof(cfg) - off));
+}
+
+void virtio_blk::queue_notify(uint32_t q)
+{
+    std::vector<blk_req*> batch;
+    std::vector<vq_desc> chain;
+    uint16_t head;
+    while (vq_pop(q, head, chain)) {
+        blk_req *req = parse(head, chain);
+        if (req) batch.push_back(req);
+    }
+    if (batch.empty()) return;
+
+    if (m_ring >= 0) {
+        uring_submit(batch);
+    } else {
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+        m_pool_queue.insert(m_pool_queue.end(), batch.begin(), batch.end());
+        m_pool_cond.notify_all();
+    }
+}
+
+void virtio_blk::dev_reset()
+{
+    std::unique_lock<std::mutex> lock(m_done_mutex);
+    m_done_cond.wait(lock, [&]{ return m_inflight.load() == 0; });
+}
+
+/**
+ * @brief Turn a chain into a request: header, data, status byte
+ *
+ * @return blk_req* nullptr if the request is already completed, for errors and requests done in place
+ */
+virtio_blk::blk_req *virtio_blk::parse(uint16_t head, std::vector<vq_desc> &chain)
+{
+    blk_req *req = new blk_req;
+    req->head   = head;
+    req->type   = UINT32_MAX;
+    req->status = 0;
+    req->len    = 0;
+    m_inflight++;
+
+    vq_desc &last = chain.back();
+    uint8_t *hdr  = (chain.size() >= 2 && !(chain[0].flags & VIRTQ_DESC_F_WRITE) && chain[0].len >= 16) ? dma(chain[0].addr, 16) : nullptr;
+    if (hdr == nullptr || !(last.flags & VIRTQ_DESC_F_WRITE) || last.len == 0) {
+        needs_reset();
+        complete(req, -EINVAL);
+        return nullptr;
+    }
+    memcpy(&req->type, hdr, 4);
+    memcpy(&req->off, hdr + 8, 8);
+    req->off   *= SECTOR_SIZE;
+    req->status = last.addr + last.len - 1;
+
+    /* data, the status byte may share the last descriptor */
+    bool     in    = (req->type == VIRTIO_BLK_T_IN || req->type == VIRTIO_BLK_T_GET_ID);
+    uint64_t total = 0;
+    for (size_t i=1; i<chain.size(); i++) {
+        uint32_t len = chain[i].len - (i == chain.size() - 1 ? 1 : 0);
+        if (len == 0) continue;
+        uint8_t *p = dma(chain[i].addr, len);
+        if (p == nullptr || ((chain[i].flags & VIRTQ_DESC_F_WRITE) != 0) != in) {
+            complete(req, -EFAULT);
+            return nullptr;
+        }
+        req->iov.push_back({p, len});
+        req->gpa.push_back({chain[i].addr, len});
+        total += len;
+    }
+
+    switch(req->type) {
+        case VIRTIO_BLK_T_IN:
+        case VIRTIO_BLK_T_OUT:
+            if ((req->type == VIRTIO_BLK_T_OUT && m_readonly) || (total % SECTOR_SIZE) != 0
+                || req->off + total > m_sectors * SECTOR_SIZE) {
+                complete(req, -EIO);
+                return nullptr;
+            }
+            req->len = total;
+            return req;
+        case VIRTIO_BLK_T_FLUSH:
+            return req;
+        case VIRTIO_BLK_T_GET_ID: {
+            const char id[VIRTIO_BLK_ID_BYTES] = "rvvm-virtio-blk";
+            uint32_t n = 0;
+            for (auto &it:req->iov) {
+                uint32_t m = std::min<uint32_t>(it.iov_len, VIRTIO_BLK_ID_BYTES - n);
+                memcpy(it.iov_base, id + n, m);
+                n += m;
+            }
+            req->len = n;
+            complete(req, n);
+            return nullptr;
+        }
+        default:
+            req->type = UINT32_MAX;
+            complete(req, -ENOTSUP);
+            return nullptr;
+    }
+}
+
+/**
+ * @brief Write the status, hand the chain back to the driver, from any thread
+ *
+ * @param res Bytes transferred, or -errno
+ */
+void virtio_blk::complete(blk_req *req, int64_t res)
+{
+    uint8_t status = VIRTIO_BLK_S_OK;
+    if (req->type == UINT32_MAX) {
+        status = VIRTIO_BLK_S_UNSUPP;
+    } else if (res < 0 || (uint64_t)res != req->len) {
+        status = VIRTIO_BLK_S_IOERR;
+    }
+
+    uint32_t used = 0;
+    if (status == VIRTIO_BLK_S_OK && (req->type == VIRTIO_BLK_T_IN || req->type == VIRTIO_BLK_T_GET_ID)) {
+        for (auto &it:req->gpa) {
+            dma_written(it.first, it.second);
+        }
+        used = req->len;
+    }
+    uint8_t *p = req->status ? dma(req->status, 1) : nullptr;
+    if (p) {
+        *p = status;
+        dma_written(req->status, 1);
+        used++;
+    }
+    if (req->status) vq_push(0, req->head, used);
+    delete req;
+
+    std::lock_guard<std::mutex> lock(m_done_mutex);
+    if (--m_inflight == 0) m_done_cond.notify_all();
+}
+
+bool virtio_blk::uring_setup(uint32_t entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) return false;
+
+    m_sq_len   = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cq_len   = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sq_len = m_cq_len = std::max(m_sq_len, m_cq_len);
+    }
+    m_sq_map = mmap(nullptr, m_sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    m_cq_map = (params.features & IORING_FEAT_SINGLE_MMAP) ? m_sq_map :
+               mmap(nullptr, m_cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    m_sqes   = mmap(nullptr, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (m_sq_map == MAP_FAILED || m_cq_map == MAP_FAILED || m_sqes == MAP_FAILED) {
+        if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_len);
+        if (m_cq_map != MAP_FAILED && m_cq_map != m_sq_map) munmap(m_cq_map, m_cq_len);
+        if (m_sq_map != MAP_FAILED) munmap(m_sq_map, m_sq_len);
+        m_sqes = m_cq_map = m_sq_map = nullptr;
+        ::close(fd);
+        return false;
+    }
+    m_ring = fd;
+
+    uint8_t *sq = (uint8_t*)m_sq_map;
+    uint8_t *cq = (uint8_t*)m_cq_map;
+    m_sq_head  = (uint32_t*)(sq + params.sq_off.head);
+    m_sq_tail  = (uint32_t*)(sq + params.sq_off.tail);
+    m_sq_mask  = (uint32_t*)(sq + params.sq_off.ring_mask);
+    m_sq_array = (uint32_t*)(sq + params.sq_off.array);
+    m_cq_head  = (uint32_t*)(cq + params.cq_off.head);
+    m_cq_tail  = (uint32_t*)(cq + params.cq_off.tail);
+    m_cq_mask  = (uint32_t*)(cq + params.cq_off.ring_mask);
+    m_cqes     = cq + params.cq_off.cqes;
+    return true;
+}
+
+/**
+ * @brief Queue one SQE per request, and submit them all with one io_uring_enter
+ *
+ * Requests in flight are at most the queue size, the SQ has as many entries.
+ */
+void virtio_blk::uring_submit(std::vector<blk_req*> &reqs)
+{
+    struct io_uring_sqe *sqes = (struct io_uring_sqe*)m_sqes;
+    uint32_t tail = *m_sq_tail;
+    for (auto req:reqs) {
+        uint32_t idx = tail & *m_sq_mask;
+        struct io_uring_sqe *sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->fd        = m_fd;
+        sqe->user_data = (uint64_t)(uintptr_t)req;
+        if (req->type == VIRTIO_BLK_T_FLUSH) {
+            sqe->opcode      = IORING_OP_FSYNC;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        } else {
+            sqe->opcode = (req->type == VIRTIO_BLK_T_IN) ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr   = (uint64_t)(uintptr_t)req->iov.data();
+            sqe->len    = req->iov.size();
+            sqe->off    = req->off;
+        }
+        m_sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+    uint32_t left = reqs.size();
+    while (left) {
+        int ret = syscall(__NR_io_uring_enter, m_ring, left, 0, 0, nullptr, 0);
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) continue;
+        if (ret <= 0) break;
+        left -= ret;
+    }
+}
+
+/**
+ * @brief io_uring reaper thread, a NOP without request stops it
+ */
+void virtio_blk::uring_run()
+{
+    struct io_uring_cqe *cqes = (struct io_uring_cqe*)m_cqes;
+    bool quit = false;
+    while (!quit) {
+        int ret = syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0 && errno != EINTR) break;
+
+        uint32_t head = *m_cq_head;
+        uint32_t tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &cqes[head & *m_cq_mask];
+            if (cqe->user_data == 0) {
+                quit = true;
+                continue;
+            }
+            complete((blk_req*)(uintptr_t)cqe->user_data, cqe->res);
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief Worker of the thread pool fallback
+ */
+void virtio_blk::pool_run()
+{
+    for (;;) {
+        blk_req *req;
+        {
+            std::unique_lock<std::mutex> lock(m_pool_mutex);
+            m_pool_cond.wait(lock, [&]{ return m_quit || !m_pool_queue.empty(); });
+            if (m_pool_queue.empty()) break;
+            req = m_pool_queue.front();
+            m_pool_queue.pop_front();
+        }
+
+        if (req->type == VIRTIO_BLK_T_FLUSH) {
+            complete(req, fdatasync(m_fd) == 0 ? 0 : -errno);
+            continue;
+        }
+        /* a short transfer goes on from where it stopped */
+        std::vector<struct iovec> iov = req->iov;
+        struct iovec *cur = iov.data();
+        int      cnt  = iov.size();
+        uint64_t done = 0;
+        int64_t  err  = 0;
+        while (cnt > 0) {
+            ssize_t n = (req->type == VIRTIO_BLK_T_IN) ? preadv(m_fd, cur, cnt, req->off + done) : pwritev(m_fd, cur, cnt, req->off + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                err = (n < 0) ? -errno : -EIO;
+                break;
+            }
+            done += n;
+            while (cnt > 0 && (size_t)n >= cur->iov_len) {
+                n -= cur->iov_len;
+                cur++;
+                cnt--;
+            }
+            if (cnt > 0) {
+                cur->iov_base = (uint8_t*)cur->iov_base + n;
+                cur->iov_len -= n;
+            }
+        }
+        complete(req, err ? err : (int64_t)done);
+    }
+}
+
+void virtio_blk::close()
+{
+    if (m_ring >= 0 && m_sqes && !m_threads.empty()) {
+        /* a NOP without request stops the reaper */
+        std::vector<blk_req*> none;
+        struct io_uring_sqe *sqes = (struct io_uring_sqe*)m_sqes;
+        uint32_t tail = *m_sq_tail;
+        uint32_t idx  = tail & *m_sq_mask;
+        memset(&sqes[idx], 0, sizeof(sqes[idx]));
+        sqes[idx].opcode = IORING_OP_NOP;
+        m_sq_array[idx]  = idx;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        syscall(__NR_io_uring_enter, m_ring, 1, 0, 0, nullptr, 0);
+    } else {
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+        m_quit = true;
+        m_pool_cond.notify_all();
+    }
+    for (auto &it:m_threads) {
+        it.join();
+    }
+    m_threads.clear();
+
+    if (m_sqes) munmap(m_sqes, m_sqes_len);
+    if (m_cq_map && m_cq_map != m_sq_map) munmap(m_cq_map, m_cq_len);
+    if (m_sq_map) munmap(m_sq_map, m_sq_len);
+    if (m_ring >= 0) ::close(m_ring);
+    if (m_fd >= 0) ::close(m_fd);
+    m_sqes = m_cq_map = m_sq_map = nullptr;
+    m_ring = m_fd = -1;
+}
@@ -0,0 +1,344 @@
+#include "virtio_mmio.h"
+
+#define VIRTIO_MMIO_MAGIC   0x74726976
+#define VIRTIO_MMIO_VERSION 2
+/* "ZGRV", not a registered vendor */
+#define VIRTIO_MMIO_VENDOR  0x5652475a
+
+/* registers */
+#define REG_MAGIC          0x000
+#define REG_VERSION        0x004
+#define REG_DEVICE_ID      0x008
+#define REG_VENDOR_ID      0x00c
+#define REG_DEV_FEATURES   0x010
+#define REG_DEV_FEAT_SEL   0x014
+#define REG_DRV_FEATURES   0x020
+#define REG_DRV_FEAT_SEL   0x024
+#define REG_QUEUE_SEL      0x030
+#define REG_QUEUE_NUM_MAX  0x034
+#define REG_QUEUE_NUM      0x038
+#define REG_QUEUE_READY    0x044
+#define REG_QUEUE_NOTIFY   0x050
+#define REG_INT_STATUS     0x060
+#define REG_INT_ACK        0x064
+#define REG_STATUS         0x070
+#define REG_QUEUE_DESC_LO  0x080
+#define REG_QUEUE_DESC_HI  0x084
+#define REG_QUEUE_AVAIL_LO 0x090
+#define REG_QUEUE_AVAIL_HI 0x094
+#define REG_QUEUE_USED_LO  0x0a0
+#define REG_QUEUE_USED_HI  0x0a4
+#define REG_CONFIG_GEN     0x0fc
+#define REG_CONFIG         0x100
+
+#define STATUS_DRIVER_OK    4
+#define STATUS_NEEDS_RESET  64
+
+#define INT_USED_BUFFER 1
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+
+/* the event has been passed by the index moving from old to idx */
+static bool need_event(uint16_t event, uint16_t idx, uint16_t old)
+{
+    return (uint16_t)(idx - event - 1) < (uint16_t)(idx - old);
+}
+
+using namespace ZoraGA::RVVM;
+
+static void set_lo(uint64_t &v, uint32_t lo) { v = (v & ~0xffffffffULL) | lo; }
+static void set_hi(uint64_t &v, uint32_t hi) { v = (v & 0xffffffffULL) | ((uint64_t)hi << 32); }
+
+virtio_mmio::virtio_mmio(uint32_t device_id, uint32_t queues, uint16_t queue_max)
+    : m_device_id(device_id), m_queue_max(queue_max), m_queues(queues)
+{}
+
+virtio_mmio::~virtio_mmio()
+{}
+
+void virtio_mmio::set_ram(rv32_mem *ram, uint32_t addr)
+{
+    m_ram      = ram;
+    m_ram_addr = addr;
+}
+
+void virtio_mmio::set_irq(std::function<void(bool level)> irq)
+{
+    std::lock_guard<std::mutex> lock(m_used_mutex);
+    m_irq = irq;
+    if (m_irq && m_irq_level) m_irq(true);
+}
+
+rv_err virtio_mmio::read(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > VIRTIO_MMIO_SIZE) return RV_ERANGE;
+    if (addr >= REG_CONFIG) {
+        config_read(addr - REG_CONFIG, p, len);
+        return RV_EOK;
+    }
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val = reg_read(addr);
+    memcpy(p, &val, 4);
+    return RV_EOK;
+}
+
+rv_err virtio_mmio::write(uint32_t addr, void *p, uint32_t len)
+{
+    if ((size_t)addr + len > VIRTIO_MMIO_SIZE) return RV_ERANGE;
+    if (addr >= REG_CONFIG) {
+        config_write(addr - REG_CONFIG, p, len);
+        return RV_EOK;
+    }
+    if (len != 4 || (addr & 3)) return RV_EDALIGN;
+    uint32_t val;
+    memcpy(&val, p, 4);
+    reg_write(addr, val);
+    return RV_EOK;
+}
+
+bool virtio_mmio::vq_pop(uint32_t q, uint16_t &head, std::vector<vq_desc> &chain)
+{
+    virtq &vq = m_queues[q];
+    chain.clear();
+    if (!vq.ready || vq.num == 0) return false;
+
+    uint8_t *avail = dma(vq.avail, 6 + vq.num * 2);
+    uint8_t *used  = dma(vq.used, 6 + vq.num * 8);
+    vq_desc *desc  = (vq_desc*)dma(vq.desc, vq.num * sizeof(vq_desc));
+    if (avail == nullptr || used == nullptr || desc == nullptr) {
+        needs_reset();
+        return false;
+    }
+    uint16_t idx = __atomic_load_n((uint16_t*)(avail + 2), __ATOMIC_ACQUIRE);
+    if (idx == vq.last_avail && event_idx()) {
+        /* notify on the next chain, then check for one added meanwhile */
+        __atomic_store_n((uint16_t*)(used + 4 + vq.num * 8), vq.last_avail, __ATOMIC_RELAXED);
+        dma_written(vq.used + 4 + vq.num * 8, 2);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        idx = __atomic_load_n((uint16_t*)(avail + 2), __ATOMIC_ACQUIRE);
+    }
+    if (idx == vq.last_avail) return false;
+    /* the driver can't have more chains available than the queue holds */
+    if ((uint16_t)(idx - vq.last_avail) > vq.num) {
+        needs_reset();
+        return false;
+    }
+
+    head = ((uint16_t*)(avail + 4))[vq.last_avail % vq.num];
+    vq.last_avail++;
+    for (uint16_t i = head, n = 0; ; i = desc[i].next, n++) {
+        /* a loop in the chain */
+        if (i >= vq.num || n >= vq.num) {
+            needs_reset();
+            return false;
+        }
+        chain.push_back(desc[i]);
+        if (!(desc[i].flags & VIRTQ_DESC_F_NEXT)) break;
+    }
+    return true;
+}
+
+uint16_t virtio_mmio::vq_next(uint32_t q)
+{
+    return m_queues[q].last_avail;
+}
+
+void virtio_mmio::vq_rewind(uint32_t q, uint16_t idx)
+{
+    m_queues[q].last_avail = idx;
+}
+
+void virtio_mmio::vq_push(uint32_t q, uint16_t head, uint32_t len)
+{
+    vq_fill(q, head, len);
+    vq_flush(q);
+}
+
+void virtio_mmio::vq_fill(uint32_t q, uint16_t head, uint32_t len)
+{
+    std::lock_guard<std::mutex> lock(m_used_mutex);
+    virtq &vq = m_queues[q];
+    uint8_t *used = dma(vq.used, 4 + vq.num * 8);
+    if (used == nullptr) return;
+
+    uint32_t *elem = (uint32_t*)(used + 4 + (vq.used_idx % vq.num) * 8);
+    elem[0] = head;
+    elem[1] = len;
+    dma_written(vq.used + 4 + (vq.used_idx % vq.num) * 8, 8);
+    vq.used_idx++;
+}
+
+void virtio_mmio::vq_flush(uint32_t q)
+{
+    std::lock_guard<std::mutex> lock(m_used_mutex);
+    virtq &vq = m_queues[q];
+    uint8_t *avail = dma(vq.avail, 6 + vq.num * 2);
+    uint8_t *used  = dma(vq.used, 4 + vq.num * 8);
+    if (avail == nullptr || used == nullptr || vq.used_pub == vq.used_idx) return;
+
+    uint16_t old = vq.used_pub;
+    vq.used_pub  = vq.used_idx;
+    __atomic_store_n((uint16_t*)(used + 2), vq.used_idx, __ATOMIC_RELEASE);
+    dma_written(vq.used + 2, 2);
+
+    /* the driver updates its event after reading the index */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool notify;
+    if (event_idx()) {
+        uint16_t event = __atomic_load_n((uint16_t*)(avail + 4 + vq.num * 2), __ATOMIC_RELAXED);
+        notify = need_event(event, vq.used_idx, old);
+    } else {
+        notify = !(__atomic_load_n((uint16_t*)avail, __ATOMIC_RELAXED) & VIRTQ_AVAIL_F_NO_INTERRUPT);
+    }
+    if (notify) {
+        m_int_status |= INT_USED_BUFFER;
+        irq_update();
+    }
+}
+
+uint8_t *virtio_mmio::dma(uint64_t addr, uint32_t len)
+{
+    uint32_t size = 0;
+    if (m_ram == nullptr) return nullptr;
+    /* the RAM may be moved by a flat address space, ask each time */
+    uint8_t *host = (uint8_t*)m_ram->host(size);
+    if (host == nullptr || addr < m_ram_addr || addr - m_ram_addr + len > size) return nullptr;
+    return host + (addr - m_ram_addr);
+}
+
+void virtio_mmio::dma_written(uint64_t addr, uint32_t len)
+{
+    if (m_ram) m_ram->host_written(addr - m_ram_addr, len);
+}
+
+uint64_t virtio_mmio::features()
+{
+    return m_drv_features;
+}
+
+bool virtio_mmio::running()
+{
+    uint32_t status = m_status.load();
+    return (status & STATUS_DRIVER_OK) && !(status & STATUS_NEEDS_RESET);
+}
+
+void virtio_mmio::needs_reset()
+{
+    m_status.fetch_or(STATUS_NEEDS_RESET);
+}
+
+uint32_t virtio_mmio::reg_read(uint32_t reg)
+{
+    virtq *vq = (m_queue_sel < m_queues.size()) ? &m_queues[m_queue_sel] : nullptr;
+    uint64_t feat = dev_features() | (1ULL << VIRTIO_F_VERSION_1);
+    switch(reg) {
+        case REG_MAGIC:         return VIRTIO_MMIO_MAGIC;
+        case REG_VERSION:       return VIRTIO_MMIO_VERSION;
+        case REG_DEVICE_ID:     return m_device_id;
+        case REG_VENDOR_ID:     return VIRTIO_MMIO_VENDOR;
+        case REG_DEV_FEATURES:  return (m_dev_feat_sel < 2) ? (uint32_t)(feat >> (m_dev_feat_sel * 32)) : 0;
+        case REG_QUEUE_NUM_MAX: return vq ? m_queue_max : 0;
+        case REG_QUEUE_READY:   return vq ? vq->ready : 0;
+        case REG_INT_STATUS: {
+            std::lock_guard<std::mutex> lock(m_used_mutex);
+            return m_int_status;
+        }
+        case REG_STATUS:        return m_status.load();
+        case REG_CONFIG_GEN:    return m_config_gen;
+        default:                return 0;
+    }
+}
+
+void virtio_mmio::reg_write(uint32_t reg, uint32_t val)
+{
+    virtq *vq = (m_queue_sel < m_queues.size()) ? &m_queues[m_queue_sel] : nullptr;
+    switch(reg) {
+        case REG_DEV_FEAT_SEL:
+            m_dev_feat_sel = val;
+            break;
+        case REG_DRV_FEATURES:
+            if (m_drv_feat_sel == 0) set_lo(m_drv_features, val);
+            if (m_drv_feat_sel == 1) set_hi(m_drv_features, val);
+            /* only offered features */
+            m_drv_features &= dev_features() | (1ULL << VIRTIO_F_VERSION_1);
+            break;
+        case REG_DRV_FEAT_SEL:
+            m_drv_feat_sel = val;
+            break;
+        case REG_QUEUE_SEL:
+            m_queue_sel = val;
+            break;
+        case REG_QUEUE_NUM:
+            /* split queue sizes are powers of 2 up to the max */
+            if (val & (val - 1)) {
+                needs_reset();
+                break;
+            }
+            if (vq && val <= m_queue_max) vq->num = val;
+            break;
+        case REG_QUEUE_READY:
+            if (vq) vq->ready = (val & 1);
+            break;
+        case REG_QUEUE_NOTIFY:
+            if (val < m_queues.size() && running()) queue_notify(val);
+            break;
+        case REG_INT_ACK: {
+            std::lock_guard<std::mutex> lock(m_used_mutex);
+            m_int_status &= ~val;
+            irq_update();
+            break;
+        }
+        case REG_STATUS: {
+            if (val == 0) {
+                reset();
+                break;
+            }
+            /* NEEDS_RESET is the device's, only a reset clears it */
+            uint32_t old = m_status.load();
+            while (!m_status.compare_exchange_weak(old, val | (old & STATUS_NEEDS_RESET))) {}
+            if ((val & STATUS_DRIVER_OK) && !(old & STATUS_DRIVER_OK)) driver_ok();
+            break;
+        }
+        case REG_QUEUE_DESC_LO:  if (vq) set_lo(vq->desc, val);  break;
+        case REG_QUEUE_DESC_HI:  if (vq) set_hi(vq->desc, val);  break;
+        case REG_QUEUE_AVAIL_LO: if (vq) set_lo(vq->avail, val); break;
+        case REG_QUEUE_AVAIL_HI: if (vq) set_hi(vq->avail, val); break;
+        case REG_QUEUE_USED_LO:  if (vq) set_lo(vq->used, val);  break;
+        case REG_QUEUE_USED_HI:  if (vq) set_hi(vq->used, val);  break;
+        default:
+            break;
+    }
+}
+
+void virtio_mmio::reset()
+{
+    /* no more notifies, then wait for buffers in flight */
+    m_status.store(0);
+    dev_reset();
+    std::lock_guard<std::mutex> lock(m_used_mutex);
+    for (auto &it:m_queues) {
+        it = virtq();
+    }
+    m_dev_feat_sel = 0;
+    m_drv_feat_sel = 0;
+    m_drv_features = 0;
+    m_queue_sel    = 0;
+    m_int_status   = 0;
+    irq_update();
+}
+
+/**
+ * @brief Level of the interrupt from the interrupt status, m_used_mutex held
+ */
+void virtio_mmio::irq_update()
+{
+    bool level = m_int_status != 0;
+    if (level == m_irq_level) return;
+    m_irq_level = level;
+    if (m_irq) m_irq(level);
+}
+
+bool virtio_mmio::event_idx()
+{
+    return (m_drv_features >> VIRTIO_RING_F_EVENT_IDX) & 1;
+}
@@ -0,0 +1,244 @@
+#include "virtio_net.h"
+#include <algorithm>
+
+#define VIRTIO_ID_NET 1
+
+/* features */
+#define VIRTIO_NET_F_MAC    5
+#define VIRTIO_NET_F_STATUS 16
+
+#define VIRTIO_NET_S_LINK_UP 1
+
+/* virtio_net_hdr of VIRTIO_F_VERSION_1, num_buffers is the last field */
+#define NET_HDR_SIZE     12
+#define NET_HDR_NUM_BUFS 10
+
+#define RXQ 0
+#define TXQ 1
+#define QUEUE_MAX 256
+/* chains per batch, to the pipe and to the driver */
+#define BATCH 64
+
+using namespace ZoraGA::RVVM;
+
+virtio_net::virtio_net()
+    : virtio_mmio(VIRTIO_ID_NET, 2, QUEUE_MAX),
+      m_rx_heads(BATCH), m_tx_heads(BATCH), m_rx_pos(BATCH), m_tx_pos(BATCH),
+      m_rx_chains(BATCH), m_rx_iov(BATCH), m_tx_iov(BATCH),
+      m_rx_msgs(BATCH), m_tx_msgs(BATCH)
+{}
+
+virtio_net::~virtio_net()
+{
+    close();
+}
+
+void virtio_net::set_pipe(net_pipe *pipe)
+{
+    close();
+    m_pipe = pipe;
+    if (m_pipe == nullptr) return;
+    m_quit.store(false);
+    m_rx_thread = std::thread(&virtio_net::run, this, false);
+    m_tx_thread = std::thread(&virtio_net::run, this, true);
+}
+
+void virtio_net::set_mac(const uint8_t mac[6])
+{
+    memcpy(m_mac, mac, 6);
+}
+
+uint64_t virtio_net::dev_features()
+{
+    return (1ULL << VIRTIO_NET_F_MAC) | (1ULL << VIRTIO_NET_F_STATUS) | (1ULL << VIRTIO_RING_F_EVENT_IDX);
+}
+
+void virtio_net::config_read(uint32_t off, void *p, uint32_t len)
+{
+    /* mac, status */
+    uint8_t cfg[8];
+    uint16_t status = VIRTIO_NET_S_LINK_UP;
+    memcpy(&cfg[0], m_mac, 6);
+    memcpy(&cfg[6], &status, 2);
+    memset(p, 0, len);
+    if (off < sizeof(cfg)) memcpy(p, &cfg[off], std::min<uint32_t>(len, sizeof(cfg) - off));
+}
+
+void virtio_net::queue_notify(uint32_t q)
+{
+    kick(q == TXQ);
+}
+
+void virtio_net::dev_reset()
+{
+    /* batches in progress are done, the next ones see the device stopped */
+    std::lock_guard<std::mutex> rx_lock(m_rx_mutex);
+    std::lock_guard<std::mutex> tx_lock(m_tx_mutex);
+}
+
+void virtio_net::driver_ok()
+{
+    kick(false);
+    kick(true);
+}
+
+/**
+ * @brief Buffers of a chain, past the header
+ *
+ * @param write RX, the chain must be device writable, and the header is written
+ * @return false If a descriptor isn't as expected or out of RAM
+ */
+bool virtio_net::chain_iov(std::vector<vq_desc> &chain, bool write, std::vector<struct iovec> &iov)
+{
+    uint8_t hdr[NET_HDR_SIZE] = {0};
+    uint32_t skip = NET_HDR_SIZE;
+    hdr[NET_HDR_NUM_BUFS] = 1;
+    iov.clear();
+    for (auto &it:chain) {
+        uint8_t *p = dma(it.addr, it.len);
+        if (p == nullptr || ((it.flags & VIRTQ_DESC_F_WRITE) != 0) != write) return false;
+        uint32_t n = std::min(skip, it.len);
+        if (write) memcpy(p, hdr + NET_HDR_SIZE - skip, n);
+        skip -= n;
+        if (it.len > n) iov.push_back({p + n, it.len - n});
+    }
+    return skip == 0;
+}
+
+/**
+ * @brief Fill a batch of RX chains from the pipe
+ */
+virtio_net::batch_state virtio_net::rx_batch()
+{
+    std::lock_guard<std::mutex> lock(m_rx_mutex);
+    if (!running()) return BATCH_NO_BUFS;
+
+    uint16_t start = vq_next(RXQ);
+    uint16_t head;
+    int n = 0;
+    m_rx_bad.clear();
+    while (n < BATCH) {
+        uint16_t pos = vq_next(RXQ);
+        if (!vq_pop(RXQ, head, m_rx_chains[n])) break;
+        if (!chain_iov(m_rx_chains[n], true, m_rx_iov[n])) {
+            m_rx_bad.push_back({pos, head});
+            continue;
+        }
+        m_rx_heads[n] = head;
+        m_rx_pos[n]   = pos;
+        memset(&m_rx_msgs[n], 0, sizeof(m_rx_msgs[n]));
+        m_rx_msgs[n].msg_hdr.msg_iov    = m_rx_iov[n].data();
+        m_rx_msgs[n].msg_hdr.msg_iovlen = m_rx_iov[n].size();
+        n++;
+    }
+    int got = n ? m_pipe->recv(m_rx_msgs.data(), n) : 0;
+    for (int i=0; i<got; i++) {
+        for (auto &it:m_rx_chains[i]) {
+            dma_written(it.addr, it.len);
+        }
+        vq_fill(RXQ, m_rx_heads[i], NET_HDR_SIZE + m_rx_msgs[i].msg_len);
+    }
+    batch_rewind(RXQ, start, (got < n) ? m_rx_pos[got] : vq_next(RXQ), m_rx_bad);
+    vq_flush(RXQ);
+    if (n == 0) return BATCH_NO_BUFS;
+    return got ? BATCH_DONE : BATCH_PIPE;
+}
+
+/**
+ * @brief Send a batch of TX chains, those without room are given back
+ */
+virtio_net::batch_state virtio_net::tx_batch()
+{
+    std::lock_guard<std::mutex> lock(m_tx_mutex);
+    if (!running()) return BATCH_NO_BUFS;
+
+    std::vector<vq_desc> chain;
+    uint16_t start = vq_next(TXQ);
+    uint16_t head;
+    int n = 0;
+    m_tx_bad.clear();
+    while (n < BATCH) {
+        uint16_t pos = vq_next(TXQ);
+        if (!vq_pop(TXQ, head, chain)) break;
+        if (!chain_iov(chain, false, m_tx_iov[n])) {
+            m_tx_bad.push_back({pos, head});
+            continue;
+        }
+        m_tx_heads[n] = head;
+        m_tx_pos[n]   = pos;
+        memset(&m_tx_msgs[n], 0, sizeof(m_tx_msgs[n]));
+        m_tx_msgs[n].msg_hdr.msg_iov    = m_tx_iov[n].data();
+        m_tx_msgs[n].msg_hdr.msg_iovlen = m_tx_iov[n].size();
+        n++;
+    }
+    int sent = n ? m_pipe->send(m_tx_msgs.data(), n) : 0;
+    for (int i=0; i<sent; i++) {
+        vq_fill(TXQ, m_tx_heads[i], 0);
+    }
+    batch_rewind(TXQ, start, (sent < n) ? m_tx_pos[sent] : vq_next(TXQ), m_tx_bad);
+    vq_flush(TXQ);
+    if (n == 0) return BATCH_NO_BUFS;
+    return (sent < n) ? BATCH_PIPE : BATCH_DONE;
+}
+
+/**
+ * @brief Give back the chains from the first one unused, and return the malformed ones before it
+ *
+ * A malformed chain after the rewind point is taken again by the next batch,
+ * so it is returned once, and the chains are taken again in the driver's order.
+ *
+ * @param q
+ * @param start Avail index of the first chain of the batch
+ * @param end Avail index of the first chain given back
+ * @param bad Avail index and head of the malformed chains of the batch
+ */
+void virtio_net::batch_rewind(uint32_t q, uint16_t start, uint16_t end, std::vector<std::pair<uint16_t, uint16_t>> &bad)
+{
+    for (auto &it:bad) {
+        if ((uint16_t)(it.first - start) < (uint16_t)(end - start)) vq_fill(q, it.second, 0);
+    }
+    vq_rewind(q, end);
+}
+
+/**
+ * @brief Send or receive thread, sleeps on a notify for chains, or on the pipe
+ */
+void virtio_net::run(bool tx)
+{
+    while (!m_quit.load()) {
+        batch_state state = tx ? tx_batch() : rx_batch();
+        if (state == BATCH_NO_BUFS) {
+            std::unique_lock<std::mutex> lock(m_kick_mutex);
+            m_kick_cond.wait(lock, [&]{ return m_kicked[tx] || m_quit.load(); });
+            m_kicked[tx] = false;
+        } else if (state == BATCH_PIPE) {
+            if (tx) {
+                m_pipe->wait_send();
+            } else {
+                m_pipe->wait_recv();
+            }
+        }
+    }
+}
+
+void virtio_net::kick(bool tx)
+{
+    std::lock_guard<std::mutex> lock(m_kick_mutex);
+    m_kicked[tx] = true;
+    m_kick_cond.notify_all();
+}
+
+void virtio_net::close()
+{
+    if (m_rx_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_kick_mutex);
+            m_quit.store(true);
+            m_kick_cond.notify_all();
+        }
+        m_pipe->stop();
+        m_rx_thread.join();
+        m_tx_thread.join();
+    }
+    m_pipe = nullptr;
+}
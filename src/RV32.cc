@@ -12,6 +12,30 @@
 #define RV32_EVT_START (1UL << 0)
 #define RV32_EVT_STOP  (1UL << 1)
 
+#define MSTATUS_SIE  (1U << 1)
+#define MSTATUS_MIE  (1U << 3)
+#define MSTATUS_SPIE (1U << 5)
+#define MSTATUS_MPIE (1U << 7)
+#define MSTATUS_SPP  (1U << 8)
+#define MSTATUS_MPP  (3U << 11)
+#define MSTATUS_MPRV (1U << 17)
+
+#define MIP_STIP (1U << 5)
+#define MIP_SEIP (1U << 9)
+#define MIP_MEIP (1U << 11)
+
+/* exception codes of mcause */
+#define CAUSE_FETCH_ACCESS 1
+#define CAUSE_ILLEGAL      2
+#define CAUSE_BREAKPOINT   3
+#define CAUSE_LOAD_ACCESS  5
+#define CAUSE_STORE_ACCESS 7
+#define CAUSE_ECALL_U      8
+#define CAUSE_FETCH_PAGE   12
+#define CAUSE_LOAD_PAGE    13
+#define CAUSE_STORE_PAGE   15
+#define CAUSE_INTERRUPT    (1U << 31)
+
 namespace ZoraGA::RVVM::RV32
 {
 
@@ -19,14 +43,20 @@ rv32::rv32()
 {
     m_regs.reg = new rv32_regs_base;
     m_regs.ctl = new rv32_regs_ctrl;
+    m_mmu.set_mems(&m_mems);
 }
 
 rv32::~rv32()
 {
     stop();
+    /* the clones leave the flat space before they go */
+    m_flat.release();
     if (m_regs.reg) delete m_regs.reg;
     if (m_regs.fp) delete m_regs.fp;
     if (m_regs.ctl) delete m_regs.ctl;
+    for (auto it:m_clones) {
+        delete it;
+    }
 }
 
 bool rv32::add_inst(std::string name, rv32_inst *inst)
@@ -76,6 +106,9 @@ bool rv32::add_mem(uint32_t addr, uint32_t length, rv32_mem *mem)
         }
         if (err) break;
         m_mems.push_back(rv32_mem_info{addr, length, mem});
+        if (m_flat.base() && !m_flat.map(addr, length, mem)) {
+            LOGD("mem %08x not in flat space", addr);
+        }
         ret = true;
     }while(0);
     return ret;
@@ -109,6 +142,23 @@ bool rv32::set_start_addr(uint32_t addr)
     return ret;
 }
 
+bool rv32::set_start_priv(uint8_t priv)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running) break;
+        if (priv == 2 || priv > 3) break;
+        /* the lower modes are announced by misa */
+        uint32_t misa = csr_get(CSR_misa);
+        if (priv == 1 && !(misa & (1U << 18))) break;
+        if (priv == 0 && !(misa & (1U << 20))) break;
+        m_regs.ctl->priv = priv;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
 bool rv32::set_compress(rv32_comprs *comprs)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
@@ -172,125 +222,799 @@ bool rv32::wait_for_stop(uint32_t toms)
     return m_event.wait(RV32_EVT_STOP, toms);
 }
 
-void rv32::run()
+rv32 *rv32::clone()
 {
-    uint32_t pc_prv = 0;
-    rv32_inst_fmt inst;
-    bool is_compress = false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    rv32 *vm = nullptr;
+    do{
+        if (m_started || m_running) break;
+        if (m_linux || m_semihost || m_htif) break;
+        flat_sync();
 
-    m_running = true;
-    m_event.set(RV32_EVT_START);
-    while(1) {
-        if (m_exit_req) break;
+        vm = new rv32;
+        *vm->m_regs.reg = *m_regs.reg;
+        *vm->m_regs.ctl = *m_regs.ctl;
+        if (m_regs.fp) vm->m_regs.fp = new rv32_regs_fp(*m_regs.fp);
+
+        vm->m_insts  = m_insts;
+        vm->m_comprs = m_comprs;
+        vm->m_log    = m_log;
+        vm->m_syms   = m_syms;
+        vm->m_sbi    = m_sbi;
+
+        for (auto it:m_mems) {
+            rv32_mem *mem = it.mem->clone();
+            if (mem == nullptr) {
+                LOGW("clone: memory at %08x can't be cloned", it.addr);
+                delete vm;
+                vm = nullptr;
+                break;
+            }
+            if (mem != it.mem) {
+                vm->m_clones.push_back(mem);
+                it.mem = mem;
+            }
+            vm->m_mems.push_back(it);
+        }
+        if (vm && m_flat.base() && !vm->flat_map()) {
+            delete vm;
+            vm = nullptr;
+        }
+    }while(0);
+    return vm;
+}
+
+size_t rv32::fetch_dirty(std::vector<uint32_t> &addrs)
+{
+    std::vector<uint32_t> pages;
+    size_t n = 0;
+    flat_sync();
+    for (auto it:m_mems) {
+        rv_dirty *dirty = it.mem->dirty();
+        if (dirty == nullptr) continue;
+        pages.clear();
+        n += dirty->fetch_clear(pages);
+        for (auto pg:pages) {
+            addrs.push_back(it.addr + (pg << RV_PAGE_SHIFT));
+        }
+    }
+    return n;
+}
+
+rv_stop rv32::step(uint64_t count)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_started || m_running) return RV_STOP_REQ;
+        m_exit_req = false;
+        m_running  = true;
+    }
+    rv_stop stop = loop(count);
+    m_running = false;
+    return stop;
+}
+
+bool rv32::add_breakpoint(uint32_t addr)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) return false;
+    return m_breakpoints.insert(addr).second;
+}
+
+bool rv32::del_breakpoint(uint32_t addr)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) return false;
+    return m_breakpoints.erase(addr) != 0;
+}
+
+bool rv32::set_edge_map(uint8_t *map, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_running) break;
+        if (map && (size == 0 || (size & (size - 1)) || size > 0x100000000ULL)) break;
+        m_edges     = map;
+        m_edge_mask = map ? size - 1 : 0;
+        m_edge_prev   = 0;
+        m_block_entry = true;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+bool rv32::set_symbols(rv_elf *elf)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_running) break;
+        m_syms = elf;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+bool rv32::set_coverage(rv_coverage *cov)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_running) break;
+        m_cov         = cov;
+        m_block_entry = true;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+bool rv32::set_baseline()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running) break;
 
-        if (!inst_fetch(m_regs.reg->pc, inst, is_compress))
-        {
-            LOGE("inst fetch err");
+        bool ok = true;
+        std::vector<uint32_t> pages;
+        flat_sync();
+        m_base_states.resize(m_mems.size());
+        for (size_t i=0; i<m_mems.size() && ok; i++) {
+            rv32_mem *mem = m_mems[i].mem;
+            m_base_states[i].clear();
+            ok = (mem->save_state(m_base_states[i]) == RV_EOK);
+            if (!ok || mem->dirty() == nullptr) continue;
+            ok = (mem->set_baseline() == RV_EOK);
+            mem->dirty()->fetch_clear(pages);
+        }
+        if (!ok) {
+            LOGE("set baseline failed");
             break;
         }
-        pc_prv = m_regs.reg->pc;
-        LOGD("PC %08x, fetch instruction: %08x, opcode: %02x, aa: %01x, bbb: %01x, cc: %01x", pc_prv, inst.inst, inst.opcode, inst.aa, inst.bbb, inst.cc);
 
-        if (inst.inst == 0) {
-            LOGE("illegal instruction");
+        m_base_reg = *m_regs.reg;
+        m_base_ctl = *m_regs.ctl;
+        if (m_regs.fp) m_base_fp = *m_regs.fp;
+        m_has_base = true;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+bool rv32::revert()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running || !m_has_base) break;
+
+        bool ok = true;
+        std::vector<uint32_t> pages;
+        flat_sync();
+        for (size_t i=0; i<m_mems.size() && ok; i++) {
+            rv32_mem *mem = m_mems[i].mem;
+            if (mem->dirty()) {
+                pages.clear();
+                if (mem->dirty()->fetch_clear(pages)) {
+                    ok = (mem->revert_pages(pages) == RV_EOK);
+                }
+            }
+            ok = ok && (mem->load_state(m_base_states[i]) == RV_EOK);
+        }
+        if (!ok) {
+            LOGE("revert failed");
             break;
         }
 
-        m_regs.ctl->pc_changed = false;
-        m_regs.reg->x[0] = 0;
-        if (!inst_exec(inst))
-        {
-            LOGE("inst exec err");
+        *m_regs.reg = m_base_reg;
+        *m_regs.ctl = m_base_ctl;
+        if (m_regs.fp) *m_regs.fp = m_base_fp;
+        m_edge_prev = 0;
+        /* page tables may have been reverted */
+        m_mmu.flush();
+        pmp_refresh();
+        mode_refresh();
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+rv32_regs_base *rv32::regs()
+{
+    return m_regs.reg;
+}
+
+bool rv32::read_mem(uint32_t addr, void *p, uint32_t len)
+{
+    return mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(addr, p, len, m_mems) == RV_EOK;
+}
+
+bool rv32::write_mem(uint32_t addr, void *p, uint32_t len)
+{
+    return mem_write_region<uint32_t, rv32_mem_info, rv32_mem_infos>(addr, p, len, m_mems) == RV_EOK;
+}
+
+bool rv32::set_flat(bool enable)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running) break;
+        flat_sync();
+        m_mems.flat       = nullptr;
+        m_mems.flat_pages = nullptr;
+        m_mems.flat_dirty = nullptr;
+        m_flat.release();
+        ret = !enable || flat_map();
+    }while(0);
+    return ret;
+}
+
+bool rv32::set_sbi(RV32Sbi *sbi)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running) break;
+        if (sbi && sbi->regist(m_regs) != RV_EOK) {
+            LOGE("SBI needs S-Mode");
             break;
         }
-        regs_dump();
+        m_sbi = sbi;
+        ret = true;
+    }while(0);
+    return ret;
+}
 
-        if (m_regs.reg->pc != pc_prv || m_regs.ctl->pc_changed) {
-            LOGD("pc changed");
-        } else {
-            m_regs.reg->pc += is_compress ? 2 : 4;
+bool rv32::set_linux(RV32Linux *user)
+{
+    bool ret = false;
+    do{
+        if (user == nullptr || m_started || m_running) break;
+        /* add_mem takes the lock */
+        if (!add_mem(0, RV32_LINUX_SPACE, user->space())) {
+            LOGE("user space overlaps a memory");
+            break;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_linux = user;
+        m_regs.reg->pc   = user->entry();
+        m_regs.reg->x[2] = user->stack();
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+bool rv32::set_semihost(RV32Semihost *semihost)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running) break;
+        m_semihost = semihost;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+bool rv32::set_htif(RV32Htif *htif)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    do{
+        if (m_started || m_running) break;
+        m_htif = htif;
+        ret = true;
+    }while(0);
+    return ret;
+}
+
+void rv32::set_ext_irq(uint32_t line, bool level)
+{
+    uint32_t bit = 1U << (line & 31);
+    uint32_t old = level ? m_ext_lines.fetch_or(bit) : m_ext_lines.fetch_and(~bit);
+    if (((old & bit) != 0) != level) {
+        m_ext_changed.store(true);
+    }
+}
+
+/**
+ * @brief Reserve the flat space and map the regions in
+ */
+bool rv32::flat_map()
+{
+    if (!m_flat.reserve()) {
+        LOGE("reserve flat space failed");
+        return false;
+    }
+    for (auto it:m_mems) {
+        if (!m_flat.map(it.addr, it.len, it.mem)) {
+            LOGD("mem %08x not in flat space", it.addr);
         }
     }
+    m_mems.flat       = m_flat.base();
+    m_mems.flat_pages = m_flat.pages();
+    m_mems.flat_dirty = m_flat.dirty();
+    return true;
+}
+
+/**
+ * @brief Forward pages written through the flat space to their memories
+ */
+void rv32::flat_sync()
+{
+    if (m_flat.base() == nullptr) return;
+    std::vector<uint32_t> pages;
+    m_flat.dirty()->fetch_clear(pages);
+    for (auto pg:pages) {
+        uint32_t addr = pg << RV_PAGE_SHIFT;
+        for (auto it:m_mems) {
+            if (!rv32_mem_range(addr, it)) continue;
+            it.mem->host_written(addr - it.addr, std::min<uint64_t>(RV_PAGE_SIZE, (uint64_t)it.addr + it.len - addr));
+            break;
+        }
+    }
+}
+
+void rv32::run()
+{
+    m_running = true;
+    m_event.set(RV32_EVT_START);
+    loop(0);
     m_running = false;
     m_event.set(RV32_EVT_STOP);
 }
 
-bool rv32::inst_fetch(uint32_t addr, rv32_inst_fmt &out, bool &is_compress)
+rv_stop rv32::loop(uint64_t count)
 {
-    bool ret = false;
-    bool found = false;
+    m_steps = 0;
+    time_load();
+    pmp_refresh();
+    ext_irq_refresh();
+    mode_refresh();
+    rv_stop stop = loop_run(count);
+    time_store();
+    return stop;
+}
+
+rv_stop rv32::loop_run(uint64_t count)
+{
+    bool bp = !m_breakpoints.empty();
+    for (; count == 0 || m_steps < count; m_steps++) {
+        if (m_exit_req) return RV_STOP_REQ;
+        if (bp && m_steps != 0 && m_breakpoints.count(m_regs.reg->pc)) {
+            LOGD("breakpoint %08x", m_regs.reg->pc);
+            return RV_STOP_BREAK;
+        }
+        if (!inst_step()) return RV_STOP_ERROR;
+    }
+    return RV_STOP_BUDGET;
+}
+
+void rv32::log_symbol(uint32_t pc, bool err)
+{
+    if (m_log == nullptr || m_syms == nullptr) return;
+    const rv_elf_symbol *sym = m_syms->symbol_at(pc);
+    if (sym == nullptr) return;
+    if (err) {
+        LOGE("PC %08x: <%s+0x%x>", pc, sym->name.c_str(), pc - sym->value);
+    } else {
+        LOGD("PC %08x: <%s+0x%x>", pc, sym->name.c_str(), pc - sym->value);
+    }
+}
+
+bool rv32::inst_step()
+{
+    uint32_t pc_prv = 0;
+    rv32_inst_fmt inst;
+    bool is_compress = false;
     rv_err err;
-    rv32_mem_info info;
+
+    /* time counts retired instructions, reaching stimecmp raises STIP */
+    if (m_sbi && ++m_time >= m_timecmp) {
+        mode_refresh();
+    }
+    if (m_ext_changed.load(std::memory_order_relaxed)) {
+        ext_irq_refresh();
+        mode_refresh();
+    }
+    if (m_irq) {
+        irq_take();
+    }
+
+    err = inst_fetch(m_regs.reg->pc, inst, is_compress);
+    if (err != RV_EOK)
+    {
+        if (exception(err, m_regs.reg->pc, 0)) return true;
+        LOGE("inst fetch err");
+        log_symbol(m_regs.reg->pc, true);
+        return false;
+    }
+    pc_prv = m_regs.reg->pc;
+    LOGD("PC %08x, fetch instruction: %08x, opcode: %02x, aa: %01x, bbb: %01x, cc: %01x", pc_prv, inst.inst, inst.opcode, inst.aa, inst.bbb, inst.cc);
+
+    if (inst.inst == 0) {
+        if (exception(RV_EININST, pc_prv, inst.inst)) return true;
+        LOGE("illegal instruction");
+        log_symbol(pc_prv, true);
+        return false;
+    }
+
+    m_regs.ctl->pc_changed = false;
+    m_regs.reg->x[0] = 0;
+    if (m_sbi && inst.opcode == 0b1110011) {
+        /* csrr of time */
+        time_store();
+    }
+    /* a store's address, the registers may be changed by a trap */
+    uint32_t st_addr = 0;
+    bool     st_htif = m_htif && inst.opcode == 0b0100011;
+    if (st_htif) {
+        st_addr = m_regs.reg->x[inst.S.rs1] + (((int32_t)inst.inst >> 20 & ~0x1f) | inst.S.imm_4_0);
+    }
+    err = inst_exec(inst);
+    if (st_htif && err == RV_EOK) {
+        uint32_t st_len = 1U << (inst.S.funct3 & 0x3);
+        if ((m_mems.xlate == nullptr || mem_translate<uint32_t, rv32_mem_infos>(st_addr, st_len, RV_ACC_W, m_mems) == RV_EOK)
+            && m_htif->hit(st_addr, st_len) && !m_htif->written(m_mems)) {
+            LOGI("HTIF exit %d", m_htif->exit_code());
+            m_exit_req = true;
+        }
+    }
+    if (err == RV_ECALL && m_linux) {
+        if (!m_linux->call(m_regs)) {
+            LOGI("program exit %d", m_linux->exit_code());
+            m_exit_req = true;
+        }
+        err = RV_EOK;
+    }
+    if (err == RV_ECALL && m_sbi && m_regs.ctl->priv == 1) {
+        /* served here instead of trapping to M-Mode firmware */
+        if (!m_sbi->call(m_regs, m_mems)) {
+            LOGI("SBI shutdown");
+            m_exit_req = true;
+        }
+        err = RV_EOK;
+    }
+    if (err == RV_EBREAK && m_semihost && !is_compress && semihost_at(pc_prv)) {
+        if (!m_semihost->call(m_regs, m_mems)) {
+            LOGI("semihosting exit %d", m_semihost->exit_code());
+            m_exit_req = true;
+        }
+        err = RV_EOK;
+    }
+    if ((err == RV_ECALL || err == RV_EBREAK) && !m_traps) {
+        /* no trap vector, ecall and ebreak do nothing */
+        err = RV_EOK;
+    }
+    if (err != RV_EOK)
+    {
+        if (exception(err, pc_prv, inst.inst)) return true;
+        LOGE("inst exec err");
+        log_symbol(pc_prv, true);
+        return false;
+    }
+    if (m_regs.ctl->csr_changed) {
+        m_regs.ctl->csr_changed = false;
+        if (m_regs.ctl->pmp_changed) {
+            m_regs.ctl->pmp_changed = false;
+            pmp_refresh();
+        }
+        mode_refresh();
+    }
+    if (m_regs.ctl->sfence.pending) {
+        m_regs.ctl->sfence.pending = false;
+        m_mmu.fence(m_regs.ctl->sfence);
+    }
+    regs_dump();
+
+    bool jumped = (m_regs.reg->pc != pc_prv || m_regs.ctl->pc_changed);
+    if (jumped) {
+        LOGD("pc changed");
+        log_symbol(m_regs.reg->pc, false);
+    } else {
+        m_regs.reg->pc += is_compress ? 2 : 4;
+    }
+
+    /* branch/jalr/jal, taken or not */
+    bool branch = (inst.aa == 0b11 && inst.cc == 0b11 && (inst.bbb == 0b000 || inst.bbb == 0b001 || inst.bbb == 0b011));
+
+    /* a block ends at a branch, a jump, a system instruction or any pc change */
+    if (m_cov) {
+        if (m_block_entry) m_cov->block(pc_prv);
+        if (branch && inst.bbb == 0b000) m_cov->branch(pc_prv, jumped);
+        m_block_entry = jumped || branch || (inst.opcode == 0b1110011 && inst.I.funct3 == 0);
+    }
+
+    if (m_edges && branch) {
+        uint32_t cur = m_regs.reg->pc;
+        cur = (cur >> 1) ^ (cur >> 13) ^ (cur * 0x9E3779B1U >> 16);
+        uint8_t &hit = m_edges[(cur ^ m_edge_prev) & m_edge_mask];
+        if (hit != 0xff) hit++;
+        m_edge_prev = cur >> 1;
+    }
+    return true;
+}
+
+rv_err rv32::inst_fetch(uint32_t addr, rv32_inst_fmt &out, bool &is_compress)
+{
+    rv_err err = RV_EOK;
+    uint32_t paddr = addr;
     union {
         uint8_t u8[4];
         uint16_t u16[2];
         uint32_t u32;
     } inst;
+
+    /* fetch by region, not through the flat space, code in devices would fault on every fetch */
+    auto fetch = [&](uint32_t pa, auto &v) -> rv_err {
+        for (auto &it:m_mems) {
+            if (rv32_mem_range(pa, it)) return mem_read_as(it.mem, pa - it.addr, v);
+        }
+        return RV_EFETCH;
+    };
     do{
-        /* find mem for fetch */
-        for (auto it:m_mems) {
-            if (rv32_mem_range(addr, it))
-            {
-                info = it;
-                found = true;
-                break;
-            }
+        if (m_fetch_xlate) {
+            err = m_mmu.translate(addr, m_comprs ? 2 : 4, RV_ACC_X, paddr);
+            if (err != RV_EOK) break;
         }
-        if (!found) break;
 
         /* fetch */
         if (m_comprs) {
 
             /* read fist 16bit for check compress */
-            err = info.mem->read(addr - info.addr, inst.u8, 2);
-            if (err != RV_EOK) {
-                LOGE("instruction fetch err: %d", err);
-                break;
-            }
+            err = fetch(paddr, inst.u16[0]);
+            if (err != RV_EOK) break;
 
             /* if is compress instruction, break while */
             if (m_comprs->isCompress(inst.u16[0], out)) {
                 is_compress = true;
-                ret = true;
                 break;
             }
 
-            /* read last 16bit if not compress */
-            err = info.mem->read(addr - info.addr, inst.u8+2, 2);
-            if (err != RV_EOK) {
-                LOGE("instruction fetch err: %d", err);
-                break;
+            /* read last 16bit if not compress, it may be on the next page */
+            paddr += 2;
+            if (m_fetch_xlate && (paddr & (RV_PAGE_SIZE - 1)) == 0) {
+                err = m_mmu.translate(addr + 2, 2, RV_ACC_X, paddr);
+                if (err != RV_EOK) break;
             }
+            err = fetch(paddr, inst.u16[1]);
+            if (err != RV_EOK) break;
             is_compress = false;
             out.inst    = inst.u32;
-            ret         = true;
         } else {
-            err = info.mem->read(addr - info.addr, inst.u8, 4);
-            if (err != RV_EOK) {
-                LOGE("instruction fetch err: %d", err);
-                break;
-            }
-            ret = true;
+            err = fetch(paddr, inst.u32);
+            if (err != RV_EOK) break;
             out.inst = inst.u32;
         }
     }while(0);
-    return ret;
+    if (err != RV_EOK && err != RV_EPAGE) {
+        LOGE("instruction fetch err: %d", err);
+    }
+    return err;
 }
 
-bool rv32::inst_exec(rv32_inst_fmt inst)
+rv_err rv32::inst_exec(rv32_inst_fmt inst)
 {
-    rv_err err;
-    bool ret = false;
-    do{
-        for (auto it:m_insts) {
-            err = it.second->isValid(inst);
-            if (err != RV_EOK) continue;
-            err = it.second->exec(inst, m_regs, m_mems);
-            ret = (err == RV_EOK);
+    rv_err err = RV_EUNDEF;
+    for (auto &it:m_insts) {
+        if (it.second->isValid(inst) != RV_EOK) continue;
+        err = it.second->exec(inst, m_regs, m_mems);
+        /* opcode level decoders like "I" leave the rest of an opcode to other sets */
+        if (err != RV_EUNDEF) break;
+    }
+    return err;
+}
+
+/**
+ * @brief Check the ebreak at pc is a semihosting request, surrounded by the entry and exit markers
+ */
+bool rv32::semihost_at(uint32_t pc)
+{
+    rv32_inst_fmt prev, next;
+    bool is_compress = false;
+    if (inst_fetch(pc - 4, prev, is_compress) != RV_EOK || prev.inst != RV32_SEMIHOST_ENTRY) return false;
+    if (inst_fetch(pc + 4, next, is_compress) != RV_EOK || next.inst != RV32_SEMIHOST_EXIT) return false;
+    return true;
+}
+
+/**
+ * @brief Raise the exception of a failed fetch or execution
+ *
+ * @param err
+ * @param epc Instruction raising it
+ * @param inst Instruction bits, for illegal instructions
+ * @return true If a trap is taken, the handler redoes or skips the instruction
+ * @return false If err is not an exception, or there is no trap vector
+ */
+bool rv32::exception(rv_err err, uint32_t epc, uint32_t inst)
+{
+    if (!m_traps) return false;
+
+    uint32_t cause = 0, tval = 0;
+    rv_access acc  = RV_ACC_R;
+    switch(err) {
+        case RV_EPAGE:
+        case RV_EACCESS:
+            if (m_mmu.fault(tval, acc) != err) return false;
+            if (err == RV_EPAGE) {
+                cause = (acc == RV_ACC_X) ? CAUSE_FETCH_PAGE : (acc == RV_ACC_W) ? CAUSE_STORE_PAGE : CAUSE_LOAD_PAGE;
+            } else {
+                cause = (acc == RV_ACC_X) ? CAUSE_FETCH_ACCESS : (acc == RV_ACC_W) ? CAUSE_STORE_ACCESS : CAUSE_LOAD_ACCESS;
+            }
+            break;
+        case RV_EUNDEF:
+        case RV_EININST:
+            cause = CAUSE_ILLEGAL;
+            tval  = inst;
+            break;
+        case RV_ECALL:
+            cause = CAUSE_ECALL_U + m_regs.ctl->priv;
             break;
+        case RV_EBREAK:
+            cause = CAUSE_BREAKPOINT;
+            tval  = epc;
+            break;
+        default:
+            return false;
+    }
+    trap_enter(cause, tval, epc);
+    return true;
+}
+
+/**
+ * @brief Enter the trap handler, in S-Mode if delegated by medeleg/mideleg, else in M-Mode
+ *
+ * @param cause mcause/scause value
+ * @param tval
+ * @param epc
+ */
+void rv32::trap_enter(uint32_t cause, uint32_t tval, uint32_t epc)
+{
+    bool     irq     = (cause & CAUSE_INTERRUPT) != 0;
+    uint32_t code    = cause & ~CAUSE_INTERRUPT;
+    uint32_t deleg   = csr_get(irq ? CSR_mideleg : CSR_medeleg);
+    uint32_t mstatus = csr_get(CSR_mstatus);
+    uint32_t tvec;
+    uint8_t  priv    = m_regs.ctl->priv;
+    LOGD("trap: cause %08x, tval %08x, epc %08x, mode %u", cause, tval, epc, priv);
+
+    if (priv <= 1 && code < 32 && (deleg & (1U << code))) {
+        mstatus = (mstatus & ~(MSTATUS_SPIE | MSTATUS_SPP)) | ((mstatus & MSTATUS_SIE) ? MSTATUS_SPIE : 0);
+        mstatus = (mstatus & ~MSTATUS_SIE) | (priv ? MSTATUS_SPP : 0);
+        csr_set(CSR_sepc, epc);
+        csr_set(CSR_scause, cause);
+        csr_set(CSR_stval, tval);
+        tvec = csr_get(CSR_stvec);
+        m_regs.ctl->priv = 1;
+    } else {
+        mstatus = (mstatus & ~(MSTATUS_MPIE | MSTATUS_MPP)) | ((mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+        mstatus = (mstatus & ~MSTATUS_MIE) | ((uint32_t)priv << 11);
+        csr_set(CSR_mepc, epc);
+        csr_set(CSR_mcause, cause);
+        csr_set(CSR_mtval, tval);
+        tvec = csr_get(CSR_mtvec);
+        m_regs.ctl->priv = 3;
+    }
+    csr_set(CSR_mstatus, mstatus);
+
+    /* vectored mode applies to interrupts only */
+    m_regs.reg->pc = (tvec & ~3U) + ((irq && (tvec & 3) == 1) ? code * 4 : 0);
+    m_block_entry  = true;
+    mode_refresh();
+}
+
+/**
+ * @brief Take the interrupt of highest priority among the ones enabled in this mode
+ */
+void rv32::irq_take()
+{
+    /* MEI, MSI, MTI, SEI, SSI, STI */
+    static const uint8_t order[] = {11, 3, 7, 9, 1, 5};
+    uint32_t m    = m_irq & ~csr_get(CSR_mideleg);
+    uint32_t pend = m ? m : m_irq;
+    for (auto code:order) {
+        if (pend & (1U << code)) {
+            trap_enter(CAUSE_INTERRUPT | code, 0, m_regs.reg->pc);
+            return;
         }
-    }while(0);
-    return ret;
+    }
+    trap_enter(CAUSE_INTERRUPT | __builtin_ctz(pend), 0, m_regs.reg->pc);
+}
+
+/**
+ * @brief Reflect the external interrupt lines in mip, mode_refresh makes them pending
+ */
+void rv32::ext_irq_refresh()
+{
+    m_ext_changed.store(false);
+    if (m_regs.ctl->csrs.find(rv_csr_addr(CSR_mip)) == m_regs.ctl->csrs.end()) return;
+    uint32_t bit = m_sbi ? MIP_SEIP : MIP_MEIP;
+    uint32_t mip = csr_get(CSR_mip);
+    csr_set(CSR_mip, m_ext_lines.load() ? (mip | bit) : (mip & ~bit));
+}
+
+/**
+ * @brief Resolve the state depending on the privilege mode, at mode switches and CSR writes
+ *
+ * Translation context from satp and mstatus, and the interrupts that can be taken,
+ * so instructions check neither.
+ */
+void rv32::mode_refresh()
+{
+    uint32_t mstatus = csr_get(CSR_mstatus);
+    uint8_t  priv    = m_regs.ctl->priv;
+    uint8_t  data    = (priv == 3 && (mstatus & MSTATUS_MPRV)) ? (mstatus & MSTATUS_MPP) >> 11 : priv;
+    m_mmu.set_context(csr_get(CSR_satp), priv, data, mstatus);
+
+    /* STIP follows time >= stimecmp, with the SBI in the VM */
+    if (m_sbi) {
+        uint64_t cmp = ((uint64_t)csr_get(CSR_stimecmph) << 32) | csr_get(CSR_stimecmp);
+        uint32_t mip = csr_get(CSR_mip);
+        csr_set(CSR_mip, (m_time >= cmp) ? (mip | MIP_STIP) : (mip & ~MIP_STIP));
+        m_timecmp = (m_time >= cmp) ? UINT64_MAX : cmp;
+    }
+    m_mems.xlate  = m_mmu.active(RV_ACC_R) ? &m_mmu : nullptr;
+    m_fetch_xlate = m_mmu.active(RV_ACC_X);
+
+    m_traps = m_regs.ctl->csrs.find(rv_csr_addr(CSR_mtvec)) != m_regs.ctl->csrs.end();
+    uint32_t pend  = csr_get(CSR_mip) & csr_get(CSR_mie);
+    uint32_t deleg = csr_get(CSR_mideleg);
+    bool m_on = (priv < 3) || (mstatus & MSTATUS_MIE);
+    bool s_on = (priv < 1) || (priv == 1 && (mstatus & MSTATUS_SIE));
+    m_irq = (m_on ? (pend & ~deleg) : 0) | (s_on ? (pend & deleg) : 0);
+}
+
+/**
+ * @brief Reload the PMP entries from pmpcfg0-3 and pmpaddr0-15
+ */
+void rv32::pmp_refresh()
+{
+    uint32_t cfg[RV32_PMP_COUNT / 4];
+    uint32_t addr[RV32_PMP_COUNT];
+    for (size_t i=0; i<RV32_PMP_COUNT / 4; i++) {
+        cfg[i] = csr_get(CSR_pmpcfg0 + i);
+    }
+    for (size_t i=0; i<RV32_PMP_COUNT; i++) {
+        addr[i] = csr_get(CSR_pmpaddr0 + i);
+    }
+    m_mmu.set_pmp(cfg, addr);
+}
+
+/**
+ * @brief Load time from the time/timeh CSRs, at the start of a run
+ */
+void rv32::time_load()
+{
+    m_time = ((uint64_t)csr_get(CSR_timeh) << 32) | csr_get(CSR_time);
+}
+
+/**
+ * @brief Store time to the time/timeh CSRs, before they are read and at the end of a run
+ */
+void rv32::time_store()
+{
+    if (m_sbi == nullptr) return;
+    csr_set(CSR_time, m_time);
+    csr_set(CSR_timeh, m_time >> 32);
+}
+
+/**
+ * @brief Read a CSR
+ *
+ * @param addr
+ * @return uint32_t 0 if the CSR doesn't exist
+ */
+uint32_t rv32::csr_get(uint16_t addr)
+{
+    auto it = m_regs.ctl->csrs.find(rv_csr_addr(addr));
+    return (it == m_regs.ctl->csrs.end()) ? 0 : it->second.to_ulong();
+}
+
+void rv32::csr_set(uint16_t addr, uint32_t val)
+{
+    m_regs.ctl->csrs[rv_csr_addr(addr)] = val;
 }
 
 void rv32::regs_dump()
@@ -0,0 +1,95 @@
+#include "ZoraGA/RV32Htif.h"
+
+/* syscalls of the riscv-tests proxy, Linux numbers */
+#define HTIF_SYS_write 64
+#define HTIF_SYS_exit  93
+
+#define HTIF_ENOSYS 38
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief Host access to a guest buffer, which must lie in one memory
+ */
+static bool buf_check(uint64_t addr, uint64_t len, rv32_mem_infos &mems)
+{
+    for (auto &it:mems) {
+        if (addr >= it.addr && addr < (uint64_t)it.addr + it.len) {
+            return addr + len <= (uint64_t)it.addr + it.len;
+        }
+    }
+    return false;
+}
+
+void RV32Htif::set_addr(uint32_t tohost, uint32_t fromhost)
+{
+    m_tohost   = tohost;
+    m_fromhost = fromhost;
+}
+
+void RV32Htif::set_console(FILE *out)
+{
+    m_out = out;
+}
+
+bool RV32Htif::hit(uint32_t addr, uint32_t len)
+{
+    return (uint64_t)addr + len > m_tohost && addr < (uint64_t)m_tohost + 8;
+}
+
+bool RV32Htif::written(rv32_mem_infos &mems)
+{
+    uint64_t cmd = 0;
+    bool exit = false;
+    if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(m_tohost, &cmd, 8, mems) != RV_EOK) return true;
+    /* the upper word of a 64-bit store comes on its own, with nothing to do yet */
+    if ((uint32_t)cmd == 0 || (cmd >> 56) != 0) return true;
+
+    if (cmd & 1) {
+        m_exit = (int)(cmd >> 1);
+        exit = true;
+    } else {
+        syscall((uint32_t)cmd, mems, exit);
+    }
+    write64(m_tohost, 0, mems);
+    return !exit;
+}
+
+int RV32Htif::exit_code()
+{
+    return m_exit;
+}
+
+void RV32Htif::syscall(uint32_t addr, rv32_mem_infos &mems, bool &exit)
+{
+    uint64_t arg[8];
+    int64_t  ret = -HTIF_ENOSYS;
+    if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(addr, arg, sizeof(arg), mems) != RV_EOK) return;
+
+    switch(arg[0]) {
+        case HTIF_SYS_write: {
+            if ((arg[1] != 1 && arg[1] != 2) || !buf_check(arg[2], arg[3], mems)) break;
+            std::vector<uint8_t> buf(arg[3]);
+            if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(arg[2], buf.data(), buf.size(), mems) != RV_EOK) break;
+            if (m_out) fwrite(buf.data(), 1, buf.size(), m_out);
+            ret = buf.size();
+            break;
+        }
+        case HTIF_SYS_exit:
+            m_exit = (int)arg[1];
+            exit = true;
+            return;
+        default:
+            break;
+    }
+    write64(addr, ret, mems);
+    if (m_fromhost) write64(m_fromhost, 1, mems);
+}
+
+void RV32Htif::write64(uint32_t addr, uint64_t val, rv32_mem_infos &mems)
+{
+    mem_write_region<uint32_t, rv32_mem_info, rv32_mem_infos>(addr, &val, 8, mems);
+}
+
+}
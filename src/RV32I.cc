@@ -76,7 +76,11 @@ rv_err RV32I::exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_inf
                     } else if (inst.I.funct3 == 0b111) {
                         err = andi(a);
                     } else if (inst.I.funct3 == 0b001) {
-                        err = slli(a);
+                        if (inst.R.funct7 == 0) {
+                            err = slli(a);
+                        } else {
+                            // err = RV_EUNDEF;
+                        }
                     } else if (inst.I.funct3 == 0b101) {
                         if (inst.R.funct7 == 0) {
                             err = srli(a);
@@ -137,6 +141,9 @@ rv_err RV32I::exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_inf
                         } else {
                             // err = RV_EUNDEF;
                         }
+                    } else if (inst.R.funct7 != 0 && inst.R.funct3 != 0b101) {
+                        /* funct7 of the other sets of the opcode, Zb* */
+                        // err = RV_EUNDEF;
                     } else if (inst.R.funct3 == 0b001) {
                         err = sll(a);
                     } else if (inst.R.funct3 == 0b010) {
@@ -300,7 +307,7 @@ rv_err RV32I::lb(inst_args a)
 
     uint32_t addr = a.regs->reg->x[a.inst.I.rs1] + dat.i32;
     uint8_t d;
-    rv_err err = rv32_mem_read(addr, (void *)&d, 1, *a.mems);
+    rv_err err = rv32_mem_read8(addr, d, *a.mems);
     if (err != RV_EOK) return err;
     a.regs->reg->x[a.inst.I.rd] = rv32_sext(d, 7);
     return RV_EOK;
@@ -320,15 +327,10 @@ rv_err RV32I::lh(inst_args a)
         a.inst.I.rd, a.regs->reg->x[a.inst.I.rs1], a.inst.I.rs1, imm.I.imm, dat.u32, dat.i32);
 
     uint32_t addr = a.regs->reg->x[a.inst.I.rs1] + dat.i32;
-    #pragma pack(push, 1)
-    union {
-        uint8_t u8[2];
-        uint16_t u16;
-    } d;
-    #pragma pack(pop)
-    rv_err err = rv32_mem_read(addr, d.u8, 2, *a.mems);
+    uint16_t d;
+    rv_err err = rv32_mem_read16(addr, d, *a.mems);
     if (err != RV_EOK) return err;
-    a.regs->reg->x[a.inst.I.rd] = rv32_sext(d.u16, 15);
+    a.regs->reg->x[a.inst.I.rd] = rv32_sext(d, 15);
     return RV_EOK;
 }
 
@@ -346,13 +348,10 @@ rv_err RV32I::lw(inst_args a)
         a.inst.I.rd, a.regs->reg->x[a.inst.I.rs1], a.inst.I.rs1, imm.I.imm, dat.u32, dat.i32);
 
     uint32_t addr = a.regs->reg->x[a.inst.I.rs1] + dat.i32;
-    union {
-        uint8_t u8[4];
-        uint32_t u32;
-    } d;
-    rv_err err = rv32_mem_read(addr, d.u8, 4, *a.mems);
+    uint32_t d;
+    rv_err err = rv32_mem_read32(addr, d, *a.mems);
     if (err != RV_EOK) return err;
-    a.regs->reg->x[a.inst.I.rd] = d.u32;
+    a.regs->reg->x[a.inst.I.rd] = d;
     return RV_EOK;
 }
 
@@ -371,7 +370,7 @@ rv_err RV32I::lbu(inst_args a)
 
     uint32_t addr = a.regs->reg->x[a.inst.I.rs1] + dat.i32;
     uint8_t d;
-    rv_err err = rv32_mem_read(addr, (void *)&d, 1, *a.mems);
+    rv_err err = rv32_mem_read8(addr, d, *a.mems);
     if (err != RV_EOK) return err;
     a.regs->reg->x[a.inst.I.rd] = d;
     return RV_EOK;
@@ -391,13 +390,10 @@ rv_err RV32I::lhu(inst_args a)
         a.inst.I.rd, a.regs->reg->x[a.inst.I.rs1], a.inst.I.rs1, imm.I.imm, dat.u32, dat.i32);
 
     uint32_t addr = a.regs->reg->x[a.inst.I.rs1] + dat.i32;
-    union {
-        uint8_t u8[2];
-        uint16_t u16;
-    } d;
-    rv_err err = rv32_mem_read(addr, d.u8, 2, *a.mems);
+    uint16_t d;
+    rv_err err = rv32_mem_read16(addr, d, *a.mems);
     if (err != RV_EOK) return err;
-    a.regs->reg->x[a.inst.I.rd] = d.u16;
+    a.regs->reg->x[a.inst.I.rd] = d;
     return RV_EOK;
 }
 
@@ -582,8 +578,7 @@ rv_err RV32I::sb(inst_args a)
     LOGINST("sh, M[ (0x%08x(x%u) + {sext(0x%05x) = 0x%08x = %d}) = 0x%08x ] = 0x%08x(x%u)[7:0]", 
         a.regs->reg->x[a.inst.S.rs1], a.inst.S.rs1, imm.S.imm, dat.u32, dat.i32, addr, a.regs->reg->x[a.inst.S.rs2], a.inst.S.rs2);
     
-    uint8_t  d    = a.regs->reg->x[a.inst.S.rs2];
-    return rv32_mem_write(addr, &d, 1, *a.mems);
+    return rv32_mem_write8(addr, (uint8_t)a.regs->reg->x[a.inst.S.rs2], *a.mems);
 }
 
 rv_err RV32I::sh(inst_args a)
@@ -601,12 +596,7 @@ rv_err RV32I::sh(inst_args a)
     LOGINST("sh, M[ (0x%08x(x%u) + {sext(0x%05x) = 0x%08x = %d}) = 0x%08x ] = 0x%08x(x%u)[15:0]", 
         a.regs->reg->x[a.inst.S.rs1], a.inst.S.rs1, imm.S.imm, dat.u32, dat.i32, addr, a.regs->reg->x[a.inst.S.rs2], a.inst.S.rs2);
     
-    union {
-        uint8_t u8[2];
-        uint16_t u16;
-    } d;
-    d.u16 = a.regs->reg->x[a.inst.S.rs2];
-    return rv32_mem_write(addr, d.u8, 2, *a.mems);
+    return rv32_mem_write16(addr, (uint16_t)a.regs->reg->x[a.inst.S.rs2], *a.mems);
 }
 
 rv_err RV32I::sw(inst_args a)
@@ -624,12 +614,7 @@ rv_err RV32I::sw(inst_args a)
     LOGINST("sw, M[ (0x%08x(x%u) + {sext(0x%05x) = 0x%08x = %d}) = 0x%08x ] = 0x%08x(x%u)[31:0]", 
         a.regs->reg->x[a.inst.S.rs1], a.inst.S.rs1, imm.S.imm, dat.u32, dat.i32, addr, a.regs->reg->x[a.inst.S.rs2], a.inst.S.rs2);
 
-    union {
-        uint8_t u8[4];
-        uint32_t u32;
-    } d;
-    d.u32 = a.regs->reg->x[a.inst.S.rs2];
-    return rv32_mem_write(addr, d.u8, 4, *a.mems);
+    return rv32_mem_write32(addr, a.regs->reg->x[a.inst.S.rs2], *a.mems);
 }
 
 rv_err RV32I::add(inst_args a)
@@ -930,15 +915,14 @@ rv_err RV32I::jalr(inst_args a)
 rv_err RV32I::ecall(inst_args a)
 {
     LOGINST("ecall");
-    //TODO implement
-    return RV_EOK;
+    /* the VM raises the exception */
+    return RV_ECALL;
 }
 
 rv_err RV32I::ebreak(inst_args a)
 {
     LOGINST("ebreak");
-    //TODO implement
-    return RV_EOK;
+    return RV_EBREAK;
 }
 
 }
@@ -0,0 +1,697 @@
+#include "ZoraGA/RV32Linux.h"
+#include <algorithm>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* asm-generic syscall numbers of rv32, 64-bit time only */
+#define SYS_RV_getcwd          17
+#define SYS_RV_dup             23
+#define SYS_RV_dup3            24
+#define SYS_RV_fcntl64         25
+#define SYS_RV_ioctl           29
+#define SYS_RV_mkdirat         34
+#define SYS_RV_unlinkat        35
+#define SYS_RV_faccessat       48
+#define SYS_RV_chdir           49
+#define SYS_RV_openat          56
+#define SYS_RV_close           57
+#define SYS_RV_getdents64      61
+#define SYS_RV_llseek          62
+#define SYS_RV_read            63
+#define SYS_RV_write           64
+#define SYS_RV_readv           65
+#define SYS_RV_writev          66
+#define SYS_RV_pread64         67
+#define SYS_RV_pwrite64        68
+#define SYS_RV_readlinkat      78
+#define SYS_RV_exit            93
+#define SYS_RV_exit_group      94
+#define SYS_RV_set_tid_address 96
+#define SYS_RV_set_robust_list 99
+#define SYS_RV_sched_yield     124
+#define SYS_RV_kill            129
+#define SYS_RV_tgkill          131
+#define SYS_RV_rt_sigaction    134
+#define SYS_RV_rt_sigprocmask  135
+#define SYS_RV_uname           160
+#define SYS_RV_umask           166
+#define SYS_RV_getpid          172
+#define SYS_RV_getppid         173
+#define SYS_RV_getuid          174
+#define SYS_RV_geteuid         175
+#define SYS_RV_getgid          176
+#define SYS_RV_getegid         177
+#define SYS_RV_gettid          178
+#define SYS_RV_brk             214
+#define SYS_RV_munmap          215
+#define SYS_RV_mmap2           222
+#define SYS_RV_mprotect        226
+#define SYS_RV_madvise         233
+#define SYS_RV_prlimit64       261
+#define SYS_RV_getrandom       278
+#define SYS_RV_statx           291
+#define SYS_RV_clock_gettime64 403
+#define SYS_RV_clock_nanosleep_time64 407
+#define SYS_RV_futex_time64    422
+
+#define FUTEX_CMD_MASK 0x7f
+#define FUTEX_WAIT     0
+#define FUTEX_WAKE     1
+
+#define PAGE_UP(x)   (((uint64_t)(x) + RV_PAGE_SIZE - 1) & ~(uint64_t)(RV_PAGE_SIZE - 1))
+/* static-pie is loaded here, off the null page */
+#define PIE_BASE     0x10000
+#define MMAP_TOP     (RV32_LINUX_SPACE - RV32_LINUX_STACK_SIZE - RV_PAGE_SIZE)
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief A syscall result, -errno on failure, the call is made once
+ */
+static int64_t sys_ret(int64_t r)
+{
+    return (r < 0) ? -errno : r;
+}
+
+RV32Linux::RV32Linux()
+{}
+
+RV32Linux::~RV32Linux()
+{
+    fd_close_all();
+}
+
+bool RV32Linux::load(std::string path, const std::vector<std::string> &argv, const std::vector<std::string> &envp)
+{
+    if (!m_elf.load(path)) return false;
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr*)m_elf.data(0, sizeof(Elf32_Ehdr));
+    if (eh == nullptr || (eh->e_type != ET_EXEC && eh->e_type != ET_DYN)) return false;
+    fd_close_all();
+    if (m_space.base() == nullptr) {
+        if (!m_space.reserve(RV32_LINUX_SPACE)) return false;
+    } else {
+        release(0, RV32_LINUX_SPACE);
+    }
+
+    uint32_t bias = (eh->e_type == ET_DYN) ? PIE_BASE : 0;
+    uint32_t phdr = 0;
+    uint64_t end  = 0;
+    for (auto &seg:m_elf.segments()) {
+        /* an interpreter means a dynamic executable */
+        if (seg.type == PT_INTERP) return false;
+        if (seg.type != PT_LOAD || seg.memsz == 0) continue;
+        uint64_t va = (uint64_t)seg.vaddr + bias;
+        if (seg.filesz > seg.memsz || va + seg.memsz > MMAP_TOP) return false;
+        const uint8_t *data = m_elf.data(seg.offset, seg.filesz);
+        if (data == nullptr || m_space.write(va, (void*)data, seg.filesz) != RV_EOK) return false;
+        if (eh->e_phoff >= seg.offset && eh->e_phoff < (uint64_t)seg.offset + seg.filesz) {
+            phdr = va + eh->e_phoff - seg.offset;
+        }
+        end = std::max<uint64_t>(end, va + seg.memsz);
+    }
+    if (end == 0) return false;
+    m_entry     = eh->e_entry + bias;
+    m_brk_start = PAGE_UP(end);
+    m_brk       = m_brk_start;
+    m_maps.clear();
+
+    /* strings and AT_RANDOM bytes at the top of the stack */
+    uint32_t sp = RV32_LINUX_SPACE;
+    std::vector<uint32_t> args, envs;
+    for (auto &it:argv) {
+        if (!push(sp, it.c_str(), it.size() + 1)) return false;
+        args.push_back(sp);
+    }
+    for (auto &it:envp) {
+        if (!push(sp, it.c_str(), it.size() + 1)) return false;
+        envs.push_back(sp);
+    }
+    uint8_t rnd[16];
+    if (getrandom(rnd, sizeof(rnd), 0) != sizeof(rnd)) memset(rnd, 0x5a, sizeof(rnd));
+    if (!push(sp, rnd, sizeof(rnd))) return false;
+    uint32_t at_random = sp;
+
+    /* argc, argv, envp, auxv */
+    std::vector<uint32_t> vec;
+    vec.push_back(args.size());
+    vec.insert(vec.end(), args.begin(), args.end());
+    vec.push_back(0);
+    vec.insert(vec.end(), envs.begin(), envs.end());
+    vec.push_back(0);
+    uint32_t auxv[][2] = {
+        {AT_PHDR,   phdr},
+        {AT_PHENT,  eh->e_phentsize},
+        {AT_PHNUM,  eh->e_phnum},
+        {AT_PAGESZ, RV_PAGE_SIZE},
+        {AT_BASE,   0},
+        {AT_ENTRY,  m_entry},
+        {AT_UID,    (uint32_t)getuid()},
+        {AT_EUID,   (uint32_t)geteuid()},
+        {AT_GID,    (uint32_t)getgid()},
+        {AT_EGID,   (uint32_t)getegid()},
+        {AT_HWCAP,  1U << ('I' - 'A')},
+        {AT_SECURE, 0},
+        {AT_RANDOM, at_random},
+        {AT_NULL,   0},
+    };
+    for (auto &it:auxv) {
+        vec.push_back(it[0]);
+        vec.push_back(it[1]);
+    }
+    sp = (sp - vec.size() * 4) & ~15U;
+    if (m_space.write(sp, vec.data(), vec.size() * 4) != RV_EOK) return false;
+    m_sp   = sp;
+    m_exit = 0;
+    return true;
+}
+
+rv32_mem *RV32Linux::space()
+{
+    return &m_space;
+}
+
+uint32_t RV32Linux::entry()
+{
+    return m_entry;
+}
+
+uint32_t RV32Linux::stack()
+{
+    return m_sp;
+}
+
+int RV32Linux::exit_code()
+{
+    return m_exit;
+}
+
+bool RV32Linux::call(rv32_regs &regs)
+{
+    uint32_t *a  = &regs.reg->x[10];
+    uint32_t nr  = regs.reg->x[17];
+    int64_t  ret = -ENOSYS;
+
+    if (!fd_args(nr, a)) {
+        a[0] = (uint32_t)-EBADF;
+        return true;
+    }
+    switch(nr) {
+        case SYS_RV_getcwd: {
+            char *buf = ptr<char>(a[0], a[1]);
+            ret = (buf && getcwd(buf, a[1])) ? strlen(buf) + 1 : -errno;
+            break;
+        }
+        case SYS_RV_dup:
+            ret = fd_add(sys_ret(dup(a[0])));
+            break;
+        case SYS_RV_dup3:
+            /* host fds, stdio included, are not replaced */
+            if (!m_fds.count(a[1]) && fcntl(a[1], F_GETFD) >= 0) {
+                ret = -EBUSY;
+                break;
+            }
+            ret = fd_add(sys_ret(dup3(a[0], a[1], a[2])));
+            break;
+        case SYS_RV_fcntl64:
+            /* commands with an integer argument only */
+            switch(a[1]) {
+                case F_DUPFD:
+                case F_DUPFD_CLOEXEC:
+                    ret = fd_add(sys_ret(fcntl(a[0], a[1], a[2])));
+                    break;
+                case F_GETFD:
+                case F_SETFD:
+                case F_GETFL:
+                case F_SETFL:
+                    ret = sys_ret(fcntl(a[0], a[1], a[2]));
+                    break;
+                default:
+                    ret = -EINVAL;
+                    break;
+            }
+            break;
+        case SYS_RV_ioctl:
+            /* termios and winsize have the same layout, for isatty and line editing */
+            if (a[1] == TCGETS || a[1] == TIOCGWINSZ) {
+                ret = sys_ret(ioctl(a[0], a[1], ptr<uint8_t>(a[2], 36)));
+            } else {
+                ret = -ENOTTY;
+            }
+            break;
+        case SYS_RV_mkdirat:
+            ret = sys_ret(mkdirat(a[0], str(a[1]), a[2]));
+            break;
+        case SYS_RV_unlinkat:
+            ret = sys_ret(unlinkat(a[0], str(a[1]), a[2]));
+            break;
+        case SYS_RV_faccessat:
+            ret = sys_ret(faccessat(a[0], str(a[1]), a[2], 0));
+            break;
+        case SYS_RV_chdir:
+            ret = sys_ret(chdir(str(a[0])));
+            break;
+        case SYS_RV_openat:
+            ret = fd_add(sys_ret(openat(a[0], str(a[1]), a[2], a[3])));
+            break;
+        case SYS_RV_close:
+            /* the VM shares stdio with the host, other host fds are not the program's */
+            if (m_fds.erase(a[0])) {
+                ret = sys_ret(close(a[0]));
+            } else {
+                ret = (a[0] <= 2) ? 0 : -EBADF;
+            }
+            break;
+        case SYS_RV_getdents64:
+            ret = sys_ret(syscall(SYS_getdents64, a[0], ptr<uint8_t>(a[1], a[2]), a[2]));
+            break;
+        case SYS_RV_llseek: {
+            uint64_t *res = ptr<uint64_t>(a[3]);
+            off_t off = lseek(a[0], ((uint64_t)a[1] << 32) | a[2], a[4]);
+            if (off < 0) {
+                ret = -errno;
+            } else if (res == nullptr) {
+                ret = -EFAULT;
+            } else {
+                *res = off;
+                ret  = 0;
+            }
+            break;
+        }
+        case SYS_RV_read:
+            ret = sys_ret(read(a[0], ptr<uint8_t>(a[1], a[2]), a[2]));
+            break;
+        case SYS_RV_write:
+            ret = sys_ret(write(a[0], ptr<uint8_t>(a[1], a[2]), a[2]));
+            break;
+        case SYS_RV_readv:
+        case SYS_RV_writev:
+            ret = sys_iov(nr == SYS_RV_writev, a[0], a[1], a[2]);
+            break;
+        case SYS_RV_pread64:
+            ret = sys_ret(pread(a[0], ptr<uint8_t>(a[1], a[2]), a[2], ((uint64_t)a[4] << 32) | a[3]));
+            break;
+        case SYS_RV_pwrite64:
+            ret = sys_ret(pwrite(a[0], ptr<uint8_t>(a[1], a[2]), a[2], ((uint64_t)a[4] << 32) | a[3]));
+            break;
+        case SYS_RV_readlinkat:
+            ret = sys_ret(readlinkat(a[0], str(a[1]), ptr<char>(a[2], a[3]), a[3]));
+            break;
+        case SYS_RV_exit:
+        case SYS_RV_exit_group:
+            m_exit = (int32_t)a[0];
+            return false;
+        case SYS_RV_set_tid_address:
+        case SYS_RV_gettid:
+        case SYS_RV_getpid:
+            ret = getpid();
+            break;
+        case SYS_RV_set_robust_list:
+        case SYS_RV_sched_yield:
+        case SYS_RV_rt_sigaction:
+        case SYS_RV_mprotect:
+        case SYS_RV_madvise:
+            /* signals are never delivered, and protection isn't enforced */
+            ret = 0;
+            break;
+        case SYS_RV_rt_sigprocmask:
+            if (a[2] && ptr<uint8_t>(a[2], a[3])) memset(ptr<uint8_t>(a[2], a[3]), 0, a[3]);
+            ret = 0;
+            break;
+        case SYS_RV_kill:
+        case SYS_RV_tgkill: {
+            /* a signal to itself, like abort(), ends the program */
+            uint32_t sig = (nr == SYS_RV_kill) ? a[1] : a[2];
+            if (sig == 0) {
+                ret = 0;
+                break;
+            }
+            m_exit = 128 + sig;
+            return false;
+        }
+        case SYS_RV_uname:
+            ret = sys_uname(a[0]);
+            break;
+        case SYS_RV_umask:
+            ret = umask(a[0]);
+            break;
+        case SYS_RV_getppid:
+            ret = getppid();
+            break;
+        case SYS_RV_getuid:
+            ret = getuid();
+            break;
+        case SYS_RV_geteuid:
+            ret = geteuid();
+            break;
+        case SYS_RV_getgid:
+            ret = getgid();
+            break;
+        case SYS_RV_getegid:
+            ret = getegid();
+            break;
+        case SYS_RV_brk:
+            ret = sys_brk(a[0]);
+            break;
+        case SYS_RV_munmap:
+            ret = sys_munmap(a[0], a[1]);
+            break;
+        case SYS_RV_mmap2:
+            ret = sys_mmap(a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+        case SYS_RV_prlimit64:
+            /* limits can be read, not set */
+            if (a[2]) {
+                ret = -EPERM;
+                break;
+            }
+            ret = sys_ret(prlimit(0, (__rlimit_resource)a[1], nullptr, ptr<struct rlimit>(a[3])));
+            break;
+        case SYS_RV_getrandom:
+            ret = sys_ret(getrandom(ptr<uint8_t>(a[0], a[1]), a[1], a[2]));
+            break;
+        case SYS_RV_statx:
+            /* struct statx is the same on every architecture */
+            ret = sys_ret(syscall(SYS_statx, (int32_t)a[0], str(a[1]), a[2], a[3], ptr<uint8_t>(a[4], 256)));
+            break;
+        case SYS_RV_clock_gettime64:
+            /* struct __kernel_timespec, two 64-bit fields like a 64-bit host timespec */
+            ret = sys_ret(clock_gettime(a[0], ptr<struct timespec>(a[1])));
+            break;
+        case SYS_RV_clock_nanosleep_time64:
+            ret = -clock_nanosleep(a[0], a[1], ptr<struct timespec>(a[2]), ptr<struct timespec>(a[3]));
+            break;
+        case SYS_RV_futex_time64: {
+            /* one thread, nobody to wait for or to wake */
+            uint32_t *uaddr = ptr<uint32_t>(a[0]);
+            if (uaddr == nullptr) {
+                ret = -EFAULT;
+            } else if ((a[1] & FUTEX_CMD_MASK) == FUTEX_WAKE) {
+                ret = 0;
+            } else if ((a[1] & FUTEX_CMD_MASK) == FUTEX_WAIT) {
+                ret = (*uaddr != a[2]) ? -EAGAIN : -ETIMEDOUT;
+            } else {
+                ret = -ENOSYS;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    a[0] = (uint32_t)ret;
+    return true;
+}
+
+/**
+ * @brief Host pointer of a guest range
+ *
+ * @return V* nullptr for the guest NULL, or if the range is out of the user space
+ */
+template<typename V> V *RV32Linux::ptr(uint32_t addr, uint32_t len)
+{
+    if (addr == 0 || (uint64_t)addr + len > RV32_LINUX_SPACE) return nullptr;
+    return (V*)(m_space.base() + addr);
+}
+
+/**
+ * @brief Host pointer of a guest string
+ *
+ * @return const char* nullptr if it isn't terminated in the user space
+ */
+const char *RV32Linux::str(uint32_t addr)
+{
+    const char *s = ptr<const char>(addr, 1);
+    if (s == nullptr || memchr(s, 0, RV32_LINUX_SPACE - addr) == nullptr) return nullptr;
+    return s;
+}
+
+bool RV32Linux::push(uint32_t &sp, const void *data, uint32_t len)
+{
+    if (sp < RV32_LINUX_SPACE - RV32_LINUX_STACK_SIZE + len) return false;
+    sp -= len;
+    return m_space.write(sp, (void*)data, len) == RV_EOK;
+}
+
+/**
+ * @brief brk, the heap ends below the lowest mapping
+ *
+ * @return uint32_t The break, unchanged if addr can't be reached
+ */
+uint32_t RV32Linux::sys_brk(uint32_t addr)
+{
+    if (addr < m_brk_start) return m_brk;
+    uint32_t limit = m_maps.empty() ? MMAP_TOP : std::min<uint32_t>(m_maps.begin()->first, MMAP_TOP);
+    if (addr > limit) return m_brk;
+    /* pages given back read as zero when the heap grows again */
+    if (PAGE_UP(addr) < PAGE_UP(m_brk)) release(PAGE_UP(addr), PAGE_UP(m_brk) - PAGE_UP(addr));
+    m_brk = addr;
+    return m_brk;
+}
+
+int32_t RV32Linux::sys_mmap(uint32_t addr, uint32_t len, uint32_t prot, uint32_t flags, int32_t fd, uint32_t pgoff)
+{
+    if (len == 0 || (addr & (RV_PAGE_SIZE - 1))) return -EINVAL;
+    if (!(flags & MAP_ANONYMOUS) && !guest_fd(fd)) return -EBADF;
+    uint64_t size = PAGE_UP(len);
+    uint32_t at   = 0;
+    if (size > MMAP_TOP) return -ENOMEM;
+    if (flags & MAP_FIXED) {
+        if ((uint64_t)addr + size > MMAP_TOP || addr < m_brk_start) return -ENOMEM;
+        sys_munmap(addr, size);
+        at = addr;
+    } else {
+        at = map_find(size);
+        if (at == 0) return -ENOMEM;
+    }
+
+    release(at, size);
+    if (!(flags & MAP_ANONYMOUS)) {
+        /* a private copy of the file, shared writes aren't written back */
+        ssize_t n = pread(fd, m_space.base() + at, len, (off_t)pgoff * RV_PAGE_SIZE);
+        if (n < 0) {
+            release(at, size);
+            return -errno;
+        }
+    }
+    m_maps[at] = at + size;
+    return at;
+}
+
+int32_t RV32Linux::sys_munmap(uint32_t addr, uint32_t len)
+{
+    if (len == 0 || (addr & (RV_PAGE_SIZE - 1))) return -EINVAL;
+    uint64_t end = PAGE_UP((uint64_t)addr + len);
+    if (end > RV32_LINUX_SPACE) return -EINVAL;
+
+    /* split the mappings overlapping [addr, end) */
+    auto it = m_maps.upper_bound(addr);
+    if (it != m_maps.begin()) --it;
+    while (it != m_maps.end() && it->first < end) {
+        uint32_t lo = it->first, hi = it->second;
+        if (hi <= addr) {
+            ++it;
+            continue;
+        }
+        it = m_maps.erase(it);
+        if (lo < addr) m_maps[lo] = addr;
+        if (hi > end) m_maps[end] = hi;
+        uint32_t rlo = std::max<uint32_t>(lo, addr);
+        uint32_t rhi = std::min<uint64_t>(hi, end);
+        release(rlo, rhi - rlo);
+    }
+    return 0;
+}
+
+int32_t RV32Linux::sys_iov(bool wr, int32_t fd, uint32_t iov, uint32_t cnt)
+{
+    uint32_t *v = ptr<uint32_t>(iov, cnt * 8);
+    if (v == nullptr || cnt > IOV_MAX) return -EFAULT;
+    std::vector<struct iovec> host(cnt);
+    for (uint32_t i=0; i<cnt; i++) {
+        host[i].iov_base = ptr<uint8_t>(v[i * 2], v[i * 2 + 1]);
+        host[i].iov_len  = v[i * 2 + 1];
+        if (host[i].iov_base == nullptr && host[i].iov_len) return -EFAULT;
+    }
+    ssize_t n = wr ? writev(fd, host.data(), cnt) : readv(fd, host.data(), cnt);
+    return sys_ret(n);
+}
+
+int32_t RV32Linux::sys_uname(uint32_t addr)
+{
+    /* struct new_utsname, 6 fields of 65 chars */
+    static const char *fields[6] = {"Linux", "rvvm", "6.1.0", "#1", "riscv32", "(none)"};
+    char *p = ptr<char>(addr, 6 * 65);
+    if (p == nullptr) return -EFAULT;
+    memset(p, 0, 6 * 65);
+    for (size_t i=0; i<6; i++) {
+        strcpy(p + i * 65, fields[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Find a free range for mmap, top-down below the stack and above the heap
+ *
+ * @return uint32_t 0 if there is no room
+ */
+uint32_t RV32Linux::map_find(uint32_t len)
+{
+    uint32_t end = MMAP_TOP;
+    for (auto it = m_maps.rbegin(); it != m_maps.rend(); ++it) {
+        if (it->first >= end) continue;
+        if (it->second <= end && end - it->second >= len) break;
+        end = it->first;
+    }
+    if (end < len || end - len < PAGE_UP(m_brk)) return 0;
+    return end - len;
+}
+
+/**
+ * @brief Record a host fd opened by the program
+ *
+ * @param fd A syscall result
+ * @return int64_t fd
+ */
+int64_t RV32Linux::fd_add(int64_t fd)
+{
+    if (fd >= 0) m_fds.insert(fd);
+    return fd;
+}
+
+/**
+ * @brief An fd the program can use, stdio shared with the host or one it opened
+ */
+bool RV32Linux::guest_fd(int32_t fd)
+{
+    return (fd >= 0 && fd <= 2) || m_fds.count(fd);
+}
+
+/**
+ * @brief Check the fd argument of a syscall, the fds of the loader aren't the program's
+ *
+ * @return false If a0 is an fd, or a directory fd other than AT_FDCWD, not of the program
+ */
+bool RV32Linux::fd_args(uint32_t nr, const uint32_t *a)
+{
+    switch(nr) {
+        case SYS_RV_dup:
+        case SYS_RV_dup3:
+        case SYS_RV_fcntl64:
+        case SYS_RV_ioctl:
+        case SYS_RV_getdents64:
+        case SYS_RV_llseek:
+        case SYS_RV_read:
+        case SYS_RV_write:
+        case SYS_RV_readv:
+        case SYS_RV_writev:
+        case SYS_RV_pread64:
+        case SYS_RV_pwrite64:
+            return guest_fd(a[0]);
+        case SYS_RV_mkdirat:
+        case SYS_RV_unlinkat:
+        case SYS_RV_faccessat:
+        case SYS_RV_openat:
+        case SYS_RV_readlinkat:
+        case SYS_RV_statx:
+            return (int32_t)a[0] == AT_FDCWD || guest_fd(a[0]);
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Close the host fds left open by the program
+ */
+void RV32Linux::fd_close_all()
+{
+    for (auto fd:m_fds) {
+        close(fd);
+    }
+    m_fds.clear();
+}
+
+/**
+ * @brief Drop the pages of a range, they read as zero afterwards
+ */
+void RV32Linux::release(uint32_t addr, uint32_t len)
+{
+    if (len) madvise(m_space.base() + addr, len, MADV_DONTNEED);
+}
+
+RV32Linux::user_space::~user_space()
+{
+    if (m_base) munmap(m_base, m_len);
+}
+
+bool RV32Linux::user_space::reserve(uint32_t len)
+{
+    void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return false;
+    m_base = (uint8_t*)p;
+    m_len  = len;
+    return true;
+}
+
+uint8_t *RV32Linux::user_space::base()
+{
+    return m_base;
+}
+
+rv_err RV32Linux::user_space::read(uint32_t addr, void *data, uint32_t len)
+{
+    if ((uint64_t)addr + len > m_len) return RV_ERANGE;
+    memcpy(data, m_base + addr, len);
+    return RV_EOK;
+}
+
+rv_err RV32Linux::user_space::write(uint32_t addr, void *data, uint32_t len)
+{
+    if ((uint64_t)addr + len > m_len) return RV_ERANGE;
+    memcpy(m_base + addr, data, len);
+    return RV_EOK;
+}
+
+void *RV32Linux::user_space::host(uint32_t &len)
+{
+    len = m_len;
+    return m_base;
+}
+
+/**
+ * @brief Move the mapping into the VM's flat space, keeping its content, and out by unmap_at
+ */
+rv_err RV32Linux::user_space::map_at(void *addr, uint32_t len)
+{
+    if (m_base == nullptr || len != m_len) return RV_EMISSING;
+    if (addr == m_base) return RV_EOK;
+    void *p = mremap(m_base, m_len, m_len, MREMAP_MAYMOVE | MREMAP_FIXED, addr);
+    if (p == MAP_FAILED) return RV_EFAULT;
+    m_base = (uint8_t*)p;
+    return RV_EOK;
+}
+
+void RV32Linux::user_space::unmap_at(void *addr, uint32_t len)
+{
+    if (addr != m_base || len != m_len) return;
+    void *p = mmap(nullptr, m_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return;
+    if (mremap(m_base, m_len, m_len, MREMAP_MAYMOVE | MREMAP_FIXED, p) == MAP_FAILED) {
+        munmap(p, m_len);
+        return;
+    }
+    mmap(m_base, m_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    m_base = (uint8_t*)p;
+}
+
+}
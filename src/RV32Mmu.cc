@@ -0,0 +1,296 @@
+#include "ZoraGA/RV32Mmu.h"
+
+#define PTE_V (1U << 0)
+#define PTE_R (1U << 1)
+#define PTE_W (1U << 2)
+#define PTE_X (1U << 3)
+#define PTE_U (1U << 4)
+#define PTE_G (1U << 5)
+#define PTE_A (1U << 6)
+#define PTE_D (1U << 7)
+
+#define SATP_MODE (1U << 31)
+#define SATP_ASID(satp) (((satp) >> 22) & 0x1ff)
+#define SATP_PPN(satp)  ((satp) & 0x3fffff)
+
+#define PMP_A(cfg) (((cfg) >> 3) & 3)
+#define PMP_L     (1U << 7)
+#define PMP_TOR   1
+#define PMP_NA4   2
+#define PMP_NAPOT 3
+/* page cache only, the page is decided by more than one entry */
+#define PMP_PARTIAL (1U << 7)
+
+#define MSTATUS_SUM (1U << 18)
+#define MSTATUS_MXR (1U << 19)
+
+namespace ZoraGA::RVVM::RV32
+{
+
+RV32Mmu::RV32Mmu()
+{
+    flush();
+    for (auto &it:m_pmp_cache) {
+        it.ppn = UINT32_MAX;
+    }
+}
+
+void RV32Mmu::set_mems(rv32_mem_infos *mems)
+{
+    m_mems = mems;
+}
+
+void RV32Mmu::set_context(uint32_t satp, uint8_t priv, uint8_t data_priv, uint32_t mstatus)
+{
+    m_on        = (satp & SATP_MODE) != 0;
+    m_asid      = SATP_ASID(satp);
+    m_root      = SATP_PPN(satp);
+    m_priv      = priv;
+    m_data_priv = data_priv;
+    m_sum       = (mstatus & MSTATUS_SUM) != 0;
+    m_mxr       = (mstatus & MSTATUS_MXR) != 0;
+}
+
+void RV32Mmu::set_pmp(const uint32_t cfg[RV32_PMP_COUNT / 4], const uint32_t addr[RV32_PMP_COUNT])
+{
+    uint64_t prev = 0;
+    m_pmp.clear();
+    m_pmp_lock = false;
+    for (size_t i=0; i<RV32_PMP_COUNT; i++) {
+        uint8_t  c = cfg[i / 4] >> ((i % 4) * 8);
+        uint64_t a = (uint64_t)addr[i] << 2;
+        pmp_rule r = {0, 0, (uint8_t)(c & 0x7), (c & PMP_L) != 0};
+        switch(PMP_A(c)) {
+            case PMP_TOR:
+                r.lo = prev;
+                r.hi = a;
+                break;
+            case PMP_NA4:
+                r.lo = a;
+                r.hi = a + 4;
+                break;
+            case PMP_NAPOT: {
+                /* size is 8 << trailing ones of pmpaddr */
+                uint64_t size = 8ULL << __builtin_ctzll(~(uint64_t)addr[i]);
+                r.lo = a & ~(size - 1);
+                r.hi = r.lo + size;
+                break;
+            }
+            default:
+                break;
+        }
+        prev = a;
+        if (r.lo < r.hi) m_pmp.push_back(r);
+        if (r.lo < r.hi && r.lock) m_pmp_lock = true;
+    }
+
+    for (auto &it:m_pmp_cache) {
+        it.ppn = UINT32_MAX;
+    }
+    /* TLB entries hold PMP permissions too */
+    flush();
+}
+
+bool RV32Mmu::active(rv_access acc)
+{
+    return (acc == RV_ACC_X ? m_priv : m_data_priv) < 3 || m_pmp_lock;
+}
+
+/**
+ * @brief PMP permissions of a physical page
+ *
+ * @return uint8_t PMP_PARTIAL if the entry matching first covers only a part of the page
+ */
+uint8_t RV32Mmu::pmp_perm(uint32_t ppn)
+{
+    pmp_page &c = m_pmp_cache[ppn & (RV32_PMP_CACHE_SIZE - 1)];
+    if (c.ppn == ppn) return c.perm;
+
+    uint64_t lo = (uint64_t)ppn << RV_PAGE_SHIFT;
+    uint64_t hi = lo + RV_PAGE_SIZE;
+    c.ppn  = ppn;
+    /* no entry matches, S-Mode and U-Mode have no access */
+    c.perm = 0;
+    for (auto &r:m_pmp) {
+        if (r.hi <= lo || r.lo >= hi) continue;
+        c.perm = (r.lo <= lo && r.hi >= hi) ? r.perm : PMP_PARTIAL;
+        break;
+    }
+    return c.perm;
+}
+
+/**
+ * @brief Check the len bytes at paddr, in one page
+ *
+ * The first entry matching any byte decides, it must match all of them. M-Mode
+ * is only restricted by locked entries.
+ */
+bool RV32Mmu::pmp_allowed(uint32_t paddr, uint32_t len, rv_access acc, uint8_t priv)
+{
+    uint8_t perm = (priv == 3) ? PMP_PARTIAL : pmp_perm(paddr >> RV_PAGE_SHIFT);
+    if (perm & PMP_PARTIAL) {
+        uint64_t lo = paddr;
+        uint64_t hi = lo + len;
+        perm = (priv == 3) ? 0x7 : 0;
+        for (auto &r:m_pmp) {
+            if (r.hi <= lo || r.lo >= hi) continue;
+            if (r.lo > lo || r.hi < hi) {
+                perm = 0;
+            } else if (priv < 3 || r.lock) {
+                perm = r.perm;
+            }
+            break;
+        }
+    }
+    return (perm & (1U << acc)) != 0;
+}
+
+bool RV32Mmu::allowed(uint8_t pte, rv_access acc, uint8_t priv)
+{
+    if (pte & PTE_U) {
+        /* S-Mode reaches user pages with SUM, but never executes them */
+        if (priv == 1 && (acc == RV_ACC_X || !m_sum)) return false;
+    } else if (priv == 0) {
+        return false;
+    }
+    switch(acc) {
+        case RV_ACC_R:
+            return (pte & PTE_R) || (m_mxr && (pte & PTE_X));
+        case RV_ACC_W:
+            return (pte & PTE_W) && (pte & PTE_D);
+        case RV_ACC_X:
+            return (pte & PTE_X);
+    }
+    return false;
+}
+
+rv_err RV32Mmu::translate(uint32_t addr, uint32_t len, rv_access acc, uint32_t &paddr)
+{
+    uint8_t priv = (acc == RV_ACC_X) ? m_priv : m_data_priv;
+    paddr = addr;
+    if (priv == 3 && !m_pmp_lock) return RV_EOK;
+
+    rv_err err = RV_EACCESS;
+    do{
+        if (priv == 3 || !m_on) {
+            if (pmp_allowed(addr, len, acc, priv)) return RV_EOK;
+            break;
+        }
+
+        uint32_t vpn = addr >> RV_PAGE_SHIFT;
+        tlb_entry &e = m_tlb[vpn & (RV32_TLB_SIZE - 1)];
+        if (e.vpn != vpn || (e.asid != m_asid && !(e.pte & PTE_G)) || !allowed(e.pte, acc, priv)) {
+            /* miss, or a store to a clean page, which sets D */
+            err = walk(addr, acc, priv, e);
+            if (err != RV_EOK) break;
+        }
+        paddr = (e.ppn << RV_PAGE_SHIFT) | (addr & (RV_PAGE_SIZE - 1));
+        if ((e.pmp & (1U << acc)) || pmp_allowed(paddr, len, acc, priv)) return RV_EOK;
+        err = RV_EACCESS;
+    }while(0);
+    m_fault_addr = addr;
+    m_fault_acc  = acc;
+    m_fault      = err;
+    return err;
+}
+
+/**
+ * @brief Walk the page table of the current context, and fill e on success
+ */
+rv_err RV32Mmu::walk(uint32_t addr, rv_access acc, uint8_t priv, tlb_entry &e)
+{
+    uint32_t vpn[2] = { (addr >> 12) & 0x3ff, addr >> 22 };
+    uint64_t table  = (uint64_t)m_root << RV_PAGE_SHIFT;
+    uint32_t pte    = 0;
+    uint32_t pte_addr;
+    int level;
+
+    for (level = 1; ; level--) {
+        /* page tables above 4 GiB are not reachable by RV32 physical accesses */
+        if (table >> 32) return RV_EACCESS;
+        pte_addr = table + vpn[level] * 4;
+        if (!pmp_allowed(pte_addr, 4, RV_ACC_R, priv)) return RV_EACCESS;
+        if (mem_read_pv<uint32_t, uint32_t, rv32_mem_infos>(pte_addr, pte, *m_mems) != RV_EOK) return RV_EACCESS;
+        if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W))) return RV_EPAGE;
+        if (pte & (PTE_R | PTE_X)) break;
+        if (level == 0) return RV_EPAGE;
+        table = (uint64_t)(pte >> 10) << RV_PAGE_SHIFT;
+    }
+
+    /* permissions without D, A and D are set below */
+    uint8_t flags = (pte & 0xff) | PTE_D;
+    if (!allowed(flags, acc, priv)) return RV_EPAGE;
+
+    uint32_t ppn = pte >> 10;
+    if (level == 1) {
+        /* misaligned megapage */
+        if (ppn & 0x3ff) return RV_EPAGE;
+        ppn |= vpn[0];
+    }
+    if (ppn >> 20) return RV_EACCESS;
+
+    uint32_t set = PTE_A | (acc == RV_ACC_W ? PTE_D : 0);
+    if ((pte & set) != set) {
+        pte |= set;
+        if (!pmp_allowed(pte_addr, 4, RV_ACC_W, priv)) return RV_EACCESS;
+        if (mem_write_pv<uint32_t, uint32_t, rv32_mem_infos>(pte_addr, pte, *m_mems) != RV_EOK) return RV_EACCESS;
+    }
+
+    e.vpn  = addr >> RV_PAGE_SHIFT;
+    e.ppn  = ppn;
+    e.asid = m_asid;
+    e.pte  = pte & 0xff;
+    e.mega = (level == 1);
+    e.pmp  = pmp_perm(ppn) & ~PMP_PARTIAL;
+    m_mega = m_mega || e.mega;
+    return RV_EOK;
+}
+
+void RV32Mmu::fence(const rv_sfence<uint32_t> &fence)
+{
+    if (!fence.has_addr && !fence.has_asid) {
+        flush();
+        return;
+    }
+
+    /* a global mapping is only flushed when no address space is given */
+    auto match = [&](const tlb_entry &e) {
+        return !fence.has_asid || (!(e.pte & PTE_G) && e.asid == (fence.asid & 0x1ff));
+    };
+
+    if (!fence.has_addr) {
+        for (auto &e:m_tlb) {
+            if (match(e)) e.vpn = UINT32_MAX;
+        }
+        return;
+    }
+
+    uint32_t vpn = fence.addr >> RV_PAGE_SHIFT;
+    tlb_entry &e = m_tlb[vpn & (RV32_TLB_SIZE - 1)];
+    if (e.vpn == vpn && match(e)) e.vpn = UINT32_MAX;
+    if (!m_mega) return;
+
+    /* other 4 KiB entries of a megapage covering addr */
+    for (auto &it:m_tlb) {
+        if (it.vpn != UINT32_MAX && it.mega && (it.vpn >> 10) == (vpn >> 10) && match(it)) it.vpn = UINT32_MAX;
+    }
+}
+
+void RV32Mmu::flush()
+{
+    for (auto &e:m_tlb) {
+        e.vpn = UINT32_MAX;
+    }
+    m_mega = false;
+}
+
+rv_err RV32Mmu::fault(uint32_t &addr, rv_access &acc)
+{
+    rv_err err = m_fault;
+    addr    = m_fault_addr;
+    acc     = m_fault_acc;
+    m_fault = RV_EOK;
+    return err;
+}
+
+}
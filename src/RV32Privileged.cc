@@ -1,5 +1,23 @@
 #include "ZoraGA/RV32Privileged.h"
 
+#define LOGI(fmt, ...) if (m_log) m_log->I(fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) if (m_log) m_log->E(fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) if (m_log) m_log->W(fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) if (m_log) m_log->D(fmt, ##__VA_ARGS__)
+#define LOGV(fmt, ...) if (m_log) m_log->V(fmt, ##__VA_ARGS__)
+#define LOGINST(fmt, ...) if (m_log) m_log->inst(fmt, ##__VA_ARGS__)
+#define LOGREGS(fmt, ...) if (m_log) m_log->regs(fmt, ##__VA_ARGS__)
+
+#define MSTATUS_SIE  (1U << 1)
+#define MSTATUS_MIE  (1U << 3)
+#define MSTATUS_SPIE (1U << 5)
+#define MSTATUS_MPIE (1U << 7)
+#define MSTATUS_SPP  (1U << 8)
+#define MSTATUS_MPP  (3U << 11)
+#define MSTATUS_MPRV (1U << 17)
+#define MSTATUS_TVM  (1U << 20)
+#define MSTATUS_TSR  (1U << 22)
+
 namespace ZoraGA::RVVM::RV32
 {
 
@@ -7,7 +25,6 @@ rv_err RV32Privileged::isValid(rv32_inst_fmt inst)
 {
     rv_err err = RV_EUNDEF;
     bool opcode = ( op_aa_match(inst) && op_bbb_match(inst) && op_cc_match(inst) );
-    bool ok = true;
     if (!opcode) return err;
     do{
         if (inst.R.funct3 == 0b000) {
@@ -16,31 +33,33 @@ rv_err RV32Privileged::isValid(rv32_inst_fmt inst)
             switch(inst.R.funct7) {
                 case 0b0001000:
                     if (!m_smode && inst.R.rs2 != 0b00101) {
-                        // ok = false;
                         break;
                     }
+                    err = RV_EOK;
+                    break;
                 case 0b0011000:
                     err = RV_EOK;
                     break;
                 default:
                     break;
             }
-            if (err == RV_EOK || !ok) break;
+            if (err == RV_EOK) break;
 
-            /* S-Mode */
+            /* S-Mode, SFENCE.VMA/SINVAL.VMA/SFENCE.W.INVAL/SFENCE.INVAL.IR */
             if (m_smode) {
                 switch(inst.R.funct7) {
-                    case 0b0010001:
-                    case 0b0110001:
-                    case 0b0010011:
-                    case 0b0110011:
+                    case 0b0001001:
+                    case 0b0001011:
                         err = RV_EOK;
                         break;
+                    case 0b0001100:
+                        if (inst.R.rs2 <= 1) err = RV_EOK;
+                        break;
                     default:
                         break;
                 }
             }
-            if (err == RV_EOK || !ok) break;
+            if (err == RV_EOK) break;
 
             //TODO Hypervisor
         }
@@ -49,7 +68,40 @@ rv_err RV32Privileged::isValid(rv32_inst_fmt inst)
 }
 
 rv_err RV32Privileged::exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
-{}
+{
+    rv_err err = RV_EUNDEF;
+    do{
+        if (inst.R.funct3 != 0b000) break;
+        switch(inst.R.funct7) {
+            case 0b0001001:
+                err = sfence_vma(inst, regs, mem_infos);
+                break;
+            case 0b0001011:
+                err = sinval_vma(inst, regs, mem_infos);
+                break;
+            case 0b0001100:
+                if (inst.R.rs2 == 0) {
+                    err = sfence_w_inval(inst, regs, mem_infos);
+                } else {
+                    err = sfence_inval_ir(inst, regs, mem_infos);
+                }
+                break;
+            case 0b0001000:
+                if (inst.R.rs2 == 0b00101) {
+                    err = wfi(inst, regs, mem_infos);
+                } else {
+                    err = sret(inst, regs, mem_infos);
+                }
+                break;
+            case 0b0011000:
+                err = mret(inst, regs, mem_infos);
+                break;
+            default:
+                break;
+        }
+    }while(0);
+    return err;
+}
 
 rv_err RV32Privileged::set_log(rvlog *log)
 {
@@ -127,7 +179,27 @@ rv_err RV32Privileged::regist(rv32_regs &regs, std::vector<std::string> &isas)
         regs.ctl->csrs[rv_csr_addr(i)] = 0;
     }
 
-    /* S-Mode CSR initialize */
+    /* U-Mode, and MPP reads as M-Mode if it's the only mode */
+    if (m_smode || m_umode) {
+        regs.ctl->csrs[rv_csr_addr(CSR_misa)]       = 0x40000000 | (1U << 20) | (m_smode ? (1U << 18) : 0);
+    } else {
+        regs.ctl->csrs[rv_csr_addr(CSR_mstatus)]    = MSTATUS_MPP;
+    }
+
+    /* S-Mode CSR initialize, sstatus/sie/sip are views of the M-Mode ones */
+    if (m_smode) {
+        regs.ctl->csrs[rv_csr_addr(CSR_sstatus)]    = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_sie)]        = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_stvec)]      = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_scounteren)] = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_senvcfg)]    = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_sscratch)]   = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_sepc)]       = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_scause)]     = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_stval)]      = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_sip)]        = 0;
+        regs.ctl->csrs[rv_csr_addr(CSR_satp)]       = 0;
+    }
 
     /* Hypervisor CSR initialize */
     return RV_EOK;
@@ -138,6 +210,130 @@ void RV32Privileged::s_mode(bool ena)
     m_smode = ena;
 }
 
+void RV32Privileged::u_mode(bool ena)
+{
+    m_umode = ena;
+}
+
+uint32_t RV32Privileged::csr_get(rv32_regs &regs, uint16_t addr)
+{
+    auto it = regs.ctl->csrs.find(rv_csr_addr(addr));
+    return (it == regs.ctl->csrs.end()) ? 0 : it->second.to_ulong();
+}
+
+void RV32Privileged::csr_set(rv32_regs &regs, uint16_t addr, uint32_t val)
+{
+    regs.ctl->csrs[rv_csr_addr(addr)] = val;
+}
+
+/**
+ * @brief Return from M-Mode to the mode in mstatus.MPP, the VM recomputes the mode state
+ */
+rv_err RV32Privileged::mret(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    if (regs.ctl->priv != 3) {
+        LOGINST("mret: illegal below M-Mode");
+        return RV_EININST;
+    }
+    uint32_t mstatus = csr_get(regs, CSR_mstatus);
+    uint8_t  priv    = (mstatus & MSTATUS_MPP) >> 11;
+    /* MPP holds a supported mode only, and becomes the least privileged one */
+    uint8_t  least   = (m_smode || m_umode) ? 0 : 3;
+    if (priv == 2 || (priv == 1 && !m_smode) || least == 3) priv = (priv == 3) ? 3 : least;
+
+    mstatus = (mstatus & ~MSTATUS_MIE) | ((mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0);
+    mstatus |= MSTATUS_MPIE;
+    mstatus = (mstatus & ~MSTATUS_MPP) | ((uint32_t)least << 11);
+    if (priv != 3) mstatus &= ~MSTATUS_MPRV;
+    csr_set(regs, CSR_mstatus, mstatus);
+
+    regs.ctl->priv        = priv;
+    regs.ctl->csr_changed = true;
+    regs.ctl->pc_changed  = true;
+    regs.reg->pc          = csr_get(regs, CSR_mepc) & ~1U;
+    LOGINST("mret: to mode %u, pc 0x%08x", priv, regs.reg->pc);
+    return RV_EOK;
+}
+
+/**
+ * @brief Return from S-Mode to the mode in sstatus.SPP, illegal in S-Mode with mstatus.TSR
+ */
+rv_err RV32Privileged::sret(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    uint32_t mstatus = csr_get(regs, CSR_mstatus);
+    if (regs.ctl->priv == 0) {
+        LOGINST("sret: illegal in U-Mode");
+        return RV_EININST;
+    }
+    if (regs.ctl->priv == 1 && (mstatus & MSTATUS_TSR)) {
+        LOGINST("sret: trapped by mstatus.TSR");
+        return RV_EININST;
+    }
+    uint8_t  priv    = (mstatus & MSTATUS_SPP) ? 1 : 0;
+
+    mstatus = (mstatus & ~MSTATUS_SIE) | ((mstatus & MSTATUS_SPIE) ? MSTATUS_SIE : 0);
+    mstatus |= MSTATUS_SPIE;
+    mstatus &= ~(MSTATUS_SPP | MSTATUS_MPRV);
+    csr_set(regs, CSR_mstatus, mstatus);
+
+    regs.ctl->priv        = priv;
+    regs.ctl->csr_changed = true;
+    regs.ctl->pc_changed  = true;
+    regs.reg->pc          = csr_get(regs, CSR_sepc) & ~1U;
+    LOGINST("sret: to mode %u, pc 0x%08x", priv, regs.reg->pc);
+    return RV_EOK;
+}
+
+/* no interrupt source stalls the hart, wfi is a hint */
+rv_err RV32Privileged::wfi(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    LOGINST("wfi");
+    return RV_EOK;
+}
+
+/**
+ * @brief Request the VM to flush its TLB, the whole TLB, one page and/or one address space,
+ * illegal in S-Mode with mstatus.TVM
+ */
+rv_err RV32Privileged::sfence_vma(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    if (regs.ctl->priv == 0) {
+        LOGINST("sfence.vma: illegal in U-Mode");
+        return RV_EININST;
+    }
+    if (regs.ctl->priv == 1 && (csr_get(regs, CSR_mstatus) & MSTATUS_TVM)) {
+        LOGINST("sfence.vma: trapped by mstatus.TVM");
+        return RV_EININST;
+    }
+    regs.ctl->sfence.pending  = true;
+    regs.ctl->sfence.has_addr = (inst.R.rs1 != 0);
+    regs.ctl->sfence.has_asid = (inst.R.rs2 != 0);
+    regs.ctl->sfence.addr     = regs.reg->x[inst.R.rs1];
+    regs.ctl->sfence.asid     = regs.reg->x[inst.R.rs2];
+    LOGINST("sfence.vma: x%u(0x%08x), x%u(0x%08x)", inst.R.rs1, regs.reg->x[inst.R.rs1], inst.R.rs2, regs.reg->x[inst.R.rs2]);
+    return RV_EOK;
+}
+
+rv_err RV32Privileged::sinval_vma(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    return sfence_vma(inst, regs, mem_infos);
+}
+
+/* invalidations are done at sinval.vma, there is nothing to order */
+rv_err RV32Privileged::sfence_w_inval(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    if (regs.ctl->priv == 0) return RV_EININST;
+    LOGINST("sfence.w.inval");
+    return RV_EOK;
+}
+
+rv_err RV32Privileged::sfence_inval_ir(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    if (regs.ctl->priv == 0) return RV_EININST;
+    LOGINST("sfence.inval.ir");
+    return RV_EOK;
+}
+
 bool RV32Privileged::op_cc_match(rv32_inst_fmt inst)
 {
     return inst.cc == 0b11;
@@ -0,0 +1,298 @@
+#include "ZoraGA/RV32Sbi.h"
+#include <algorithm>
+
+/* extension IDs */
+#define SBI_EXT_LEGACY_END 0x0F
+#define SBI_EXT_BASE       0x10
+#define SBI_EXT_TIME       0x54494D45
+#define SBI_EXT_IPI        0x735049
+#define SBI_EXT_RFENCE     0x52464E43
+#define SBI_EXT_SRST       0x53525354
+#define SBI_EXT_DBCN       0x4442434E
+
+/* legacy extension IDs, the function is the extension */
+#define SBI_LEGACY_SET_TIMER           0x00
+#define SBI_LEGACY_CONSOLE_PUTCHAR     0x01
+#define SBI_LEGACY_CONSOLE_GETCHAR     0x02
+#define SBI_LEGACY_CLEAR_IPI           0x03
+#define SBI_LEGACY_SEND_IPI            0x04
+#define SBI_LEGACY_REMOTE_FENCE_I      0x05
+#define SBI_LEGACY_REMOTE_SFENCE_VMA   0x06
+#define SBI_LEGACY_REMOTE_SFENCE_ASID  0x07
+#define SBI_LEGACY_SHUTDOWN            0x08
+
+#define SBI_SUCCESS            0
+#define SBI_ERR_FAILED        -1
+#define SBI_ERR_NOT_SUPPORTED -2
+#define SBI_ERR_INVALID_PARAM -3
+
+/* SBI 2.0 */
+#define SBI_SPEC_VERSION (2U << 24)
+/* not a registered implementation ID */
+#define SBI_IMPL_ID      0x5A47
+#define SBI_IMPL_VERSION 1
+
+/* bounce buffer of console writes, the guest length is not allocated */
+#define SBI_DBCN_CHUNK 256
+
+#define MIP_SSIP (1U << 1)
+#define MIP_STIP (1U << 5)
+#define MIP_SEIP (1U << 9)
+
+/* misaligned fetch, fetch access, illegal, breakpoint, misaligned load, load access,
+   misaligned store, store access, ecall from U-Mode, fetch/load/store page faults */
+#define SBI_MEDELEG 0xB1FF
+
+namespace ZoraGA::RVVM::RV32
+{
+
+void RV32Sbi::set_console(FILE *out)
+{
+    m_out = out;
+}
+
+rv_err RV32Sbi::regist(rv32_regs &regs)
+{
+    if (regs.ctl->csrs.find(rv_csr_addr(CSR_stvec)) == regs.ctl->csrs.end()) return RV_EMISSING;
+
+    csr_set(regs, CSR_medeleg, SBI_MEDELEG);
+    csr_set(regs, CSR_mideleg, MIP_SSIP | MIP_STIP | MIP_SEIP);
+    csr_set(regs, CSR_mcounteren, 0x7);
+
+    /* PMP entry 0, NAPOT RWX of the whole space */
+    csr_set(regs, CSR_pmpaddr0, UINT32_MAX);
+    csr_set(regs, CSR_pmpcfg0, (csr_get(regs, CSR_pmpcfg0) & ~0xffU) | 0x1f);
+
+    /* no timer until set_timer */
+    csr_set(regs, CSR_stimecmp, UINT32_MAX);
+    csr_set(regs, CSR_stimecmph, UINT32_MAX);
+
+    regs.ctl->csr_changed = true;
+    regs.ctl->pmp_changed = true;
+    return RV_EOK;
+}
+
+bool RV32Sbi::call(rv32_regs &regs, rv32_mem_infos &mems)
+{
+    uint32_t *a  = &regs.reg->x[10];
+    uint32_t eid = regs.reg->x[17];
+    uint32_t fid = regs.reg->x[16];
+    uint32_t val = 0;
+    int32_t  err = SBI_ERR_NOT_SUPPORTED;
+
+    /* legacy calls return the value in a0 only */
+    if (eid <= SBI_EXT_LEGACY_END) {
+        int32_t ret = SBI_SUCCESS;
+        switch(eid) {
+            case SBI_LEGACY_SET_TIMER:
+                ret = timer(a[0], a[1], regs);
+                break;
+            case SBI_LEGACY_CONSOLE_PUTCHAR:
+                if (m_out) fputc(a[0], m_out);
+                break;
+            case SBI_LEGACY_CONSOLE_GETCHAR:
+                ret = -1;
+                break;
+            case SBI_LEGACY_CLEAR_IPI:
+                csr_set(regs, CSR_mip, csr_get(regs, CSR_mip) & ~MIP_SSIP);
+                regs.ctl->csr_changed = true;
+                break;
+            case SBI_LEGACY_SEND_IPI:
+                /* the mask is in S-Mode memory, the only hart is this one */
+                ret = ipi(1, 0, regs);
+                break;
+            case SBI_LEGACY_REMOTE_FENCE_I:
+                break;
+            case SBI_LEGACY_REMOTE_SFENCE_VMA:
+            case SBI_LEGACY_REMOTE_SFENCE_ASID: {
+                uint32_t args[5] = {1, 0, a[1], a[2], a[3]};
+                ret = rfence(eid == SBI_LEGACY_REMOTE_SFENCE_VMA ? 1 : 2, args, regs);
+                break;
+            }
+            case SBI_LEGACY_SHUTDOWN:
+                return false;
+            default:
+                ret = SBI_ERR_NOT_SUPPORTED;
+                break;
+        }
+        a[0] = ret;
+        return true;
+    }
+
+    switch(eid) {
+        case SBI_EXT_BASE:
+            err = base(fid, a, val, regs);
+            break;
+        case SBI_EXT_TIME:
+            if (fid == 0) err = timer(a[0], a[1], regs);
+            break;
+        case SBI_EXT_IPI:
+            if (fid == 0) err = ipi(a[0], a[1], regs);
+            break;
+        case SBI_EXT_RFENCE:
+            err = rfence(fid, a, regs);
+            break;
+        case SBI_EXT_SRST:
+            if (fid != 0) break;
+            /* shutdown, cold reboot and warm reboot all stop the VM */
+            if (a[0] <= 2) return false;
+            err = SBI_ERR_INVALID_PARAM;
+            break;
+        case SBI_EXT_DBCN:
+            err = dbcn(fid, a, val, mems);
+            break;
+        default:
+            break;
+    }
+    a[0] = err;
+    if (err == SBI_SUCCESS) a[1] = val;
+    return true;
+}
+
+int32_t RV32Sbi::base(uint32_t fid, uint32_t *a, uint32_t &val, rv32_regs &regs)
+{
+    switch(fid) {
+        case 0:
+            val = SBI_SPEC_VERSION;
+            break;
+        case 1:
+            val = SBI_IMPL_ID;
+            break;
+        case 2:
+            val = SBI_IMPL_VERSION;
+            break;
+        case 3:
+            switch(a[0]) {
+                case SBI_EXT_BASE:
+                case SBI_EXT_TIME:
+                case SBI_EXT_IPI:
+                case SBI_EXT_RFENCE:
+                case SBI_EXT_SRST:
+                case SBI_EXT_DBCN:
+                    val = 1;
+                    break;
+                default:
+                    val = (a[0] <= SBI_LEGACY_SHUTDOWN) ? 1 : 0;
+                    break;
+            }
+            break;
+        case 4:
+            val = csr_get(regs, CSR_mvendorid);
+            break;
+        case 5:
+            val = csr_get(regs, CSR_marchid);
+            break;
+        case 6:
+            val = csr_get(regs, CSR_mimpid);
+            break;
+        default:
+            return SBI_ERR_NOT_SUPPORTED;
+    }
+    return SBI_SUCCESS;
+}
+
+/**
+ * @brief Program the next timer event, sip.STIP follows time >= stimecmp in the VM
+ */
+int32_t RV32Sbi::timer(uint32_t lo, uint32_t hi, rv32_regs &regs)
+{
+    csr_set(regs, CSR_stimecmp, lo);
+    csr_set(regs, CSR_stimecmph, hi);
+    regs.ctl->csr_changed = true;
+    return SBI_SUCCESS;
+}
+
+int32_t RV32Sbi::ipi(uint32_t mask, uint32_t mask_base, rv32_regs &regs)
+{
+    bool self = false;
+    int32_t err = hart_mask(mask, mask_base, self);
+    if (err != SBI_SUCCESS || !self) return err;
+    csr_set(regs, CSR_mip, csr_get(regs, CSR_mip) | MIP_SSIP);
+    regs.ctl->csr_changed = true;
+    return SBI_SUCCESS;
+}
+
+/**
+ * @brief Remote fences, a0/a1 hart mask, a2/a3 start and size, a4 ASID
+ *
+ * A range within one page flushes the page, others flush the address space.
+ */
+int32_t RV32Sbi::rfence(uint32_t fid, uint32_t *a, rv32_regs &regs)
+{
+    bool self = false;
+    if (fid > 2) return SBI_ERR_NOT_SUPPORTED;
+    int32_t err = hart_mask(a[0], a[1], self);
+    if (err != SBI_SUCCESS || !self || fid == 0) return err;
+
+    rv_sfence<uint32_t> &fence = regs.ctl->sfence;
+    uint32_t start = a[2], size = a[3];
+    fence.pending  = true;
+    fence.has_addr = (size != 0 && size <= RV_PAGE_SIZE && (start & (RV_PAGE_SIZE - 1)) + size <= RV_PAGE_SIZE);
+    fence.has_asid = (fid == 2);
+    fence.addr     = start;
+    fence.asid     = (fid == 2) ? a[4] : 0;
+    return SBI_SUCCESS;
+}
+
+/**
+ * @brief Debug console, a0 byte count or the byte, a1/a2 physical buffer address
+ */
+int32_t RV32Sbi::dbcn(uint32_t fid, uint32_t *a, uint32_t &val, rv32_mem_infos &mems)
+{
+    switch(fid) {
+        case 0: {
+            if (a[2] != 0 || (uint64_t)a[1] + a[0] > 0x100000000ULL) return SBI_ERR_INVALID_PARAM;
+            uint8_t  buf[SBI_DBCN_CHUNK];
+            uint32_t done = 0;
+            while (done < a[0]) {
+                uint32_t n = std::min<uint32_t>(a[0] - done, sizeof(buf));
+                if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(a[1] + done, buf, n, mems) != RV_EOK) break;
+                if (m_out) fwrite(buf, 1, n, m_out);
+                done += n;
+            }
+            /* the bytes written before a bad address are reported */
+            if (done == 0 && a[0] != 0) return SBI_ERR_INVALID_PARAM;
+            val = done;
+            break;
+        }
+        case 1:
+            /* no input */
+            val = 0;
+            break;
+        case 2:
+            if (m_out) fputc(a[0] & 0xff, m_out);
+            break;
+        default:
+            return SBI_ERR_NOT_SUPPORTED;
+    }
+    return SBI_SUCCESS;
+}
+
+/**
+ * @brief Check a hart mask against the single hart 0
+ *
+ * @param self Output, hart 0 is in the mask
+ */
+int32_t RV32Sbi::hart_mask(uint32_t mask, uint32_t mask_base, bool &self)
+{
+    if (mask_base == UINT32_MAX) {
+        self = true;
+        return SBI_SUCCESS;
+    }
+    if (mask_base != 0 ? (mask != 0) : (mask & ~1U) != 0) return SBI_ERR_INVALID_PARAM;
+    self = (mask_base == 0) && (mask & 1);
+    return SBI_SUCCESS;
+}
+
+uint32_t RV32Sbi::csr_get(rv32_regs &regs, uint16_t addr)
+{
+    auto it = regs.ctl->csrs.find(rv_csr_addr(addr));
+    return (it == regs.ctl->csrs.end()) ? 0 : it->second.to_ulong();
+}
+
+void RV32Sbi::csr_set(rv32_regs &regs, uint16_t addr, uint32_t val)
+{
+    regs.ctl->csrs[rv_csr_addr(addr)] = val;
+}
+
+}
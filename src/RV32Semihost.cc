@@ -0,0 +1,311 @@
+#include "ZoraGA/RV32Semihost.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* operations */
+#define SYS_OPEN          0x01
+#define SYS_CLOSE         0x02
+#define SYS_WRITEC        0x03
+#define SYS_WRITE0        0x04
+#define SYS_WRITE         0x05
+#define SYS_READ          0x06
+#define SYS_READC         0x07
+#define SYS_ISERROR       0x08
+#define SYS_ISTTY         0x09
+#define SYS_SEEK          0x0A
+#define SYS_FLEN          0x0C
+#define SYS_REMOVE        0x0E
+#define SYS_CLOCK         0x10
+#define SYS_TIME          0x11
+#define SYS_ERRNO         0x13
+#define SYS_EXIT          0x18
+#define SYS_EXIT_EXTENDED 0x20
+
+#define ADP_Stopped_ApplicationExit 0x20026
+
+/* host fds of closed handles and of the console */
+#define FD_CLOSED  -1
+#define FD_CON_IN  -2
+#define FD_CON_OUT -3
+
+#define NAME_MAX_LEN 4096
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief Host access to a guest buffer, which must lie in one memory
+ */
+static bool buf_check(uint32_t addr, uint32_t len, rv32_mem_infos &mems)
+{
+    for (auto &it:mems) {
+        if (mem_is_range<uint32_t, rv32_mem_info>(addr, it)) {
+            return (uint64_t)addr + len <= (uint64_t)it.addr + it.len;
+        }
+    }
+    return false;
+}
+
+RV32Semihost::RV32Semihost()
+{
+    m_start = std::chrono::steady_clock::now();
+}
+
+RV32Semihost::~RV32Semihost()
+{
+    for (auto fd:m_files) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void RV32Semihost::set_console(FILE *in, FILE *out)
+{
+    m_in  = in;
+    m_out = out;
+}
+
+bool RV32Semihost::call(rv32_regs &regs, rv32_mem_infos &mems)
+{
+    uint32_t op  = regs.reg->x[10];
+    uint32_t ptr = regs.reg->x[11];
+    uint32_t arg[4] = {0};
+    int32_t  ret = -1;
+
+    switch(op) {
+        case SYS_OPEN:
+            if (args(ptr, arg, 3, mems)) ret = sys_open(arg, mems);
+            break;
+        case SYS_CLOSE:
+            if (args(ptr, arg, 1, mems)) ret = sys_close(arg[0]);
+            break;
+        case SYS_WRITEC: {
+            uint8_t ch;
+            if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(ptr, &ch, 1, mems) != RV_EOK) break;
+            if (m_out) fputc(ch, m_out);
+            ret = 0;
+            break;
+        }
+        case SYS_WRITE0: {
+            std::string str;
+            char ch;
+            while (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(ptr++, &ch, 1, mems) == RV_EOK && ch != 0) {
+                str.push_back(ch);
+            }
+            if (m_out) fwrite(str.data(), 1, str.size(), m_out);
+            ret = 0;
+            break;
+        }
+        case SYS_WRITE:
+            if (args(ptr, arg, 3, mems)) ret = sys_write(arg, mems);
+            break;
+        case SYS_READ:
+            if (args(ptr, arg, 3, mems)) ret = sys_read(arg, mems);
+            break;
+        case SYS_READC:
+            ret = m_in ? fgetc(m_in) : EOF;
+            break;
+        case SYS_ISERROR:
+            if (args(ptr, arg, 1, mems)) ret = ((int32_t)arg[0] < 0) ? 1 : 0;
+            break;
+        case SYS_ISTTY:
+            if (args(ptr, arg, 1, mems)) {
+                int fd = host_fd(arg[0]);
+                ret = (fd == FD_CON_IN || fd == FD_CON_OUT || (fd >= 0 && isatty(fd))) ? 1 : 0;
+            }
+            break;
+        case SYS_SEEK:
+            if (args(ptr, arg, 2, mems)) ret = sys_seek(arg);
+            break;
+        case SYS_FLEN:
+            if (args(ptr, arg, 1, mems)) ret = sys_flen(arg[0]);
+            break;
+        case SYS_REMOVE: {
+            if (!args(ptr, arg, 2, mems) || arg[1] > NAME_MAX_LEN) break;
+            std::string name(arg[1], 0);
+            if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(arg[0], name.data(), arg[1], mems) != RV_EOK) break;
+            ret = unlink(name.c_str());
+            if (ret != 0) m_errno = errno;
+            break;
+        }
+        case SYS_CLOCK: {
+            auto cs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count() / 10;
+            ret = (int32_t)cs;
+            break;
+        }
+        case SYS_TIME:
+            ret = (int32_t)time(nullptr);
+            break;
+        case SYS_ERRNO:
+            ret = m_errno;
+            break;
+        case SYS_EXIT:
+            /* on 32-bit targets the parameter is the reason itself */
+            sys_exit(ptr, 0);
+            return false;
+        case SYS_EXIT_EXTENDED:
+            if (!args(ptr, arg, 2, mems)) break;
+            sys_exit(arg[0], arg[1]);
+            return false;
+        default:
+            break;
+    }
+    regs.reg->x[10] = ret;
+    return true;
+}
+
+int RV32Semihost::exit_code()
+{
+    return m_exit;
+}
+
+/**
+ * @brief name, mode, name length; mode is an fopen() mode index, "r" "rb" "r+" "r+b" "w" ... "a+b"
+ */
+int32_t RV32Semihost::sys_open(uint32_t *arg, rv32_mem_infos &mems)
+{
+    static const int flags[] = {
+        O_RDONLY, O_RDWR, O_WRONLY | O_CREAT | O_TRUNC, O_RDWR | O_CREAT | O_TRUNC,
+        O_WRONLY | O_CREAT | O_APPEND, O_RDWR | O_CREAT | O_APPEND,
+    };
+    if (arg[1] > 11 || arg[2] > NAME_MAX_LEN) return -1;
+    std::string name(arg[2], 0);
+    if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(arg[0], name.data(), arg[2], mems) != RV_EOK) return -1;
+
+    int fd;
+    if (name == ":tt") {
+        fd = (arg[1] < 4) ? FD_CON_IN : FD_CON_OUT;
+    } else {
+        fd = open(name.c_str(), flags[arg[1] / 2] | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            m_errno = errno;
+            return -1;
+        }
+    }
+    for (size_t i=0; i<m_files.size(); i++) {
+        if (m_files[i] == FD_CLOSED) {
+            m_files[i] = fd;
+            return i + 1;
+        }
+    }
+    m_files.push_back(fd);
+    return m_files.size();
+}
+
+int32_t RV32Semihost::sys_close(uint32_t handle)
+{
+    int fd = host_fd(handle);
+    if (fd == FD_CLOSED) return -1;
+    m_files[handle - 1] = FD_CLOSED;
+    if (fd >= 0 && close(fd) != 0) {
+        m_errno = errno;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief handle, buffer, length; returns the number of bytes not written
+ */
+int32_t RV32Semihost::sys_write(uint32_t *arg, rv32_mem_infos &mems)
+{
+    int fd = host_fd(arg[0]);
+    if (fd == FD_CLOSED || fd == FD_CON_IN || !buf_check(arg[1], arg[2], mems)) return arg[2];
+    std::vector<uint8_t> buf(arg[2]);
+    if (mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(arg[1], buf.data(), arg[2], mems) != RV_EOK) return arg[2];
+
+    if (fd == FD_CON_OUT) {
+        if (m_out == nullptr) return 0;
+        return arg[2] - fwrite(buf.data(), 1, buf.size(), m_out);
+    }
+    size_t done = 0;
+    while (done < buf.size()) {
+        ssize_t n = write(fd, buf.data() + done, buf.size() - done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            m_errno = errno;
+            break;
+        }
+        done += n;
+    }
+    return arg[2] - done;
+}
+
+/**
+ * @brief handle, buffer, length; returns the number of bytes not read, length at end of file
+ */
+int32_t RV32Semihost::sys_read(uint32_t *arg, rv32_mem_infos &mems)
+{
+    int fd = host_fd(arg[0]);
+    if (fd == FD_CLOSED || fd == FD_CON_OUT || !buf_check(arg[1], arg[2], mems)) return arg[2];
+    std::vector<uint8_t> buf(arg[2]);
+
+    size_t done = 0;
+    if (fd == FD_CON_IN) {
+        /* a line at most, as a terminal would give */
+        while (m_in && done < buf.size()) {
+            int ch = fgetc(m_in);
+            if (ch == EOF) break;
+            buf[done++] = ch;
+            if (ch == '\n') break;
+        }
+    } else {
+        while (done < buf.size()) {
+            ssize_t n = read(fd, buf.data() + done, buf.size() - done);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) m_errno = errno;
+                break;
+            }
+            done += n;
+        }
+    }
+    if (done && mem_write_region<uint32_t, rv32_mem_info, rv32_mem_infos>(arg[1], buf.data(), done, mems) != RV_EOK) return arg[2];
+    return arg[2] - done;
+}
+
+int32_t RV32Semihost::sys_seek(uint32_t *arg)
+{
+    int fd = host_fd(arg[0]);
+    if (fd < 0) return -1;
+    if (lseek(fd, arg[1], SEEK_SET) < 0) {
+        m_errno = errno;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t RV32Semihost::sys_flen(uint32_t handle)
+{
+    struct stat st;
+    int fd = host_fd(handle);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0) {
+        m_errno = errno;
+        return -1;
+    }
+    return (int32_t)st.st_size;
+}
+
+/**
+ * @brief Only ADP_Stopped_ApplicationExit is a normal exit, with code as the status
+ */
+void RV32Semihost::sys_exit(uint32_t reason, uint32_t code)
+{
+    m_exit = (reason == ADP_Stopped_ApplicationExit) ? (int)code : 1;
+}
+
+bool RV32Semihost::args(uint32_t addr, uint32_t *arg, uint32_t cnt, rv32_mem_infos &mems)
+{
+    return mem_read_region<uint32_t, rv32_mem_info, rv32_mem_infos>(addr, arg, cnt * 4, mems) == RV_EOK;
+}
+
+int RV32Semihost::host_fd(uint32_t handle)
+{
+    if (handle == 0 || handle > m_files.size()) return FD_CLOSED;
+    return m_files[handle - 1];
+}
+
+}
@@ -0,0 +1,315 @@
+#include "ZoraGA/RV32.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOGI(fmt, ...) if (m_log) m_log->I(fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) if (m_log) m_log->E(fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) if (m_log) m_log->W(fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) if (m_log) m_log->D(fmt, ##__VA_ARGS__)
+
+/* "RVVMSNAP" */
+#define RV32_SNAP_MAGIC   0x50414e534d565652ULL
+#define RV32_SNAP_VERSION 1
+#define RV32_SNAP_PAGE    4096ULL
+#define RV32_SNAP_ALIGN(x) (((x) + RV32_SNAP_PAGE - 1) & ~(RV32_SNAP_PAGE - 1))
+
+/**
+ * Snapshot file layout:
+ *
+ * ╔════════════════════════════════╗
+ * ║ snap_head                      ║
+ * ║ snap_csr  * csr_count          ║
+ * ║ snap_mem  * mem_count          ║
+ * ║ device states                  ║
+ * ╠════════════════════════════════╣ page aligned
+ * ║ memory image 0                 ║
+ * ╠════════════════════════════════╣ page aligned
+ * ║ memory image 1 ...             ║
+ * ╚════════════════════════════════╝
+ */
+
+namespace ZoraGA::RVVM::RV32
+{
+
+#pragma pack(push, 1)
+typedef struct snap_head
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t xlen;
+    uint32_t has_fp;
+    uint32_t csr_count;
+    uint32_t mem_count;
+    /* privilege mode, 0, 1 or 3 */
+    uint32_t priv;
+    uint32_t x[32];
+    uint32_t pc;
+    uint64_t fp[32];
+}snap_head;
+
+typedef struct snap_csr
+{
+    uint32_t addr;
+    uint32_t val;
+}snap_csr;
+
+typedef struct snap_mem
+{
+    uint32_t addr;
+    uint32_t len;
+    uint64_t image_off;
+    uint64_t image_len;
+    uint64_t state_off;
+    uint64_t state_len;
+}snap_mem;
+#pragma pack(pop)
+
+static bool snap_pwrite(int fd, const void *p, size_t len, uint64_t off)
+{
+    const uint8_t *d = (const uint8_t*)p;
+    while (len) {
+        ssize_t n = pwrite(fd, d, len, off);
+        if (n <= 0) return false;
+        d   += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+static bool snap_pread(int fd, void *p, size_t len, uint64_t off)
+{
+    uint8_t *d = (uint8_t*)p;
+    while (len) {
+        ssize_t n = pread(fd, d, len, off);
+        if (n <= 0) return false;
+        d   += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+static bool snap_in_file(uint64_t off, uint64_t len, uint64_t size)
+{
+    return len <= size && off <= size - len;
+}
+
+bool rv32::save(std::string path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    int fd = -1;
+    do{
+        if (m_started || m_running) break;
+        flat_sync();
+
+        snap_head head;
+        memset(&head, 0, sizeof(head));
+        head.magic     = RV32_SNAP_MAGIC;
+        head.version   = RV32_SNAP_VERSION;
+        head.xlen      = 32;
+        head.has_fp    = m_regs.fp ? 1 : 0;
+        head.csr_count = m_regs.ctl->csrs.size();
+        head.mem_count = m_mems.size();
+        memcpy(head.x, m_regs.reg->x, sizeof(head.x));
+        head.pc = m_regs.reg->pc;
+        head.priv = m_regs.ctl->priv;
+        if (m_regs.fp) memcpy(head.fp, m_regs.fp->u, sizeof(head.fp));
+
+        std::vector<snap_csr> csrs;
+        for (auto &it:m_regs.ctl->csrs) {
+            csrs.push_back(snap_csr{it.first.addr, (uint32_t)it.second.to_ulong()});
+        }
+
+        /* device states follow the tables, memory images follow the states */
+        std::vector<snap_mem> mems(m_mems.size());
+        std::vector<std::vector<uint8_t>> states(m_mems.size());
+        std::vector<void*> images(m_mems.size());
+        uint64_t off = sizeof(head) + csrs.size() * sizeof(snap_csr) + mems.size() * sizeof(snap_mem);
+        bool ok = true;
+        for (size_t i=0; i<m_mems.size() && ok; i++) {
+            ok = (m_mems[i].mem->save_state(states[i]) == RV_EOK);
+            mems[i].addr      = m_mems[i].addr;
+            mems[i].len       = m_mems[i].len;
+            mems[i].state_off = off;
+            mems[i].state_len = states[i].size();
+            off += states[i].size();
+        }
+        if (!ok) {
+            LOGE("snapshot: save device state failed");
+            break;
+        }
+        for (size_t i=0; i<m_mems.size(); i++) {
+            uint32_t len = 0;
+            images[i] = m_mems[i].mem->host(len);
+            off = RV32_SNAP_ALIGN(off);
+            mems[i].image_off = images[i] ? off : 0;
+            mems[i].image_len = images[i] ? len : 0;
+            off += mems[i].image_len;
+        }
+
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOGE("snapshot: open %s failed", path.c_str());
+            break;
+        }
+
+        off = 0;
+        ok  = snap_pwrite(fd, &head, sizeof(head), off);
+        off += sizeof(head);
+        ok  = ok && snap_pwrite(fd, csrs.data(), csrs.size() * sizeof(snap_csr), off);
+        off += csrs.size() * sizeof(snap_csr);
+        ok  = ok && snap_pwrite(fd, mems.data(), mems.size() * sizeof(snap_mem), off);
+        for (size_t i=0; i<m_mems.size() && ok; i++) {
+            ok = snap_pwrite(fd, states[i].data(), states[i].size(), mems[i].state_off);
+            if (ok && images[i]) {
+                ok = snap_pwrite(fd, images[i], mems[i].image_len, mems[i].image_off);
+            }
+        }
+        /* keep the file size page aligned, the last image is mapped as whole pages */
+        ok = ok && (ftruncate(fd, RV32_SNAP_ALIGN(lseek(fd, 0, SEEK_END))) == 0);
+        if (!ok) {
+            LOGE("snapshot: write %s failed", path.c_str());
+            break;
+        }
+        LOGI("snapshot: saved to %s", path.c_str());
+        ret = true;
+    }while(0);
+    if (fd >= 0) close(fd);
+    return ret;
+}
+
+bool rv32::restore(std::string path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ret = false;
+    int fd = -1;
+    do{
+        if (m_started || m_running) break;
+
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            LOGE("snapshot: open %s failed", path.c_str());
+            break;
+        }
+
+        snap_head head;
+        if (!snap_pread(fd, &head, sizeof(head), 0)) break;
+        if (head.magic != RV32_SNAP_MAGIC || head.version != RV32_SNAP_VERSION || head.xlen != 32) {
+            LOGE("snapshot: %s is not a rv32 snapshot", path.c_str());
+            break;
+        }
+        if (head.priv == 2 || head.priv > 3) {
+            LOGE("snapshot: %s has a bad privilege mode %u", path.c_str(), head.priv);
+            break;
+        }
+        if (head.mem_count != m_mems.size() || (head.has_fp && m_regs.fp == nullptr) || head.csr_count > 4096) {
+            LOGE("snapshot: VM layout mismatch");
+            break;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) break;
+
+        uint64_t off = sizeof(head);
+        std::vector<snap_csr> csrs(head.csr_count);
+        std::vector<snap_mem> mems(head.mem_count);
+        if (!snap_pread(fd, csrs.data(), csrs.size() * sizeof(snap_csr), off)) break;
+        off += csrs.size() * sizeof(snap_csr);
+        if (!snap_pread(fd, mems.data(), mems.size() * sizeof(snap_mem), off)) break;
+
+        bool ok = true;
+        for (size_t i=0; i<mems.size() && ok; i++) {
+            ok = (mems[i].addr == m_mems[i].addr && mems[i].len == m_mems[i].len);
+        }
+        if (!ok) {
+            LOGE("snapshot: VM memory layout mismatch");
+            break;
+        }
+
+        /**
+         * Everything is read and checked before the VM is touched, images that can't be
+         * mapped are read into buffers, so that a bad snapshot leaves the VM as it was.
+         * Only a failed map can't be undone, see below.
+         */
+        std::vector<std::vector<uint8_t>> states(mems.size()), olds(mems.size()), images(mems.size());
+        for (size_t i=0; i<mems.size() && ok; i++) {
+            ok = snap_in_file(mems[i].state_off, mems[i].state_len, st.st_size);
+            ok = ok && snap_in_file(mems[i].image_off, mems[i].image_len, st.st_size);
+            if (ok) states[i].resize(mems[i].state_len);
+            ok = ok && snap_pread(fd, states[i].data(), states[i].size(), mems[i].state_off);
+            ok = ok && (m_mems[i].mem->save_state(olds[i]) == RV_EOK);
+            if (!ok || mems[i].image_len == 0) continue;
+
+            uint32_t len = 0;
+            void *p = m_mems[i].mem->host(len);
+            ok = (p && len == mems[i].image_len && (mems[i].image_off & (RV32_SNAP_PAGE - 1)) == 0);
+            if (ok && !m_mems[i].mem->can_map_image()) {
+                images[i].resize(len);
+                ok = snap_pread(fd, images[i].data(), len, mems[i].image_off);
+            }
+        }
+        if (!ok) {
+            LOGE("snapshot: %s is truncated or doesn't match the VM memories", path.c_str());
+            break;
+        }
+
+        /* device states are put back on failure, images are mapped before the copies that can't fail */
+        size_t loaded = 0;
+        for (; loaded<mems.size() && ok; loaded++) {
+            ok = (m_mems[loaded].mem->load_state(states[loaded]) == RV_EOK);
+        }
+        if (!ok) {
+            for (size_t i=0; i<loaded; i++) m_mems[i].mem->load_state(olds[i]);
+            LOGE("snapshot: restore device state failed");
+            break;
+        }
+
+        /**
+         * A map fails only when the host is out of memory, the memories mapped before hold
+         * the snapshot and the one failed may have lost its pages, the hart is reset rather
+         * than left running on them.
+         */
+        for (size_t i=0; i<mems.size() && ok; i++) {
+            if (mems[i].image_len == 0 || images[i].size()) continue;
+            ok = (m_mems[i].mem->map_image(fd, mems[i].image_off, mems[i].image_len) == RV_EOK);
+        }
+        if (!ok) {
+            for (size_t i=0; i<mems.size(); i++) m_mems[i].mem->load_state(olds[i]);
+            memset(m_regs.reg->x, 0, sizeof(m_regs.reg->x));
+            m_regs.reg->pc = 0;
+            if (m_regs.fp) memset(m_regs.fp->u, 0, sizeof(m_regs.fp->u));
+            m_regs.ctl->priv = 3;
+            csr_set(CSR_mstatus, 0);
+            m_mmu.flush();
+            pmp_refresh();
+            mode_refresh();
+            LOGE("snapshot: map memory image failed, memories are undefined, the hart is reset");
+            break;
+        }
+        for (size_t i=0; i<mems.size(); i++) {
+            if (images[i].empty()) continue;
+            uint32_t len = 0;
+            memcpy(m_mems[i].mem->host(len), images[i].data(), images[i].size());
+        }
+
+        memcpy(m_regs.reg->x, head.x, sizeof(head.x));
+        m_regs.reg->pc = head.pc;
+        if (head.has_fp) memcpy(m_regs.fp->u, head.fp, sizeof(head.fp));
+        for (auto &it:csrs) {
+            m_regs.ctl->csrs[rv_csr_addr(it.addr)] = it.val;
+        }
+        m_regs.ctl->priv = head.priv;
+        m_mmu.flush();
+        pmp_refresh();
+        mode_refresh();
+        LOGI("snapshot: restored from %s", path.c_str());
+        ret = true;
+    }while(0);
+    if (fd >= 0) close(fd);
+    return ret;
+}
+
+}
@@ -0,0 +1,464 @@
+#include "ZoraGA/RV32Zb.h"
+#include "ZoraGA/RVHost.h"
+#ifdef RV_HOST_X86
+#include <immintrin.h>
+#endif
+
+#define LOGI(fmt, ...) if (m_log) m_log->I(fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) if (m_log) m_log->E(fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) if (m_log) m_log->W(fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) if (m_log) m_log->D(fmt, ##__VA_ARGS__)
+#define LOGV(fmt, ...) if (m_log) m_log->V(fmt, ##__VA_ARGS__)
+#define LOGINST(fmt, ...) if (m_log) m_log->inst(fmt, ##__VA_ARGS__)
+#define LOGREGS(fmt, ...) if (m_log) m_log->regs(fmt, ##__VA_ARGS__)
+
+#define OPCODE_OP     0b0110011
+#define OPCODE_OP_IMM 0b0010011
+
+namespace ZoraGA::RVVM::RV32
+{
+
+/**
+ * @brief 0xff in each nonzero byte, 0 in the others
+ */
+static inline uint32_t orc_b32(uint32_t x)
+{
+    uint32_t t = ((x & 0x7f7f7f7f) + 0x7f7f7f7f) | x;
+    return ((t >> 7) & 0x01010101) * 0xff;
+}
+
+#ifdef RV_HOST_X86
+__attribute__((target("lzcnt")))
+static uint32_t clz_lzcnt(uint32_t x)
+{
+    return _lzcnt_u32(x);
+}
+
+__attribute__((target("bmi")))
+static uint32_t ctz_tzcnt(uint32_t x)
+{
+    return _tzcnt_u32(x);
+}
+
+__attribute__((target("popcnt")))
+static uint32_t cpop_popcnt(uint32_t x)
+{
+    return _mm_popcnt_u32(x);
+}
+
+__attribute__((target("pclmul")))
+static uint64_t clmul_pclmul(uint32_t x, uint32_t y)
+{
+    __m128i p = _mm_clmulepi64_si128(_mm_cvtsi32_si128(x), _mm_cvtsi32_si128(y), 0x00);
+    return (uint64_t)(uint32_t)_mm_cvtsi128_si32(p) | ((uint64_t)(uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(p, 4)) << 32);
+}
+#endif
+
+static inline uint32_t clz32(uint32_t x)
+{
+#ifdef RV_HOST_X86
+    if (rv_host_has(RV_HOST_LZCNT)) return clz_lzcnt(x);
+#endif
+    return x ? __builtin_clz(x) : 32;
+}
+
+static inline uint32_t ctz32(uint32_t x)
+{
+#ifdef RV_HOST_X86
+    if (rv_host_has(RV_HOST_BMI)) return ctz_tzcnt(x);
+#endif
+    return x ? __builtin_ctz(x) : 32;
+}
+
+static inline uint32_t cpop32(uint32_t x)
+{
+#ifdef RV_HOST_X86
+    if (rv_host_has(RV_HOST_POPCNT)) return cpop_popcnt(x);
+#endif
+    return __builtin_popcount(x);
+}
+
+/**
+ * @brief Carry-less product, clmul is its low half, clmulh its high half and clmulr bits 62:31
+ */
+static inline uint64_t clmul64(uint32_t x, uint32_t y)
+{
+#ifdef RV_HOST_X86
+    if (rv_host_has(RV_HOST_PCLMUL)) return clmul_pclmul(x, y);
+#endif
+    uint64_t r = 0;
+    for (int i=0; i<32; i++) {
+        if ((y >> i) & 1) r ^= (uint64_t)x << i;
+    }
+    return r;
+}
+
+rv_err RV32Zb::isValid(rv32_inst_fmt inst)
+{
+    return decode(inst) ? RV_EOK : RV_EUNDEF;
+}
+
+rv_err RV32Zb::exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    inst_fn fn = decode(inst);
+    if (fn == nullptr) return RV_EUNDEF;
+    inst_args a;
+    a.inst = inst;
+    a.regs = &regs;
+    a.mems = &mem_infos;
+    return (this->*fn)(a);
+}
+
+rv_err RV32Zb::set_log(rvlog *log)
+{
+    m_log = log;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::regist(rv32_regs &regs, std::vector<std::string> &isas)
+{
+    return RV_EOK;
+}
+
+RV32Zb::inst_fn RV32Zb::decode(rv32_inst_fmt inst)
+{
+    /* funct7 and funct3 together */
+    uint32_t f = (inst.R.funct7 << 3) | inst.R.funct3;
+    if (inst.opcode == OPCODE_OP) {
+        switch(f) {
+            case (0b0010000 << 3) | 0b010: return &RV32Zb::sh1add;
+            case (0b0010000 << 3) | 0b100: return &RV32Zb::sh2add;
+            case (0b0010000 << 3) | 0b110: return &RV32Zb::sh3add;
+            case (0b0100000 << 3) | 0b111: return &RV32Zb::andn;
+            case (0b0100000 << 3) | 0b110: return &RV32Zb::orn;
+            case (0b0100000 << 3) | 0b100: return &RV32Zb::xnor;
+            case (0b0000101 << 3) | 0b110: return &RV32Zb::max;
+            case (0b0000101 << 3) | 0b111: return &RV32Zb::maxu;
+            case (0b0000101 << 3) | 0b100: return &RV32Zb::min;
+            case (0b0000101 << 3) | 0b101: return &RV32Zb::minu;
+            case (0b0110000 << 3) | 0b001: return &RV32Zb::rol;
+            case (0b0110000 << 3) | 0b101: return &RV32Zb::ror;
+            case (0b0000101 << 3) | 0b001: return &RV32Zb::clmul;
+            case (0b0000101 << 3) | 0b011: return &RV32Zb::clmulh;
+            case (0b0000101 << 3) | 0b010: return &RV32Zb::clmulr;
+            case (0b0100100 << 3) | 0b001: return &RV32Zb::bclr;
+            case (0b0100100 << 3) | 0b101: return &RV32Zb::bext;
+            case (0b0110100 << 3) | 0b001: return &RV32Zb::binv;
+            case (0b0010100 << 3) | 0b001: return &RV32Zb::bset;
+            case (0b0000100 << 3) | 0b100: return inst.R.rs2 == 0 ? &RV32Zb::zext_h : nullptr;
+            default: break;
+        }
+    }
+    else if (inst.opcode == OPCODE_OP_IMM) {
+        switch(f) {
+            case (0b0110000 << 3) | 0b001:
+                switch(inst.R.rs2) {
+                    case 0b00000: return &RV32Zb::clz;
+                    case 0b00001: return &RV32Zb::ctz;
+                    case 0b00010: return &RV32Zb::cpop;
+                    case 0b00100: return &RV32Zb::sext_b;
+                    case 0b00101: return &RV32Zb::sext_h;
+                    default:      return nullptr;
+                }
+            case (0b0110000 << 3) | 0b101: return &RV32Zb::rori;
+            case (0b0100100 << 3) | 0b001: return &RV32Zb::bclri;
+            case (0b0100100 << 3) | 0b101: return &RV32Zb::bexti;
+            case (0b0110100 << 3) | 0b001: return &RV32Zb::binvi;
+            case (0b0010100 << 3) | 0b001: return &RV32Zb::bseti;
+            case (0b0010100 << 3) | 0b101: return inst.R.rs2 == 0b00111 ? &RV32Zb::orc_b : nullptr;
+            case (0b0110100 << 3) | 0b101: return inst.R.rs2 == 0b11000 ? &RV32Zb::rev8 : nullptr;
+            default: break;
+        }
+    }
+    return nullptr;
+}
+
+rv_err RV32Zb::sh1add(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sh1add, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 1) + rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::sh2add(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sh2add, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 2) + rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::sh3add(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sh3add, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 3) + rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::andn(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("andn, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 & ~rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::orn(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("orn, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 | ~rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::xnor(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("xnor, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = ~(rs1 ^ rs2);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::clz(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("clz, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = clz32(rs1);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::ctz(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("ctz, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = ctz32(rs1);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::cpop(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("cpop, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = cpop32(rs1);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::max(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("max, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (int32_t)rs1 > (int32_t)rs2 ? rs1 : rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::maxu(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("maxu, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 > rs2 ? rs1 : rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::min(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("min, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (int32_t)rs1 < (int32_t)rs2 ? rs1 : rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::minu(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("minu, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 < rs2 ? rs1 : rs2;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::sext_b(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("sext.b, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = (uint32_t)(int32_t)(int8_t)rs1;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::sext_h(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("sext.h, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = (uint32_t)(int32_t)(int16_t)rs1;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::zext_h(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("zext.h, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = rs1 & 0xffff;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::rol(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("rol, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rol32(rs1, rs2 & 31);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::ror(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("ror, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = ror32(rs1, rs2 & 31);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::rori(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1], shamt = a.inst.I.shamt;
+    LOGINST("rori, rd: %u, rs1: 0x%08x(x%u), shamt: %u", a.inst.I.rd, rs1, a.inst.I.rs1, shamt);
+
+    a.regs->reg->x[a.inst.I.rd] = ror32(rs1, shamt);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::orc_b(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("orc.b, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = orc_b32(rs1);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::rev8(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("rev8, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, rs1, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = __builtin_bswap32(rs1);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::clmul(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("clmul, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (uint32_t)clmul64(rs1, rs2);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::clmulh(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("clmulh, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (uint32_t)(clmul64(rs1, rs2) >> 32);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::clmulr(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("clmulr, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (uint32_t)(clmul64(rs1, rs2) >> 31);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::bclr(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("bclr, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 & ~(1u << (rs2 & 31));
+    return RV_EOK;
+}
+
+rv_err RV32Zb::bclri(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1], shamt = a.inst.I.shamt;
+    LOGINST("bclri, rd: %u, rs1: 0x%08x(x%u), shamt: %u", a.inst.I.rd, rs1, a.inst.I.rs1, shamt);
+
+    a.regs->reg->x[a.inst.I.rd] = rs1 & ~(1u << shamt);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::bext(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("bext, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 >> (rs2 & 31)) & 1;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::bexti(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1], shamt = a.inst.I.shamt;
+    LOGINST("bexti, rd: %u, rs1: 0x%08x(x%u), shamt: %u", a.inst.I.rd, rs1, a.inst.I.rs1, shamt);
+
+    a.regs->reg->x[a.inst.I.rd] = (rs1 >> shamt) & 1;
+    return RV_EOK;
+}
+
+rv_err RV32Zb::binv(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("binv, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 ^ (1u << (rs2 & 31));
+    return RV_EOK;
+}
+
+rv_err RV32Zb::binvi(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1], shamt = a.inst.I.shamt;
+    LOGINST("binvi, rd: %u, rs1: 0x%08x(x%u), shamt: %u", a.inst.I.rd, rs1, a.inst.I.rs1, shamt);
+
+    a.regs->reg->x[a.inst.I.rd] = rs1 ^ (1u << shamt);
+    return RV_EOK;
+}
+
+rv_err RV32Zb::bset(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("bset, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = rs1 | (1u << (rs2 & 31));
+    return RV_EOK;
+}
+
+rv_err RV32Zb::bseti(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.I.rs1], shamt = a.inst.I.shamt;
+    LOGINST("bseti, rd: %u, rs1: 0x%08x(x%u), shamt: %u", a.inst.I.rd, rs1, a.inst.I.rs1, shamt);
+
+    a.regs->reg->x[a.inst.I.rd] = rs1 | (1u << shamt);
+    return RV_EOK;
+}
+
+}
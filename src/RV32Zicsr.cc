@@ -8,6 +8,19 @@
 #define LOGINST(fmt, ...) if (m_log) m_log->inst(fmt, ##__VA_ARGS__)
 #define LOGREGS(fmt, ...) if (m_log) m_log->regs(fmt, ##__VA_ARGS__)
 
+/* sstatus view of mstatus, SIE SPIE UBE SPP VS FS XS SUM MXR SD */
+#define SSTATUS_MASK 0x800DE762
+#define SIP_SSIP     (1U << 1)
+#define MSTATUS_MPP  (3U << 11)
+#define MSTATUS_TVM  (1U << 20)
+/* driven by the VM, not by software */
+#define MIP_HW_MASK  ((1U << 5) | (1U << 7) | (1U << 11))
+#define MISA_S       (1U << 18)
+#define MISA_U       (1U << 20)
+#define PMP_L        (1U << 7)
+#define PMP_TOR      (1U << 3)
+#define PMP_A_MASK   (3U << 3)
+
 namespace ZoraGA::RVVM::RV32
 {
 
@@ -74,6 +87,17 @@ rv_err RV32Zicsr::regist(rv32_regs &regs, std::vector<std::string> &isas)
     return RV_EOK;
 }
 
+/**
+ * @brief Tell the VM a CSR has been written
+ */
+void RV32Zicsr::csr_written(rv32_regs &regs, rv_csr_addr_fmt addr)
+{
+    regs.ctl->csr_changed = true;
+    if (addr.addr >= CSR_pmpcfg0 && addr.addr <= CSR_pmpaddr63) {
+        regs.ctl->pmp_changed = true;
+    }
+}
+
 bool RV32Zicsr::op_cc_match(rv32_inst_fmt inst)
 {
     return inst.cc == 0b11;
@@ -94,21 +118,23 @@ rv_err RV32Zicsr::csrrw(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &me
     rv_csr_addr_fmt addr = {
         .addr = inst.I.imm_11_0
     };
-    if (regs.ctl->csrs.find(addr) == regs.ctl->csrs.end()) {
+    uint32_t csr = 0;
+    if (csr_read(regs, addr, csr) != RV_EOK) {
         LOGINST("csrrw: invalid csr %05x, rwro: %x, lowp: %x, num: %x", 
             inst.I.imm_11_0, addr.rwro, addr.lowp, addr.num);
         return RV_EININST;
     }
 
-    //TODO permission check
-    std::bitset<32> csr = regs.ctl->csrs[addr];
-    regs.ctl->csrs[addr] = std::bitset<32>(regs.reg->x[inst.I.rs1]);
+    if (csr_write(regs, addr, regs.reg->x[inst.I.rs1]) != RV_EOK) {
+        LOGINST("csrrw: csr %05x is read-only", inst.I.imm_11_0);
+        return RV_EININST;
+    }
     if (inst.I.rd != 0){
-        regs.reg->x[inst.I.rd] = csr.to_ulong();
+        regs.reg->x[inst.I.rd] = csr;
     }
 
     LOGINST("csrrw: csr 0x%08x(%05x) -> x%u, and <- 0x%08x(x%u)", 
-        csr.to_ulong(), inst.I.imm_11_0, inst.I.rd, regs.reg->x[inst.I.rs1], inst.I.rs1);
+        csr, inst.I.imm_11_0, inst.I.rd, regs.reg->x[inst.I.rs1], inst.I.rs1);
     return RV_EOK;
 }
 
@@ -117,21 +143,23 @@ rv_err RV32Zicsr::csrrs(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &me
     rv_csr_addr_fmt addr = {
         .addr = inst.I.imm_11_0
     };
-    if (regs.ctl->csrs.find(addr) == regs.ctl->csrs.end()) {
+    uint32_t csr = 0;
+    if (csr_read(regs, addr, csr) != RV_EOK) {
         LOGINST("csrrs: invalid csr %05x, rwro: %x, lowp: %x, num: %x", 
             inst.I.imm_11_0, addr.rwro, addr.lowp, addr.num);
         return RV_EININST;
     }
 
-    //TODO permission check
-    std::bitset<32> csr = regs.ctl->csrs[addr];
-    if (inst.I.rs1 != 0) {
-        regs.ctl->csrs[addr] |= std::bitset<32>(regs.reg->x[inst.I.rs1]);
+    if (inst.I.rs1 != 0 && csr_write(regs, addr, csr | regs.reg->x[inst.I.rs1]) != RV_EOK) {
+        LOGINST("csrrs: csr %05x is read-only", inst.I.imm_11_0);
+        return RV_EININST;
+    }
+    if (inst.I.rd != 0){
+        regs.reg->x[inst.I.rd] = csr;
     }
-    regs.reg->x[inst.I.rd] = csr.to_ulong();
 
     LOGINST("csrrs: csr 0x%08x(%05x) -> x%u, and |= 0x%08x(x%u)", 
-        regs.reg->x[inst.I.rd], inst.I.imm_11_0, inst.I.rd, regs.reg->x[inst.I.rs1], inst.I.rs1);
+        csr, inst.I.imm_11_0, inst.I.rd, regs.reg->x[inst.I.rs1], inst.I.rs1);
     return RV_EOK;
 }
 
@@ -140,21 +168,23 @@ rv_err RV32Zicsr::csrrc(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &me
     rv_csr_addr_fmt addr = {
         .addr = inst.I.imm_11_0
     };
-    if (regs.ctl->csrs.find(addr) == regs.ctl->csrs.end()) {
+    uint32_t csr = 0;
+    if (csr_read(regs, addr, csr) != RV_EOK) {
         LOGINST("csrrc: invalid csr %05x, rwro: %x, lowp: %x, num: %x", 
             inst.I.imm_11_0, addr.rwro, addr.lowp, addr.num);
         return RV_EININST;
     }
 
-    //TODO permission check
-    std::bitset<32> csr = regs.ctl->csrs[addr];
-    if (inst.I.rs1 != 0) {
-        regs.ctl->csrs[addr] &= ~std::bitset<32>(regs.reg->x[inst.I.rs1]);
+    if (inst.I.rs1 != 0 && csr_write(regs, addr, csr & ~regs.reg->x[inst.I.rs1]) != RV_EOK) {
+        LOGINST("csrrc: csr %05x is read-only", inst.I.imm_11_0);
+        return RV_EININST;
+    }
+    if (inst.I.rd != 0){
+        regs.reg->x[inst.I.rd] = csr;
     }
-    regs.reg->x[inst.I.rd] = csr.to_ulong();
 
     LOGINST("csrrc: csr 0x%08x(%05x) -> x%u, and &= ~0x%08x(x%u)", 
-        regs.reg->x[inst.I.rd], inst.I.imm_11_0, inst.I.rd, regs.reg->x[inst.I.rs1], inst.I.rs1);
+        csr, inst.I.imm_11_0, inst.I.rd, regs.reg->x[inst.I.rs1], inst.I.rs1);
     return RV_EOK;
 }
 
@@ -163,21 +193,23 @@ rv_err RV32Zicsr::csrrwi(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &m
     rv_csr_addr_fmt addr = {
         .addr = inst.I.imm_11_0
     };
-    if (regs.ctl->csrs.find(addr) == regs.ctl->csrs.end()) {
+    uint32_t csr = 0;
+    if (csr_read(regs, addr, csr) != RV_EOK) {
         LOGINST("csrrwi: invalid csr %05x, rwro: %x, lowp: %x, num: %x", 
             inst.I.imm_11_0, addr.rwro, addr.lowp, addr.num);
         return RV_EININST;
     }
 
-    //TODO permission check
-    std::bitset<32> csr = regs.ctl->csrs[addr];
-    regs.ctl->csrs[addr] = std::bitset<32>(inst.I.zimm_4_0);
+    if (csr_write(regs, addr, inst.I.zimm_4_0) != RV_EOK) {
+        LOGINST("csrrwi: csr %05x is read-only", inst.I.imm_11_0);
+        return RV_EININST;
+    }
     if (inst.I.rd != 0){
-        regs.reg->x[inst.I.rd] = csr.to_ulong();
+        regs.reg->x[inst.I.rd] = csr;
     }
 
     LOGINST("csrrwi: csr 0x%08x(%05x) -> x%u, and <- 0x%08x", 
-        regs.reg->x[inst.I.rd], inst.I.imm_11_0, inst.I.rd, inst.I.zimm_4_0);
+        csr, inst.I.imm_11_0, inst.I.rd, inst.I.zimm_4_0);
     return RV_EOK;
 }
 
@@ -186,26 +218,23 @@ rv_err RV32Zicsr::csrrsi(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &m
     rv_csr_addr_fmt addr = {
         .addr = inst.I.imm_11_0
     };
-    if (regs.ctl->csrs.find(addr) == regs.ctl->csrs.end()) {
+    uint32_t csr = 0;
+    if (csr_read(regs, addr, csr) != RV_EOK) {
         LOGINST("csrrsi: invalid csr %05x, rwro: %x, lowp: %x, num: %x", 
             inst.I.imm_11_0, addr.rwro, addr.lowp, addr.num);
         return RV_EININST;
     }
 
-    if (addr.rwro == 0b11) {
+    if (inst.I.zimm_4_0 != 0 && csr_write(regs, addr, csr | inst.I.zimm_4_0) != RV_EOK) {
         LOGINST("csrrsi: csr %05x is read-only", inst.I.imm_11_0);
-        return RV_EACCESS;
+        return RV_EININST;
     }
-
-    //TODO permission check
-    std::bitset<32> csr = regs.ctl->csrs[addr];
-    if (inst.I.zimm_4_0 != 0) {
-        regs.ctl->csrs[addr] |= std::bitset<32>(inst.I.zimm_4_0);
+    if (inst.I.rd != 0){
+        regs.reg->x[inst.I.rd] = csr;
     }
-    regs.reg->x[inst.I.rd] = csr.to_ulong();
 
     LOGINST("csrrsi: csr 0x%08x(%05x) -> x%u, and |= 0x%08x", 
-        regs.reg->x[inst.I.rd], inst.I.imm_11_0, inst.I.rd, inst.I.zimm_4_0);
+        csr, inst.I.imm_11_0, inst.I.rd, inst.I.zimm_4_0);
     return RV_EOK;
 }
 
@@ -214,27 +243,151 @@ rv_err RV32Zicsr::csrrci(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &m
     rv_csr_addr_fmt addr = {
         .addr = inst.I.imm_11_0
     };
-    if (regs.ctl->csrs.find(addr) == regs.ctl->csrs.end()) {
+    uint32_t csr = 0;
+    if (csr_read(regs, addr, csr) != RV_EOK) {
         LOGINST("csrrci: invalid csr %05x, rwro: %x, lowp: %x, num: %x", 
             inst.I.imm_11_0, addr.rwro, addr.lowp, addr.num);
         return RV_EININST;
     }
 
-    if (addr.rwro == 0b11) {
+    if (inst.I.zimm_4_0 != 0 && csr_write(regs, addr, csr & ~inst.I.zimm_4_0) != RV_EOK) {
         LOGINST("csrrci: csr %05x is read-only", inst.I.imm_11_0);
-        return RV_EACCESS;
+        return RV_EININST;
     }
-
-    //TODO permission check
-    std::bitset<32> csr = regs.ctl->csrs[addr];
-    if (inst.I.zimm_4_0 != 0) {
-        regs.ctl->csrs[addr] &= ~std::bitset<32>(inst.I.zimm_4_0);
+    if (inst.I.rd != 0){
+        regs.reg->x[inst.I.rd] = csr;
     }
-    regs.reg->x[inst.I.rd] = csr.to_ulong();
 
     LOGINST("csrrci: csr 0x%08x(%05x) -> x%u, and &= ~0x%08x", 
-        regs.reg->x[inst.I.rd], inst.I.imm_11_0, inst.I.rd, inst.I.zimm_4_0);
+        csr, inst.I.imm_11_0, inst.I.rd, inst.I.zimm_4_0);
     return RV_EOK;
 }
 
+/**
+ * @brief Read a CSR, sstatus/sie/sip are read from the M-Mode CSRs
+ *
+ * @return rv_err RV_EININST if the CSR doesn't exist, needs a higher privilege,
+ * is satp in S-Mode with mstatus.TVM or a counter not enabled by m/scounteren
+ */
+rv_err RV32Zicsr::csr_read(rv32_regs &regs, rv_csr_addr_fmt addr, uint32_t &val)
+{
+    auto it = regs.ctl->csrs.find(addr);
+    if (it == regs.ctl->csrs.end() || addr.lowp > regs.ctl->priv) return RV_EININST;
+    if (satp_trapped(regs, addr) || counter_trapped(regs, addr)) return RV_EININST;
+    switch(addr.addr) {
+        case CSR_sstatus:
+            val = csr_get(regs, CSR_mstatus) & SSTATUS_MASK;
+            break;
+        case CSR_sie:
+            val = csr_get(regs, CSR_mie) & csr_get(regs, CSR_mideleg);
+            break;
+        case CSR_sip:
+            val = csr_get(regs, CSR_mip) & csr_get(regs, CSR_mideleg);
+            break;
+        default:
+            val = it->second.to_ulong();
+            break;
+    }
+    return RV_EOK;
+}
+
+/**
+ * @brief Write a CSR read by csr_read, only the writable bits of the WARL ones
+ *
+ * misa is not writable, mip.MEIP/MTIP/STIP are driven by the VM, and an mstatus.MPP
+ * of a mode that isn't implemented keeps the previous one.
+ *
+ * @return rv_err RV_EININST if the CSR is read-only, or is satp in S-Mode with mstatus.TVM
+ */
+rv_err RV32Zicsr::csr_write(rv32_regs &regs, rv_csr_addr_fmt addr, uint32_t val)
+{
+    if (addr.rwro == 0b11 || satp_trapped(regs, addr)) return RV_EININST;
+    uint32_t deleg = 0, mpp = 0, misa = 0;
+    if (addr.addr >= CSR_pmpcfg0 && addr.addr <= CSR_pmpcfg15) {
+        /* locked entries keep their byte until reset */
+        for (uint32_t i=0; i<4; i++) {
+            if (!(pmp_cfg(regs, (addr.addr - CSR_pmpcfg0) * 4 + i) & PMP_L)) continue;
+            val = (val & ~(0xffU << (i * 8))) | (csr_get(regs, addr.addr) & (0xffU << (i * 8)));
+        }
+    }
+    if (addr.addr >= CSR_pmpaddr0 && addr.addr <= CSR_pmpaddr63) {
+        /* the address of a locked entry, or the bottom of a locked TOR one, is ignored */
+        uint32_t i = addr.addr - CSR_pmpaddr0;
+        if (pmp_cfg(regs, i) & PMP_L) return RV_EOK;
+        if (i < 63 && (pmp_cfg(regs, i + 1) & (PMP_L | PMP_A_MASK)) == (PMP_L | PMP_TOR)) return RV_EOK;
+    }
+    switch(addr.addr) {
+        case CSR_misa:
+            return RV_EOK;
+        case CSR_mstatus:
+            mpp  = (val & MSTATUS_MPP) >> 11;
+            misa = csr_get(regs, CSR_misa);
+            if (!(mpp == 3 || (mpp == 1 && (misa & MISA_S)) || (mpp == 0 && (misa & MISA_U)))) {
+                val = (val & ~MSTATUS_MPP) | (csr_get(regs, CSR_mstatus) & MSTATUS_MPP);
+            }
+            regs.ctl->csrs[addr] = val;
+            break;
+        case CSR_mip:
+            csr_set(regs, CSR_mip, (csr_get(regs, CSR_mip) & MIP_HW_MASK) | (val & ~MIP_HW_MASK));
+            break;
+        case CSR_sstatus:
+            csr_set(regs, CSR_mstatus, (csr_get(regs, CSR_mstatus) & ~SSTATUS_MASK) | (val & SSTATUS_MASK));
+            break;
+        case CSR_sie:
+            deleg = csr_get(regs, CSR_mideleg);
+            csr_set(regs, CSR_mie, (csr_get(regs, CSR_mie) & ~deleg) | (val & deleg));
+            break;
+        case CSR_sip:
+            /* only SSIP is writable */
+            deleg = csr_get(regs, CSR_mideleg) & SIP_SSIP;
+            csr_set(regs, CSR_mip, (csr_get(regs, CSR_mip) & ~deleg) | (val & deleg));
+            break;
+        default:
+            regs.ctl->csrs[addr] = val;
+            break;
+    }
+    csr_written(regs, addr);
+    return RV_EOK;
+}
+
+uint32_t RV32Zicsr::csr_get(rv32_regs &regs, uint16_t addr)
+{
+    auto it = regs.ctl->csrs.find(rv_csr_addr(addr));
+    return (it == regs.ctl->csrs.end()) ? 0 : it->second.to_ulong();
+}
+
+void RV32Zicsr::csr_set(rv32_regs &regs, uint16_t addr, uint32_t val)
+{
+    regs.ctl->csrs[rv_csr_addr(addr)] = val;
+}
+
+/**
+ * @brief Configuration byte of PMP entry i
+ */
+uint8_t RV32Zicsr::pmp_cfg(rv32_regs &regs, uint32_t i)
+{
+    return (csr_get(regs, CSR_pmpcfg0 + i / 4) >> ((i % 4) * 8)) & 0xff;
+}
+
+/**
+ * @brief satp is an illegal access in S-Mode with mstatus.TVM
+ */
+bool RV32Zicsr::satp_trapped(rv32_regs &regs, rv_csr_addr_fmt addr)
+{
+    return addr.addr == CSR_satp && regs.ctl->priv == 1 && (csr_get(regs, CSR_mstatus) & MSTATUS_TVM);
+}
+
+/**
+ * @brief A counter below M-Mode needs its bit in mcounteren, and in scounteren from U-Mode
+ */
+bool RV32Zicsr::counter_trapped(rv32_regs &regs, rv_csr_addr_fmt addr)
+{
+    /* cycleh... are at 0x80 above */
+    uint32_t low = addr.addr & ~0x80U;
+    if (low < CSR_cycle || low > CSR_hpmcounter31 || regs.ctl->priv == 3) return false;
+    uint32_t bit = 1U << (addr.addr & 0x1f);
+    if (!(csr_get(regs, CSR_mcounteren) & bit)) return true;
+    return regs.ctl->priv == 0 && (csr_get(regs, CSR_misa) & MISA_S) && !(csr_get(regs, CSR_scounteren) & bit);
+}
+
 }
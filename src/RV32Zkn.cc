@@ -0,0 +1,315 @@
+#include "ZoraGA/RV32Zkn.h"
+#include "ZoraGA/RVHost.h"
+#ifdef RV_HOST_X86
+#include <immintrin.h>
+#endif
+
+#define LOGI(fmt, ...) if (m_log) m_log->I(fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) if (m_log) m_log->E(fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) if (m_log) m_log->W(fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) if (m_log) m_log->D(fmt, ##__VA_ARGS__)
+#define LOGV(fmt, ...) if (m_log) m_log->V(fmt, ##__VA_ARGS__)
+#define LOGINST(fmt, ...) if (m_log) m_log->inst(fmt, ##__VA_ARGS__)
+#define LOGREGS(fmt, ...) if (m_log) m_log->regs(fmt, ##__VA_ARGS__)
+
+#define OPCODE_OP     0b0110011
+#define OPCODE_OP_IMM 0b0010011
+
+namespace ZoraGA::RVVM::RV32
+{
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    uint8_t r = 0;
+    while (b) {
+        if (b & 1) r ^= a;
+        a = (a << 1) ^ ((a & 0x80) ? 0x1b : 0);
+        b >>= 1;
+    }
+    return r;
+}
+
+/**
+ * @brief AES S-boxes, for hosts without AES-NI
+ */
+static struct aes_tables
+{
+    uint8_t sbox[256];
+    uint8_t inv[256];
+
+    aes_tables()
+    {
+        /* p runs over the field by 3, q over the inverses by 1/3 */
+        uint8_t p = 1, q = 1;
+        do {
+            p = p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0);
+            q ^= q << 1;
+            q ^= q << 2;
+            q ^= q << 4;
+            if (q & 0x80) q ^= 0x09;
+            uint8_t x = q ^ (uint8_t)((q << 1) | (q >> 7)) ^ (uint8_t)((q << 2) | (q >> 6))
+                          ^ (uint8_t)((q << 3) | (q >> 5)) ^ (uint8_t)((q << 4) | (q >> 4));
+            sbox[p] = x ^ 0x63;
+        } while (p != 1);
+        sbox[0] = 0x63;
+        for (int i=0; i<256; i++) inv[sbox[i]] = i;
+    }
+}aes;
+
+#ifdef RV_HOST_X86
+/*
+ * The byte is put in row 0 of column 0, which ShiftRows leaves in place,
+ * the other bytes of the state are substituted to 0, so MixColumns of
+ * column 0 is the mixed word of the byte alone.
+ */
+__attribute__((target("aes")))
+static uint32_t aes_enc_ni(uint8_t si, bool mix)
+{
+    const __m128i key = _mm_setzero_si128();
+    __m128i s = _mm_set_epi32(0x52525252, 0x52525252, 0x52525252, 0x52525200 | si);
+    if (mix) return _mm_cvtsi128_si32(_mm_aesenc_si128(s, key));
+    return _mm_cvtsi128_si32(_mm_aesenclast_si128(s, key)) & 0xff;
+}
+
+__attribute__((target("aes")))
+static uint32_t aes_dec_ni(uint8_t si, bool mix)
+{
+    const __m128i key = _mm_setzero_si128();
+    __m128i s = _mm_set_epi32(0x63636363, 0x63636363, 0x63636363, 0x63636300 | si);
+    if (mix) return _mm_cvtsi128_si32(_mm_aesdec_si128(s, key));
+    return _mm_cvtsi128_si32(_mm_aesdeclast_si128(s, key)) & 0xff;
+}
+#endif
+
+/**
+ * @brief Substituted byte, and its MixColumns column if mix
+ */
+static uint32_t aes_enc(uint8_t si, bool mix)
+{
+#ifdef RV_HOST_X86
+    if (rv_host_has(RV_HOST_AES)) return aes_enc_ni(si, mix);
+#endif
+    uint8_t so = aes.sbox[si];
+    if (!mix) return so;
+    return gf_mul(so, 2) | (so << 8) | (so << 16) | (gf_mul(so, 3) << 24);
+}
+
+/**
+ * @brief Inverse substituted byte, and its InvMixColumns column if mix
+ */
+static uint32_t aes_dec(uint8_t si, bool mix)
+{
+#ifdef RV_HOST_X86
+    if (rv_host_has(RV_HOST_AES)) return aes_dec_ni(si, mix);
+#endif
+    uint8_t so = aes.inv[si];
+    if (!mix) return so;
+    return gf_mul(so, 0x0e) | (gf_mul(so, 0x09) << 8) | (gf_mul(so, 0x0d) << 16) | (gf_mul(so, 0x0b) << 24);
+}
+
+/**
+ * @brief Byte bs of rs2 through one AES round, rotated back to its lane and xored into rs1
+ */
+static uint32_t aes32(uint32_t rs1, uint32_t rs2, uint32_t bs, bool dec, bool mix)
+{
+    uint32_t shamt = bs * 8;
+    uint8_t si = rs2 >> shamt;
+    return rs1 ^ rol32(dec ? aes_dec(si, mix) : aes_enc(si, mix), shamt);
+}
+
+rv_err RV32Zkn::isValid(rv32_inst_fmt inst)
+{
+    return decode(inst) ? RV_EOK : RV_EUNDEF;
+}
+
+rv_err RV32Zkn::exec(rv32_inst_fmt inst,  rv32_regs &regs, rv32_mem_infos &mem_infos)
+{
+    inst_fn fn = decode(inst);
+    if (fn == nullptr) return RV_EUNDEF;
+    inst_args a;
+    a.inst = inst;
+    a.regs = &regs;
+    a.mems = &mem_infos;
+    return (this->*fn)(a);
+}
+
+rv_err RV32Zkn::set_log(rvlog *log)
+{
+    m_log = log;
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::regist(rv32_regs &regs, std::vector<std::string> &isas)
+{
+    return RV_EOK;
+}
+
+RV32Zkn::inst_fn RV32Zkn::decode(rv32_inst_fmt inst)
+{
+    if (inst.opcode == OPCODE_OP && inst.R.funct3 == 0b000) {
+        /* aes32*, bs in the top 2 bits */
+        switch(inst.R.funct7 & 0b11111) {
+            case 0b10001: return &RV32Zkn::aes32esi;
+            case 0b10011: return &RV32Zkn::aes32esmi;
+            case 0b10101: return &RV32Zkn::aes32dsi;
+            case 0b10111: return &RV32Zkn::aes32dsmi;
+            default:      break;
+        }
+        switch(inst.R.funct7) {
+            case 0b0101000: return &RV32Zkn::sha512sum0r;
+            case 0b0101001: return &RV32Zkn::sha512sum1r;
+            case 0b0101010: return &RV32Zkn::sha512sig0l;
+            case 0b0101011: return &RV32Zkn::sha512sig1l;
+            case 0b0101110: return &RV32Zkn::sha512sig0h;
+            case 0b0101111: return &RV32Zkn::sha512sig1h;
+            default:        break;
+        }
+    }
+    else if (inst.opcode == OPCODE_OP_IMM && inst.I.funct3 == 0b001 && inst.R.funct7 == 0b0001000) {
+        switch(inst.R.rs2) {
+            case 0b00000: return &RV32Zkn::sha256sum0;
+            case 0b00001: return &RV32Zkn::sha256sum1;
+            case 0b00010: return &RV32Zkn::sha256sig0;
+            case 0b00011: return &RV32Zkn::sha256sig1;
+            default:      break;
+        }
+    }
+    return nullptr;
+}
+
+rv_err RV32Zkn::aes32esi(inst_args a)
+{
+    uint32_t bs = a.inst.R.funct7 >> 5;
+    LOGINST("aes32esi, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u), bs: %u",
+        a.inst.R.rd, a.regs->reg->x[a.inst.R.rs1], a.inst.R.rs1, a.regs->reg->x[a.inst.R.rs2], a.inst.R.rs2, bs);
+
+    a.regs->reg->x[a.inst.R.rd] = aes32(a.regs->reg->x[a.inst.R.rs1], a.regs->reg->x[a.inst.R.rs2], bs, false, false);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::aes32esmi(inst_args a)
+{
+    uint32_t bs = a.inst.R.funct7 >> 5;
+    LOGINST("aes32esmi, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u), bs: %u",
+        a.inst.R.rd, a.regs->reg->x[a.inst.R.rs1], a.inst.R.rs1, a.regs->reg->x[a.inst.R.rs2], a.inst.R.rs2, bs);
+
+    a.regs->reg->x[a.inst.R.rd] = aes32(a.regs->reg->x[a.inst.R.rs1], a.regs->reg->x[a.inst.R.rs2], bs, false, true);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::aes32dsi(inst_args a)
+{
+    uint32_t bs = a.inst.R.funct7 >> 5;
+    LOGINST("aes32dsi, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u), bs: %u",
+        a.inst.R.rd, a.regs->reg->x[a.inst.R.rs1], a.inst.R.rs1, a.regs->reg->x[a.inst.R.rs2], a.inst.R.rs2, bs);
+
+    a.regs->reg->x[a.inst.R.rd] = aes32(a.regs->reg->x[a.inst.R.rs1], a.regs->reg->x[a.inst.R.rs2], bs, true, false);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::aes32dsmi(inst_args a)
+{
+    uint32_t bs = a.inst.R.funct7 >> 5;
+    LOGINST("aes32dsmi, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u), bs: %u",
+        a.inst.R.rd, a.regs->reg->x[a.inst.R.rs1], a.inst.R.rs1, a.regs->reg->x[a.inst.R.rs2], a.inst.R.rs2, bs);
+
+    a.regs->reg->x[a.inst.R.rd] = aes32(a.regs->reg->x[a.inst.R.rs1], a.regs->reg->x[a.inst.R.rs2], bs, true, true);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha256sig0(inst_args a)
+{
+    uint32_t x = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("sha256sig0, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, x, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = ror32(x, 7) ^ ror32(x, 18) ^ (x >> 3);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha256sig1(inst_args a)
+{
+    uint32_t x = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("sha256sig1, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, x, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = ror32(x, 17) ^ ror32(x, 19) ^ (x >> 10);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha256sum0(inst_args a)
+{
+    uint32_t x = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("sha256sum0, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, x, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = ror32(x, 2) ^ ror32(x, 13) ^ ror32(x, 22);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha256sum1(inst_args a)
+{
+    uint32_t x = a.regs->reg->x[a.inst.I.rs1];
+    LOGINST("sha256sum1, rd: %u, rs1: 0x%08x(x%u)", a.inst.I.rd, x, a.inst.I.rs1);
+
+    a.regs->reg->x[a.inst.I.rd] = ror32(x, 6) ^ ror32(x, 11) ^ ror32(x, 25);
+    return RV_EOK;
+}
+
+/*
+ * The SHA-512 functions of a 64-bit word in a register pair, rs1 holds the half
+ * computed and rs2 the other one, the r forms give either half by swapping them.
+ */
+
+rv_err RV32Zkn::sha512sig0l(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sha512sig0l, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 >> 1) ^ (rs1 >> 7) ^ (rs1 >> 8) ^ (rs2 << 31) ^ (rs2 << 25) ^ (rs2 << 24);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha512sig0h(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sha512sig0h, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 >> 1) ^ (rs1 >> 7) ^ (rs1 >> 8) ^ (rs2 << 31) ^ (rs2 << 24);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha512sig1l(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sha512sig1l, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 3) ^ (rs1 >> 6) ^ (rs1 >> 19) ^ (rs2 >> 29) ^ (rs2 << 26) ^ (rs2 << 13);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha512sig1h(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sha512sig1h, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 3) ^ (rs1 >> 6) ^ (rs1 >> 19) ^ (rs2 >> 29) ^ (rs2 << 13);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha512sum0r(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sha512sum0r, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 25) ^ (rs1 << 30) ^ (rs1 >> 28) ^ (rs2 >> 7) ^ (rs2 >> 2) ^ (rs2 << 4);
+    return RV_EOK;
+}
+
+rv_err RV32Zkn::sha512sum1r(inst_args a)
+{
+    uint32_t rs1 = a.regs->reg->x[a.inst.R.rs1], rs2 = a.regs->reg->x[a.inst.R.rs2];
+    LOGINST("sha512sum1r, rd: %u, rs1: 0x%08x(x%u), rs2: 0x%08x(x%u)", a.inst.R.rd, rs1, a.inst.R.rs1, rs2, a.inst.R.rs2);
+
+    a.regs->reg->x[a.inst.R.rd] = (rs1 << 23) ^ (rs1 >> 14) ^ (rs1 >> 18) ^ (rs2 >> 9) ^ (rs2 << 18) ^ (rs2 << 14);
+    return RV_EOK;
+}
+
+}
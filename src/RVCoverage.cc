@@ -0,0 +1,198 @@
+#include "ZoraGA/RVCoverage.h"
+#include "ZoraGA/RVElf.h"
+#include <map>
+#include <algorithm>
+#include <elf.h>
+#include <fstream>
+
+/* max instructions walked from a block entry */
+#define COV_BLOCK_MAX 4096
+
+namespace ZoraGA::RVVM
+{
+
+/**
+ * @brief Decode length and control flow of the instruction at p
+ *
+ * @param p
+ * @param avail Bytes available at p
+ * @param len Output, 2 or 4, 0 if truncated
+ * @param cond Output, conditional branch
+ * @return true Instruction ends a block
+ */
+static bool cov_decode(const uint8_t *p, uint32_t avail, uint32_t &len, bool &cond)
+{
+    cond = false;
+    len  = 0;
+    if (avail < 2) return true;
+    uint16_t half = p[0] | (p[1] << 8);
+    if ((half & 0b11) != 0b11) {
+        len = 2;
+        uint8_t op = half & 0b11;
+        uint8_t f3 = half >> 13;
+        if (op == 0b01) {
+            /* c.jal/c.j/c.beqz/c.bnez */
+            cond = (f3 == 0b110 || f3 == 0b111);
+            return (f3 == 0b001 || f3 == 0b101 || cond);
+        }
+        /* c.jr/c.jalr/c.ebreak */
+        return (op == 0b10 && f3 == 0b100 && ((half >> 2) & 0x1f) == 0);
+    }
+    if (avail < 4) return true;
+    len = 4;
+    uint32_t inst = half | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    switch(inst & 0x7f) {
+        case 0b1100011:
+            cond = true;
+            return true;
+        case 0b1101111:
+        case 0b1100111:
+            return true;
+        case 0b1110011:
+            return ((inst >> 12) & 0b111) == 0;
+        default:
+            return false;
+    }
+}
+
+bool rv_coverage::set_range(uint32_t base, uint32_t len)
+{
+    m_base = base;
+    m_blocks.assign(len / 2, 0);
+    m_taken.assign(len / 2, 0);
+    m_not_taken.assign(len / 2, 0);
+    return true;
+}
+
+void rv_coverage::reset()
+{
+    std::fill(m_blocks.begin(), m_blocks.end(), 0);
+    std::fill(m_taken.begin(), m_taken.end(), 0);
+    std::fill(m_not_taken.begin(), m_not_taken.end(), 0);
+}
+
+bool rv_coverage::dump_raw(std::string path)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    uint32_t len = m_blocks.size() * 2;
+    file.write("RVCOV\0\0\0", 8);
+    file.write((const char*)&m_base, sizeof(m_base));
+    file.write((const char*)&len, sizeof(len));
+    file.write((const char*)m_blocks.data(), m_blocks.size() * sizeof(uint32_t));
+    file.write((const char*)m_taken.data(), m_taken.size() * sizeof(uint32_t));
+    file.write((const char*)m_not_taken.data(), m_not_taken.size() * sizeof(uint32_t));
+    return file.good();
+}
+
+bool rv_coverage::dump_lcov(std::string path, std::string elf_path)
+{
+    rv_elf elf;
+    std::vector<rv_elf_line> rows;
+    std::vector<std::string> files;
+    if (!elf.load(elf_path) || !elf.lines(rows, files)) return false;
+
+    /* instruction counts, every entry of a block executes it to its end */
+    std::vector<uint64_t> insts(m_blocks.size(), 0);
+    for (size_t i=0; i<m_blocks.size(); i++) {
+        if (m_blocks[i] == 0) continue;
+        uint32_t addr = m_base + i * 2;
+        for (size_t n=0; n<COV_BLOCK_MAX; n++) {
+            uint32_t avail = 0, len = 0;
+            bool cond = false;
+            const uint8_t *p = elf.code(addr, avail);
+            uint32_t slot = (addr - m_base) >> 1;
+            if (p == nullptr || slot >= insts.size()) break;
+            insts[slot] += m_blocks[i];
+            if (cov_decode(p, avail, len, cond) || len == 0) break;
+            addr += len;
+        }
+    }
+
+    typedef struct cov_branch {
+        uint32_t line;
+        bool executed;
+        uint32_t taken;
+        uint32_t not_taken;
+    } cov_branch;
+    std::map<uint32_t, std::map<uint32_t, uint64_t>> lines;
+    std::map<uint32_t, std::vector<cov_branch>> branches;
+    std::map<uint32_t, std::map<std::string, std::pair<uint32_t, uint32_t>>> funcs;
+
+    /* row k covers [rows[k].addr, rows[k+1].addr) */
+    for (size_t k=0; k+1<rows.size(); k++) {
+        if (rows[k].end || rows[k].file >= files.size()) continue;
+        uint32_t file = rows[k].file, line = rows[k].line;
+        uint64_t &cnt = lines[file][line];
+        for (uint32_t addr = rows[k].addr; addr < rows[k+1].addr; ) {
+            uint32_t avail = 0, len = 0;
+            bool cond = false;
+            const uint8_t *p = elf.code(addr, avail);
+            uint32_t slot = (addr - m_base) >> 1;
+            if (p == nullptr || slot >= insts.size()) break;
+            cov_decode(p, avail, len, cond);
+            if (len == 0) break;
+            if (insts[slot] > cnt) cnt = insts[slot];
+            if (cond) {
+                branches[file].push_back(cov_branch{line, insts[slot] != 0, m_taken[slot], m_not_taken[slot]});
+            }
+            addr += len;
+        }
+    }
+
+    for (auto &sym:elf.symbols()) {
+        if (sym.type != STT_FUNC) continue;
+        uint32_t slot = (sym.value - m_base) >> 1;
+        if (slot >= m_blocks.size()) continue;
+        for (size_t k=0; k+1<rows.size(); k++) {
+            if (rows[k].end || rows[k].file >= files.size() || sym.value < rows[k].addr || sym.value >= rows[k+1].addr) continue;
+            funcs[rows[k].file][sym.name] = {rows[k].line, m_blocks[slot]};
+            break;
+        }
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) return false;
+    out << "TN:\n";
+    for (auto &f:lines) {
+        out << "SF:" << files[f.first] << "\n";
+
+        uint32_t fnh = 0;
+        for (auto &fn:funcs[f.first]) {
+            out << "FN:" << fn.second.first << "," << fn.first << "\n";
+        }
+        for (auto &fn:funcs[f.first]) {
+            out << "FNDA:" << fn.second.second << "," << fn.first << "\n";
+            fnh += fn.second.second ? 1 : 0;
+        }
+        out << "FNF:" << funcs[f.first].size() << "\n";
+        out << "FNH:" << fnh << "\n";
+
+        uint32_t brh = 0, block = 0;
+        for (auto &br:branches[f.first]) {
+            if (br.executed) {
+                out << "BRDA:" << br.line << "," << block << ",0," << br.taken << "\n";
+                out << "BRDA:" << br.line << "," << block << ",1," << br.not_taken << "\n";
+            } else {
+                out << "BRDA:" << br.line << "," << block << ",0,-\n";
+                out << "BRDA:" << br.line << "," << block << ",1,-\n";
+            }
+            brh += (br.taken ? 1 : 0) + (br.not_taken ? 1 : 0);
+            block++;
+        }
+        out << "BRF:" << branches[f.first].size() * 2 << "\n";
+        out << "BRH:" << brh << "\n";
+
+        uint32_t lh = 0;
+        for (auto &l:f.second) {
+            out << "DA:" << l.first << "," << l.second << "\n";
+            lh += l.second ? 1 : 0;
+        }
+        out << "LF:" << f.second.size() << "\n";
+        out << "LH:" << lh << "\n";
+        out << "end_of_record\n";
+    }
+    return out.good();
+}
+
+}
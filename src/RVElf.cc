@@ -0,0 +1,436 @@
+#include "ZoraGA/RVElf.h"
+#include <algorithm>
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+
+/* DWARF line number program */
+#define DW_LNS_copy               1
+#define DW_LNS_advance_pc         2
+#define DW_LNS_advance_line       3
+#define DW_LNS_set_file           4
+#define DW_LNS_set_column         5
+#define DW_LNS_negate_stmt        6
+#define DW_LNS_set_basic_block    7
+#define DW_LNS_const_add_pc       8
+#define DW_LNS_fixed_advance_pc   9
+#define DW_LNE_end_sequence       1
+#define DW_LNE_set_address        2
+#define DW_LNCT_path              1
+#define DW_LNCT_directory_index   2
+
+#define DW_FORM_block2    0x03
+#define DW_FORM_block4    0x04
+#define DW_FORM_data2     0x05
+#define DW_FORM_data4     0x06
+#define DW_FORM_data8     0x07
+#define DW_FORM_string    0x08
+#define DW_FORM_block     0x09
+#define DW_FORM_block1    0x0a
+#define DW_FORM_data1     0x0b
+#define DW_FORM_sdata     0x0d
+#define DW_FORM_strp      0x0e
+#define DW_FORM_udata     0x0f
+#define DW_FORM_data16    0x1e
+#define DW_FORM_line_strp 0x1f
+
+namespace ZoraGA::RVVM
+{
+
+/**
+ * @brief Bounded little-endian reader over a section
+ */
+class dw_reader
+{
+    public:
+        dw_reader(const uint8_t *p, size_t len): m_p(p), m_end(p + len) {}
+
+        bool ok() { return m_ok; }
+        bool eof() { return m_p >= m_end; }
+        const uint8_t *pos() { return m_p; }
+        void seek(const uint8_t *p) { m_ok = m_ok && p <= m_end; m_p = m_ok ? p : m_end; }
+
+        uint64_t u(size_t n)
+        {
+            uint64_t v = 0;
+            if (m_p + n > m_end) { m_ok = false; m_p = m_end; return 0; }
+            for (size_t i=0; i<n; i++) v |= (uint64_t)m_p[i] << (i * 8);
+            m_p += n;
+            return v;
+        }
+
+        uint64_t uleb()
+        {
+            uint64_t v = 0;
+            for (unsigned sh = 0; ; sh += 7) {
+                if (m_p >= m_end) { m_ok = false; return 0; }
+                uint8_t b = *m_p++;
+                if (sh < 64) v |= (uint64_t)(b & 0x7f) << sh;
+                if (!(b & 0x80)) break;
+            }
+            return v;
+        }
+
+        int64_t sleb()
+        {
+            int64_t v = 0;
+            unsigned sh = 0;
+            uint8_t b = 0;
+            do {
+                if (m_p >= m_end) { m_ok = false; return 0; }
+                b = *m_p++;
+                if (sh < 64) v |= (int64_t)(b & 0x7f) << sh;
+                sh += 7;
+            } while (b & 0x80);
+            if (sh < 64 && (b & 0x40)) v |= -((int64_t)1 << sh);
+            return v;
+        }
+
+        const char *cstr()
+        {
+            const char *s = (const char *)m_p;
+            while (m_p < m_end && *m_p) m_p++;
+            if (m_p >= m_end) { m_ok = false; return ""; }
+            m_p++;
+            return s;
+        }
+
+    private:
+        const uint8_t *m_p;
+        const uint8_t *m_end;
+        bool m_ok = true;
+};
+
+rv_elf::rv_elf()
+{}
+
+rv_elf::~rv_elf()
+{
+    unload();
+}
+
+void rv_elf::unload()
+{
+    if (m_data) munmap((void*)m_data, m_size);
+    if (m_fd >= 0) close(m_fd);
+    m_fd    = -1;
+    m_data  = nullptr;
+    m_size  = 0;
+    m_entry = 0;
+    m_sections.clear();
+    m_segments.clear();
+    m_symbols.clear();
+    m_by_addr.clear();
+}
+
+bool rv_elf::load(std::string path)
+{
+    bool ret = false;
+    unload();
+    do{
+        m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) break;
+
+        struct stat st;
+        if (fstat(m_fd, &st) != 0 || (size_t)st.st_size < sizeof(Elf32_Ehdr)) break;
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (p == MAP_FAILED) break;
+        m_data = (const uint8_t*)p;
+        m_size = st.st_size;
+
+        const Elf32_Ehdr *eh = (const Elf32_Ehdr*)m_data;
+        if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0) break;
+        if (eh->e_ident[EI_CLASS] != ELFCLASS32 || eh->e_ident[EI_DATA] != ELFDATA2LSB) break;
+        if (eh->e_machine != EM_RISCV) break;
+        m_entry = eh->e_entry;
+
+        /* program headers */
+        if (!data(eh->e_phoff, eh->e_phnum * sizeof(Elf32_Phdr))) break;
+        for (size_t i=0; i<eh->e_phnum; i++) {
+            const Elf32_Phdr *ph = (const Elf32_Phdr*)(m_data + eh->e_phoff) + i;
+            m_segments.push_back(rv_elf_segment{ph->p_type, ph->p_flags, ph->p_offset, ph->p_vaddr,
+                ph->p_paddr, ph->p_filesz, ph->p_memsz, ph->p_align});
+        }
+
+        /* section headers, names from e_shstrndx */
+        if (!data(eh->e_shoff, eh->e_shnum * sizeof(Elf32_Shdr))) break;
+        const Elf32_Shdr *sh = (const Elf32_Shdr*)(m_data + eh->e_shoff);
+        const Elf32_Shdr *shstr = (eh->e_shstrndx < eh->e_shnum) ? &sh[eh->e_shstrndx] : nullptr;
+        for (size_t i=0; i<eh->e_shnum; i++) {
+            const char *name = "";
+            if (shstr && sh[i].sh_name < shstr->sh_size && data(shstr->sh_offset, shstr->sh_size)) {
+                name = (const char*)m_data + shstr->sh_offset + sh[i].sh_name;
+            }
+            m_sections.push_back(rv_elf_section{std::string(name, strnlen(name, shstr ? shstr->sh_size - sh[i].sh_name : 0)),
+                sh[i].sh_type, sh[i].sh_flags, sh[i].sh_addr, sh[i].sh_offset, sh[i].sh_size});
+        }
+
+        /* symbols */
+        for (size_t i=0; i<m_sections.size(); i++) {
+            if (m_sections[i].type != SHT_SYMTAB || sh[i].sh_link >= m_sections.size()) continue;
+            const rv_elf_section &strtab = m_sections[sh[i].sh_link];
+            const Elf32_Sym *sym = (const Elf32_Sym*)data(m_sections[i].offset, m_sections[i].size);
+            if (sym == nullptr) continue;
+            for (size_t j=1; j<m_sections[i].size / sizeof(Elf32_Sym); j++) {
+                const char *name = str(&strtab, sym[j].st_name);
+                if (name == nullptr || *name == 0) continue;
+                m_symbols.push_back(rv_elf_symbol{name, sym[j].st_value, sym[j].st_size,
+                    (uint8_t)ELF32_ST_TYPE(sym[j].st_info), (uint8_t)ELF32_ST_BIND(sym[j].st_info), sym[j].st_shndx});
+            }
+        }
+        for (size_t i=0; i<m_symbols.size(); i++) {
+            if (m_symbols[i].type == STT_FUNC || m_symbols[i].type == STT_OBJECT) m_by_addr.push_back(i);
+        }
+        std::stable_sort(m_by_addr.begin(), m_by_addr.end(),
+            [this](uint32_t a, uint32_t b){ return m_symbols[a].value < m_symbols[b].value; });
+        ret = true;
+    }while(0);
+    if (!ret) unload();
+    return ret;
+}
+
+uint32_t rv_elf::entry()
+{
+    return m_entry;
+}
+
+int rv_elf::fd()
+{
+    return m_fd;
+}
+
+const std::vector<rv_elf_section> &rv_elf::sections()
+{
+    return m_sections;
+}
+
+const std::vector<rv_elf_segment> &rv_elf::segments()
+{
+    return m_segments;
+}
+
+const std::vector<rv_elf_symbol> &rv_elf::symbols()
+{
+    return m_symbols;
+}
+
+const rv_elf_section *rv_elf::section(std::string name)
+{
+    for (auto &it:m_sections) {
+        if (it.name == name) return &it;
+    }
+    return nullptr;
+}
+
+const uint8_t *rv_elf::data(uint32_t offset, uint32_t len)
+{
+    if ((uint64_t)offset + len > m_size) return nullptr;
+    return m_data + offset;
+}
+
+const uint8_t *rv_elf::code(uint32_t addr, uint32_t &len)
+{
+    for (auto &it:m_sections) {
+        if (it.type != SHT_PROGBITS || !(it.flags & SHF_ALLOC)) continue;
+        if (addr < it.addr || addr >= it.addr + it.size) continue;
+        len = it.addr + it.size - addr;
+        return data(it.offset + (addr - it.addr), len);
+    }
+    len = 0;
+    return nullptr;
+}
+
+bool rv_elf::symbol(std::string name, uint32_t &value)
+{
+    for (auto &it:m_symbols) {
+        if (it.name == name) {
+            value = it.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+const rv_elf_symbol *rv_elf::symbol_at(uint32_t addr)
+{
+    /* last symbols starting at or below addr, sizeless ones cover a byte */
+    auto it = std::upper_bound(m_by_addr.begin(), m_by_addr.end(), addr,
+        [this](uint32_t a, uint32_t i){ return a < m_symbols[i].value; });
+    while (it != m_by_addr.begin()) {
+        const rv_elf_symbol &sym = m_symbols[*--it];
+        if ((uint64_t)addr < (uint64_t)sym.value + (sym.size ? sym.size : 1)) return &sym;
+        if (it != m_by_addr.begin() && m_symbols[*(it - 1)].value != sym.value) break;
+    }
+    return nullptr;
+}
+
+const char *rv_elf::str(const rv_elf_section *sec, uint32_t offset)
+{
+    if (sec == nullptr || offset >= sec->size) return nullptr;
+    const char *s = (const char*)data(sec->offset, sec->size);
+    if (s == nullptr || memchr(s + offset, 0, sec->size - offset) == nullptr) return nullptr;
+    return s + offset;
+}
+
+bool rv_elf::lines(std::vector<rv_elf_line> &rows, std::vector<std::string> &files)
+{
+    const rv_elf_section *sec = section(".debug_line");
+    if (sec == nullptr || data(sec->offset, sec->size) == nullptr) return false;
+    const rv_elf_section *line_str = section(".debug_line_str");
+    const rv_elf_section *debug_str = section(".debug_str");
+
+    dw_reader rd(m_data + sec->offset, sec->size);
+    while (!rd.eof() && rd.ok()) {
+        /* unit header */
+        uint64_t unit_len = rd.u(4);
+        size_t ofs_size = 4;
+        if (unit_len == 0xffffffff) {
+            unit_len = rd.u(8);
+            ofs_size = 8;
+        }
+        const uint8_t *unit_end = rd.pos() + unit_len;
+        uint16_t version = rd.u(2);
+        if (!rd.ok() || version < 2 || version > 5) return false;
+        if (version >= 5) rd.u(2);      // address_size, segment_selector_size
+        uint64_t hdr_len = rd.u(ofs_size);
+        const uint8_t *prog = rd.pos() + hdr_len;
+        uint8_t min_len = rd.u(1);
+        if (version >= 4) rd.u(1);      // maximum_operations_per_instruction
+        rd.u(1);                        // default_is_stmt
+        int8_t line_base = (int8_t)rd.u(1);
+        uint8_t line_range = rd.u(1);
+        uint8_t opcode_base = rd.u(1);
+        if (line_range == 0 || opcode_base == 0) return false;
+        std::vector<uint8_t> std_lens(opcode_base, 0);
+        for (size_t i=1; i<opcode_base; i++) std_lens[i] = rd.u(1);
+
+        /* directory and file tables, file_base maps unit file index to files[] */
+        std::vector<std::string> dirs;
+        std::vector<uint32_t> unit_files;
+        auto add_file = [&](std::string name, uint64_t dir) {
+            if (!name.empty() && name[0] != '/' && dir < dirs.size() && !dirs[dir].empty()) {
+                name = dirs[dir] + "/" + name;
+            }
+            unit_files.push_back(files.size());
+            files.push_back(name);
+        };
+        if (version < 5) {
+            dirs.push_back("");
+            while (rd.ok()) {
+                const char *d = rd.cstr();
+                if (*d == 0) break;
+                dirs.push_back(d);
+            }
+            /* file index starts from 1 */
+            unit_files.push_back(UINT32_MAX);
+            while (rd.ok()) {
+                const char *f = rd.cstr();
+                if (*f == 0) break;
+                uint64_t dir = rd.uleb();
+                rd.uleb();
+                rd.uleb();
+                add_file(f, dir);
+            }
+        } else {
+            for (int tbl = 0; tbl < 2 && rd.ok(); tbl++) {
+                uint8_t fmt_count = rd.u(1);
+                std::vector<std::pair<uint64_t, uint64_t>> fmt;
+                for (size_t i=0; i<fmt_count; i++) {
+                    uint64_t type = rd.uleb();
+                    uint64_t form = rd.uleb();
+                    fmt.push_back({type, form});
+                }
+                uint64_t count = rd.uleb();
+                for (uint64_t i=0; i<count && rd.ok(); i++) {
+                    std::string path;
+                    uint64_t dir = 0;
+                    for (auto &f:fmt) {
+                        uint64_t v = 0;
+                        const char *s = nullptr;
+                        switch(f.second) {
+                            case DW_FORM_string:    s = rd.cstr(); break;
+                            case DW_FORM_line_strp: s = str(line_str, rd.u(ofs_size)); break;
+                            case DW_FORM_strp:      s = str(debug_str, rd.u(ofs_size)); break;
+                            case DW_FORM_udata:     v = rd.uleb(); break;
+                            case DW_FORM_sdata:     v = rd.sleb(); break;
+                            case DW_FORM_data1:     v = rd.u(1); break;
+                            case DW_FORM_data2:     v = rd.u(2); break;
+                            case DW_FORM_data4:     v = rd.u(4); break;
+                            case DW_FORM_data8:     v = rd.u(8); break;
+                            case DW_FORM_data16:    rd.u(8); rd.u(8); break;
+                            case DW_FORM_block:     rd.seek(rd.pos() + rd.uleb()); break;
+                            case DW_FORM_block1:    rd.seek(rd.pos() + rd.u(1)); break;
+                            case DW_FORM_block2:    rd.seek(rd.pos() + rd.u(2)); break;
+                            case DW_FORM_block4:    rd.seek(rd.pos() + rd.u(4)); break;
+                            default:                return false;
+                        }
+                        if (f.first == DW_LNCT_path && s) path = s;
+                        if (f.first == DW_LNCT_directory_index) dir = v;
+                    }
+                    if (tbl == 0) {
+                        dirs.push_back(path);
+                    } else {
+                        add_file(path, dir);
+                    }
+                }
+            }
+        }
+        if (!rd.ok()) return false;
+
+        /* line number program */
+        rd.seek(prog);
+        uint64_t addr = 0, file = 1, line = 1;
+        auto emit = [&](bool end) {
+            uint32_t f = (file < unit_files.size()) ? unit_files[file] : UINT32_MAX;
+            rows.push_back(rv_elf_line{(uint32_t)addr, f, (uint32_t)line, end});
+        };
+        while (rd.ok() && rd.pos() < unit_end) {
+            uint8_t op = rd.u(1);
+            if (op >= opcode_base) {
+                uint8_t adj = op - opcode_base;
+                addr += (adj / line_range) * min_len;
+                line += line_base + adj % line_range;
+                emit(false);
+                continue;
+            }
+            switch(op) {
+                case 0: {
+                    uint64_t len = rd.uleb();
+                    const uint8_t *next = rd.pos() + len;
+                    uint8_t sub = len ? rd.u(1) : 0;
+                    if (sub == DW_LNE_end_sequence) {
+                        emit(true);
+                        addr = 0; file = 1; line = 1;
+                    } else if (sub == DW_LNE_set_address) {
+                        addr = rd.u(len - 1);
+                    }
+                    rd.seek(next);
+                    break;
+                }
+                case DW_LNS_copy:             emit(false); break;
+                case DW_LNS_advance_pc:       addr += rd.uleb() * min_len; break;
+                case DW_LNS_advance_line:     line += rd.sleb(); break;
+                case DW_LNS_set_file:         file = rd.uleb(); break;
+                case DW_LNS_set_column:       rd.uleb(); break;
+                case DW_LNS_negate_stmt:      break;
+                case DW_LNS_set_basic_block:  break;
+                case DW_LNS_const_add_pc:     addr += ((255 - opcode_base) / line_range) * min_len; break;
+                case DW_LNS_fixed_advance_pc: addr += rd.u(2); break;
+                default:
+                    for (size_t i=0; i<std_lens[op]; i++) rd.uleb();
+                    break;
+            }
+        }
+        rd.seek(unit_end);
+    }
+    return rd.ok();
+}
+
+}
@@ -0,0 +1,70 @@
+#include "ZoraGA/RVFlat.h"
+#include <sys/mman.h>
+
+#define FLAT_SPACE (1ULL << 32)
+#define FLAT_PAGES (FLAT_SPACE >> RV_PAGE_SHIFT)
+
+namespace ZoraGA::RVVM
+{
+
+rv_flat::rv_flat()
+{}
+
+rv_flat::~rv_flat()
+{
+    release();
+}
+
+bool rv_flat::reserve()
+{
+    if (m_base) return true;
+    void *p = mmap(nullptr, FLAT_SPACE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return false;
+    m_base = (uint8_t*)p;
+    m_pages.assign(FLAT_PAGES + 1, 0);
+    m_dirty.resize(FLAT_SPACE);
+    m_maps.clear();
+    return true;
+}
+
+void rv_flat::release()
+{
+    if (m_base == nullptr) return;
+    for (auto &it:m_maps) {
+        it.mem->unmap_at(m_base + it.addr, it.len);
+    }
+    munmap(m_base, FLAT_SPACE);
+    m_base = nullptr;
+    m_maps.clear();
+    m_pages.clear();
+}
+
+bool rv_flat::map(uint32_t addr, uint32_t len, rv32_mem *mem)
+{
+    if (m_base == nullptr || len == 0) return false;
+    if ((addr | len) & (RV_PAGE_SIZE - 1)) return false;
+    if ((uint64_t)addr + len > FLAT_SPACE) return false;
+    if (mem->map_at(m_base + addr, len) != RV_EOK) return false;
+    m_maps.push_back(rv32_mem_info{addr, len, mem});
+
+    uint8_t bits = RV_FLAT_R | (mem->read_only() ? 0 : RV_FLAT_W);
+    memset(&m_pages[addr >> RV_PAGE_SHIFT], bits, len >> RV_PAGE_SHIFT);
+    return true;
+}
+
+uint8_t *rv_flat::base()
+{
+    return m_base;
+}
+
+const uint8_t *rv_flat::pages()
+{
+    return m_pages.data();
+}
+
+rv_dirty *rv_flat::dirty()
+{
+    return &m_dirty;
+}
+
+}
@@ -0,0 +1,31 @@
+#include "ZoraGA/RVHost.h"
+
+namespace ZoraGA::RVVM
+{
+
+static uint32_t host_detect()
+{
+    uint32_t features = 0;
+#ifdef RV_HOST_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("aes"))    features |= RV_HOST_AES;
+    if (__builtin_cpu_supports("lzcnt"))  features |= RV_HOST_LZCNT;
+    if (__builtin_cpu_supports("bmi"))    features |= RV_HOST_BMI;
+    if (__builtin_cpu_supports("popcnt")) features |= RV_HOST_POPCNT;
+    if (__builtin_cpu_supports("pclmul")) features |= RV_HOST_PCLMUL;
+    if (__builtin_cpu_supports("sse4.2")) features |= RV_HOST_SSE42;
+#endif
+    return features;
+}
+
+static const uint32_t host_detected = host_detect();
+uint32_t rv_host_features = host_detected;
+
+uint32_t rv_host_mask(uint32_t mask)
+{
+    uint32_t old = rv_host_features;
+    rv_host_features = host_detected & mask;
+    return old;
+}
+
+}
@@ -0,0 +1,167 @@
+#ifndef __ELFBUILDER_H__
+#define __ELFBUILDER_H__
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+
+#define ELF_BUILDER_PAGE 0x1000
+
+/**
+ * @brief Writes a small ELF32 RISC-V executable for the tests
+ *
+ * The first page holds the ELF header. Segment contents are placed at file offsets
+ * congruent to their vaddr modulo the page, sections are appended after them, the
+ * program and section headers go last.
+ */
+class elf_builder
+{
+    public:
+        elf_builder(uint32_t entry = 0): m_entry(entry)
+        {
+            m_data.resize(ELF_BUILDER_PAGE);
+            m_shdrs.push_back(Elf32_Shdr{});
+            m_names.push_back("");
+        }
+
+        /**
+         * @brief Add a PT_LOAD segment
+         *
+         * @return uint32_t File offset of its content
+         */
+        uint32_t segment(uint32_t flags, uint32_t vaddr, uint32_t paddr, const std::vector<uint8_t> &data, uint32_t memsz)
+        {
+            size_t off = (m_data.size() + ELF_BUILDER_PAGE - 1) & ~(size_t)(ELF_BUILDER_PAGE - 1);
+            off += vaddr & (ELF_BUILDER_PAGE - 1);
+            m_data.resize(off);
+            m_data.insert(m_data.end(), data.begin(), data.end());
+            Elf32_Phdr ph = {};
+            ph.p_type   = PT_LOAD;
+            ph.p_flags  = flags;
+            ph.p_offset = off;
+            ph.p_vaddr  = vaddr;
+            ph.p_paddr  = paddr;
+            ph.p_filesz = data.size();
+            ph.p_memsz  = memsz;
+            ph.p_align  = ELF_BUILDER_PAGE;
+            m_phdrs.push_back(ph);
+            return off;
+        }
+
+        /**
+         * @brief Add a section with its own content
+         *
+         * @return uint32_t Section index
+         */
+        uint32_t section(std::string name, uint32_t type, uint32_t flags, uint32_t addr, const std::vector<uint8_t> &data)
+        {
+            size_t off = (m_data.size() + 3) & ~(size_t)3;
+            m_data.resize(off);
+            m_data.insert(m_data.end(), data.begin(), data.end());
+            return section_at(name, type, flags, addr, off, data.size());
+        }
+
+        /**
+         * @brief Add a section over content already in the file, a segment's
+         *
+         * @return uint32_t Section index
+         */
+        uint32_t section_at(std::string name, uint32_t type, uint32_t flags, uint32_t addr, uint32_t off, uint32_t size)
+        {
+            Elf32_Shdr sh = {};
+            sh.sh_type      = type;
+            sh.sh_flags     = flags;
+            sh.sh_addr      = addr;
+            sh.sh_offset    = off;
+            sh.sh_size      = size;
+            sh.sh_addralign = 1;
+            m_shdrs.push_back(sh);
+            m_names.push_back(name);
+            return m_shdrs.size() - 1;
+        }
+
+        void symbol(std::string name, uint32_t value, uint32_t size, uint8_t type, uint16_t shndx = SHN_ABS)
+        {
+            Elf32_Sym sym = {};
+            sym.st_name  = m_strtab.size();
+            sym.st_value = value;
+            sym.st_size  = size;
+            sym.st_info  = ELF32_ST_INFO(STB_GLOBAL, type);
+            sym.st_shndx = shndx;
+            m_strtab.insert(m_strtab.end(), name.begin(), name.end());
+            m_strtab.push_back(0);
+            m_syms.push_back(sym);
+        }
+
+        bool write(std::string path)
+        {
+            if (m_syms.size() > 1) {
+                uint32_t str = section(".strtab", SHT_STRTAB, 0, 0, m_strtab);
+                std::vector<uint8_t> syms((uint8_t*)m_syms.data(), (uint8_t*)(m_syms.data() + m_syms.size()));
+                uint32_t tab = section(".symtab", SHT_SYMTAB, 0, 0, syms);
+                m_shdrs[tab].sh_link    = str;
+                m_shdrs[tab].sh_entsize = sizeof(Elf32_Sym);
+            }
+            std::vector<uint8_t> shstr(1, 0);
+            uint32_t shstrndx = m_shdrs.size();
+            m_shdrs.push_back(Elf32_Shdr{});
+            m_names.push_back(".shstrtab");
+            for (size_t i=1; i<m_shdrs.size(); i++) {
+                m_shdrs[i].sh_name = shstr.size();
+                shstr.insert(shstr.end(), m_names[i].begin(), m_names[i].end());
+                shstr.push_back(0);
+            }
+            size_t off = (m_data.size() + 3) & ~(size_t)3;
+            m_data.resize(off);
+            m_data.insert(m_data.end(), shstr.begin(), shstr.end());
+            m_shdrs[shstrndx].sh_type      = SHT_STRTAB;
+            m_shdrs[shstrndx].sh_offset    = off;
+            m_shdrs[shstrndx].sh_size      = shstr.size();
+            m_shdrs[shstrndx].sh_addralign = 1;
+
+            Elf32_Ehdr eh = {};
+            memcpy(eh.e_ident, ELFMAG, SELFMAG);
+            eh.e_ident[EI_CLASS]   = ELFCLASS32;
+            eh.e_ident[EI_DATA]    = ELFDATA2LSB;
+            eh.e_ident[EI_VERSION] = EV_CURRENT;
+            eh.e_type      = ET_EXEC;
+            eh.e_machine   = EM_RISCV;
+            eh.e_version   = EV_CURRENT;
+            eh.e_entry     = m_entry;
+            eh.e_ehsize    = sizeof(Elf32_Ehdr);
+            eh.e_phentsize = sizeof(Elf32_Phdr);
+            eh.e_phnum     = m_phdrs.size();
+            eh.e_shentsize = sizeof(Elf32_Shdr);
+            eh.e_shnum     = m_shdrs.size();
+            eh.e_shstrndx  = shstrndx;
+            eh.e_phoff     = (m_data.size() + 3) & ~(size_t)3;
+            m_data.resize(eh.e_phoff);
+            m_data.insert(m_data.end(), (uint8_t*)m_phdrs.data(), (uint8_t*)(m_phdrs.data() + m_phdrs.size()));
+            eh.e_shoff     = m_data.size();
+            m_data.insert(m_data.end(), (uint8_t*)m_shdrs.data(), (uint8_t*)(m_shdrs.data() + m_shdrs.size()));
+            memcpy(m_data.data(), &eh, sizeof(eh));
+
+            FILE *f = fopen(path.c_str(), "wb");
+            if (f == nullptr) return false;
+            bool ok = fwrite(m_data.data(), 1, m_data.size(), f) == m_data.size();
+            return (fclose(f) == 0) && ok;
+        }
+
+    private:
+        uint32_t m_entry;
+        std::vector<uint8_t>     m_data;
+        std::vector<Elf32_Phdr>  m_phdrs;
+        std::vector<Elf32_Shdr>  m_shdrs;
+        std::vector<std::string> m_names;
+        std::vector<uint8_t>     m_strtab = {0};
+        std::vector<Elf32_Sym>   m_syms   = {Elf32_Sym{}};
+};
+
+#endif
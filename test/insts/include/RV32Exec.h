@@ -0,0 +1,44 @@
+#ifndef __RV32EXEC_H__
+#define __RV32EXEC_H__
+
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+
+#define OP     0b0110011
+#define OP_IMM 0b0010011
+
+/**
+ * @brief Run one instruction of an instruction set on x1 and x2 into x3
+ */
+template<typename T>
+class rv32_exec
+{
+    public:
+        rv32_exec()
+        {
+            regs.reg = &reg;
+            regs.ctl = &ctrl;
+            memset(reg.x, 0, sizeof(reg.x));
+        }
+
+        /**
+         * @brief An R-type on x1 and x2, or an I-type on x1 with rs2 as the low immediate bits
+         */
+        uint32_t exec(uint32_t opcode, uint32_t funct7, uint32_t rs2, uint32_t funct3, uint32_t rs1)
+        {
+            ZoraGA::RVVM::rv32_inst_fmt inst;
+            inst.inst = (funct7 << 25) | (rs2 << 20) | (1 << 15) | (funct3 << 12) | (3 << 7) | opcode;
+            reg.x[1] = rs1;
+            EXPECT_EQ(set.isValid(inst), ZoraGA::RVVM::RV_EOK);
+            EXPECT_EQ(set.exec(inst, regs, mems), ZoraGA::RVVM::RV_EOK);
+            return reg.x[3];
+        }
+
+        T set;
+        ZoraGA::RVVM::rv32_regs_base reg;
+        ZoraGA::RVVM::rv32_regs_ctrl ctrl;
+        ZoraGA::RVVM::rv32_regs regs;
+        ZoraGA::RVVM::rv32_mem_infos mems;
+};
+
+#endif
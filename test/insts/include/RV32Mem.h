@@ -10,7 +10,14 @@ class RV32Mem:public ZoraGA::RVVM::rv32_mem
         std::vector<uint8_t> *raw();
         ZoraGA::RVVM::rv_err read(uint32_t addr, void *data, uint32_t len);
         ZoraGA::RVVM::rv_err write(uint32_t addr, void *data, uint32_t len);
+        ZoraGA::RVVM::rv_dirty *dirty();
+        ZoraGA::RVVM::rv_err set_baseline();
+        ZoraGA::RVVM::rv_err revert_pages(const std::vector<uint32_t> &pages);
+        ZoraGA::RVVM::rv32_mem *clone();
+        void *host(uint32_t &len);
 
     private:
         std::vector<uint8_t> m_mem;
+        std::vector<uint8_t> m_base;
+        ZoraGA::RVVM::rv_dirty m_dirty;
 };
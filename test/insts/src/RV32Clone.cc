@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+/**
+ * @brief A device without clone
+ */
+class RV32Dev:public RVVM::rv32_mem
+{
+    public:
+        RVVM::rv_err read(uint32_t addr, void *data, uint32_t len) { memset(data, 0, len); return RVVM::RV_EOK; }
+        RVVM::rv_err write(uint32_t addr, void *data, uint32_t len) { return RVVM::RV_EOK; }
+};
+
+TEST(RV32Clone, Memories) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+
+    /* addi a0, a0, 1; j . */
+    uint32_t code[] = {0x00150513, 0x0000006f};
+    memcpy(&ram[0], code, sizeof(code));
+    vm.add_inst("I", &rv32i);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.step(1);
+
+    RVVM::RV32::rv32 *fork = vm.clone();
+    ASSERT_NE(fork, nullptr);
+    EXPECT_EQ(fork->regs()->pc, 4);
+    EXPECT_EQ(fork->regs()->x[10], 1);
+
+    /* the fork doesn't see writes to the parent memory */
+    ram[0x100] = 0x5a;
+    uint8_t v = 0xff;
+    EXPECT_TRUE(fork->read_mem(0x100, &v, 1));
+    EXPECT_EQ(v, 0);
+    delete fork;
+
+    /* a device that can't be cloned fails the fork, instead of being shared */
+    RV32Dev dev;
+    vm.add_mem(0x10000000, 0x1000, &dev);
+    EXPECT_EQ(vm.clone(), nullptr);
+}
@@ -0,0 +1,269 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "ZoraGA/RVCoverage.h"
+#include "ElfBuilder.h"
+#include "RV32Mem.h"
+#include <fstream>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+/**
+ * _start: li a0, 3; li a1, 0
+ * loop:   addi a1, a1, 1; addi a0, a0, -1; bnez a0, loop
+ *         beqz a1, skip; li a2, 7
+ * skip:   j skip
+ */
+static const std::vector<uint32_t> cov_code = {
+    0x00300513, 0x00000593, 0x00158593, 0xfff50513, 0xfe051ce3, 0x00058463, 0x00700613, 0x0000006f,
+};
+#define COV_SKIP 0x1c
+
+/**
+ * @brief Run the program to skip, with coverage of its range
+ */
+static void cov_run(RVVM::rv_coverage &cov)
+{
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RV32Mem mem(64*1024);
+    memcpy(&(*mem.raw())[0], cov_code.data(), cov_code.size() * 4);
+    vm.add_inst("I", &rv32i);
+    vm.add_mem(0, 64*1024, &mem);
+    ASSERT_TRUE(cov.set_range(0, cov_code.size() * 4));
+    ASSERT_TRUE(vm.set_coverage(&cov));
+    vm.add_breakpoint(COV_SKIP);
+    EXPECT_EQ(vm.step(100), RVVM::RV_STOP_BREAK);
+}
+
+static std::vector<std::string> read_lines(std::string path, std::string prefix = "")
+{
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, prefix.size(), prefix) == 0) lines.push_back(line);
+    }
+    return lines;
+}
+
+/**
+ * @brief A .debug_line unit, the header of version and the program given
+ */
+class dw_line
+{
+    public:
+        void u8(uint8_t v) { data.push_back(v); }
+        void u16(uint16_t v) { u8(v); u8(v >> 8); }
+        void u32(uint32_t v) { u16(v); u16(v >> 16); }
+        void str(std::string s) { data.insert(data.end(), s.begin(), s.end()); u8(0); }
+        void uleb(uint32_t v) { do { u8((v & 0x7f) | (v > 0x7f ? 0x80 : 0)); v >>= 7; } while (v); }
+        void sleb(int32_t v)
+        {
+            bool more = true;
+            while (more) {
+                uint8_t b = v & 0x7f;
+                v >>= 7;
+                more = !((v == 0 && !(b & 0x40)) || (v == -1 && (b & 0x40)));
+                u8(b | (more ? 0x80 : 0));
+            }
+        }
+
+        /**
+         * @brief The rows of cov_code, minimum instruction length 2, lines 1-7 in the
+         * first file, skip on line 10 of the second, through each kind of opcode
+         */
+        void program()
+        {
+            /* set_address 0, copy */
+            u8(0); uleb(5); u8(2); u32(0);
+            u8(1);
+            /* special, 4 bytes and a line */
+            u8(special(2, 1));
+            /* advance_pc, advance_line, copy */
+            u8(2); uleb(2); u8(3); sleb(1); u8(1);
+            /* fixed_advance_pc in bytes, special without address */
+            u8(9); u16(4); u8(special(0, 1));
+            /* a column and is_stmt, ignored */
+            u8(5); uleb(7); u8(6); u8(6);
+            u8(special(2, 1));
+            u8(special(2, 1));
+            u8(special(2, 1));
+            /* set_file 2, back up and forward, then end the sequence at 0x20 */
+            u8(4); uleb(2); u8(3); sleb(-4); u8(3); sleb(7); u8(special(2, 0));
+            u8(2); uleb(2);
+            u8(0); uleb(1); u8(1);
+        }
+
+        /**
+         * @brief The unit around program(), version 2 to 4 with include_directories
+         * and file_names, 5 with entry formats
+         */
+        std::vector<uint8_t> unit(uint16_t version, std::vector<uint8_t> &line_str)
+        {
+            std::vector<uint8_t> prog;
+            data.clear();
+            program();
+            prog.swap(data);
+
+            u8(2);                      // minimum_instruction_length
+            if (version >= 4) u8(1);    // maximum_operations_per_instruction
+            u8(1);                      // default_is_stmt
+            u8((uint8_t)LINE_BASE);
+            u8(LINE_RANGE);
+            u8(OPCODE_BASE);
+            const uint8_t std_lens[OPCODE_BASE - 1] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+            for (auto it:std_lens) u8(it);
+            if (version < 5) {
+                str("/src");
+                u8(0);
+                str("cov.S"); uleb(1); uleb(0); uleb(0);
+                str("inc.h"); uleb(0); uleb(0); uleb(0);
+                u8(0);
+            } else {
+                /* directories, path in .debug_line_str */
+                u8(1); uleb(1); uleb(0x1f);
+                uleb(2);
+                u32(line_str.size()); line_str.insert(line_str.end(), {'/', 'b', 0});
+                u32(line_str.size()); line_str.insert(line_str.end(), {'/', 's', 'r', 'c', 0});
+                /* files, path as a string, directory as udata, an MD5 skipped */
+                u8(3); uleb(1); uleb(0x08); uleb(2); uleb(0x0f); uleb(5); uleb(0x1e);
+                uleb(3);
+                for (auto it:{std::make_pair("cov.S", 1), std::make_pair("cov.S", 1), std::make_pair("inc.h", 0)}) {
+                    str(it.first); uleb(it.second);
+                    for (int i=0; i<16; i++) u8(i);
+                }
+            }
+            std::vector<uint8_t> hdr;
+            hdr.swap(data);
+
+            u16(version);
+            if (version >= 5) { u8(4); u8(0); }
+            u32(hdr.size());
+            data.insert(data.end(), hdr.begin(), hdr.end());
+            data.insert(data.end(), prog.begin(), prog.end());
+            std::vector<uint8_t> body;
+            body.swap(data);
+            u32(body.size());
+            data.insert(data.end(), body.begin(), body.end());
+            return data;
+        }
+
+        std::vector<uint8_t> data;
+
+    private:
+        static const int8_t  LINE_BASE   = -5;
+        static const uint8_t LINE_RANGE  = 14;
+        static const uint8_t OPCODE_BASE = 13;
+
+        /* address advance in units of the minimum instruction length */
+        uint8_t special(uint32_t addr, int32_t line)
+        {
+            return (line - LINE_BASE) + LINE_RANGE * addr + OPCODE_BASE;
+        }
+};
+
+/**
+ * @brief An ELF of cov_code at 0, with _start and a .debug_line of version
+ */
+static std::string cov_elf(uint16_t version)
+{
+    char path[] = "/tmp/rv32_covXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    std::vector<uint8_t> text((uint8_t*)cov_code.data(), (uint8_t*)(cov_code.data() + cov_code.size()));
+    std::vector<uint8_t> line_str;
+    dw_line dw;
+    std::vector<uint8_t> unit = dw.unit(version, line_str);
+    elf_builder elf;
+    uint32_t sec = elf.section(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, text);
+    elf.section(".debug_line", SHT_PROGBITS, 0, 0, unit);
+    if (line_str.size()) elf.section(".debug_line_str", SHT_PROGBITS, 0, 0, line_str);
+    elf.symbol("_start", 0, cov_code.size() * 4, STT_FUNC, sec);
+    EXPECT_TRUE(elf.write(path));
+    return path;
+}
+
+TEST(RV32Coverage, Raw) {
+    RVVM::rv_coverage cov;
+    cov_run(cov);
+    char path[] = "/tmp/rv32_covXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    ASSERT_TRUE(cov.dump_raw(path));
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    unlink(path);
+    ASSERT_EQ(raw.size(), 16 + 3 * 16 * 4);
+    EXPECT_EQ(memcmp(raw.data(), "RVCOV\0\0\0", 8), 0);
+    uint32_t head[2], blocks[16], taken[16], not_taken[16];
+    memcpy(head, &raw[8], 8);
+    memcpy(blocks, &raw[16], 64);
+    memcpy(taken, &raw[80], 64);
+    memcpy(not_taken, &raw[144], 64);
+    EXPECT_EQ(head[0], 0);
+    EXPECT_EQ(head[1], 0x20);
+
+    /* block entries per 2-byte slot: _start, loop twice, after bnez, after beqz */
+    const uint32_t want[16] = {1, 0, 0, 0, 2, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0};
+    for (int i=0; i<16; i++) {
+        EXPECT_EQ(blocks[i], want[i]) << i;
+    }
+    EXPECT_EQ(taken[8], 2);
+    EXPECT_EQ(not_taken[8], 1);
+    EXPECT_EQ(taken[10], 0);
+    EXPECT_EQ(not_taken[10], 1);
+
+    /* reset clears the counts, not the range */
+    cov.reset();
+    ASSERT_TRUE(cov.dump_raw(path));
+    std::ifstream again(path, std::ios::binary);
+    raw.assign((std::istreambuf_iterator<char>(again)), std::istreambuf_iterator<char>());
+    unlink(path);
+    ASSERT_EQ(raw.size(), 16 + 3 * 16 * 4);
+    for (size_t i=16; i<raw.size(); i++) {
+        ASSERT_EQ(raw[i], 0) << i;
+    }
+}
+
+TEST(RV32Coverage, Lcov) {
+    RVVM::rv_coverage cov;
+    cov_run(cov);
+    char path[] = "/tmp/rv32_lcovXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    /* the instructions of a block count its entries, the skip one is the end of the last block */
+    const std::vector<std::string> da = {
+        "SF:/src/cov.S", "DA:1,1", "DA:2,1", "DA:3,3", "DA:4,3", "DA:5,3", "DA:6,1", "DA:7,1",
+        "SF:inc.h", "DA:10,1",
+    };
+    const std::vector<std::string> br = {
+        "BRDA:5,0,0,2", "BRDA:5,0,1,1", "BRDA:6,1,0,0", "BRDA:6,1,1,1",
+    };
+    for (uint16_t version:{2, 3, 4, 5}) {
+        std::string elf = cov_elf(version);
+        ASSERT_TRUE(cov.dump_lcov(path, elf)) << version;
+        unlink(elf.c_str());
+
+        std::vector<std::string> want = da;
+        if (version == 5) want[8] = "SF:/b/inc.h";
+        std::vector<std::string> got;
+        for (auto &it:read_lines(path)) {
+            if (it.compare(0, 3, "SF:") == 0 || it.compare(0, 3, "DA:") == 0) got.push_back(it);
+        }
+        EXPECT_EQ(got, want) << version;
+        EXPECT_EQ(read_lines(path, "BRDA:"), br) << version;
+        EXPECT_EQ(read_lines(path, "FN"), std::vector<std::string>({"FN:1,_start", "FNDA:1,_start", "FNF:1", "FNH:1", "FNF:0", "FNH:0"})) << version;
+    }
+
+    /* no line table */
+    elf_builder bare;
+    std::vector<uint8_t> text((uint8_t*)cov_code.data(), (uint8_t*)(cov_code.data() + cov_code.size()));
+    bare.section(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, text);
+    ASSERT_TRUE(bare.write(path));
+    EXPECT_FALSE(cov.dump_lcov(path, path));
+    unlink(path);
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include <sys/mman.h>
+
+using namespace ZoraGA;
+
+/**
+ * @brief RAM that moves into the flat space
+ */
+class FlatRam:public RVVM::rv32_mem
+{
+    public:
+        FlatRam(uint32_t len):m_len(len)
+        {
+            m_mem = (uint8_t*)mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        ~FlatRam() { munmap(m_mem, m_len); }
+
+        RVVM::rv_err read(uint32_t addr, void *data, uint32_t len)
+        {
+            if ((uint64_t)addr + len > m_len) return RVVM::RV_ERANGE;
+            memcpy(data, m_mem + addr, len);
+            return RVVM::RV_EOK;
+        }
+
+        RVVM::rv_err write(uint32_t addr, void *data, uint32_t len)
+        {
+            if ((uint64_t)addr + len > m_len) return RVVM::RV_ERANGE;
+            memcpy(m_mem + addr, data, len);
+            return RVVM::RV_EOK;
+        }
+
+        RVVM::rv32_mem *clone()
+        {
+            FlatRam *ram = new FlatRam(m_len);
+            memcpy(ram->m_mem, m_mem, m_len);
+            return ram;
+        }
+
+        RVVM::rv_err map_at(void *addr, uint32_t len)
+        {
+            void *p = mremap(m_mem, m_len, m_len, MREMAP_MAYMOVE | MREMAP_FIXED, addr);
+            if (p == MAP_FAILED) return RVVM::RV_EFAULT;
+            m_mem = (uint8_t*)p;
+            return RVVM::RV_EOK;
+        }
+
+        void unmap_at(void *addr, uint32_t len)
+        {
+            void *p = mmap(nullptr, m_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            m_mem = (uint8_t*)mremap(m_mem, m_len, m_len, MREMAP_MAYMOVE | MREMAP_FIXED, p);
+            mmap(addr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+            m_unmapped++;
+        }
+
+        uint8_t *m_mem;
+        uint32_t m_len;
+        int m_unmapped = 0;
+};
+
+/**
+ * @brief A register reading 0x12345678, keeping the last write
+ */
+class FlatDev:public RVVM::rv32_mem
+{
+    public:
+        RVVM::rv_err read(uint32_t addr, void *data, uint32_t len) { uint32_t v = 0x12345678; memcpy(data, &v, len); return RVVM::RV_EOK; }
+        RVVM::rv_err write(uint32_t addr, void *data, uint32_t len) { memcpy(&m_last, data, len); return RVVM::RV_EOK; }
+        RVVM::rv32_mem *clone() { return this; }
+        uint32_t m_last = 0;
+};
+
+TEST(RV32Flat, Access) {
+    RVVM::RV32::rv32 *fork = nullptr;
+    FlatRam ram(64*1024);
+    FlatDev dev;
+    {
+        RVVM::RV32::rv32 vm;
+        RVVM::RV32::RV32I rv32i;
+
+        /* lui a0, 0x10000; lw a1, 0(a0); sw a1, 0x100(zero); sw a1, 4(a0); j . */
+        uint32_t code[] = {0x10000537, 0x00052583, 0x10b02023, 0x00b52223, 0x0000006f};
+        memcpy(ram.m_mem, code, sizeof(code));
+        vm.add_inst("I", &rv32i);
+        vm.add_mem(0, 64*1024, &ram);
+        vm.add_mem(0x10000000, 0x1000, &dev);
+        ASSERT_TRUE(vm.set_flat(true));
+
+        /* the device is read and written through its region, the RAM in the flat space */
+        vm.step(2);
+        EXPECT_EQ(vm.regs()->x[11], 0x12345678);
+        fork = vm.clone();
+        ASSERT_NE(fork, nullptr);
+        vm.step(2);
+        uint32_t v = 0;
+        memcpy(&v, ram.m_mem + 0x100, 4);
+        EXPECT_EQ(v, 0x12345678);
+        EXPECT_EQ(dev.m_last, 0x12345678);
+
+        /* the RAM leaves the flat space with its content */
+        ASSERT_TRUE(vm.set_flat(false));
+        EXPECT_EQ(ram.m_unmapped, 1);
+        memcpy(&v, ram.m_mem + 0x100, 4);
+        EXPECT_EQ(v, 0x12345678);
+        ASSERT_TRUE(vm.set_flat(true));
+    }
+    EXPECT_EQ(ram.m_unmapped, 2);
+
+    /* the fork has a flat space of its own, and the same device */
+    dev.m_last = 0;
+    fork->step(2);
+    EXPECT_EQ(dev.m_last, 0x12345678);
+    delete fork;
+}
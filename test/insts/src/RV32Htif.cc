@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+#define TOHOST   0x1000
+#define FROMHOST 0x1040
+
+static void put64(std::vector<uint8_t> &ram, uint32_t addr, uint64_t val)
+{
+    memcpy(&ram[addr], &val, 8);
+}
+
+static uint64_t get64(std::vector<uint8_t> &ram, uint32_t addr)
+{
+    uint64_t val;
+    memcpy(&val, &ram[addr], 8);
+    return val;
+}
+
+TEST(RV32Htif, Mailbox) {
+    RVVM::RV32::RV32Htif htif;
+    RVVM::rv32_mem_infos mems;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    char buf[8] = {0};
+
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+    htif.set_addr(TOHOST, FROMHOST);
+    EXPECT_TRUE(htif.hit(TOHOST + 4, 4));
+    EXPECT_TRUE(htif.hit(TOHOST - 2, 4));
+    EXPECT_FALSE(htif.hit(TOHOST + 8, 4));
+    EXPECT_FALSE(htif.hit(TOHOST - 4, 4));
+
+    /* nothing stored, or the device field of another device */
+    EXPECT_TRUE(htif.written(mems));
+    put64(ram, TOHOST, (1ULL << 56) | (1ULL << 48) | 'x');
+    EXPECT_TRUE(htif.written(mems));
+
+    /* syscall proxy, write(1, "ok", 2) */
+    FILE *out = tmpfile();
+    htif.set_console(out);
+    memcpy(&ram[0x300], "ok", 2);
+    put64(ram, 0x200, 64);
+    put64(ram, 0x208, 1);
+    put64(ram, 0x210, 0x300);
+    put64(ram, 0x218, 2);
+    put64(ram, TOHOST, 0x200);
+    EXPECT_TRUE(htif.written(mems));
+    EXPECT_EQ(get64(ram, 0x200), 2);
+    EXPECT_EQ(get64(ram, FROMHOST), 1);
+    EXPECT_EQ(get64(ram, TOHOST), 0);
+    rewind(out);
+    EXPECT_EQ(fread(buf, 1, sizeof(buf), out), 2);
+    EXPECT_STREQ(buf, "ok");
+    fclose(out);
+
+    /* an unknown syscall */
+    put64(ram, 0x200, 1234);
+    put64(ram, TOHOST, 0x200);
+    EXPECT_TRUE(htif.written(mems));
+    EXPECT_EQ((int64_t)get64(ram, 0x200), -38);
+
+    /* exit of a failing test number 3 */
+    put64(ram, TOHOST, (3 << 1) | 1);
+    EXPECT_FALSE(htif.written(mems));
+    EXPECT_EQ(htif.exit_code(), 3);
+}
+
+TEST(RV32Htif, Exit) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::RV32::RV32Htif htif;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+
+    /* li a0, 0x1000; li a1, 1; sw a1, 0(a0); sw zero, 4(a0); j . */
+    uint32_t code[] = {0x00001537, 0x00100593, 0x00b52023, 0x00052223, 0x0000006f};
+    memcpy(&ram[0], code, sizeof(code));
+    htif.set_addr(TOHOST, 0);
+    vm.add_inst("I", &rv32i);
+    vm.add_mem(0, 64*1024, &mem);
+    ASSERT_TRUE(vm.set_htif(&htif));
+    EXPECT_EQ(vm.step(1000), RVVM::RV_STOP_REQ);
+    EXPECT_EQ(vm.regs()->pc, 0xc);
+    EXPECT_EQ(htif.exit_code(), 0);
+}
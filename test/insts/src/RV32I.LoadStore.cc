@@ -117,3 +117,143 @@ TEST(RV32I, LoadStore) {
     reg.x[0] = 0;
     EXPECT_EQ(rv32i_exec(a)->regs->reg->x[0], 0x8000);
 }
+
+TEST(RV32I, DirtyPages) {
+    rv32i_args a;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    RVVM::rv32_inst_fmt inst;
+    RVVM::rv32_mem_info info;
+    RVVM::rv32_mem_infos mems;
+    RV32Mem mem(64*1024);
+    std::vector<uint32_t> pages;
+
+    info.addr = 0;
+    info.len  = 64*1024;
+    info.mem  = &mem;
+    mems.push_back(info);
+
+    regs.ctl = &ctrl;
+    regs.reg = &reg;
+    a.i      = &rv32i;
+    a.inst   = &inst;
+    a.regs   = &regs;
+    a.mems   = &mems;
+
+    reg.pc = 0;
+    memset(reg.x, 0, sizeof(reg.x));
+
+    /* sw x2, 0(x1), crossing no page */
+    inst.inst       = 0;
+    inst.opcode     = 0b0100011;
+    inst.S.funct3   = 0b010;
+    inst.S.rs1      = 1;
+    inst.S.rs2      = 2;
+    reg.x[1] = 0x2004;
+    reg.x[2] = 0x12345678;
+    rv32i_exec(a);
+    EXPECT_EQ(mem.dirty()->fetch_clear(pages), 1);
+    EXPECT_EQ(pages[0], 2);
+
+    /* cleared by fetch */
+    pages.clear();
+    EXPECT_EQ(mem.dirty()->fetch_clear(pages), 0);
+
+    /* sw x2, 0(x1), crossing page 3 and 4 */
+    reg.x[1] = 0x3FFE;
+    rv32i_exec(a);
+    EXPECT_EQ(mem.dirty()->fetch_clear(pages), 2);
+    EXPECT_EQ(pages[0], 3);
+    EXPECT_EQ(pages[1], 4);
+}
+
+/* records the width of typed accesses, like an MMIO device decoding registers */
+class RV32MmioMem:public RVVM::rv32_mem
+{
+    public:
+        RVVM::rv_err read(uint32_t addr, void *data, uint32_t len) { width = 0; return RVVM::RV_EACCESS; }
+        RVVM::rv_err write(uint32_t addr, void *data, uint32_t len) { width = 0; return RVVM::RV_EACCESS; }
+        RVVM::rv_err read8(uint32_t addr, uint8_t &data)   { width = 8;  offset = addr; data = 0x81; return RVVM::RV_EOK; }
+        RVVM::rv_err read16(uint32_t addr, uint16_t &data) { width = 16; offset = addr; data = 0x8001; return RVVM::RV_EOK; }
+        RVVM::rv_err read32(uint32_t addr, uint32_t &data) { width = 32; offset = addr; data = 0x80000001; return RVVM::RV_EOK; }
+        RVVM::rv_err write8(uint32_t addr, uint8_t data)   { width = 8;  offset = addr; value = data; return RVVM::RV_EOK; }
+        RVVM::rv_err write16(uint32_t addr, uint16_t data) { width = 16; offset = addr; value = data; return RVVM::RV_EOK; }
+        RVVM::rv_err write32(uint32_t addr, uint32_t data) { width = 32; offset = addr; value = data; return RVVM::RV_EOK; }
+
+        int width = 0;
+        uint32_t offset = 0;
+        uint32_t value  = 0;
+};
+
+TEST(RV32I, TypedAccess) {
+    rv32i_args a;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    RVVM::rv32_inst_fmt inst;
+    RVVM::rv32_mem_info info;
+    RVVM::rv32_mem_infos mems;
+    RV32MmioMem mem;
+
+    info.addr = 0x10000000;
+    info.len  = 0x1000;
+    info.mem  = &mem;
+    mems.push_back(info);
+
+    regs.ctl = &ctrl;
+    regs.reg = &reg;
+    a.i      = &rv32i;
+    a.inst   = &inst;
+    a.regs   = &regs;
+    a.mems   = &mems;
+
+    reg.pc = 0;
+    memset(reg.x, 0, sizeof(reg.x));
+    reg.x[1] = 0x10000010;
+
+    /* lb/lh/lw/lbu/lhu x3, 4(x1) */
+    inst.inst       = 0;
+    inst.opcode     = 0b0000011;
+    inst.I.rd       = 3;
+    inst.I.rs1      = 1;
+    inst.I.imm_11_0 = 4;
+    inst.I.funct3   = 0b000;
+    EXPECT_EQ(rv32i_exec(a)->regs->reg->x[3], 0xFFFFFF81);
+    EXPECT_EQ(mem.width, 8);
+    EXPECT_EQ(mem.offset, 0x14);
+    inst.I.funct3   = 0b001;
+    EXPECT_EQ(rv32i_exec(a)->regs->reg->x[3], 0xFFFF8001);
+    EXPECT_EQ(mem.width, 16);
+    inst.I.funct3   = 0b010;
+    EXPECT_EQ(rv32i_exec(a)->regs->reg->x[3], 0x80000001);
+    EXPECT_EQ(mem.width, 32);
+    inst.I.funct3   = 0b100;
+    EXPECT_EQ(rv32i_exec(a)->regs->reg->x[3], 0x81);
+    EXPECT_EQ(mem.width, 8);
+    inst.I.funct3   = 0b101;
+    EXPECT_EQ(rv32i_exec(a)->regs->reg->x[3], 0x8001);
+    EXPECT_EQ(mem.width, 16);
+
+    /* sb/sh/sw x2, 0(x1) */
+    inst.inst       = 0;
+    inst.opcode     = 0b0100011;
+    inst.S.rs1      = 1;
+    inst.S.rs2      = 2;
+    reg.x[2] = 0xFFAA71BB;
+    inst.S.funct3   = 0b000;
+    rv32i_exec(a);
+    EXPECT_EQ(mem.width, 8);
+    EXPECT_EQ(mem.offset, 0x10);
+    EXPECT_EQ(mem.value, 0xBB);
+    inst.S.funct3   = 0b001;
+    rv32i_exec(a);
+    EXPECT_EQ(mem.width, 16);
+    EXPECT_EQ(mem.value, 0x71BB);
+    inst.S.funct3   = 0b010;
+    rv32i_exec(a);
+    EXPECT_EQ(mem.width, 32);
+    EXPECT_EQ(mem.value, 0xFFAA71BB);
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include <elf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define TEXT_ADDR 0x10000
+
+/**
+ * @brief Write a static ELF of one PT_LOAD segment holding code, at TEXT_ADDR
+ */
+static std::string elf_make(const std::vector<uint32_t> &code)
+{
+    std::string path = testing::TempDir() + "rv32linux.elf";
+    Elf32_Ehdr eh = {};
+    Elf32_Phdr ph = {};
+    uint32_t off = sizeof(eh) + sizeof(ph);
+
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS]   = ELFCLASS32;
+    eh.e_ident[EI_DATA]    = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type      = ET_EXEC;
+    eh.e_machine   = EM_RISCV;
+    eh.e_version   = EV_CURRENT;
+    eh.e_entry     = TEXT_ADDR + off;
+    eh.e_phoff     = sizeof(eh);
+    eh.e_ehsize    = sizeof(eh);
+    eh.e_phentsize = sizeof(ph);
+    eh.e_phnum     = 1;
+    ph.p_type   = PT_LOAD;
+    ph.p_vaddr  = TEXT_ADDR;
+    ph.p_paddr  = TEXT_ADDR;
+    ph.p_filesz = off + code.size() * 4;
+    ph.p_memsz  = ph.p_filesz;
+    ph.p_flags  = PF_R | PF_X;
+    ph.p_align  = RV_PAGE_SIZE;
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    fwrite(&eh, sizeof(eh), 1, fp);
+    fwrite(&ph, sizeof(ph), 1, fp);
+    fwrite(code.data(), 4, code.size(), fp);
+    fclose(fp);
+    return path;
+}
+
+static uint32_t addi(uint32_t rd, uint32_t rs1, int32_t imm)
+{
+    return 0x13 | (rd << 7) | (rs1 << 15) | ((imm & 0xfff) << 20);
+}
+
+static int32_t sys_call(RVVM::RV32::RV32Linux &user, RVVM::rv32_regs &regs, uint32_t nr,
+                       uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0, uint32_t a4 = 0)
+{
+    regs.reg->x[17] = nr;
+    regs.reg->x[10] = a0;
+    regs.reg->x[11] = a1;
+    regs.reg->x[12] = a2;
+    regs.reg->x[13] = a3;
+    regs.reg->x[14] = a4;
+    user.call(regs);
+    return regs.reg->x[10];
+}
+
+TEST(RV32Linux, Run) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::RV32::RV32Linux user;
+    uint32_t val = 0;
+    char arg[8] = {0};
+
+    /* exit(argc + 40) */
+    std::string path = elf_make({
+        addi(5, 2, 0), 0x0002a503,      /* lw a0, 0(sp) */
+        addi(10, 10, 40), addi(17, 0, 93), 0x00000073,
+    });
+    ASSERT_TRUE(user.load(path, {"prog", "-x"}, {"A=1"}));
+    EXPECT_EQ(user.entry(), TEXT_ADDR + sizeof(Elf32_Ehdr) + sizeof(Elf32_Phdr));
+    EXPECT_EQ(user.stack() & 15, 0);
+
+    /* argc, then argv[0] */
+    user.space()->read(user.stack(), &val, 4);
+    EXPECT_EQ(val, 2);
+    user.space()->read(user.stack() + 4, &val, 4);
+    user.space()->read(val, arg, 5);
+    EXPECT_STREQ(arg, "prog");
+
+    vm.add_inst("I", &rv32i);
+    ASSERT_TRUE(vm.set_linux(&user));
+    EXPECT_EQ(vm.regs()->pc, user.entry());
+    vm.step(100);
+    EXPECT_EQ(user.exit_code(), 42);
+    remove(path.c_str());
+}
+
+TEST(RV32Linux, Memory) {
+    RVVM::RV32::RV32Linux user;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    uint32_t val = 0x12345678;
+
+    regs.reg = &reg;
+    regs.ctl = &ctrl;
+    std::string path = elf_make({addi(17, 0, 93), 0x00000073});
+    ASSERT_TRUE(user.load(path, {"prog"}, {}));
+    remove(path.c_str());
+
+    /* brk starts past the segment, grows and shrinks */
+    uint32_t brk = sys_call(user, regs, 214);
+    EXPECT_EQ(brk, TEXT_ADDR + RV_PAGE_SIZE);
+    EXPECT_EQ(sys_call(user, regs, 214, brk + 0x3000), brk + 0x3000);
+    EXPECT_EQ(user.space()->write(brk + 0x2000, &val, 4), RVVM::RV_EOK);
+    EXPECT_EQ(sys_call(user, regs, 214, brk), brk);
+
+    /* anonymous mmap2 is zeroed, page aligned, below the stack, and released by munmap */
+    uint32_t map = sys_call(user, regs, 222, 0, 0x2000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+    ASSERT_LT(map, RV32_LINUX_SPACE - RV32_LINUX_STACK_SIZE);
+    ASSERT_GT(map, brk);
+    EXPECT_EQ(map & (RV_PAGE_SIZE - 1), 0);
+    user.space()->read(map + 0x1000, &val, 4);
+    EXPECT_EQ(val, 0);
+    EXPECT_EQ(sys_call(user, regs, 215, map, 0x2000), 0);
+    EXPECT_EQ(sys_call(user, regs, 215, map + 1, 0x1000), -EINVAL);
+
+    /* a mapping larger than the space fails before looking for room */
+    EXPECT_EQ(sys_call(user, regs, 222, 0, 0xfff00000, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1), -ENOMEM);
+    EXPECT_EQ(sys_call(user, regs, 215, map, 0x2000), 0);
+
+    /* prlimit64 reads limits, and refuses to set them */
+    EXPECT_EQ(sys_call(user, regs, 261, 0, RLIMIT_STACK, 0, brk), 0);
+    EXPECT_EQ(sys_call(user, regs, 261, 0, RLIMIT_STACK, brk, 0), -EPERM);
+
+    /* unknown syscalls */
+    EXPECT_EQ(sys_call(user, regs, 0x7ff), -ENOSYS);
+
+    /* the program is still running, exit_group ends it */
+    EXPECT_TRUE(user.call(regs));
+    regs.reg->x[17] = 94;
+    regs.reg->x[10] = 3;
+    EXPECT_FALSE(user.call(regs));
+    EXPECT_EQ(user.exit_code(), 3);
+}
+
+TEST(RV32Linux, Fds) {
+    RVVM::RV32::RV32Linux user;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    int host[2];
+
+    regs.reg = &reg;
+    regs.ctl = &ctrl;
+    std::string path = elf_make({addi(17, 0, 93), 0x00000073});
+    ASSERT_TRUE(user.load(path, {"prog"}, {}));
+    remove(path.c_str());
+    ASSERT_EQ(pipe(host), 0);
+
+    /* fds of the host are neither closed nor replaced, stdio closes as a no-op */
+    EXPECT_EQ(sys_call(user, regs, 57, host[0]), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 24, 1, host[1], 0), -EBUSY);
+    EXPECT_EQ(sys_call(user, regs, 57, 1), 0);
+    EXPECT_GE(fcntl(host[0], F_GETFD), 0);
+    EXPECT_GE(fcntl(1, F_GETFD), 0);
+
+    /* nor used by any call taking an fd, or as a directory */
+    uint32_t name = TEXT_ADDR + RV_PAGE_SIZE;
+    user.space()->write(name, (void*)"/dev/null", 10);
+    for (uint32_t nr:{63, 64, 65, 66, 67, 68}) {
+        EXPECT_EQ(sys_call(user, regs, nr, host[(nr + 1) & 1], name, 1), -EBADF) << nr;
+    }
+    EXPECT_EQ(sys_call(user, regs, 23, host[0]), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 24, host[0], 100, 0), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 25, host[0], F_GETFL), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 29, host[0], TCGETS, name), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 61, host[0], name, 64), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 62, host[0], 0, 0, name, SEEK_SET), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 56, host[0], name, O_RDONLY), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 78, host[0], name, name, 16), -EBADF);
+    regs.reg->x[15] = 0;
+    EXPECT_EQ(sys_call(user, regs, 222, 0, 0x1000, PROT_READ, MAP_PRIVATE, host[0]), -EBADF);
+    ASSERT_EQ(fcntl(host[0], F_SETFL, O_NONBLOCK), 0);
+    char c;
+    EXPECT_EQ(read(host[0], &c, 1), -1);
+
+    /* fds the program opened are */
+    int32_t fd = sys_call(user, regs, 56, AT_FDCWD, name, O_RDONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(sys_call(user, regs, 63, fd, name, 1), 0);
+    uint32_t map = sys_call(user, regs, 222, 0, 0x1000, PROT_READ, MAP_PRIVATE, fd);
+    EXPECT_EQ(map & (RV_PAGE_SIZE - 1), 0);
+    EXPECT_EQ(sys_call(user, regs, 215, map, 0x1000), 0);
+    int32_t dup = sys_call(user, regs, 23, fd);
+    ASSERT_GE(dup, 0);
+    EXPECT_EQ(sys_call(user, regs, 57, fd), 0);
+    EXPECT_EQ(sys_call(user, regs, 57, fd), -EBADF);
+    EXPECT_EQ(sys_call(user, regs, 57, dup), 0);
+    EXPECT_EQ(fcntl(dup, F_GETFD), -1);
+
+    close(host[0]);
+    close(host[1]);
+}
@@ -1,10 +1,12 @@
 #include "RV32Mem.h"
+#include <algorithm>
 
 using namespace ZoraGA::RVVM;
 
 RV32Mem::RV32Mem(size_t size)
 {
     m_mem.resize(size);
+    m_dirty.resize(size);
 }
 
 RV32Mem::~RV32Mem()
@@ -18,6 +20,7 @@ std::vector<uint8_t> *RV32Mem::raw()
 void RV32Mem::reset()
 {
     memset(&m_mem[0], 0, m_mem.size());
+    m_dirty.clear();
 }
 
 rv_err RV32Mem::read(uint32_t addr, void *p, uint32_t sz)
@@ -31,5 +34,41 @@ rv_err RV32Mem::write(uint32_t addr, void *p, uint32_t sz)
 {
     if (addr + sz > m_mem.size()) return RV_ERANGE;
     memcpy(&m_mem[addr], p, sz);
+    m_dirty.mark(addr, sz);
     return RV_EOK;
 }
+
+rv_dirty *RV32Mem::dirty()
+{
+    return &m_dirty;
+}
+
+rv_err RV32Mem::set_baseline()
+{
+    m_base = m_mem;
+    return RV_EOK;
+}
+
+rv_err RV32Mem::revert_pages(const std::vector<uint32_t> &pages)
+{
+    if (m_base.size() != m_mem.size()) return RV_EMISSING;
+    for (auto pg:pages) {
+        size_t off = (size_t)pg << RV_PAGE_SHIFT;
+        if (off >= m_mem.size()) continue;
+        memcpy(&m_mem[off], &m_base[off], std::min((size_t)RV_PAGE_SIZE, m_mem.size() - off));
+    }
+    return RV_EOK;
+}
+
+rv32_mem *RV32Mem::clone()
+{
+    RV32Mem *mem = new RV32Mem(m_mem.size());
+    memcpy(&(*mem->raw())[0], &m_mem[0], m_mem.size());
+    return mem;
+}
+
+void *RV32Mem::host(uint32_t &len)
+{
+    len = m_mem.size();
+    return &m_mem[0];
+}
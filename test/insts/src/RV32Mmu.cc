@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32Mmu.h"
+#include "ZoraGA/RV32Zicsr.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+using namespace ZoraGA::RVVM;
+
+static void pte_set(std::vector<uint8_t> &ram, uint32_t addr, uint32_t pte)
+{
+    memcpy(&ram[addr], &pte, 4);
+}
+
+static uint32_t pte_get(std::vector<uint8_t> &ram, uint32_t addr)
+{
+    uint32_t pte;
+    memcpy(&pte, &ram[addr], 4);
+    return pte;
+}
+
+TEST(RV32Mmu, Sv32) {
+    RVVM::RV32::RV32Mmu mmu;
+    RVVM::rv32_mem_infos mems;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    uint32_t pa = 0, fault = 0;
+    RVVM::rv_access acc;
+
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+    mmu.set_mems(&mems);
+
+    /* PMP entry 0, NAPOT RWX of the whole space */
+    uint32_t cfg[4] = {0x1f, 0, 0, 0};
+    uint32_t addr[16] = {0xffffffff};
+    mmu.set_pmp(cfg, addr);
+
+    /* root at 0x1000, 0x40000000 -> table at 0x2000 -> 0x3000, 0x80000000 global megapage -> 0 */
+    pte_set(ram, 0x1000 + 0x100 * 4, (2 << 10) | 0x01);
+    pte_set(ram, 0x2000, (3 << 10) | 0x07);
+    pte_set(ram, 0x2004, (4 << 10) | 0x17);
+    pte_set(ram, 0x1000 + 0x200 * 4, (0 << 10) | 0xef);
+
+    /* S-Mode, ASID 1 */
+    mmu.set_context(0x80000000 | (1 << 22) | 1, 1, 1, 0);
+    EXPECT_TRUE(mmu.active(RVVM::RV_ACC_R));
+
+    /* walk sets A, a store sets D */
+    EXPECT_EQ(mmu.translate(0x40000010, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x3010);
+    EXPECT_EQ(pte_get(ram, 0x2000) & 0xc0, 0x40);
+    EXPECT_EQ(mmu.translate(0x40000020, RVVM::RV_ACC_W, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x3020);
+    EXPECT_EQ(pte_get(ram, 0x2000) & 0xc0, 0xc0);
+    EXPECT_EQ(mmu.translate(0x40000000, RVVM::RV_ACC_X, pa), RVVM::RV_EPAGE);
+
+    /* U page without SUM */
+    EXPECT_EQ(mmu.translate(0x40001008, RVVM::RV_ACC_R, pa), RVVM::RV_EPAGE);
+    mmu.fault(fault, acc);
+    EXPECT_EQ(fault, 0x40001008);
+    EXPECT_EQ(acc, RVVM::RV_ACC_R);
+    mmu.set_context(0x80000000 | (1 << 22) | 1, 1, 1, 1 << 18);
+    EXPECT_EQ(mmu.translate(0x40001008, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x4008);
+
+    /* megapage */
+    EXPECT_EQ(mmu.translate(0x80005004, RVVM::RV_ACC_X, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x5004);
+    EXPECT_EQ(mmu.translate(0xc0000000, RVVM::RV_ACC_R, pa), RVVM::RV_EPAGE);
+
+    /* stale entries are used until sfence.vma of their page */
+    pte_set(ram, 0x2000, (5 << 10) | 0xc7);
+    pte_set(ram, 0x1000 + 0x200 * 4, (1024 << 10) | 0xef);
+    EXPECT_EQ(mmu.translate(0x40000010, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x3010);
+    mmu.fence(RVVM::rv_sfence<uint32_t>{true, true, false, 0x40000abc, 0});
+    EXPECT_EQ(mmu.translate(0x40000010, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x5010);
+
+    /* global entries survive an ASID switch and an ASID flush, one address flushes its megapage */
+    mmu.set_context(0x80000000 | (2 << 22) | 1, 1, 1, 0);
+    EXPECT_EQ(mmu.translate(0x80005004, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x5004);
+    mmu.fence(RVVM::rv_sfence<uint32_t>{true, false, true, 0, 2});
+    EXPECT_EQ(mmu.translate(0x80005004, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x5004);
+    mmu.fence(RVVM::rv_sfence<uint32_t>{true, true, false, 0x80123000, 0});
+    EXPECT_EQ(mmu.translate(0x80005004, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x405004);
+
+    /* M-Mode is not translated */
+    mmu.set_context(0x80000000 | (2 << 22) | 1, 3, 3, 0);
+    EXPECT_FALSE(mmu.active(RVVM::RV_ACC_X));
+    EXPECT_EQ(mmu.translate(0xc0000000, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0xc0000000);
+}
+
+TEST(RV32Mmu, Split) {
+    RVVM::RV32::RV32Mmu mmu;
+    RVVM::rv32_mem_infos mems;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    uint32_t v = 0, fault = 0;
+    RVVM::rv_access acc;
+
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+    mmu.set_mems(&mems);
+    uint32_t cfg[4] = {0x1f, 0, 0, 0};
+    uint32_t addr[16] = {0xffffffff};
+    mmu.set_pmp(cfg, addr);
+
+    /* 0x40000000 -> 0x3000, 0x40001000 -> 0x6000, 0x40002000 unmapped */
+    pte_set(ram, 0x1000 + 0x100 * 4, (2 << 10) | 0x01);
+    pte_set(ram, 0x2000, (3 << 10) | 0xc7);
+    pte_set(ram, 0x2004, (6 << 10) | 0xc7);
+    mmu.set_context(0x80000000 | 1, 1, 1, 0);
+    mems.xlate = &mmu;
+
+    /* a misaligned word across the pages goes to both frames */
+    EXPECT_EQ((rv32_mem_write32(0x40000ffe, 0xaabbccdd, mems)), RVVM::RV_EOK);
+    EXPECT_EQ(ram[0x3ffe], 0xdd);
+    EXPECT_EQ(ram[0x3fff], 0xcc);
+    EXPECT_EQ(ram[0x6000], 0xbb);
+    EXPECT_EQ(ram[0x6001], 0xaa);
+    EXPECT_EQ((rv32_mem_read32(0x40000ffe, v, mems)), RVVM::RV_EOK);
+    EXPECT_EQ(v, 0xaabbccdd);
+
+    /* the second half faults, at the start of its page, before the first is written */
+    EXPECT_EQ((rv32_mem_write16(0x40001fff, 0x1234, mems)), RVVM::RV_EPAGE);
+    EXPECT_EQ(ram[0x6fff], 0);
+    mmu.fault(fault, acc);
+    EXPECT_EQ(fault, 0x40002000);
+    EXPECT_EQ(acc, RVVM::RV_ACC_W);
+}
+
+TEST(RV32Mmu, Pmp) {
+    RVVM::RV32::RV32Mmu mmu;
+    RVVM::rv32_mem_infos mems;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    uint32_t pa = 0, fault = 0;
+    RVVM::rv_access acc;
+
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+    mmu.set_mems(&mems);
+
+    /* S-Mode without entries has no access */
+    mmu.set_context(0, 1, 1, 0);
+    EXPECT_EQ(mmu.translate(0x1000, RVVM::RV_ACC_R, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.fault(fault, acc), RVVM::RV_EACCESS);
+    EXPECT_EQ(fault, 0x1000);
+    EXPECT_EQ(mmu.fault(fault, acc), RVVM::RV_EOK);
+
+    /* TOR [0, 0x2000) R, NA4 0x3004 RW, NAPOT [0x3000, 0x4000) R */
+    uint32_t cfg[4] = {0x09 | (0x13 << 8) | (0x19 << 16), 0, 0, 0};
+    uint32_t addr[16] = {0x2000 >> 2, 0x3004 >> 2, 0xdff};
+    mmu.set_pmp(cfg, addr);
+    EXPECT_EQ(mmu.translate(0x1ffc, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(mmu.translate(0x1ffc, RVVM::RV_ACC_W, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.translate(0x1ffc, RVVM::RV_ACC_X, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.translate(0x3004, RVVM::RV_ACC_W, pa), RVVM::RV_EOK);
+    EXPECT_EQ(mmu.translate(0x3008, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(mmu.translate(0x3008, RVVM::RV_ACC_W, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.translate(0x4000, RVVM::RV_ACC_R, pa), RVVM::RV_EACCESS);
+
+    /* M-Mode is not checked by unlocked entries */
+    mmu.set_context(0, 3, 3, 0);
+    EXPECT_EQ(mmu.translate(0x4000, RVVM::RV_ACC_W, pa), RVVM::RV_EOK);
+
+    /* the walk reads the root in [0, 0x2000), but can't set A */
+    memset(&ram[0x1000], 0, 4096);
+    ram[0x1000] = 0x0f;
+    mmu.set_context(0x80000001, 1, 1, 0);
+    EXPECT_EQ(mmu.translate(0x00000100, RVVM::RV_ACC_R, pa), RVVM::RV_EACCESS);
+    ram[0x1000] = 0x4f;
+    EXPECT_EQ(mmu.translate(0x00000100, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(pa, 0x100);
+
+    /* the entry matching any byte decides, accesses partly in the NA4 entry fail */
+    mmu.set_context(0, 1, 1, 0);
+    EXPECT_EQ(mmu.translate(0x3006, 2, RVVM::RV_ACC_W, pa), RVVM::RV_EOK);
+    EXPECT_EQ(mmu.translate(0x3006, 4, RVVM::RV_ACC_W, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.translate(0x3002, 4, RVVM::RV_ACC_R, pa), RVVM::RV_EACCESS);
+}
+
+TEST(RV32Mmu, PmpLock) {
+    RVVM::RV32::RV32Mmu mmu;
+    RVVM::RV32::RV32Zicsr zicsr;
+    RVVM::rv32_mem_infos mems;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    RV32Mem mem(64*1024);
+    uint32_t pa = 0;
+
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+    mmu.set_mems(&mems);
+    mmu.set_context(0, 3, 3, 0);
+
+    /* locked TOR [0, 0x2000) R, unlocked NAPOT [0x3000, 0x4000) R */
+    uint32_t cfg[4] = {0x89 | (0x19 << 8), 0, 0, 0};
+    uint32_t addr[16] = {0x2000 >> 2, 0xdff};
+    mmu.set_pmp(cfg, addr);
+    EXPECT_TRUE(mmu.active(RVVM::RV_ACC_R));
+    EXPECT_EQ(mmu.translate(0x1000, RVVM::RV_ACC_R, pa), RVVM::RV_EOK);
+    EXPECT_EQ(mmu.translate(0x1000, RVVM::RV_ACC_W, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.translate(0x1ffe, 4, RVVM::RV_ACC_R, pa), RVVM::RV_EACCESS);
+    EXPECT_EQ(mmu.translate(0x3000, RVVM::RV_ACC_W, pa), RVVM::RV_EOK);
+    EXPECT_EQ(mmu.translate(0x8000, RVVM::RV_ACC_X, pa), RVVM::RV_EOK);
+
+    /* locked entries and the bottom of a locked TOR one ignore writes */
+    regs.reg = &reg;
+    regs.ctl = &ctrl;
+    ctrl.priv = 3;
+    ctrl.csrs[RVVM::rv_csr_addr(RVVM::CSR_pmpcfg0)] = cfg[0];
+    ctrl.csrs[RVVM::rv_csr_addr(RVVM::CSR_pmpaddr0)] = addr[0];
+    ctrl.csrs[RVVM::rv_csr_addr(RVVM::CSR_pmpaddr1)] = addr[1];
+    reg.x[1] = 0;
+    RVVM::rv32_inst_fmt inst;
+    /* csrw pmpcfg0, x1; csrw pmpaddr0, x1; csrw pmpaddr1, x1 */
+    inst.inst = 0x3a009073;
+    EXPECT_EQ(zicsr.exec(inst, regs, mems), RVVM::RV_EOK);
+    EXPECT_EQ(ctrl.csrs[RVVM::rv_csr_addr(RVVM::CSR_pmpcfg0)].to_ulong(), 0x89);
+    inst.inst = 0x3b009073;
+    EXPECT_EQ(zicsr.exec(inst, regs, mems), RVVM::RV_EOK);
+    EXPECT_EQ(ctrl.csrs[RVVM::rv_csr_addr(RVVM::CSR_pmpaddr0)].to_ulong(), 0x2000 >> 2);
+    inst.inst = 0x3b109073;
+    EXPECT_EQ(zicsr.exec(inst, regs, mems), RVVM::RV_EOK);
+    EXPECT_EQ(ctrl.csrs[RVVM::rv_csr_addr(RVVM::CSR_pmpaddr1)].to_ulong(), 0);
+}
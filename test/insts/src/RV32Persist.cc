@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+#define ENTRY 0x08
+#define RET   0x1c
+#define BUF   0x100
+
+/**
+ * @brief The loop of the fuzzer: run to the entry, baseline, then run inputs to the return
+ */
+class persist_vm
+{
+    public:
+        persist_vm():mem(64*1024)
+        {
+            /**
+             * li a0, BUF; li a1, 1
+             * entry: lw a2, 0(a0); beqz a2, 1f; sw a1, 0(a0)
+             * 1: addi a1, a1, 5; sw a1, 4(a0)
+             * ret: j .
+             */
+            uint32_t code[] = {0x10000513, 0x00100593, 0x00052603, 0x00060463, 0x00b52023, 0x00558593, 0x00b52223, 0x0000006f};
+            memcpy(&(*mem.raw())[0], code, sizeof(code));
+            vm.add_inst("I", &rv32i);
+            vm.add_mem(0, 64*1024, &mem);
+        }
+
+        /**
+         * @brief Write the input to BUF and run to the return
+         */
+        RVVM::rv_stop run(uint32_t input)
+        {
+            EXPECT_TRUE(vm.write_mem(BUF, &input, 4));
+            return vm.step(100);
+        }
+
+        uint32_t word(uint32_t addr)
+        {
+            uint32_t val = 0;
+            EXPECT_TRUE(vm.read_mem(addr, &val, 4));
+            return val;
+        }
+
+        RVVM::RV32::rv32 vm;
+        RVVM::RV32::RV32I rv32i;
+        RV32Mem mem;
+};
+
+TEST(RV32Persist, Revert) {
+    persist_vm p;
+    ASSERT_TRUE(p.vm.add_breakpoint(ENTRY));
+    EXPECT_EQ(p.vm.step(100), RVVM::RV_STOP_BREAK);
+    EXPECT_EQ(p.vm.regs()->pc, ENTRY);
+    EXPECT_FALSE(p.vm.add_breakpoint(ENTRY));
+    ASSERT_TRUE(p.vm.del_breakpoint(ENTRY));
+    ASSERT_TRUE(p.vm.add_breakpoint(RET));
+    ASSERT_TRUE(p.vm.set_baseline());
+
+    /* the input is stored back, a1 and a2 change */
+    EXPECT_EQ(p.run(7), RVVM::RV_STOP_BREAK);
+    EXPECT_EQ(p.vm.regs()->pc, RET);
+    EXPECT_EQ(p.vm.regs()->x[11], 6);
+    EXPECT_EQ(p.vm.regs()->x[12], 7);
+    EXPECT_EQ(p.word(BUF), 1);
+    EXPECT_EQ(p.word(BUF + 4), 6);
+
+    /* memory, registers and pc are back to the entry */
+    p.vm.regs()->x[20] = 0x1234;
+    ASSERT_TRUE(p.vm.revert());
+    EXPECT_EQ(p.vm.regs()->pc, ENTRY);
+    EXPECT_EQ(p.vm.regs()->x[10], BUF);
+    EXPECT_EQ(p.vm.regs()->x[11], 1);
+    EXPECT_EQ(p.vm.regs()->x[12], 0);
+    EXPECT_EQ(p.vm.regs()->x[20], 0);
+    EXPECT_EQ(p.word(BUF), 0);
+    EXPECT_EQ(p.word(BUF + 4), 0);
+
+    /* and again, from the same baseline */
+    EXPECT_EQ(p.run(0), RVVM::RV_STOP_BREAK);
+    EXPECT_EQ(p.word(BUF), 0);
+    EXPECT_EQ(p.word(BUF + 4), 6);
+    ASSERT_TRUE(p.vm.revert());
+    EXPECT_EQ(p.word(BUF + 4), 0);
+    EXPECT_EQ(p.vm.regs()->pc, ENTRY);
+}
+
+TEST(RV32Persist, Edges) {
+    persist_vm p;
+    uint8_t taken[256] = {0}, fall[256] = {0};
+    EXPECT_FALSE(p.vm.set_edge_map(taken, 100));
+    p.vm.add_breakpoint(ENTRY);
+    p.vm.step(100);
+    p.vm.del_breakpoint(ENTRY);
+    p.vm.add_breakpoint(RET);
+    ASSERT_TRUE(p.vm.set_baseline());
+
+    /* beqz taken, then not taken, each leaves hits the other doesn't */
+    ASSERT_TRUE(p.vm.set_edge_map(taken, sizeof(taken)));
+    EXPECT_EQ(p.run(0), RVVM::RV_STOP_BREAK);
+    ASSERT_TRUE(p.vm.revert());
+    ASSERT_TRUE(p.vm.set_edge_map(fall, sizeof(fall)));
+    EXPECT_EQ(p.run(1), RVVM::RV_STOP_BREAK);
+    ASSERT_TRUE(p.vm.set_edge_map(nullptr, 0));
+
+    int hits = 0, only_taken = 0;
+    for (size_t i=0; i<sizeof(taken); i++) {
+        hits += taken[i];
+        only_taken += (taken[i] && !fall[i]);
+    }
+    EXPECT_GT(hits, 0);
+    EXPECT_GT(only_taken, 0);
+    EXPECT_NE(memcmp(taken, fall, sizeof(taken)), 0);
+}
@@ -0,0 +1,284 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "ZoraGA/RV32Zicsr.h"
+#include "ZoraGA/RV32Privileged.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+#define MRET            0x30200073
+#define SRET            0x10200073
+#define WFI             0x10500073
+#define SFENCE_VMA      0x12000073
+#define SINVAL_VMA      0x16000073
+#define CSRR_A0_SATP    0x18002573
+#define CSRW_SATP_A0    0x18051073
+#define CSRW_MIP_A0     0x34451073
+#define CSRW_MISA_A0    0x30151073
+#define CSRW_MSTATUS_A0 0x30051073
+#define RDCYCLE_A0      0xc0002573
+#define RDTIME_A0       0xc0102573
+#define RDINSTRET_A0    0xc0202573
+#define RDCYCLEH_A0     0xc8002573
+
+/**
+ * @brief Privileged and Zicsr instructions on registers with the S-Mode CSRs
+ */
+class priv_exec
+{
+    public:
+        priv_exec()
+        {
+            regs.reg = &reg;
+            regs.ctl = &ctrl;
+            memset(reg.x, 0, sizeof(reg.x));
+            privileged.s_mode(true);
+            privileged.regist(regs, isas);
+        }
+
+        RVVM::rv_err exec(RVVM::rv32_inst *set, uint32_t bits)
+        {
+            RVVM::rv32_inst_fmt inst;
+            inst.inst = bits;
+            EXPECT_EQ(set->isValid(inst), RVVM::RV_EOK);
+            return set->exec(inst, regs, mems);
+        }
+
+        uint32_t csr(uint16_t addr)
+        {
+            return ctrl.csrs[RVVM::rv_csr_addr(addr)].to_ulong();
+        }
+
+        void csr_set(uint16_t addr, uint32_t val)
+        {
+            ctrl.csrs[RVVM::rv_csr_addr(addr)] = val;
+        }
+
+        RVVM::RV32::RV32Privileged privileged;
+        RVVM::RV32::RV32Zicsr zicsr;
+        RVVM::rv32_regs_base reg;
+        RVVM::rv32_regs_ctrl ctrl;
+        RVVM::rv32_regs regs;
+        RVVM::rv32_mem_infos mems;
+        std::vector<std::string> isas;
+};
+
+TEST(RV32Privileged, Mret) {
+    priv_exec p;
+
+    /* illegal below M-Mode */
+    p.ctrl.priv = 1;
+    EXPECT_EQ(p.exec(&p.privileged, MRET), RVVM::RV_EININST);
+
+    /* to S-Mode at mepc, MIE from MPIE, MPP to U-Mode and MPRV cleared */
+    p.ctrl.priv = 3;
+    p.csr_set(RVVM::CSR_mepc, 0x1001);
+    p.csr_set(RVVM::CSR_mstatus, (1U << 7) | (1U << 11) | (1U << 17));
+    EXPECT_EQ(p.exec(&p.privileged, MRET), RVVM::RV_EOK);
+    EXPECT_EQ(p.ctrl.priv, 1);
+    EXPECT_EQ(p.reg.pc, 0x1000);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), (1U << 3) | (1U << 7));
+    EXPECT_TRUE(p.ctrl.pc_changed);
+    EXPECT_TRUE(p.ctrl.csr_changed);
+}
+
+TEST(RV32Privileged, Sret) {
+    priv_exec p;
+
+    /* illegal in U-Mode */
+    p.ctrl.priv = 0;
+    EXPECT_EQ(p.exec(&p.privileged, SRET), RVVM::RV_EININST);
+
+    /* to U-Mode at sepc, SIE from SPIE */
+    p.ctrl.priv = 1;
+    p.csr_set(RVVM::CSR_sepc, 0x2000);
+    p.csr_set(RVVM::CSR_mstatus, 1U << 5);
+    EXPECT_EQ(p.exec(&p.privileged, SRET), RVVM::RV_EOK);
+    EXPECT_EQ(p.ctrl.priv, 0);
+    EXPECT_EQ(p.reg.pc, 0x2000);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), (1U << 1) | (1U << 5));
+
+    /* TSR traps sret in S-Mode only */
+    p.ctrl.priv = 1;
+    p.csr_set(RVVM::CSR_mstatus, (1U << 8) | (1U << 22));
+    EXPECT_EQ(p.exec(&p.privileged, SRET), RVVM::RV_EININST);
+    EXPECT_EQ(p.ctrl.priv, 1);
+    p.ctrl.priv = 3;
+    EXPECT_EQ(p.exec(&p.privileged, SRET), RVVM::RV_EOK);
+    EXPECT_EQ(p.ctrl.priv, 1);
+}
+
+TEST(RV32Privileged, Tvm) {
+    priv_exec p;
+    p.csr_set(RVVM::CSR_satp, 0x80000123);
+    p.reg.x[10] = 0x80000456;
+
+    /* without TVM, S-Mode manages the translation */
+    p.ctrl.priv = 1;
+    EXPECT_EQ(p.exec(&p.privileged, SFENCE_VMA), RVVM::RV_EOK);
+    EXPECT_EQ(p.exec(&p.privileged, SINVAL_VMA), RVVM::RV_EOK);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRR_A0_SATP), RVVM::RV_EOK);
+    EXPECT_EQ(p.reg.x[10], 0x80000123);
+
+    /* TVM traps sfence.vma, sinval.vma and satp in S-Mode, satp is kept */
+    p.csr_set(RVVM::CSR_mstatus, 1U << 20);
+    p.ctrl.sfence.pending = false;
+    p.reg.x[10] = 0x80000456;
+    EXPECT_EQ(p.exec(&p.privileged, SFENCE_VMA), RVVM::RV_EININST);
+    EXPECT_EQ(p.exec(&p.privileged, SINVAL_VMA), RVVM::RV_EININST);
+    EXPECT_FALSE(p.ctrl.sfence.pending);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRR_A0_SATP), RVVM::RV_EININST);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_SATP_A0), RVVM::RV_EININST);
+    EXPECT_EQ(p.reg.x[10], 0x80000456);
+    EXPECT_EQ(p.csr(RVVM::CSR_satp), 0x80000123);
+
+    /* not in M-Mode */
+    p.ctrl.priv = 3;
+    EXPECT_EQ(p.exec(&p.privileged, SFENCE_VMA), RVVM::RV_EOK);
+    EXPECT_TRUE(p.ctrl.sfence.pending);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_SATP_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_satp), 0x80000456);
+}
+
+TEST(RV32Privileged, Wfi) {
+    priv_exec p;
+    p.ctrl.priv = 0;
+    p.reg.pc    = 0x100;
+    EXPECT_EQ(p.exec(&p.privileged, WFI), RVVM::RV_EOK);
+    EXPECT_EQ(p.reg.pc, 0x100);
+}
+
+TEST(RV32Privileged, Csr) {
+    priv_exec p;
+
+    /* csrr a0, mstatus needs M-Mode */
+    p.csr_set(RVVM::CSR_mstatus, 0x88);
+    p.ctrl.priv = 1;
+    EXPECT_EQ(p.exec(&p.zicsr, 0x30002573), RVVM::RV_EININST);
+    p.ctrl.priv = 3;
+    EXPECT_EQ(p.exec(&p.zicsr, 0x30002573), RVVM::RV_EOK);
+    EXPECT_EQ(p.reg.x[10], 0x88);
+
+    /* csrw mvendorid, zero, the CSR is read-only */
+    EXPECT_EQ(p.exec(&p.zicsr, 0xf1101073), RVVM::RV_EININST);
+
+    /* a CSR that doesn't exist */
+    p.ctrl.csrs.erase(RVVM::rv_csr_addr(RVVM::CSR_mstatus));
+    EXPECT_EQ(p.exec(&p.zicsr, 0x30002573), RVVM::RV_EININST);
+}
+
+TEST(RV32Privileged, Warl) {
+    priv_exec p;
+    p.ctrl.priv = 3;
+
+    /* MEIP, MTIP and STIP are kept, the others written */
+    p.csr_set(RVVM::CSR_mip, 1U << 7);
+    p.reg.x[10] = UINT32_MAX & ~(1U << 7);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MIP_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_mip), UINT32_MAX & ~((1U << 5) | (1U << 11)));
+
+    /* misa ignores writes */
+    uint32_t misa = p.csr(RVVM::CSR_misa);
+    p.reg.x[10] = 0;
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MISA_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_misa), misa);
+
+    /* MPP to S-Mode and U-Mode, 2 keeps the previous mode */
+    p.reg.x[10] = (1U << 11) | (1U << 3);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MSTATUS_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), (1U << 11) | (1U << 3));
+    p.reg.x[10] = (2U << 11) | (1U << 7);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MSTATUS_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), (1U << 11) | (1U << 7));
+    p.reg.x[10] = 0;
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MSTATUS_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), 0);
+
+    /* with M-Mode only, MPP stays M-Mode */
+    p.csr_set(RVVM::CSR_misa, 0x40000000);
+    p.csr_set(RVVM::CSR_mstatus, 3U << 11);
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MSTATUS_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), 3U << 11);
+    p.reg.x[10] = 1U << 11;
+    EXPECT_EQ(p.exec(&p.zicsr, CSRW_MSTATUS_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.csr(RVVM::CSR_mstatus), 3U << 11);
+}
+
+TEST(RV32Privileged, Counters) {
+    priv_exec p;
+    p.csr_set(RVVM::CSR_cycle, 11);
+    p.csr_set(RVVM::CSR_time, 22);
+    p.csr_set(RVVM::CSR_instret, 33);
+    p.csr_set(RVVM::CSR_cycleh, 44);
+
+    /* M-Mode always reads them */
+    p.ctrl.priv = 3;
+    for (uint32_t inst:{RDCYCLE_A0, RDTIME_A0, RDINSTRET_A0, RDCYCLEH_A0}) {
+        EXPECT_EQ(p.exec(&p.zicsr, inst), RVVM::RV_EOK);
+    }
+    EXPECT_EQ(p.reg.x[10], 44);
+
+    /* S-Mode needs mcounteren */
+    p.ctrl.priv = 1;
+    for (uint32_t inst:{RDCYCLE_A0, RDTIME_A0, RDINSTRET_A0, RDCYCLEH_A0}) {
+        EXPECT_EQ(p.exec(&p.zicsr, inst), RVVM::RV_EININST);
+    }
+    p.csr_set(RVVM::CSR_mcounteren, 0x2);
+    EXPECT_EQ(p.exec(&p.zicsr, RDTIME_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.reg.x[10], 22);
+    EXPECT_EQ(p.exec(&p.zicsr, RDCYCLE_A0), RVVM::RV_EININST);
+    EXPECT_EQ(p.exec(&p.zicsr, RDCYCLEH_A0), RVVM::RV_EININST);
+
+    /* U-Mode needs scounteren too */
+    p.ctrl.priv = 0;
+    p.csr_set(RVVM::CSR_mcounteren, 0x7);
+    p.csr_set(RVVM::CSR_scounteren, 0x4);
+    EXPECT_EQ(p.exec(&p.zicsr, RDINSTRET_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.reg.x[10], 33);
+    EXPECT_EQ(p.exec(&p.zicsr, RDTIME_A0), RVVM::RV_EININST);
+    p.csr_set(RVVM::CSR_scounteren, 0x1);
+    EXPECT_EQ(p.exec(&p.zicsr, RDCYCLEH_A0), RVVM::RV_EOK);
+    EXPECT_EQ(p.reg.x[10], 44);
+    p.csr_set(RVVM::CSR_mcounteren, 0x6);
+    EXPECT_EQ(p.exec(&p.zicsr, RDCYCLE_A0), RVVM::RV_EININST);
+}
+
+TEST(RV32Privileged, Delegation) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::RV32::RV32Zicsr zicsr;
+    RVVM::RV32::RV32Privileged privileged;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+
+    /* PMP RWX on everything, mtvec 0x200, stvec 0x300, medeleg illegal instruction, mret to S-Mode at 0x400 */
+    uint32_t boot[] = {0xfff00293, 0x3b029073, 0x01f00293, 0x3a029073,
+                       0x20000293, 0x30529073, 0x30000293, 0x10529073, 0x00400293, 0x30229073,
+                       0x40000293, 0x34129073, 0x000012b7, 0x80028293, 0x30029073, MRET};
+    /* M-Mode handler, read mcause, mepc, scause, sepc, mstatus into a0-a4 */
+    uint32_t mtrap[] = {0x34202573, 0x341025f3, 0x14202673, 0x141026f3, 0x30002773, 0x0000006f};
+    /* S-Mode handler, ecall, which is not delegated */
+    uint32_t strap[] = {0x00000073};
+    uint32_t ill = 0;
+    memcpy(&ram[0], boot, sizeof(boot));
+    memcpy(&ram[0x200], mtrap, sizeof(mtrap));
+    memcpy(&ram[0x300], strap, sizeof(strap));
+    memcpy(&ram[0x400], &ill, sizeof(ill));
+
+    privileged.s_mode(true);
+    vm.add_inst("I", &rv32i);
+    vm.add_inst("Zicsr", &zicsr);
+    vm.add_inst("Privileged", &privileged);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.step(30);
+
+    /* the illegal instruction went to S-Mode, the ecall from S-Mode to M-Mode */
+    EXPECT_EQ(vm.regs()->pc, 0x214);
+    EXPECT_EQ(vm.regs()->x[10], 9);
+    EXPECT_EQ(vm.regs()->x[11], 0x300);
+    EXPECT_EQ(vm.regs()->x[12], 2);
+    EXPECT_EQ(vm.regs()->x[13], 0x400);
+    EXPECT_EQ((vm.regs()->x[14] >> 11) & 3, 1);
+    EXPECT_NE(vm.regs()->x[14] & (1U << 8), 0);
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32Sbi.h"
+#include "ZoraGA/RV32Privileged.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+static uint32_t csr(RVVM::rv32_regs &regs, uint16_t addr)
+{
+    return regs.ctl->csrs[RVVM::rv_csr_addr(addr)].to_ulong();
+}
+
+static bool ecall(RVVM::RV32::RV32Sbi &sbi, RVVM::rv32_regs &regs, RVVM::rv32_mem_infos &mems,
+                  uint32_t eid, uint32_t fid, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0)
+{
+    regs.reg->x[17] = eid;
+    regs.reg->x[16] = fid;
+    regs.reg->x[10] = a0;
+    regs.reg->x[11] = a1;
+    regs.reg->x[12] = a2;
+    return sbi.call(regs, mems);
+}
+
+TEST(RV32Sbi, Call) {
+    RVVM::RV32::RV32Sbi sbi;
+    RVVM::RV32::RV32Privileged privileged;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    RVVM::rv32_mem_infos mems;
+    std::vector<std::string> isas;
+    RV32Mem mem(64*1024);
+
+    regs.reg = &reg;
+    regs.ctl = &ctrl;
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+
+    /* S-Mode is needed */
+    EXPECT_EQ(sbi.regist(regs), RVVM::RV_EMISSING);
+    privileged.s_mode(true);
+    privileged.regist(regs, isas);
+    EXPECT_EQ(sbi.regist(regs), RVVM::RV_EOK);
+    EXPECT_EQ(csr(regs, RVVM::CSR_mideleg), 0x222);
+    EXPECT_EQ(csr(regs, RVVM::CSR_pmpcfg0) & 0xff, 0x1f);
+    EXPECT_TRUE(ctrl.pmp_changed);
+
+    /* base, spec version and probe */
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x10, 0));
+    EXPECT_EQ(reg.x[10], 0);
+    EXPECT_EQ(reg.x[11], 2U << 24);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x10, 3, 0x54494D45));
+    EXPECT_EQ(reg.x[11], 1);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x10, 3, 0x48534D));
+    EXPECT_EQ(reg.x[11], 0);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x48534D, 0));
+    EXPECT_EQ((int32_t)reg.x[10], -2);
+
+    /* timer goes to stimecmp */
+    ctrl.csr_changed = false;
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x54494D45, 0, 0x1000, 0x2));
+    EXPECT_EQ(csr(regs, RVVM::CSR_stimecmp), 0x1000);
+    EXPECT_EQ(csr(regs, RVVM::CSR_stimecmph), 0x2);
+    EXPECT_TRUE(ctrl.csr_changed);
+
+    /* IPI to hart 0 only */
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x735049, 0, 0x2, 0));
+    EXPECT_EQ((int32_t)reg.x[10], -3);
+    EXPECT_EQ(csr(regs, RVVM::CSR_mip) & 0x2, 0);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x735049, 0, 0, UINT32_MAX));
+    EXPECT_EQ(reg.x[10], 0);
+    EXPECT_EQ(csr(regs, RVVM::CSR_mip) & 0x2, 0x2);
+
+    /* remote sfence.vma of one page, then of everything */
+    ecall(sbi, regs, mems, 0x52464E43, 1, 1, 0, 0x40001000);
+    reg.x[13] = 0x1000;
+    ecall(sbi, regs, mems, 0x52464E43, 1, 1, 0, 0x40001000);
+    EXPECT_TRUE(ctrl.sfence.pending);
+    EXPECT_TRUE(ctrl.sfence.has_addr);
+    EXPECT_EQ(ctrl.sfence.addr, 0x40001000);
+    reg.x[13] = 0x2000;
+    ecall(sbi, regs, mems, 0x52464E43, 1, 1, 0, 0x40001000);
+    EXPECT_FALSE(ctrl.sfence.has_addr);
+
+    /* debug console writes guest memory */
+    FILE *out = tmpfile();
+    char buf[8] = {0};
+    sbi.set_console(out);
+    memcpy(&(*mem.raw())[0x100], "hello", 5);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x4442434E, 0, 5, 0x100, 0));
+    EXPECT_EQ(reg.x[11], 5);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x01, 0, '!'));
+    rewind(out);
+    EXPECT_EQ(fread(buf, 1, sizeof(buf), out), 6);
+    EXPECT_STREQ(buf, "hello!");
+
+    /* a length past the memory writes the bytes up to its end, none past it is an error */
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x4442434E, 0, 0xfff00000, 0x100, 0));
+    EXPECT_EQ(reg.x[10], 0);
+    EXPECT_EQ(reg.x[11], 64*1024 - 0x100);
+    EXPECT_EQ(ftell(out), 6 + 64*1024 - 0x100);
+    EXPECT_TRUE(ecall(sbi, regs, mems, 0x4442434E, 0, 16, 0x20000, 0));
+    EXPECT_EQ((int32_t)reg.x[10], -3);
+    fclose(out);
+
+    /* shutdown */
+    EXPECT_FALSE(ecall(sbi, regs, mems, 0x53525354, 0, 0));
+    EXPECT_FALSE(ecall(sbi, regs, mems, 0x08, 0));
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32Semihost.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+#define SYS_OPEN          0x01
+#define SYS_CLOSE         0x02
+#define SYS_WRITE0        0x04
+#define SYS_WRITE         0x05
+#define SYS_READ          0x06
+#define SYS_FLEN          0x0C
+#define SYS_REMOVE        0x0E
+#define SYS_CLOCK         0x10
+#define SYS_EXIT          0x18
+#define SYS_EXIT_EXTENDED 0x20
+
+#define BLOCK 0x100
+
+static int32_t request(RVVM::RV32::RV32Semihost &sh, RVVM::rv32_regs &regs, RVVM::rv32_mem_infos &mems,
+                       RV32Mem &mem, uint32_t op, std::vector<uint32_t> block, bool *running = nullptr)
+{
+    memcpy(&(*mem.raw())[BLOCK], block.data(), block.size() * 4);
+    regs.reg->x[10] = op;
+    regs.reg->x[11] = BLOCK;
+    bool ret = sh.call(regs, mems);
+    if (running) *running = ret;
+    return regs.reg->x[10];
+}
+
+TEST(RV32Semihost, Call) {
+    RVVM::RV32::RV32Semihost sh;
+    RVVM::rv32_regs_base reg;
+    RVVM::rv32_regs_ctrl ctrl;
+    RVVM::rv32_regs regs;
+    RVVM::rv32_mem_infos mems;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    char buf[16] = {0};
+    bool running = false;
+
+    regs.reg = &reg;
+    regs.ctl = &ctrl;
+    mems.push_back(RVVM::rv32_mem_info{0, 64*1024, &mem});
+
+    /* console output, whole buffers */
+    FILE *out = tmpfile();
+    sh.set_console(nullptr, out);
+    memcpy(&ram[0x200], ":tt", 3);
+    int32_t con = request(sh, regs, mems, mem, SYS_OPEN, {0x200, 4, 3});
+    EXPECT_GT(con, 0);
+    memcpy(&ram[0x300], "hello ", 6);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_WRITE, {(uint32_t)con, 0x300, 6}), 0);
+    memcpy(&ram[0x300], "world\0", 6);
+    regs.reg->x[10] = SYS_WRITE0;
+    regs.reg->x[11] = 0x300;
+    EXPECT_TRUE(sh.call(regs, mems));
+    rewind(out);
+    EXPECT_EQ(fread(buf, 1, sizeof(buf), out), 11);
+    EXPECT_STREQ(buf, "hello world");
+    fclose(out);
+    sh.set_console(nullptr, nullptr);
+
+    /* a buffer past the end of the memory isn't written */
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_WRITE, {(uint32_t)con, 0xfff0, 0x20}), 0x20);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_CLOSE, {(uint32_t)con}), 0);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_CLOSE, {(uint32_t)con}), -1);
+
+    /* host file, written then read back */
+    std::string path = testing::TempDir() + "rv32semihost.txt";
+    memcpy(&ram[0x200], path.c_str(), path.size());
+    int32_t fh = request(sh, regs, mems, mem, SYS_OPEN, {0x200, 7, (uint32_t)path.size()});
+    ASSERT_GT(fh, 0);
+    memcpy(&ram[0x300], "0123456789", 10);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_WRITE, {(uint32_t)fh, 0x300, 10}), 0);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_FLEN, {(uint32_t)fh}), 10);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_CLOSE, {(uint32_t)fh}), 0);
+
+    fh = request(sh, regs, mems, mem, SYS_OPEN, {0x200, 1, (uint32_t)path.size()});
+    ASSERT_GT(fh, 0);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_READ, {(uint32_t)fh, 0x400, 16}), 6);
+    EXPECT_EQ(memcmp(&ram[0x400], "0123456789", 10), 0);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_READ, {(uint32_t)fh, 0x400, 16}), 16);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_CLOSE, {(uint32_t)fh}), 0);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_REMOVE, {0x200, (uint32_t)path.size()}), 0);
+    EXPECT_EQ(request(sh, regs, mems, mem, SYS_OPEN, {0x200, 0, (uint32_t)path.size()}), -1);
+
+    EXPECT_GE(request(sh, regs, mems, mem, SYS_CLOCK, {}), 0);
+
+    /* exit, the reason itself on 32-bit, a block for the extended one */
+    request(sh, regs, mems, mem, SYS_EXIT_EXTENDED, {0x20026, 5}, &running);
+    EXPECT_FALSE(running);
+    EXPECT_EQ(sh.exit_code(), 5);
+    regs.reg->x[10] = SYS_EXIT;
+    regs.reg->x[11] = 0x20023;
+    EXPECT_FALSE(sh.call(regs, mems));
+    EXPECT_EQ(sh.exit_code(), 1);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "RV32Mem.h"
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+TEST(RV32Snapshot, Restore) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    char path[] = "/tmp/rv32_snapXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    /* addi a0, a0, 1; j . */
+    uint32_t code[] = {0x00150513, 0x0000006f};
+    memcpy(&ram[0], code, sizeof(code));
+    ram[0x100] = 0x5a;
+    vm.add_inst("I", &rv32i);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.step(1);
+    ASSERT_TRUE(vm.save(path));
+
+    vm.step(1);
+    ram[0x100] = 0xa5;
+
+    /* a truncated snapshot leaves the VM as it was */
+    ASSERT_EQ(truncate(path, 8192), 0);
+    EXPECT_FALSE(vm.restore(path));
+    EXPECT_EQ(vm.regs()->pc, 4);
+    EXPECT_EQ(ram[0x100], 0xa5);
+    EXPECT_EQ(ram[0], 0x13);
+
+    ASSERT_TRUE(vm.save(path));
+    vm.step(1);
+    ram[0x100] = 0;
+    EXPECT_TRUE(vm.restore(path));
+    EXPECT_EQ(ram[0x100], 0xa5);
+    EXPECT_EQ(vm.regs()->x[10], 1);
+    unlink(path);
+}
+
+/**
+ * @brief A RAM that claims map_image, and fails it, as out of host memory
+ */
+class RV32MapFail:public RV32Mem
+{
+    public:
+        RV32MapFail(size_t size):RV32Mem(size) {}
+        RVVM::rv_err map_image(int fd, uint64_t off, uint32_t len) { return RVVM::RV_EFAULT; }
+        bool can_map_image() { return true; }
+};
+
+TEST(RV32Snapshot, Header) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RV32Mem mem(64*1024);
+    char path[] = "/tmp/rv32_snapXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    vm.add_inst("I", &rv32i);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.set_start_addr(0x40);
+    ASSERT_TRUE(vm.save(path));
+
+    /* priv follows magic, version, xlen, has_fp, csr_count and mem_count */
+    uint32_t val = 2;
+    ASSERT_EQ(pwrite(fd, &val, 4, 28), 4);
+    EXPECT_FALSE(vm.restore(path));
+    val = 3;
+    ASSERT_EQ(pwrite(fd, &val, 4, 28), 4);
+    EXPECT_TRUE(vm.restore(path));
+
+    /* a single version */
+    val = 2;
+    ASSERT_EQ(pwrite(fd, &val, 4, 8), 4);
+    EXPECT_FALSE(vm.restore(path));
+    EXPECT_EQ(vm.regs()->pc, 0x40);
+    close(fd);
+    unlink(path);
+}
+
+TEST(RV32Snapshot, MapFail) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RV32MapFail mem(64*1024);
+    char path[] = "/tmp/rv32_snapXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    vm.add_inst("I", &rv32i);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.set_start_addr(0x40);
+    vm.regs()->x[10] = 5;
+    ASSERT_TRUE(vm.save(path));
+
+    /* the memory can't be put back, the hart doesn't keep running on it */
+    EXPECT_FALSE(vm.restore(path));
+    EXPECT_EQ(vm.regs()->pc, 0);
+    EXPECT_EQ(vm.regs()->x[10], 0);
+    unlink(path);
+}
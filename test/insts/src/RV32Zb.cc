@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "ZoraGA/RV32Zb.h"
+#include "ZoraGA/RVHost.h"
+#include "RV32Exec.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+/**
+ * @brief Zb on x1 and x2 into x3, rs2 is the field of exec and imm
+ */
+class zb_exec:public rv32_exec<RVVM::RV32::RV32Zb>
+{
+    public:
+        uint32_t op(uint32_t funct7, uint32_t funct3, uint32_t rs1, uint32_t rs2)
+        {
+            reg.x[2] = rs2;
+            return exec(OP, funct7, 2, funct3, rs1);
+        }
+
+        uint32_t imm(uint32_t funct7, uint32_t rs2, uint32_t funct3, uint32_t rs1)
+        {
+            return exec(OP_IMM, funct7, rs2, funct3, rs1);
+        }
+};
+
+TEST(RV32Zb, Zba) {
+    zb_exec z;
+    EXPECT_EQ(z.op(0b0010000, 0b010, 3, 100), 106);
+    EXPECT_EQ(z.op(0b0010000, 0b100, 3, 100), 112);
+    EXPECT_EQ(z.op(0b0010000, 0b110, 0x20000001, 1), 9);
+}
+
+TEST(RV32Zb, Zbb) {
+    zb_exec z;
+
+    /* andn/orn/xnor */
+    EXPECT_EQ(z.op(0b0100000, 0b111, 0xff00ff00, 0x0ff00ff0), 0xf000f000);
+    EXPECT_EQ(z.op(0b0100000, 0b110, 0x00000001, 0xfffffff0), 0x0000000f);
+    EXPECT_EQ(z.op(0b0100000, 0b100, 0x12345678, 0x12345678), 0xffffffff);
+
+    /* clz/ctz/cpop, 32 for zero */
+    EXPECT_EQ(z.imm(0b0110000, 0, 0b001, 0x00010000), 15);
+    EXPECT_EQ(z.imm(0b0110000, 0, 0b001, 0), 32);
+    EXPECT_EQ(z.imm(0b0110000, 1, 0b001, 0x00010000), 16);
+    EXPECT_EQ(z.imm(0b0110000, 1, 0b001, 0), 32);
+    EXPECT_EQ(z.imm(0b0110000, 2, 0b001, 0xf0f0f0f1), 17);
+
+    /* max/maxu/min/minu */
+    EXPECT_EQ(z.op(0b0000101, 0b110, 0xffffffff, 1), 1);
+    EXPECT_EQ(z.op(0b0000101, 0b111, 0xffffffff, 1), 0xffffffff);
+    EXPECT_EQ(z.op(0b0000101, 0b100, 0xffffffff, 1), 0xffffffff);
+    EXPECT_EQ(z.op(0b0000101, 0b101, 0xffffffff, 1), 1);
+
+    /* sext.b/sext.h/zext.h */
+    EXPECT_EQ(z.imm(0b0110000, 4, 0b001, 0x12345680), 0xffffff80);
+    EXPECT_EQ(z.imm(0b0110000, 5, 0b001, 0x12348000), 0xffff8000);
+    EXPECT_EQ(z.exec(OP, 0b0000100, 0, 0b100, 0x12348000), 0x8000);
+
+    /* rol/ror/rori, the shift amount is taken modulo 32 */
+    EXPECT_EQ(z.op(0b0110000, 0b001, 0x80000001, 33), 0x00000003);
+    EXPECT_EQ(z.op(0b0110000, 0b101, 0x80000001, 4), 0x18000000);
+    EXPECT_EQ(z.imm(0b0110000, 8, 0b101, 0x12345678), 0x78123456);
+    EXPECT_EQ(z.imm(0b0110000, 0, 0b101, 0x12345678), 0x12345678);
+
+    /* orc.b/rev8 */
+    EXPECT_EQ(z.imm(0b0010100, 0b00111, 0b101, 0x00800100), 0x00ffff00);
+    EXPECT_EQ(z.imm(0b0110100, 0b11000, 0b101, 0x12345678), 0x78563412);
+}
+
+TEST(RV32Zb, Zbc) {
+    zb_exec z;
+
+    /* (x + 1)^2 = x^2 + 1, and the top bits of a 63-bit product */
+    EXPECT_EQ(z.op(0b0000101, 0b001, 3, 3), 5);
+    EXPECT_EQ(z.op(0b0000101, 0b001, 0x80000001, 0x80000001), 1);
+    EXPECT_EQ(z.op(0b0000101, 0b011, 0x80000001, 0x80000001), 0x40000000);
+    EXPECT_EQ(z.op(0b0000101, 0b010, 0x80000001, 0x80000001), 0x80000000);
+    EXPECT_EQ(z.op(0b0000101, 0b011, 0xffffffff, 0xffffffff), 0x55555555);
+}
+
+TEST(RV32Zb, Fallback) {
+    const uint32_t features = RV_HOST_LZCNT | RV_HOST_BMI | RV_HOST_POPCNT | RV_HOST_PCLMUL;
+    if ((RVVM::rv_host_features & features) != features) GTEST_SKIP() << "no LZCNT, BMI, POPCNT or PCLMUL on the host";
+    zb_exec z;
+    std::vector<uint32_t> vals = {0, 1, 0x80000000, 0x80000001, 0x7fffffff, 0xffffffff, 0x00010000};
+    uint32_t x = 0x12345678;
+    for (int i=0; i<1000; i++) {
+        x = x * 1103515245 + 12345;
+        vals.push_back(x >> (i % 32));
+    }
+
+    /* clz, ctz and cpop, then clmul, clmulr and clmulh against the next value */
+    auto run = [&](std::vector<uint32_t> &out) {
+        for (size_t i=0; i<vals.size(); i++) {
+            uint32_t a = vals[i], b = vals[(i + 1) % vals.size()];
+            for (uint32_t rs2=0; rs2<3; rs2++) out.push_back(z.imm(0b0110000, rs2, 0b001, a));
+            for (uint32_t funct3=1; funct3<4; funct3++) out.push_back(z.op(0b0000101, funct3, a, b));
+        }
+    };
+    std::vector<uint32_t> host, portable;
+    run(host);
+
+    /* the builtins and the loop give the same */
+    uint32_t old = RVVM::rv_host_mask(0);
+    run(portable);
+    RVVM::rv_host_mask(old);
+    EXPECT_TRUE(host == portable);
+    EXPECT_EQ(RVVM::rv_host_features & features, features);
+}
+
+TEST(RV32Zb, Zbs) {
+    zb_exec z;
+    EXPECT_EQ(z.op(0b0100100, 0b001, 0xffffffff, 35), 0xfffffff7);
+    EXPECT_EQ(z.op(0b0100100, 0b101, 0x00000008, 3), 1);
+    EXPECT_EQ(z.op(0b0110100, 0b001, 0x00000008, 3), 0);
+    EXPECT_EQ(z.op(0b0010100, 0b001, 0, 31), 0x80000000);
+    EXPECT_EQ(z.imm(0b0100100, 31, 0b001, 0xffffffff), 0x7fffffff);
+    EXPECT_EQ(z.imm(0b0100100, 31, 0b101, 0x80000000), 1);
+    EXPECT_EQ(z.imm(0b0110100, 0, 0b001, 0x00000001), 0);
+    EXPECT_EQ(z.imm(0b0010100, 4, 0b001, 0), 0x10);
+}
+
+TEST(RV32Zb, Decode) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::RV32::RV32Zb zb;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+    RVVM::rv32_inst_fmt inst;
+
+    /* li a0, 0x100; clz a1, a0; andn a2, a0, a0; sll a3, a0, a0; rev8 a4, a0; j . */
+    uint32_t code[] = {0x10000513, 0x60051593, 0x40a57633, 0x00a516b3, 0x69855713, 0x0000006f};
+    memcpy(&ram[0], code, sizeof(code));
+    vm.add_inst("I", &rv32i);
+    vm.add_inst("Zb", &zb);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.step(5);
+    EXPECT_EQ(vm.regs()->pc, 0x14);
+    EXPECT_EQ(vm.regs()->x[11], 23);
+    EXPECT_EQ(vm.regs()->x[12], 0);
+    EXPECT_EQ(vm.regs()->x[13], 0x100);
+    EXPECT_EQ(vm.regs()->x[14], 0x00010000);
+
+    /* funct7 of the base shifts and logic is left to RV32I */
+    inst.inst = 0x00a516b3;
+    EXPECT_EQ(zb.isValid(inst), RVVM::RV_EUNDEF);
+    inst.inst = 0x00251613;
+    EXPECT_EQ(zb.isValid(inst), RVVM::RV_EUNDEF);
+}
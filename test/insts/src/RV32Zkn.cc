@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "ZoraGA/RV32Zkn.h"
+#include "ZoraGA/RVHost.h"
+#include "RV32Exec.h"
+#include "RV32Mem.h"
+
+using namespace ZoraGA;
+
+/**
+ * @brief Zkn on x1 and x2 into x3
+ */
+class zkn_exec:public rv32_exec<RVVM::RV32::RV32Zkn>
+{
+    public:
+        uint32_t op(uint32_t funct7, uint32_t rs1, uint32_t rs2, uint32_t funct3 = 0, uint32_t opcode = OP)
+        {
+            reg.x[2] = rs2;
+            return exec(opcode, funct7, opcode == OP ? 2 : rs2, funct3, rs1);
+        }
+
+        uint32_t aes32(uint32_t kind, uint32_t rs1, uint32_t rs2, uint32_t bs) { return op((bs << 5) | kind, rs1, rs2); }
+        uint32_t sha256(uint32_t fn, uint32_t rs1) { return op(0b0001000, rs1, fn, 0b001, OP_IMM); }
+};
+
+#define ESI  0b10001
+#define ESMI 0b10011
+#define DSI  0b10101
+#define DSMI 0b10111
+
+using RVVM::ror32;
+static uint64_t ror64(uint64_t x, uint32_t n) { return (x >> n) | (x << (64 - n)); }
+
+TEST(RV32Zkn, AES) {
+    zkn_exec z;
+    uint32_t rk[44], drk[44];
+    const uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    const uint8_t pt[16]  = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    const uint8_t ct[16]  = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+    const uint8_t rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+
+    /* the first S-box entries, and a MixColumns column of 2, 1, 1, 3 */
+    EXPECT_EQ(z.aes32(ESI, 0, 0x00, 0), 0x63);
+    EXPECT_EQ(z.aes32(ESI, 0, 0x5300, 1), 0xed00);
+    EXPECT_EQ(z.aes32(DSI, 0, 0x63000000, 3), 0);
+    EXPECT_EQ(z.aes32(ESMI, 0, 0x01, 0), 0x847c7cf8);
+
+    /* FIPS-197 AES-128, the key schedule through aes32esi */
+    memcpy(rk, key, 16);
+    for (int i=4; i<44; i++) {
+        uint32_t t = rk[i-1];
+        if (i % 4 == 0) {
+            uint32_t w = ror32(t, 8);
+            t = 0;
+            for (uint32_t bs=0; bs<4; bs++) t = z.aes32(ESI, t, w, bs);
+            t ^= rcon[i/4 - 1];
+        }
+        rk[i] = rk[i-4] ^ t;
+    }
+
+    uint32_t s[4], n[4];
+    memcpy(s, pt, 16);
+    for (int j=0; j<4; j++) s[j] ^= rk[j];
+    for (int r=1; r<=10; r++) {
+        for (int j=0; j<4; j++) {
+            n[j] = rk[r*4 + j];
+            for (uint32_t bs=0; bs<4; bs++) n[j] = z.aes32(r < 10 ? ESMI : ESI, n[j], s[(j + bs) % 4], bs);
+        }
+        memcpy(s, n, 16);
+    }
+    EXPECT_EQ(memcmp(s, ct, 16), 0);
+
+    /* back with the equivalent inverse cipher, InvMixColumns of a round key is esi then dsmi */
+    for (int i=0; i<44; i++) {
+        uint32_t u = 0, v = 0;
+        for (uint32_t bs=0; bs<4; bs++) u = z.aes32(ESI, u, rk[i], bs);
+        for (uint32_t bs=0; bs<4; bs++) v = z.aes32(DSMI, v, u, bs);
+        drk[i] = (i < 4 || i >= 40) ? rk[i] : v;
+    }
+    for (int j=0; j<4; j++) s[j] ^= drk[40 + j];
+    for (int r=9; r>=0; r--) {
+        for (int j=0; j<4; j++) {
+            n[j] = drk[r*4 + j];
+            for (uint32_t bs=0; bs<4; bs++) n[j] = z.aes32(r > 0 ? DSMI : DSI, n[j], s[(j + 4 - bs) % 4], bs);
+        }
+        memcpy(s, n, 16);
+    }
+    EXPECT_EQ(memcmp(s, pt, 16), 0);
+}
+
+TEST(RV32Zkn, Fallback) {
+    if (!RVVM::rv_host_has(RV_HOST_AES)) GTEST_SKIP() << "no AES-NI on the host";
+    zkn_exec z;
+    const uint32_t kinds[4] = {ESI, ESMI, DSI, DSMI};
+    static uint32_t ni[4][4][256];
+
+    /* every byte in every lane, the other lanes must be ignored */
+    for (int k=0; k<4; k++) {
+        for (uint32_t bs=0; bs<4; bs++) {
+            for (uint32_t b=0; b<256; b++) {
+                uint32_t rs2 = (0xa5a5a5a5 & ~(0xffU << (bs * 8))) | (b << (bs * 8));
+                ni[k][bs][b] = z.aes32(kinds[k], 0x01234567, rs2, bs);
+            }
+        }
+    }
+
+    /* the tables and gf_mul give the same */
+    uint32_t old = RVVM::rv_host_mask(0);
+    int diff = 0;
+    for (int k=0; k<4; k++) {
+        for (uint32_t bs=0; bs<4; bs++) {
+            for (uint32_t b=0; b<256; b++) {
+                uint32_t rs2 = (0xa5a5a5a5 & ~(0xffU << (bs * 8))) | (b << (bs * 8));
+                diff += z.aes32(kinds[k], 0x01234567, rs2, bs) != ni[k][bs][b];
+            }
+        }
+    }
+    RVVM::rv_host_mask(old);
+    EXPECT_EQ(diff, 0);
+    EXPECT_TRUE(RVVM::rv_host_has(RV_HOST_AES));
+}
+
+TEST(RV32Zkn, SHA) {
+    zkn_exec z;
+    uint32_t x = 0x6a09e667;
+    EXPECT_EQ(z.sha256(0, x), ror32(x, 2) ^ ror32(x, 13) ^ ror32(x, 22));
+    EXPECT_EQ(z.sha256(1, x), ror32(x, 6) ^ ror32(x, 11) ^ ror32(x, 25));
+    EXPECT_EQ(z.sha256(2, x), ror32(x, 7) ^ ror32(x, 18) ^ (x >> 3));
+    EXPECT_EQ(z.sha256(3, x), ror32(x, 17) ^ ror32(x, 19) ^ (x >> 10));
+
+    /* the halves of the 64-bit functions */
+    uint64_t w = 0x6a09e667f3bcc908ULL;
+    uint32_t lo = w, hi = w >> 32;
+    uint64_t sum0 = ror64(w, 28) ^ ror64(w, 34) ^ ror64(w, 39);
+    uint64_t sum1 = ror64(w, 14) ^ ror64(w, 18) ^ ror64(w, 41);
+    uint64_t sig0 = ror64(w, 1) ^ ror64(w, 8) ^ (w >> 7);
+    uint64_t sig1 = ror64(w, 19) ^ ror64(w, 61) ^ (w >> 6);
+    EXPECT_EQ(z.op(0b0101000, lo, hi), (uint32_t)sum0);
+    EXPECT_EQ(z.op(0b0101000, hi, lo), (uint32_t)(sum0 >> 32));
+    EXPECT_EQ(z.op(0b0101001, lo, hi), (uint32_t)sum1);
+    EXPECT_EQ(z.op(0b0101001, hi, lo), (uint32_t)(sum1 >> 32));
+    EXPECT_EQ(z.op(0b0101010, lo, hi), (uint32_t)sig0);
+    EXPECT_EQ(z.op(0b0101110, hi, lo), (uint32_t)(sig0 >> 32));
+    EXPECT_EQ(z.op(0b0101011, lo, hi), (uint32_t)sig1);
+    EXPECT_EQ(z.op(0b0101111, hi, lo), (uint32_t)(sig1 >> 32));
+}
+
+TEST(RV32Zkn, Decode) {
+    RVVM::RV32::rv32 vm;
+    RVVM::RV32::RV32I rv32i;
+    RVVM::RV32::RV32Zkn zkn;
+    RV32Mem mem(64*1024);
+    std::vector<uint8_t> &ram = *mem.raw();
+
+    /* li a0, 8; sha256sig0 a1, a0; slli a2, a0, 2; aes32esi a3, zero, a0, 0; j . */
+    uint32_t code[] = {0x00800513, 0x10251593, 0x00251613, 0x22a006b3, 0x0000006f};
+    memcpy(&ram[0], code, sizeof(code));
+    vm.add_inst("I", &rv32i);
+    vm.add_inst("Zkn", &zkn);
+    vm.add_mem(0, 64*1024, &mem);
+    vm.step(4);
+    EXPECT_EQ(vm.regs()->pc, 0x10);
+    EXPECT_EQ(vm.regs()->x[11], ror32(8, 7) ^ ror32(8, 18) ^ 1);
+    EXPECT_EQ(vm.regs()->x[12], 32);
+    EXPECT_EQ(vm.regs()->x[13], 0x30);
+}
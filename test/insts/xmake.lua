@@ -9,5 +9,5 @@ target("test_insts")
     set_targetdir("dist")
     add_packages("gtest")
     add_files("src/*.cc")
-    add_includedirs("include")
+    add_includedirs("include", "../common/include")
     add_deps("rvvm")
@@ -0,0 +1,22 @@
+#ifndef __LOADERTEST_H__
+#define __LOADERTEST_H__
+
+#include "ZoraGA/RVdefs.h"
+#include <functional>
+
+/**
+ * @brief 32-bit register access of a device, as the hart does it
+ */
+uint32_t mmio_read(ZoraGA::RVVM::rv32_mem *dev, uint32_t addr);
+void mmio_write(ZoraGA::RVVM::rv32_mem *dev, uint32_t addr, uint32_t val);
+
+/**
+ * @brief Poll a condition set by a device thread
+ *
+ * @param cond
+ * @param ms Timeout
+ * @return false If the condition is still false after the timeout
+ */
+bool wait_for(std::function<bool()> cond, int ms = 5000);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef __VIRTQ_H__
+#define __VIRTQ_H__
+
+#include "mem_ram.h"
+#include "virtio_mmio.h"
+
+/* guest RAM of the driver */
+#define VQ_RAM_ADDR 0x80000000
+#define VQ_RAM_SIZE (8*1024*1024)
+/* buffers of the tests, past the rings */
+#define VQ_DATA     (VQ_RAM_ADDR + 0x100000)
+
+/**
+ * @brief Driver side of a virtio-mmio device, split queues in its own RAM
+ *
+ * Descriptors are taken in turn from each queue, the tests keep fewer in
+ * flight than the queue size and the devices complete in order.
+ */
+class VirtQ
+{
+    public:
+        typedef struct buf
+        {
+            uint32_t addr;
+            uint32_t len;
+            bool     write;
+        }buf;
+
+        VirtQ(virtio_mmio *dev, uint32_t queues, uint16_t num);
+        ~VirtQ();
+
+        /**
+         * @brief Negotiate the features, set the queues up and set DRIVER_OK
+         *
+         * @param features VIRTIO_F_VERSION_1 is added
+         */
+        void start(uint64_t features);
+
+        uint32_t reg(uint32_t addr);
+        void reg_write(uint32_t addr, uint32_t val);
+
+        /**
+         * @brief Host pointer of a guest address
+         */
+        uint8_t *mem(uint32_t addr);
+
+        /**
+         * @brief Add a chain to the avail ring
+         *
+         * @param q
+         * @param bufs
+         * @param publish Bump the avail index, or leave it to set_avail
+         * @return uint16_t Head descriptor
+         */
+        uint16_t add(uint32_t q, const std::vector<buf> &bufs, bool publish = true);
+
+        /**
+         * @brief Set the avail index, chains added but not published become available
+         */
+        void set_avail(uint32_t q, uint16_t idx);
+        uint16_t avail(uint32_t q);
+
+        void notify(uint32_t q);
+
+        /**
+         * @brief Used index written by the device
+         */
+        uint16_t used(uint32_t q);
+
+        /**
+         * @brief Used element i, modulo the queue size
+         */
+        void used_elem(uint32_t q, uint16_t i, uint32_t &id, uint32_t &len);
+
+        /**
+         * @brief Wait until the used index reaches idx
+         */
+        bool wait_used(uint32_t q, uint16_t idx, int ms = 5000);
+
+        mem_ram ram;
+
+    private:
+        uint32_t desc_addr(uint32_t q);
+        uint32_t avail_addr(uint32_t q);
+        uint32_t used_addr(uint32_t q);
+
+    private:
+        virtio_mmio *m_dev;
+        uint32_t m_queues;
+        uint16_t m_num;
+        std::vector<uint16_t> m_next;
+        std::vector<uint16_t> m_avail;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "ZoraGA/RVHost.h"
+#include "crc_unit.h"
+#include "mem_ram.h"
+#include "mem_shm.h"
+#include "LoaderTest.h"
+#include <zlib.h>
+
+using namespace ZoraGA;
+
+#define REG_ADDR   0x00
+#define REG_LEN    0x04
+#define REG_CTRL   0x08
+#define REG_STATUS 0x0c
+#define REG_DATA   0x10
+#define REG_RESULT 0x14
+
+#define CTRL_START  0x01
+#define CTRL_CRC32C 0x02
+
+#define RAM_ADDR 0x80000000
+#define RAM_SIZE 0x10000
+#define SHM_ADDR 0x20000000
+
+/**
+ * @brief Bitwise CRC-32C, the reference of the fast paths
+ */
+static uint32_t crc32c_ref(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+    for (size_t i=0; i<len; i++) {
+        crc ^= p[i];
+        for (int k=0; k<8; k++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static std::vector<uint8_t> crc_data(size_t len)
+{
+    std::vector<uint8_t> data(len);
+    uint32_t x = 0x12345678;
+    for (auto &it:data) {
+        x = x * 1103515245 + 12345;
+        it = x >> 24;
+    }
+    return data;
+}
+
+/**
+ * @brief crc_unit::update against zlib and the reference CRC-32C
+ */
+static void crc_check()
+{
+    std::vector<uint8_t> data = crc_data(4096 + 64);
+
+    /* every alignment and the lengths around the folds */
+    for (size_t off=0; off<16; off++) {
+        for (size_t len=0; len<=4096; len += (len < 300) ? 1 : 61) {
+            const uint8_t *p = &data[off];
+            ASSERT_EQ(crc_unit::update(0, false, p, len), crc32(0, p, len)) << off << " " << len;
+            ASSERT_EQ(crc_unit::update(0, true, p, len), crc32c_ref(0, p, len)) << off << " " << len;
+        }
+    }
+
+    /* continued over split buffers */
+    uint32_t crc = crc_unit::update(0, false, &data[0], 1000);
+    EXPECT_EQ(crc_unit::update(crc, false, &data[1000], 3000), crc32(0, &data[0], 4000));
+    crc = crc_unit::update(0, true, &data[0], 77);
+    EXPECT_EQ(crc_unit::update(crc, true, &data[77], 3000), crc32c_ref(0, &data[0], 3077));
+
+    /* the check values of both polynomials */
+    EXPECT_EQ(crc_unit::update(0, false, "123456789", 9), 0xcbf43926);
+    EXPECT_EQ(crc_unit::update(0, true, "123456789", 9), 0xe3069283);
+}
+
+TEST(CrcUnit, Update) {
+    crc_check();
+
+    /* and the table loop without the host instructions */
+    uint32_t old = RVVM::rv_host_mask(0);
+    crc_check();
+    RVVM::rv_host_mask(old);
+}
+
+TEST(CrcUnit, Registers) {
+    std::vector<uint8_t> data = crc_data(RAM_SIZE);
+    mem_ram ram;
+    mem_shm shm;
+    crc_unit crc;
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+    ASSERT_TRUE(shm.create(RAM_SIZE, 1));
+    ram.write(0, data.data(), RAM_SIZE);
+    shm.write(0, data.data(), RAM_SIZE);
+    crc.add_region(RAM_ADDR, RAM_SIZE, &ram);
+    crc.add_region(SHM_ADDR, RAM_SIZE, &shm);
+
+    /* a buffer, then more of it */
+    mmio_write(&crc, REG_ADDR, RAM_ADDR + 3);
+    mmio_write(&crc, REG_LEN, 5000);
+    mmio_write(&crc, REG_CTRL, CTRL_START);
+    EXPECT_EQ(mmio_read(&crc, REG_RESULT), crc32(0, &data[3], 5000));
+    mmio_write(&crc, REG_ADDR, RAM_ADDR + 5003);
+    mmio_write(&crc, REG_CTRL, CTRL_START);
+    EXPECT_EQ(mmio_read(&crc, REG_RESULT), crc32(0, &data[3], 10000));
+    EXPECT_EQ(mmio_read(&crc, REG_STATUS), 0);
+
+    /* CRC-32C of a memory without host() */
+    mmio_write(&crc, REG_RESULT, 0);
+    mmio_write(&crc, REG_ADDR, SHM_ADDR + 1);
+    mmio_write(&crc, REG_LEN, RAM_SIZE - 1);
+    mmio_write(&crc, REG_CTRL, CTRL_START | CTRL_CRC32C);
+    EXPECT_EQ(mmio_read(&crc, REG_RESULT), crc32c_ref(0, &data[1], RAM_SIZE - 1));
+
+    /* bytes, halves and words written to DATA */
+    uint8_t b = data[0];
+    uint16_t h;
+    uint32_t w;
+    memcpy(&h, &data[1], 2);
+    memcpy(&w, &data[4], 4);
+    mmio_write(&crc, REG_CTRL, 0);
+    mmio_write(&crc, REG_RESULT, 0);
+    EXPECT_EQ(crc.write(REG_DATA, &b, 1), RVVM::RV_EOK);
+    EXPECT_EQ(crc.write(REG_DATA, &h, 2), RVVM::RV_EOK);
+    EXPECT_EQ(crc.write(REG_DATA + 1, &h, 2), RVVM::RV_EDALIGN);
+    b = data[3];
+    EXPECT_EQ(crc.write(REG_DATA, &b, 1), RVVM::RV_EOK);
+    EXPECT_EQ(crc.write(REG_DATA, &w, 4), RVVM::RV_EOK);
+    EXPECT_EQ(mmio_read(&crc, REG_RESULT), crc32(0, &data[0], 8));
+
+    /* outside the regions, the bytes inside are fed */
+    mmio_write(&crc, REG_RESULT, 0);
+    mmio_write(&crc, REG_ADDR, RAM_ADDR + RAM_SIZE - 16);
+    mmio_write(&crc, REG_LEN, 32);
+    mmio_write(&crc, REG_CTRL, CTRL_START);
+    EXPECT_EQ(mmio_read(&crc, REG_STATUS), 1);
+    EXPECT_EQ(mmio_read(&crc, REG_RESULT), crc32(0, &data[RAM_SIZE - 16], 16));
+    mmio_write(&crc, REG_STATUS, 1);
+    EXPECT_EQ(mmio_read(&crc, REG_STATUS), 0);
+}
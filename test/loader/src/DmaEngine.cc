@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "dma_engine.h"
+#include "mem_ram.h"
+#include "mem_shm.h"
+#include "LoaderTest.h"
+
+using namespace ZoraGA;
+
+#define REG_SRC     0x00
+#define REG_DST     0x04
+#define REG_LEN     0x08
+#define REG_PATTERN 0x0c
+#define REG_CTRL    0x10
+#define REG_STATUS  0x14
+#define REG_COUNT   0x18
+
+#define CTRL_START  0x01
+#define CTRL_FILL   0x02
+#define CTRL_IRQ_EN 0x04
+
+#define STATUS_DONE  0x02
+#define STATUS_ERROR 0x04
+
+#define RAM_ADDR 0x80000000
+#define RAM_SIZE 0x100000
+/* a memory without host(), through the bounce buffer */
+#define SHM_ADDR 0x20000000
+#define SHM_SIZE 0x10000
+
+/**
+ * @brief An engine over a RAM, its bytes i & 0xff, and a shared memory
+ */
+class dma_test
+{
+    public:
+        dma_test()
+        {
+            ram.set_size(RAM_SIZE);
+            shm.create(SHM_SIZE, 1);
+            for (uint32_t i=0; i<RAM_SIZE; i++) {
+                host()[i] = i;
+            }
+            dma.add_region(RAM_ADDR, RAM_SIZE, &ram);
+            dma.add_region(SHM_ADDR, SHM_SIZE, &shm);
+            dma.set_irq([&](bool level) { irq = level; });
+        }
+
+        uint8_t *host()
+        {
+            uint32_t len;
+            return (uint8_t*)ram.host(len);
+        }
+
+        uint32_t start(uint32_t src, uint32_t dst, uint32_t len, uint32_t ctrl)
+        {
+            mmio_write(&dma, REG_SRC, src);
+            mmio_write(&dma, REG_DST, dst);
+            mmio_write(&dma, REG_LEN, len);
+            mmio_write(&dma, REG_CTRL, ctrl | CTRL_START);
+            return mmio_read(&dma, REG_STATUS);
+        }
+
+        mem_ram ram;
+        mem_shm shm;
+        dma_engine dma;
+        bool irq = false;
+};
+
+TEST(DmaEngine, Copy) {
+    dma_test t;
+    uint8_t *p = t.host();
+
+    EXPECT_EQ(t.start(RAM_ADDR + 1, RAM_ADDR + 0x80003, 0x10000, 0), STATUS_DONE);
+    EXPECT_EQ(mmio_read(&t.dma, REG_COUNT), 0x10000);
+    for (uint32_t i=0; i<0x10000; i++) {
+        ASSERT_EQ(p[0x80003 + i], (uint8_t)(i + 1));
+    }
+
+    /* overlapping both ways, as memmove */
+    std::vector<uint8_t> ref(p, p + 0x2000);
+    memmove(&ref[0x100], &ref[0], 0x1000);
+    EXPECT_EQ(t.start(RAM_ADDR, RAM_ADDR + 0x100, 0x1000, 0), STATUS_DONE);
+    EXPECT_EQ(memcmp(p, ref.data(), ref.size()), 0);
+    memmove(&ref[0], &ref[0x80], 0x1000);
+    EXPECT_EQ(t.start(RAM_ADDR + 0x80, RAM_ADDR, 0x1000, 0), STATUS_DONE);
+    EXPECT_EQ(memcmp(p, ref.data(), ref.size()), 0);
+
+    /* to and within a memory without host() */
+    EXPECT_EQ(t.start(RAM_ADDR + 0x1000, SHM_ADDR + 2, 0x6000, 0), STATUS_DONE);
+    EXPECT_EQ(t.start(SHM_ADDR + 2, SHM_ADDR + 0x8000, 0x6000, 0), STATUS_DONE);
+    EXPECT_EQ(t.start(SHM_ADDR + 0x8000, RAM_ADDR + 0x40000, 0x6000, 0), STATUS_DONE);
+    EXPECT_EQ(memcmp(p + 0x1000, p + 0x40000, 0x6000), 0);
+}
+
+TEST(DmaEngine, Fill) {
+    dma_test t;
+    uint8_t *p = t.host();
+    const uint8_t pattern[4] = {0x44, 0x33, 0x22, 0x11};
+
+    mmio_write(&t.dma, REG_PATTERN, 0x11223344);
+    EXPECT_EQ(t.start(0, RAM_ADDR + 5, 0x3001, CTRL_FILL), STATUS_DONE);
+    for (uint32_t i=0; i<0x3001; i++) {
+        ASSERT_EQ(p[5 + i], pattern[i & 3]);
+    }
+    EXPECT_EQ(p[4], 4);
+    EXPECT_EQ(p[0x3006], 6);
+
+    uint32_t val = 0;
+    EXPECT_EQ(t.start(0, SHM_ADDR + 1, 0x2000, CTRL_FILL), STATUS_DONE);
+    EXPECT_EQ(t.shm.read32(0x1001, val), RVVM::RV_EOK);
+    EXPECT_EQ(val, 0x11223344);
+}
+
+TEST(DmaEngine, Errors) {
+    dma_test t;
+
+    /* a range leaving the regions stops where it does */
+    EXPECT_EQ(t.start(RAM_ADDR + RAM_SIZE - 0x10, RAM_ADDR, 0x20, 0), STATUS_ERROR);
+    EXPECT_EQ(mmio_read(&t.dma, REG_COUNT), 0x10);
+    EXPECT_EQ(t.start(0xfffffff0, RAM_ADDR, 0x20, 0), STATUS_ERROR);
+    EXPECT_FALSE(t.irq);
+
+    /* the interrupt follows the status while enabled, write 1 to clear */
+    EXPECT_EQ(t.start(RAM_ADDR, RAM_ADDR + 0x10, 0x10, CTRL_IRQ_EN), STATUS_DONE);
+    EXPECT_TRUE(t.irq);
+    mmio_write(&t.dma, REG_STATUS, STATUS_DONE);
+    EXPECT_FALSE(t.irq);
+    EXPECT_EQ(t.start(0, RAM_ADDR, 0x10, CTRL_IRQ_EN), STATUS_ERROR);
+    EXPECT_TRUE(t.irq);
+
+    std::vector<uint8_t> state;
+    dma_engine other;
+    bool irq = false;
+    EXPECT_EQ(t.dma.save_state(state), RVVM::RV_EOK);
+    EXPECT_EQ(other.load_state(state), RVVM::RV_EOK);
+    other.set_irq([&](bool level) { irq = level; });
+    EXPECT_TRUE(irq);
+    EXPECT_EQ(mmio_read(&other, REG_STATUS), STATUS_ERROR);
+}
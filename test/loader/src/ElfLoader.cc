@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+#include "elf_loader.h"
+#include "ElfBuilder.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define TEXT_ADDR  0x00010000
+/* file bytes of .text, the last page is partial */
+#define TEXT_FILE  0x1800
+#define TEXT_MEM   0x2000
+#define RAM_ADDR   0x80000000
+#define RAM_SIZE   0x10000
+#define DATA_ADDR  (RAM_ADDR + 0x100)
+#define DATA_FILE  0x10
+#define DATA_MEM   0x1000
+/* load address of .data, startup code copies it from there */
+#define DATA_LMA   0x00020000
+#define OTHER_ADDR 0x40000000
+#define OTHER_FILE 8
+#define OTHER_MEM  0x100
+
+static std::vector<uint8_t> pattern(size_t len, uint8_t seed)
+{
+    std::vector<uint8_t> data(len);
+    for (size_t i=0; i<len; i++) {
+        data[i] = (uint8_t)(i * 13 + seed) | 1;
+    }
+    return data;
+}
+
+/**
+ * @brief An ELF of a text segment, a .data in the RAM with a load address and
+ * .bss, and a writable segment outside of the RAM
+ */
+class elf_file
+{
+    public:
+        elf_file()
+        {
+            char tmpl[] = "/tmp/rvvm_elfXXXXXX";
+            int fd = mkstemp(tmpl);
+            close(fd);
+            path = tmpl;
+            text  = pattern(TEXT_FILE, 1);
+            data  = pattern(DATA_FILE, 2);
+            other = pattern(OTHER_FILE, 3);
+            elf_builder elf(TEXT_ADDR);
+            uint32_t off = elf.segment(PF_R | PF_X, TEXT_ADDR, TEXT_ADDR, text, TEXT_MEM);
+            elf.section_at(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, TEXT_ADDR, off, TEXT_FILE);
+            elf.segment(PF_R | PF_W, DATA_ADDR, DATA_LMA, data, DATA_MEM);
+            elf.segment(PF_R | PF_W, OTHER_ADDR, OTHER_ADDR, other, OTHER_MEM);
+            elf.symbol("_start", TEXT_ADDR, 4, STT_FUNC);
+            EXPECT_TRUE(elf.write(path));
+        }
+
+        ~elf_file()
+        {
+            unlink(path.c_str());
+        }
+
+        std::string path;
+        std::vector<uint8_t> text, data, other;
+};
+
+static uint8_t byte(RVVM::RV32::rv32 &vm, uint32_t addr, bool ok = true)
+{
+    uint8_t val = 0xee;
+    EXPECT_EQ(vm.read_mem(addr, &val, 1), ok) << std::hex << addr;
+    return val;
+}
+
+TEST(ElfLoader, Map) {
+    elf_file f;
+    elf_loader loader;
+    mem_ram ram;
+    RVVM::RV32::rv32 vm;
+    ASSERT_TRUE(loader.load(f.path));
+    EXPECT_EQ(loader.entry(), TEXT_ADDR);
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+    ASSERT_TRUE(vm.add_mem(RAM_ADDR, RAM_SIZE, &ram));
+    ASSERT_TRUE(loader.map(vm, &ram, RAM_ADDR, RAM_SIZE));
+
+    uint32_t base = 0, len = 0;
+    ASSERT_TRUE(loader.code_range(base, len));
+    EXPECT_EQ(base, TEXT_ADDR);
+    EXPECT_EQ(len, TEXT_MEM);
+    uint32_t val = 0;
+    EXPECT_TRUE(loader.elf()->symbol("_start", val));
+    EXPECT_EQ(val, TEXT_ADDR);
+
+    /* file-backed text, zero past the file, read-only */
+    EXPECT_EQ(byte(vm, TEXT_ADDR), f.text[0]);
+    EXPECT_EQ(byte(vm, TEXT_ADDR + 0xfff), f.text[0xfff]);
+    EXPECT_EQ(byte(vm, TEXT_ADDR + 0x1000), f.text[0x1000]);
+    EXPECT_EQ(byte(vm, TEXT_ADDR + TEXT_FILE - 1), f.text[TEXT_FILE - 1]);
+    EXPECT_EQ(byte(vm, TEXT_ADDR + TEXT_FILE), 0);
+    EXPECT_EQ(byte(vm, TEXT_ADDR + TEXT_MEM - 1), 0);
+    byte(vm, TEXT_ADDR + TEXT_MEM, false);
+    uint8_t b = 0;
+    EXPECT_FALSE(vm.write_mem(TEXT_ADDR, &b, 1));
+
+    /* .data copied into the RAM, .bss zero, the RAM around untouched */
+    EXPECT_EQ(byte(vm, DATA_ADDR - 1), 0);
+    EXPECT_EQ(byte(vm, DATA_ADDR), f.data[0]);
+    EXPECT_EQ(byte(vm, DATA_ADDR + DATA_FILE - 1), f.data[DATA_FILE - 1]);
+    EXPECT_EQ(byte(vm, DATA_ADDR + DATA_FILE), 0);
+    EXPECT_EQ(byte(vm, DATA_ADDR + DATA_MEM - 1), 0);
+
+    /* its load image, as long as the file part */
+    EXPECT_EQ(byte(vm, DATA_LMA), f.data[0]);
+    EXPECT_EQ(byte(vm, DATA_LMA + DATA_FILE - 1), f.data[DATA_FILE - 1]);
+    byte(vm, DATA_LMA + DATA_FILE, false);
+    EXPECT_FALSE(vm.write_mem(DATA_LMA, &b, 1));
+
+    /* outside of the RAM, a RAM of its own */
+    EXPECT_EQ(byte(vm, OTHER_ADDR), f.other[0]);
+    EXPECT_EQ(byte(vm, OTHER_ADDR + OTHER_FILE - 1), f.other[OTHER_FILE - 1]);
+    EXPECT_EQ(byte(vm, OTHER_ADDR + OTHER_FILE), 0);
+    EXPECT_EQ(byte(vm, OTHER_ADDR + OTHER_MEM - 1), 0);
+    byte(vm, OTHER_ADDR + OTHER_MEM, false);
+    b = 0x5a;
+    EXPECT_TRUE(vm.write_mem(OTHER_ADDR + OTHER_MEM - 1, &b, 1));
+    EXPECT_EQ(byte(vm, OTHER_ADDR + OTHER_MEM - 1), 0x5a);
+}
+
+TEST(ElfLoader, NoRam) {
+    elf_file f;
+    elf_loader loader;
+    RVVM::RV32::rv32 vm;
+    ASSERT_TRUE(loader.load(f.path));
+    ASSERT_TRUE(loader.map(vm, nullptr, 0, 0));
+    EXPECT_EQ(byte(vm, DATA_ADDR), f.data[0]);
+    EXPECT_EQ(byte(vm, DATA_ADDR + DATA_MEM - 1), 0);
+    byte(vm, DATA_ADDR + DATA_MEM, false);
+}
+
+TEST(MemFile, Map) {
+    elf_file f;
+    RVVM::rv_elf elf;
+    ASSERT_TRUE(elf.load(f.path));
+    const RVVM::rv_elf_segment &seg = elf.segments()[0];
+
+    /* at an offset inside a page */
+    mem_file part;
+    uint8_t buf[4];
+    ASSERT_TRUE(part.map(elf.fd(), seg.offset + 3, 5, 8));
+    EXPECT_EQ(part.read(0, buf, 4), RVVM::RV_EOK);
+    EXPECT_EQ(memcmp(buf, &f.text[3], 4), 0);
+    EXPECT_EQ(part.read(4, buf, 4), RVVM::RV_EOK);
+    EXPECT_EQ(buf[0], f.text[7]);
+    EXPECT_EQ(buf[1], 0);
+    EXPECT_EQ(part.read(6, buf, 4), RVVM::RV_ERANGE);
+    EXPECT_EQ(part.write(0, buf, 1), RVVM::RV_EACCESS);
+    EXPECT_FALSE(part.map(elf.fd(), seg.offset, 9, 8));
+    /* not page aligned, no flat view */
+    EXPECT_EQ(part.map_at(nullptr, 8), RVVM::RV_EMISSING);
+}
+
+TEST(MemFile, MapAt) {
+    elf_file f;
+    RVVM::rv_elf elf;
+    ASSERT_TRUE(elf.load(f.path));
+    const RVVM::rv_elf_segment &seg = elf.segments()[0];
+    uint8_t *at = (uint8_t*)mmap(nullptr, TEXT_MEM, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(at, MAP_FAILED);
+    {
+        mem_file mem;
+        ASSERT_TRUE(mem.map(elf.fd(), seg.offset, TEXT_FILE, TEXT_MEM));
+        EXPECT_EQ(mem.map_at(at, TEXT_FILE), RVVM::RV_EMISSING);
+        ASSERT_EQ(mem.map_at(at, TEXT_MEM), RVVM::RV_EOK);
+
+        /* the whole page from the file, the partial one copied, zero after */
+        EXPECT_EQ(memcmp(at, f.text.data(), TEXT_FILE), 0);
+        EXPECT_EQ(at[TEXT_FILE], 0);
+        EXPECT_EQ(at[TEXT_MEM - 1], 0);
+
+        /* given back, the range stays reserved */
+        mem.unmap_at(at, TEXT_MEM);
+        void *p = mmap(at, TEXT_MEM, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        EXPECT_EQ(p, MAP_FAILED);
+        EXPECT_EQ(errno, EEXIST);
+
+        /* a view left at unmap is given back too */
+        ASSERT_EQ(mem.map_at(at, TEXT_MEM), RVVM::RV_EOK);
+        EXPECT_EQ(at[0], f.text[0]);
+    }
+    void *p = mmap(at, TEXT_MEM, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    EXPECT_EQ(p, MAP_FAILED);
+    EXPECT_EQ(errno, EEXIST);
+    munmap(at, TEXT_MEM);
+}
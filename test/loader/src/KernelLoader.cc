@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include "kernel_loader.h"
+#include <fstream>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define RAM_ADDR    0x80000000
+#define RAM_SIZE    0x100000
+#define TEXT_OFFSET 0x2000
+#define IMAGE_SIZE  0x9000
+#define KERNEL_FILE 0x1100
+#define INITRD_FILE 0x2345
+
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Parse a blob back into its header and "/node/prop" paths, the root's props are "/prop"
+ */
+class fdt_reader
+{
+    public:
+        bool parse(const std::vector<uint8_t> &blob)
+        {
+            if (blob.size() < 40) return false;
+            for (int i=0; i<10; i++) {
+                head[i] = be32(&blob[i * 4]);
+            }
+            if (head[0] != 0xd00dfeed || head[1] != blob.size()) return false;
+            const uint8_t *p   = &blob[head[2]];
+            const uint8_t *end = p + head[9];
+            const char *strs   = (const char*)&blob[head[3]];
+            std::vector<std::string> path;
+            while (p < end) {
+                uint32_t token = be32(p);
+                p += 4;
+                if (token == 1) {
+                    std::string name((const char*)p);
+                    path.push_back(path.empty() ? "" : path.back() + "/" + name);
+                    nodes.push_back(path.back());
+                    p += (name.size() + 4) & ~3;
+                } else if (token == 2) {
+                    if (path.empty()) return false;
+                    path.pop_back();
+                } else if (token == 3) {
+                    uint32_t len = be32(p), name = be32(p + 4);
+                    if (path.empty() || name >= head[8]) return false;
+                    props[path.back() + "/" + (strs + name)] = std::vector<uint8_t>(p + 8, p + 8 + len);
+                    p += 8 + ((len + 3) & ~3);
+                } else if (token == 9) {
+                    return path.empty() && p == end;
+                } else {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        bool has(std::string name)
+        {
+            return props.count(name) != 0;
+        }
+
+        std::string str(std::string name)
+        {
+            std::vector<uint8_t> &val = props[name];
+            if (val.empty() || val.back() != 0) return "<bad>";
+            return std::string((const char*)val.data());
+        }
+
+        std::vector<uint32_t> cells(std::string name)
+        {
+            std::vector<uint32_t> out;
+            std::vector<uint8_t> &val = props[name];
+            for (size_t i=0; i+4<=val.size(); i+=4) {
+                out.push_back(be32(&val[i]));
+            }
+            return out;
+        }
+
+        uint32_t head[10];
+        std::vector<std::string> nodes;
+        std::map<std::string, std::vector<uint8_t>> props;
+};
+
+static std::string write_tmp(const std::vector<uint8_t> &data)
+{
+    char path[] = "/tmp/rvvm_kernelXXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_EQ(write(fd, data.data(), data.size()), (ssize_t)data.size());
+    close(fd);
+    return path;
+}
+
+/**
+ * @brief A kernel with a RISC-V Image header and an initrd, written to files
+ */
+class boot_files
+{
+    public:
+        boot_files()
+        {
+            kernel.resize(KERNEL_FILE);
+            for (size_t i=0; i<kernel.size(); i++) kernel[i] = i * 3 + 1;
+            uint64_t hdr[8] = {0, TEXT_OFFSET, IMAGE_SIZE, 0, 0, 0, 0, 0x05435352};
+            memcpy(kernel.data(), hdr, sizeof(hdr));
+            initrd.resize(INITRD_FILE);
+            for (size_t i=0; i<initrd.size(); i++) initrd[i] = i * 5 + 2;
+            kernel_path = write_tmp(kernel);
+            initrd_path = write_tmp(initrd);
+        }
+
+        ~boot_files()
+        {
+            unlink(kernel_path.c_str());
+            unlink(initrd_path.c_str());
+        }
+
+        std::vector<uint8_t> kernel, initrd;
+        std::string kernel_path, initrd_path;
+};
+
+TEST(FdtBuilder, Blob) {
+    fdt_builder fdt;
+    fdt.begin_node("");
+    fdt.prop_u32("#address-cells", 1);
+    fdt.begin_node("node@10");
+    fdt.prop_cells("reg", {0x10, 0x20});
+    fdt.prop_strs("compatible", {"a,b", "c"});
+    fdt.prop_empty("ranges");
+    fdt.prop_u32("#address-cells", 2);
+    fdt.end_node();
+    EXPECT_TRUE(fdt.finish().empty());
+    fdt.end_node();
+    std::vector<uint8_t> blob = fdt.finish();
+
+    /* version 17, compatible with 16, an empty reservation map after the header */
+    fdt_reader r;
+    ASSERT_TRUE(r.parse(blob));
+    EXPECT_EQ(r.head[2], 40 + 16);
+    EXPECT_EQ(r.head[3], r.head[2] + r.head[9]);
+    EXPECT_EQ(r.head[1], r.head[3] + r.head[8]);
+    EXPECT_EQ(r.head[4], 40);
+    EXPECT_EQ(r.head[5], 17);
+    EXPECT_EQ(r.head[6], 16);
+    EXPECT_EQ(r.head[7], 0);
+    for (int i=40; i<56; i++) {
+        EXPECT_EQ(blob[i], 0) << i;
+    }
+
+    /* the names are stored once */
+    EXPECT_EQ(r.head[8], sizeof("#address-cells") + sizeof("reg") + sizeof("compatible") + sizeof("ranges"));
+    EXPECT_EQ(r.nodes, std::vector<std::string>({"", "/node@10"}));
+    EXPECT_EQ(r.cells("/#address-cells"), std::vector<uint32_t>({1}));
+    EXPECT_EQ(r.cells("/node@10/#address-cells"), std::vector<uint32_t>({2}));
+    EXPECT_EQ(r.cells("/node@10/reg"), std::vector<uint32_t>({0x10, 0x20}));
+    EXPECT_EQ(r.props["/node@10/compatible"], std::vector<uint8_t>({'a', ',', 'b', 0, 'c', 0}));
+    EXPECT_TRUE(r.has("/node@10/ranges"));
+    EXPECT_TRUE(r.props["/node@10/ranges"].empty());
+}
+
+TEST(KernelLoader, Boot) {
+    boot_files f;
+    kernel_loader loader;
+    mem_ram ram;
+    RVVM::RV32::rv32 vm;
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+    ASSERT_TRUE(vm.add_mem(RAM_ADDR, RAM_SIZE, &ram));
+    ASSERT_TRUE(loader.load(f.kernel_path, f.initrd_path));
+    loader.set_bootargs("console=ttyS0 root=/dev/ram");
+    loader.set_stdout("/soc/serial@10000000");
+    loader.add_device([](fdt_builder &fdt) {
+        fdt.begin_node("serial@10000000");
+        fdt.prop_cells("reg", {0x10000000, 0x100});
+        fdt.prop_u32("interrupt-parent", PHANDLE_PLIC);
+        fdt.end_node();
+    });
+    ASSERT_TRUE(loader.boot(vm, ram, RAM_ADDR, RAM_SIZE, "rv32ima_zicsr"));
+
+    fdt_reader r;
+    ASSERT_TRUE(r.parse(loader.dtb()));
+    EXPECT_EQ(r.cells("/#address-cells"), std::vector<uint32_t>({1}));
+    EXPECT_EQ(r.cells("/#size-cells"), std::vector<uint32_t>({1}));
+    EXPECT_EQ(r.str("/memory@80000000/device_type"), "memory");
+    EXPECT_EQ(r.cells("/memory@80000000/reg"), std::vector<uint32_t>({RAM_ADDR, RAM_SIZE}));
+    EXPECT_EQ(r.cells("/cpus/timebase-frequency"), std::vector<uint32_t>({RV32_SBI_TIMEBASE}));
+    EXPECT_EQ(r.str("/cpus/cpu@0/device_type"), "cpu");
+    EXPECT_EQ(r.str("/cpus/cpu@0/riscv,isa"), "rv32ima_zicsr");
+    EXPECT_EQ(r.str("/cpus/cpu@0/mmu-type"), "riscv,sv32");
+    EXPECT_EQ(r.cells("/cpus/cpu@0/interrupt-controller/phandle"), std::vector<uint32_t>({PHANDLE_INTC}));
+    EXPECT_EQ(r.str("/chosen/bootargs"), "console=ttyS0 root=/dev/ram");
+    EXPECT_EQ(r.str("/chosen/stdout-path"), "/soc/serial@10000000");
+    EXPECT_EQ(r.cells("/soc/serial@10000000/reg"), std::vector<uint32_t>({0x10000000, 0x100}));
+
+    /* a0 the hart, a1 the tree at the last page it fits in, pc the kernel at its text_offset */
+    uint32_t dtb = vm.regs()->x[11];
+    const std::vector<uint8_t> &blob = loader.dtb();
+    EXPECT_EQ(vm.regs()->x[10], 0);
+    EXPECT_EQ(dtb, (RAM_ADDR + RAM_SIZE - blob.size()) & ~0xfffU);
+    EXPECT_EQ(vm.regs()->pc, RAM_ADDR + TEXT_OFFSET);
+    std::vector<uint8_t> buf(blob.size());
+    ASSERT_EQ(ram.read(dtb - RAM_ADDR, buf.data(), buf.size()), RVVM::RV_EOK);
+    EXPECT_EQ(buf, blob);
+    buf.resize(KERNEL_FILE);
+    ASSERT_EQ(ram.read(TEXT_OFFSET, buf.data(), buf.size()), RVVM::RV_EOK);
+    EXPECT_EQ(buf, f.kernel);
+
+    /* the initrd page aligned right below the tree, after the kernel image */
+    std::vector<uint32_t> start = r.cells("/chosen/linux,initrd-start");
+    std::vector<uint32_t> end   = r.cells("/chosen/linux,initrd-end");
+    ASSERT_EQ(start.size(), 1);
+    ASSERT_EQ(end.size(), 1);
+    EXPECT_EQ(start[0], (dtb - INITRD_FILE) & ~0xfffU);
+    EXPECT_EQ(end[0], start[0] + INITRD_FILE);
+    EXPECT_GE(start[0], RAM_ADDR + TEXT_OFFSET + IMAGE_SIZE);
+    buf.resize(INITRD_FILE);
+    ASSERT_EQ(ram.read(start[0] - RAM_ADDR, buf.data(), buf.size()), RVVM::RV_EOK);
+    EXPECT_EQ(buf, f.initrd);
+}
+
+TEST(KernelLoader, NoInitrd) {
+    boot_files f;
+    kernel_loader loader;
+    mem_ram ram;
+    RVVM::RV32::rv32 vm;
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+    ASSERT_TRUE(vm.add_mem(RAM_ADDR, RAM_SIZE, &ram));
+    ASSERT_TRUE(loader.load(f.kernel_path, ""));
+    ASSERT_TRUE(loader.boot(vm, ram, RAM_ADDR, RAM_SIZE, "rv32i"));
+
+    fdt_reader r;
+    ASSERT_TRUE(r.parse(loader.dtb()));
+    EXPECT_FALSE(r.has("/chosen/linux,initrd-start"));
+    EXPECT_FALSE(r.has("/chosen/linux,initrd-end"));
+    EXPECT_FALSE(r.has("/chosen/bootargs"));
+    EXPECT_EQ(r.str("/cpus/cpu@0/riscv,isa"), "rv32i");
+
+    /* nor an image that doesn't fit below the tree */
+    kernel_loader big;
+    ASSERT_TRUE(big.load(f.kernel_path, f.initrd_path));
+    EXPECT_FALSE(big.boot(vm, ram, RAM_ADDR, 0x4000, "rv32i"));
+    EXPECT_FALSE(big.load("/nonexistent/kernel", ""));
+}
@@ -0,0 +1,27 @@
+#include "LoaderTest.h"
+#include <chrono>
+#include <thread>
+
+using namespace ZoraGA::RVVM;
+
+uint32_t mmio_read(rv32_mem *dev, uint32_t addr)
+{
+    uint32_t val = 0xdeadbeef;
+    if (dev->read(addr, &val, 4) != RV_EOK) return 0xdeadbeef;
+    return val;
+}
+
+void mmio_write(rv32_mem *dev, uint32_t addr, uint32_t val)
+{
+    dev->write(addr, &val, 4);
+}
+
+bool wait_for(std::function<bool()> cond, int ms)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > end) return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return true;
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include "mem_ram.h"
+#include <memory>
+
+using namespace ZoraGA;
+
+#define RAM_SIZE 0x10000
+#define PAGE     0x1000
+
+static uint32_t word(RVVM::rv32_mem *mem, uint32_t addr)
+{
+    uint32_t val = 0xdeadbeef;
+    EXPECT_EQ(mem->read32(addr, val), RVVM::RV_EOK);
+    return val;
+}
+
+static std::unique_ptr<mem_ram> ram_clone(mem_ram &ram)
+{
+    RVVM::rv32_mem *mem = ram.clone();
+    EXPECT_NE(mem, nullptr);
+    EXPECT_NE(mem, &ram);
+    return std::unique_ptr<mem_ram>((mem_ram*)mem);
+}
+
+TEST(MemRam, Clone) {
+    mem_ram ram;
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+    ram.write32(0, 0xaaaa0000);
+    ram.write32(PAGE, 0xaaaa0001);
+
+    /* parent and clone write the same page and others, each sees its own */
+    auto a = ram_clone(ram);
+    EXPECT_EQ(word(a.get(), 0), 0xaaaa0000);
+    EXPECT_EQ(word(a.get(), PAGE), 0xaaaa0001);
+    ram.write32(0, 0xbbbb0000);
+    a->write32(PAGE, 0xcccc0001);
+    a->write32(2 * PAGE, 0xcccc0002);
+    EXPECT_EQ(word(&ram, 0), 0xbbbb0000);
+    EXPECT_EQ(word(&ram, PAGE), 0xaaaa0001);
+    EXPECT_EQ(word(&ram, 2 * PAGE), 0);
+    EXPECT_EQ(word(a.get(), 0), 0xaaaa0000);
+    EXPECT_EQ(word(a.get(), PAGE), 0xcccc0001);
+
+    /* a clone of the clone, from its written pages */
+    auto b = ram_clone(*a);
+    EXPECT_EQ(word(b.get(), 0), 0xaaaa0000);
+    EXPECT_EQ(word(b.get(), PAGE), 0xcccc0001);
+    EXPECT_EQ(word(b.get(), 2 * PAGE), 0xcccc0002);
+    a->write32(2 * PAGE, 0xdddd0002);
+    b->write32(0, 0xeeee0000);
+    EXPECT_EQ(word(b.get(), 2 * PAGE), 0xcccc0002);
+    EXPECT_EQ(word(a.get(), 0), 0xaaaa0000);
+    EXPECT_EQ(word(&ram, 0), 0xbbbb0000);
+
+    /* the parent diverged since its first clone, a written page and one never written */
+    ram.write32(3 * PAGE + 8, 0xbbbb0003);
+    auto c = ram_clone(ram);
+    EXPECT_EQ(word(c.get(), 0), 0xbbbb0000);
+    EXPECT_EQ(word(c.get(), PAGE), 0xaaaa0001);
+    EXPECT_EQ(word(c.get(), 2 * PAGE), 0);
+    EXPECT_EQ(word(c.get(), 3 * PAGE + 8), 0xbbbb0003);
+    EXPECT_EQ(word(a.get(), 0), 0xaaaa0000);
+    EXPECT_EQ(word(a.get(), 3 * PAGE + 8), 0);
+
+    /* the first clones don't follow the parent going away */
+    ram.set_size(0);
+    EXPECT_EQ(word(a.get(), PAGE), 0xcccc0001);
+    EXPECT_EQ(word(c.get(), 3 * PAGE + 8), 0xbbbb0003);
+}
+
+TEST(MemRam, Revert) {
+    mem_ram ram;
+    std::vector<uint32_t> pages;
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+    ram.write32(0, 0x11111111);
+    ram.write32(PAGE, 0x22222222);
+    ram.dirty()->fetch_clear(pages);
+    ASSERT_EQ(ram.set_baseline(), RVVM::RV_EOK);
+
+    /* written pages, then back to the baseline, the others kept */
+    ram.write32(0, 0x33333333);
+    ram.write32(PAGE + 4, 0x44444444);
+    ram.write32(5 * PAGE, 0x55555555);
+    pages.clear();
+    ram.dirty()->fetch_clear(pages);
+    EXPECT_EQ(pages, std::vector<uint32_t>({0, 1, 5}));
+    ASSERT_EQ(ram.revert_pages({0, 5}), RVVM::RV_EOK);
+    EXPECT_EQ(word(&ram, 0), 0x11111111);
+    EXPECT_EQ(word(&ram, 5 * PAGE), 0);
+    EXPECT_EQ(word(&ram, PAGE + 4), 0x44444444);
+    ASSERT_EQ(ram.revert_pages({1}), RVVM::RV_EOK);
+    EXPECT_EQ(word(&ram, PAGE), 0x22222222);
+    EXPECT_EQ(word(&ram, PAGE + 4), 0);
+
+    /* a clone taken after the baseline keeps it, reverts don't reach it */
+    ram.write32(0, 0x66666666);
+    auto a = ram_clone(ram);
+    ASSERT_EQ(ram.revert_pages({0}), RVVM::RV_EOK);
+    EXPECT_EQ(word(a.get(), 0), 0x66666666);
+}
+
+TEST(MemRam, Reset) {
+    mem_ram ram;
+    std::vector<uint32_t> pages;
+    ASSERT_TRUE(ram.set_size(RAM_SIZE));
+
+    /* through the shared mapping, all dirty afterwards */
+    ram.write32(0, 0x11111111);
+    ram.dirty()->fetch_clear(pages);
+    ASSERT_TRUE(ram.reset());
+    EXPECT_EQ(word(&ram, 0), 0);
+    pages.clear();
+    EXPECT_EQ(ram.dirty()->fetch_clear(pages), RAM_SIZE / PAGE);
+
+    /* from a baseline, the clone keeps its content */
+    ram.write32(PAGE, 0x22222222);
+    ASSERT_EQ(ram.set_baseline(), RVVM::RV_EOK);
+    auto a = ram_clone(ram);
+    ram.write32(0, 0x33333333);
+    ASSERT_TRUE(ram.reset());
+    EXPECT_EQ(word(&ram, 0), 0);
+    EXPECT_EQ(word(&ram, PAGE), 0);
+    EXPECT_EQ(word(a.get(), PAGE), 0x22222222);
+
+    /* and is a shared RAM again */
+    ram.write32(0, 0x44444444);
+    auto b = ram_clone(ram);
+    EXPECT_EQ(word(b.get(), 0), 0x44444444);
+    EXPECT_EQ(word(b.get(), PAGE), 0);
+}
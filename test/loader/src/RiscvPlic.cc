@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include "riscv_plic.h"
+#include "LoaderTest.h"
+
+using namespace ZoraGA;
+
+#define PRIORITY(s) (4 * (s))
+#define PENDING   0x001000
+#define ENABLE    0x002000
+#define THRESHOLD 0x200000
+#define CLAIM     0x200004
+
+TEST(RiscvPlic, Claim) {
+    riscv_plic plic;
+    bool irq = false;
+    plic.set_irq([&](bool level) { irq = level; });
+
+    /* pending but not enabled, nor of a priority above 0 */
+    plic.set_line(3, true);
+    EXPECT_EQ(mmio_read(&plic, PENDING), 1U << 3);
+    EXPECT_FALSE(irq);
+    mmio_write(&plic, ENABLE, 0xffffffff);
+    EXPECT_EQ(mmio_read(&plic, ENABLE), 0xfffffffe);
+    EXPECT_FALSE(irq);
+    mmio_write(&plic, PRIORITY(3), 1);
+    EXPECT_TRUE(irq);
+
+    /* the highest priority first, the lowest ID among equals */
+    plic.set_line(5, true);
+    plic.set_line(2, true);
+    mmio_write(&plic, PRIORITY(5), 2);
+    mmio_write(&plic, PRIORITY(2), 2);
+    EXPECT_EQ(mmio_read(&plic, CLAIM), 2);
+    EXPECT_EQ(mmio_read(&plic, CLAIM), 5);
+    EXPECT_TRUE(irq);
+    EXPECT_EQ(mmio_read(&plic, CLAIM), 3);
+    EXPECT_FALSE(irq);
+    EXPECT_EQ(mmio_read(&plic, CLAIM), 0);
+
+    /* level triggered, pending again on completion while the line is high */
+    plic.set_line(5, false);
+    mmio_write(&plic, CLAIM, 5);
+    mmio_write(&plic, CLAIM, 3);
+    EXPECT_EQ(mmio_read(&plic, PENDING), 1U << 3);
+    EXPECT_TRUE(irq);
+
+    /* the threshold masks priorities up to it */
+    mmio_write(&plic, THRESHOLD, 1);
+    EXPECT_FALSE(irq);
+    mmio_write(&plic, THRESHOLD, 0);
+    EXPECT_TRUE(irq);
+    plic.set_line(3, false);
+    EXPECT_FALSE(irq);
+    EXPECT_EQ(mmio_read(&plic, PENDING), 0);
+    mmio_write(&plic, CLAIM, 2);
+    EXPECT_EQ(mmio_read(&plic, PENDING), 1U << 2);
+    EXPECT_TRUE(irq);
+}
+
+TEST(RiscvPlic, Lines) {
+    riscv_plic plic;
+    int changes = 0;
+    bool irq = false;
+    auto line = plic.line(7);
+    mmio_write(&plic, ENABLE, 1U << 7);
+    mmio_write(&plic, PRIORITY(7), 7);
+    EXPECT_EQ(mmio_read(&plic, PRIORITY(7)), 7);
+
+    /* a raised output is given to the callback set later */
+    line(true);
+    plic.set_irq([&](bool level) { irq = level; changes++; });
+    EXPECT_TRUE(irq);
+    EXPECT_EQ(changes, 1);
+
+    /* source 0 and sources out of range */
+    plic.set_line(0, true);
+    plic.set_line(PLIC_SOURCES, true);
+    EXPECT_EQ(mmio_read(&plic, PENDING), 1U << 7);
+
+    /* only 32-bit aligned accesses */
+    uint16_t half;
+    EXPECT_EQ(plic.read(CLAIM, &half, 2), RVVM::RV_EDALIGN);
+    EXPECT_EQ(plic.read(PLIC_SIZE, &half, 2), RVVM::RV_ERANGE);
+}
+
+TEST(RiscvPlic, State) {
+    riscv_plic a, b;
+    bool irq = false;
+    std::vector<uint8_t> state;
+    mmio_write(&a, ENABLE, 1U << 4);
+    mmio_write(&a, PRIORITY(4), 3);
+    mmio_write(&a, THRESHOLD, 2);
+    a.set_line(4, true);
+    EXPECT_EQ(mmio_read(&a, CLAIM), 4);
+    EXPECT_EQ(a.save_state(state), RVVM::RV_EOK);
+
+    /* claimed in the state, so not pending until completed */
+    b.set_irq([&](bool level) { irq = level; });
+    b.set_line(4, true);
+    EXPECT_EQ(b.load_state(state), RVVM::RV_EOK);
+    EXPECT_EQ(mmio_read(&b, PRIORITY(4)), 3);
+    EXPECT_EQ(mmio_read(&b, THRESHOLD), 2);
+    EXPECT_FALSE(irq);
+    mmio_write(&b, CLAIM, 4);
+    EXPECT_TRUE(irq);
+    EXPECT_EQ(mmio_read(&b, CLAIM), 4);
+
+    state.pop_back();
+    EXPECT_EQ(b.load_state(state), RVVM::RV_ERANGE);
+}
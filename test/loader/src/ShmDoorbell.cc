@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include "shm_doorbell.h"
+#include "mem_ram.h"
+#include "LoaderTest.h"
+#include "ZoraGA/RV32.h"
+#include "ZoraGA/RV32I.h"
+#include "ZoraGA/RV32Zicsr.h"
+#include "ZoraGA/RV32Privileged.h"
+#include <atomic>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define REG_ID       0x00
+#define REG_PEERS    0x04
+#define REG_DOORBELL 0x08
+#define REG_STATUS   0x0c
+#define REG_MASK     0x10
+
+#define RAM_ADDR  0x00000000
+#define RAM_SIZE  0x10000
+#define BELL_ADDR 0x10000000
+#define SHM_ADDR  0x20000000
+
+TEST(ShmDoorbell, Memory) {
+    mem_shm shm;
+    uint32_t val = 0;
+    EXPECT_FALSE(shm.create(4096, 0));
+    EXPECT_FALSE(shm.create(4096, SHM_PEERS_MAX + 1));
+    ASSERT_TRUE(shm.create(5000, 2));
+    EXPECT_EQ(shm.size(), 8192);
+    EXPECT_EQ(shm.write32(8188, 0x12345678), RVVM::RV_EOK);
+    EXPECT_EQ(shm.write32(8190, 0), RVVM::RV_ERANGE);
+
+    /* a view at another address, of the same pages */
+    void *at = mmap(nullptr, 8192, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(at, MAP_FAILED);
+    EXPECT_EQ(shm.map_at(at, 4096), RVVM::RV_EMISSING);
+    ASSERT_EQ(shm.map_at(at, 8192), RVVM::RV_EOK);
+    EXPECT_EQ(*(uint32_t*)((uint8_t*)at + 8188), 0x12345678);
+    *(uint32_t*)at = 0xcafe;
+    EXPECT_EQ(shm.read32(0, val), RVVM::RV_EOK);
+    EXPECT_EQ(val, 0xcafe);
+    shm.unmap_at(at, 8192);
+    munmap(at, 8192);
+}
+
+TEST(ShmDoorbell, Open) {
+    std::string name = "/rvvm_test_" + std::to_string(getpid());
+    mem_shm a, b, c;
+    uint32_t val = 0;
+    ASSERT_TRUE(a.open(name, 4096, 3));
+    ASSERT_TRUE(b.open(name, 4096, 3));
+    /* another layout than the creator's */
+    EXPECT_FALSE(c.open(name, 4096, 2));
+    shm_unlink(name.c_str());
+
+    EXPECT_EQ(a.write32(64, 0xa5a5a5a5), RVVM::RV_EOK);
+    EXPECT_EQ(b.read32(64, val), RVVM::RV_EOK);
+    EXPECT_EQ(val, 0xa5a5a5a5);
+    EXPECT_EQ(b.ctl()->peers, 3);
+}
+
+TEST(ShmDoorbell, Ring) {
+    mem_shm shm;
+    shm_doorbell a, b, c;
+    std::atomic<bool> irq{false};
+    ASSERT_TRUE(shm.create(4096, 2));
+    EXPECT_FALSE(c.attach(&shm, 2));
+    ASSERT_TRUE(a.attach(&shm, 0));
+    ASSERT_TRUE(b.attach(&shm, 1));
+    EXPECT_EQ(mmio_read(&b, REG_ID), 1);
+    EXPECT_EQ(mmio_read(&b, REG_PEERS), 2);
+    b.set_irq([&](bool level) { irq.store(level); });
+
+    /* masked, then raised by unmasking */
+    mmio_write(&a, REG_DOORBELL, 1);
+    EXPECT_TRUE(wait_for([&]{ return mmio_read(&b, REG_STATUS) == 1; }));
+    EXPECT_FALSE(irq.load());
+    mmio_write(&b, REG_MASK, 1);
+    EXPECT_TRUE(irq.load());
+
+    /* write 1 to clear, then a ring from the other thread */
+    mmio_write(&b, REG_STATUS, 1);
+    EXPECT_FALSE(irq.load());
+    mmio_write(&a, REG_DOORBELL, 1);
+    EXPECT_TRUE(wait_for([&]{ return irq.load(); }));
+    mmio_write(&b, REG_STATUS, 1);
+    EXPECT_FALSE(irq.load());
+
+    /* a peer out of range is ignored */
+    mmio_write(&b, REG_DOORBELL, 5);
+    mmio_write(&b, REG_DOORBELL, 0);
+    EXPECT_TRUE(wait_for([&]{ return mmio_read(&a, REG_STATUS) == 2; }));
+}
+
+TEST(ShmDoorbell, Close) {
+    void *at = mmap(nullptr, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(at, MAP_FAILED);
+    {
+        mem_shm shm;
+        ASSERT_TRUE(shm.create(4096, 1));
+        ASSERT_EQ(shm.map_at(at, 4096), RVVM::RV_EOK);
+    }
+
+    /* the view closed is still reserved, nothing else is mapped there */
+    void *p = mmap(at, 4096, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    EXPECT_EQ(p, MAP_FAILED);
+    EXPECT_EQ(errno, EEXIST);
+    munmap(at, 4096);
+}
+
+/**
+ * @brief A hart with a RAM at 0, the shared memory and a doorbell
+ */
+class shm_vm
+{
+    public:
+        shm_vm(mem_shm &shm, uint32_t id, bool flat, const std::vector<uint32_t> &prog, uint32_t trap = 0, const std::vector<uint32_t> &handler = {})
+        {
+            ram.set_size(RAM_SIZE);
+            ram.write(0, (void*)prog.data(), prog.size() * 4);
+            if (handler.size()) ram.write(trap, (void*)handler.data(), handler.size() * 4);
+            bell.attach(&shm, id);
+            bell.set_irq([&](bool level) {
+                vm.set_ext_irq(0, level);
+                irq.store(level);
+            });
+            vm.add_inst("I", &rv32i);
+            vm.add_inst("Zicsr", &zicsr);
+            vm.add_inst("Privileged", &privileged);
+            vm.add_mem(RAM_ADDR, RAM_SIZE, &ram);
+            vm.add_mem(BELL_ADDR, SHM_DOORBELL_SIZE, &bell);
+            vm.add_mem(SHM_ADDR, shm.size(), &shm);
+            EXPECT_TRUE(vm.set_flat(flat));
+        }
+
+        /* the VM goes first, it maps the memories */
+        std::atomic<bool> irq{false};
+        mem_ram ram;
+        shm_doorbell bell;
+        RVVM::RV32::RV32I rv32i;
+        RVVM::RV32::RV32Zicsr zicsr;
+        RVVM::RV32::RV32Privileged privileged;
+        RVVM::RV32::rv32 vm;
+};
+
+/* store 0x5a5 to the shared memory, ring peer 1 */
+static const std::vector<uint32_t> prog_ring = {
+    0x200002b7, 0x5a500313, 0x0062a023, 0x100003b7, 0x00100e13, 0x01c3a423, 0x0000006f,
+};
+/* mtvec 0x100, MEIE and MIE, wait */
+static const std::vector<uint32_t> prog_wait = {
+    0x10000293, 0x30529073, 0x000012b7, 0x80028293, 0x30429073, 0x30046073, 0x10500073, 0xffdff06f,
+};
+/* read the shared memory and mcause into a0 and a1 */
+static const std::vector<uint32_t> trap_read = {
+    0x200002b7, 0x0002a503, 0x342025f3, 0x0000006f,
+};
+
+static void shm_vms(bool flat_a, bool flat_b)
+{
+    mem_shm shm;
+    ASSERT_TRUE(shm.create(4096, 2));
+    shm_vm a(shm, 0, flat_a, prog_ring);
+    shm_vm b(shm, 1, flat_b, prog_wait, 0x100, trap_read);
+    mmio_write(&b.bell, REG_MASK, 1);
+
+    b.vm.step(8);
+    EXPECT_EQ(b.vm.regs()->pc, 0x18);
+    a.vm.step(7);
+    EXPECT_TRUE(wait_for([&]{ return b.irq.load(); }));
+    EXPECT_EQ(mmio_read(&b.bell, REG_STATUS), 1);
+    b.vm.step(8);
+    EXPECT_EQ(b.vm.regs()->x[10], 0x5a5);
+    EXPECT_EQ(b.vm.regs()->x[11], 0x8000000b);
+}
+
+TEST(ShmDoorbell, Vms) {
+    shm_vms(false, false);
+}
+
+TEST(ShmDoorbell, FlatVms) {
+    shm_vms(true, false);
+    shm_vms(true, true);
+}
+
+TEST(ShmDoorbell, Processes) {
+    std::string name = "/rvvm_test_" + std::to_string(getpid());
+    mem_shm shm;
+    shm_doorbell bell;
+    std::atomic<bool> irq{false};
+    ASSERT_TRUE(shm.open(name, 4096, 2));
+    ASSERT_TRUE(bell.attach(&shm, 0));
+    bell.set_irq([&](bool level) { irq.store(level); });
+    mmio_write(&bell, REG_MASK, 2);
+
+    /* the peer opens the same name, stores and rings */
+    pid_t pid = fork();
+    if (pid == 0) {
+        mem_shm peer;
+        shm_doorbell peer_bell;
+        bool ok = peer.open(name, 4096, 2) && peer_bell.attach(&peer, 1);
+        ok = ok && peer.write32(128, 0x600df00d) == RVVM::RV_EOK;
+        mmio_write(&peer_bell, REG_DOORBELL, 0);
+        _exit(ok ? 0 : 1);
+    }
+    ASSERT_GT(pid, 0);
+    int status = -1;
+    EXPECT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_EQ(status, 0);
+    shm_unlink(name.c_str());
+
+    uint32_t val = 0;
+    EXPECT_TRUE(wait_for([&]{ return irq.load(); }));
+    EXPECT_EQ(mmio_read(&bell, REG_STATUS), 2);
+    EXPECT_EQ(shm.read32(128, val), RVVM::RV_EOK);
+    EXPECT_EQ(val, 0x600df00d);
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "uart_16550.h"
+#include "LoaderTest.h"
+#include <atomic>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define RBR 0
+#define IER 1
+#define IIR 2
+#define LCR 3
+#define LSR 5
+
+#define IER_ERBFI 0x01
+#define IER_ETBEI 0x02
+#define IIR_NONE  0x01
+#define IIR_THRE  0x02
+#define IIR_RDA   0x04
+#define LSR_DR    0x01
+#define LSR_THRE  0x20
+#define LSR_TEMT  0x40
+
+static uint8_t reg(uart_16550 &uart, uint32_t addr)
+{
+    uint8_t val = 0;
+    uart.read(addr, &val, 1);
+    return val;
+}
+
+static void reg_write(uart_16550 &uart, uint32_t addr, uint8_t val)
+{
+    uart.write(addr, &val, 1);
+}
+
+TEST(Uart16550, File) {
+    char path[] = "/tmp/rvvm_uartXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    {
+        uart_16550 uart;
+        ASSERT_TRUE(uart.open(path));
+        EXPECT_EQ(reg(uart, LSR) & (LSR_THRE | LSR_TEMT), LSR_THRE | LSR_TEMT);
+        for (const char *s = "hello\n"; *s; s++) {
+            reg_write(uart, RBR, *s);
+        }
+        /* TX is drained before the I/O thread quits */
+    }
+    char buf[16] = {0};
+    EXPECT_EQ(pread(fd, buf, sizeof(buf), 0), 6);
+    EXPECT_STREQ(buf, "hello\n");
+    close(fd);
+    unlink(path);
+}
+
+TEST(Uart16550, Pty) {
+    uart_16550 uart;
+    std::atomic<bool> irq{false};
+    ASSERT_TRUE(uart.open("pty"));
+    int fd = open(uart.pty_name().c_str(), O_RDWR | O_NOCTTY);
+    ASSERT_GE(fd, 0);
+    struct termios tios;
+    tcgetattr(fd, &tios);
+    cfmakeraw(&tios);
+    tcsetattr(fd, TCSANOW, &tios);
+    uart.set_irq([&](bool level) { irq.store(level); });
+
+    /* received data, with its interrupt */
+    reg_write(uart, IER, IER_ERBFI);
+    EXPECT_EQ(reg(uart, IIR), IIR_NONE);
+    EXPECT_EQ(write(fd, "ab", 2), 2);
+    EXPECT_TRUE(wait_for([&]{ return irq.load(); }));
+    EXPECT_EQ(reg(uart, LSR) & LSR_DR, LSR_DR);
+    EXPECT_EQ(reg(uart, IIR), IIR_RDA);
+    EXPECT_EQ(reg(uart, RBR), 'a');
+    EXPECT_TRUE(wait_for([&]{ return reg(uart, LSR) & LSR_DR; }));
+    EXPECT_EQ(reg(uart, RBR), 'b');
+    EXPECT_FALSE(irq.load());
+    EXPECT_EQ(reg(uart, LSR) & LSR_DR, 0);
+
+    /* sent data */
+    reg_write(uart, RBR, 'z');
+    struct pollfd pfd = {fd, POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 5000), 1);
+    char c = 0;
+    EXPECT_EQ(read(fd, &c, 1), 1);
+    EXPECT_EQ(c, 'z');
+
+    /* THRE, acknowledged by reading IIR */
+    reg_write(uart, IER, IER_ETBEI);
+    EXPECT_TRUE(irq.load());
+    EXPECT_EQ(reg(uart, IIR), IIR_THRE);
+    EXPECT_FALSE(irq.load());
+    EXPECT_EQ(reg(uart, IIR), IIR_NONE);
+    close(fd);
+}
+
+TEST(Uart16550, Registers) {
+    uart_16550 uart;
+    bool irq = false;
+
+    /* the divisor latch behind DLAB */
+    reg_write(uart, LCR, 0x83);
+    reg_write(uart, RBR, 0x12);
+    reg_write(uart, IER, 0x34);
+    EXPECT_EQ(reg(uart, RBR), 0x12);
+    EXPECT_EQ(reg(uart, IER), 0x34);
+    reg_write(uart, LCR, 0x03);
+    EXPECT_EQ(reg(uart, IER), 0);
+    EXPECT_EQ(reg(uart, LCR), 0x03);
+
+    /* a raised output is given to the callback set later */
+    reg_write(uart, IER, IER_ETBEI);
+    uart.set_irq([&](bool level) { irq = level; });
+    EXPECT_TRUE(irq);
+
+    std::vector<uint8_t> state;
+    uart_16550 other;
+    EXPECT_EQ(uart.save_state(state), RVVM::RV_EOK);
+    EXPECT_EQ(other.load_state(state), RVVM::RV_EOK);
+    EXPECT_EQ(reg(other, IER), IER_ETBEI);
+    EXPECT_EQ(reg(other, IIR), IIR_THRE);
+    EXPECT_EQ(uart.read(UART_16550_SIZE, &state[0], 1), RVVM::RV_ERANGE);
+}
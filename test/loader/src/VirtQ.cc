@@ -0,0 +1,140 @@
+#include "VirtQ.h"
+#include "LoaderTest.h"
+
+/* registers */
+#define REG_DRV_FEATURES   0x020
+#define REG_DRV_FEAT_SEL   0x024
+#define REG_QUEUE_SEL      0x030
+#define REG_QUEUE_NUM      0x038
+#define REG_QUEUE_READY    0x044
+#define REG_QUEUE_NOTIFY   0x050
+#define REG_STATUS         0x070
+#define REG_QUEUE_DESC_LO  0x080
+#define REG_QUEUE_AVAIL_LO 0x090
+#define REG_QUEUE_USED_LO  0x0a0
+
+#define STATUS_ACKNOWLEDGE 1
+#define STATUS_DRIVER      2
+#define STATUS_DRIVER_OK   4
+#define STATUS_FEATURES_OK 8
+
+/* rings of a queue, descriptors, avail and used a page each */
+#define QUEUE_STRIDE 0x4000
+
+using namespace ZoraGA::RVVM;
+
+VirtQ::VirtQ(virtio_mmio *dev, uint32_t queues, uint16_t num)
+    : m_dev(dev), m_queues(queues), m_num(num), m_next(queues), m_avail(queues)
+{
+    ram.set_size(VQ_RAM_SIZE);
+    m_dev->set_ram(&ram, VQ_RAM_ADDR);
+}
+
+VirtQ::~VirtQ()
+{}
+
+void VirtQ::start(uint64_t features)
+{
+    features |= 1ULL << VIRTIO_F_VERSION_1;
+    reg_write(REG_STATUS, STATUS_ACKNOWLEDGE);
+    reg_write(REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+    for (uint32_t i=0; i<2; i++) {
+        reg_write(REG_DRV_FEAT_SEL, i);
+        reg_write(REG_DRV_FEATURES, (uint32_t)(features >> (i * 32)));
+    }
+    reg_write(REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_FEATURES_OK);
+    for (uint32_t q=0; q<m_queues; q++) {
+        reg_write(REG_QUEUE_SEL, q);
+        reg_write(REG_QUEUE_NUM, m_num);
+        reg_write(REG_QUEUE_DESC_LO, desc_addr(q));
+        reg_write(REG_QUEUE_AVAIL_LO, avail_addr(q));
+        reg_write(REG_QUEUE_USED_LO, used_addr(q));
+        reg_write(REG_QUEUE_READY, 1);
+    }
+    reg_write(REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_FEATURES_OK | STATUS_DRIVER_OK);
+}
+
+uint32_t VirtQ::reg(uint32_t addr)
+{
+    return mmio_read(m_dev, addr);
+}
+
+void VirtQ::reg_write(uint32_t addr, uint32_t val)
+{
+    mmio_write(m_dev, addr, val);
+}
+
+uint8_t *VirtQ::mem(uint32_t addr)
+{
+    uint32_t len = 0;
+    return (uint8_t*)ram.host(len) + (addr - VQ_RAM_ADDR);
+}
+
+uint16_t VirtQ::add(uint32_t q, const std::vector<buf> &bufs, bool publish)
+{
+    uint16_t head = m_next[q];
+    for (size_t i=0; i<bufs.size(); i++) {
+        uint16_t idx   = m_next[q];
+        uint16_t next  = (idx + 1) % m_num;
+        uint64_t addr  = bufs[i].addr;
+        uint16_t flags = (bufs[i].write ? VIRTQ_DESC_F_WRITE : 0) | (i + 1 < bufs.size() ? VIRTQ_DESC_F_NEXT : 0);
+        uint8_t *desc  = mem(desc_addr(q) + idx * 16);
+        memcpy(desc, &addr, 8);
+        memcpy(desc + 8, &bufs[i].len, 4);
+        memcpy(desc + 12, &flags, 2);
+        memcpy(desc + 14, &next, 2);
+        m_next[q] = next;
+    }
+    uint8_t *avail = mem(avail_addr(q));
+    memcpy(avail + 4 + (m_avail[q] % m_num) * 2, &head, 2);
+    m_avail[q]++;
+    if (publish) set_avail(q, m_avail[q]);
+    return head;
+}
+
+void VirtQ::set_avail(uint32_t q, uint16_t idx)
+{
+    __atomic_store_n((uint16_t*)(mem(avail_addr(q)) + 2), idx, __ATOMIC_RELEASE);
+}
+
+uint16_t VirtQ::avail(uint32_t q)
+{
+    return m_avail[q];
+}
+
+void VirtQ::notify(uint32_t q)
+{
+    reg_write(REG_QUEUE_NOTIFY, q);
+}
+
+uint16_t VirtQ::used(uint32_t q)
+{
+    return __atomic_load_n((uint16_t*)(mem(used_addr(q)) + 2), __ATOMIC_ACQUIRE);
+}
+
+void VirtQ::used_elem(uint32_t q, uint16_t i, uint32_t &id, uint32_t &len)
+{
+    uint8_t *elem = mem(used_addr(q)) + 4 + (i % m_num) * 8;
+    memcpy(&id, elem, 4);
+    memcpy(&len, elem + 4, 4);
+}
+
+bool VirtQ::wait_used(uint32_t q, uint16_t idx, int ms)
+{
+    return wait_for([&]{ return used(q) == idx; }, ms);
+}
+
+uint32_t VirtQ::desc_addr(uint32_t q)
+{
+    return VQ_RAM_ADDR + q * QUEUE_STRIDE;
+}
+
+uint32_t VirtQ::avail_addr(uint32_t q)
+{
+    return desc_addr(q) + 0x1000;
+}
+
+uint32_t VirtQ::used_addr(uint32_t q)
+{
+    return desc_addr(q) + 0x2000;
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include "virtio_blk.h"
+#include "VirtQ.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define REG_DEVICE_ID 0x008
+#define REG_STATUS    0x070
+#define REG_CONFIG    0x100
+
+#define T_IN     0
+#define T_OUT    1
+#define T_FLUSH  4
+#define T_GET_ID 8
+#define T_BAD    99
+
+#define S_OK     0
+#define S_IOERR  1
+#define S_UNSUPP 2
+
+#define NEEDS_RESET 64
+
+#define SECTORS 128
+
+/**
+ * @brief A disk image of SECTORS sectors, byte i is i * 7
+ */
+class blk_image
+{
+    public:
+        blk_image()
+        {
+            char tmpl[] = "/tmp/rvvm_blkXXXXXX";
+            fd   = mkstemp(tmpl);
+            path = tmpl;
+            std::vector<uint8_t> data(SECTORS * 512);
+            for (size_t i=0; i<data.size(); i++) {
+                data[i] = i * 7;
+            }
+            EXPECT_EQ(write(fd, data.data(), data.size()), (ssize_t)data.size());
+        }
+
+        ~blk_image()
+        {
+            close(fd);
+            unlink(path.c_str());
+        }
+
+        int fd;
+        std::string path;
+};
+
+/**
+ * @brief A request, header at VQ_DATA, status after the data, returns the status
+ */
+static uint8_t blk_req(VirtQ &vq, uint32_t type, uint64_t sector, uint32_t data, uint32_t len, bool write)
+{
+    uint8_t *hdr = vq.mem(VQ_DATA);
+    memset(hdr, 0, 16);
+    memcpy(hdr, &type, 4);
+    memcpy(hdr + 8, &sector, 8);
+    uint32_t status = data + len;
+    *vq.mem(status) = 0xff;
+
+    std::vector<VirtQ::buf> bufs = {{VQ_DATA, 16, false}};
+    if (len) bufs.push_back({data, len, write});
+    bufs.push_back({status, 1, true});
+    uint16_t head = vq.add(0, bufs);
+    uint16_t used = vq.used(0);
+    vq.notify(0);
+    EXPECT_TRUE(vq.wait_used(0, used + 1));
+
+    uint32_t id, n;
+    vq.used_elem(0, used, id, n);
+    EXPECT_EQ(id, head);
+    return *vq.mem(status);
+}
+
+TEST(VirtioBlk, ReadWrite) {
+    blk_image img;
+    virtio_blk blk;
+    VirtQ vq(&blk, 1, 16);
+    ASSERT_TRUE(blk.open(img.path, false));
+    EXPECT_EQ(vq.reg(REG_DEVICE_ID), 2);
+    EXPECT_EQ(vq.reg(REG_CONFIG), SECTORS);
+    vq.start(0);
+
+    /* read sectors 2 and 3 */
+    uint32_t data = VQ_DATA + 0x1000;
+    EXPECT_EQ(blk_req(vq, T_IN, 2, data, 1024, true), S_OK);
+    for (uint32_t i=0; i<1024; i++) {
+        ASSERT_EQ(vq.mem(data)[i], (uint8_t)((1024 + i) * 7));
+    }
+
+    /* write sector 5, read back from the image */
+    memset(vq.mem(data), 0x5a, 512);
+    EXPECT_EQ(blk_req(vq, T_OUT, 5, data, 512, false), S_OK);
+    EXPECT_EQ(blk_req(vq, T_FLUSH, 0, data, 0, false), S_OK);
+    uint8_t buf[512];
+    EXPECT_EQ(pread(img.fd, buf, 512, 5 * 512), 512);
+    for (uint32_t i=0; i<512; i++) {
+        ASSERT_EQ(buf[i], 0x5a);
+    }
+
+    /* the ID string */
+    EXPECT_EQ(blk_req(vq, T_GET_ID, 0, data, 20, true), S_OK);
+    EXPECT_STREQ((char*)vq.mem(data), "rvvm-virtio-blk");
+}
+
+TEST(VirtioBlk, Errors) {
+    blk_image img;
+    virtio_blk blk;
+    VirtQ vq(&blk, 1, 16);
+    ASSERT_TRUE(blk.open(img.path, true));
+    vq.start(0);
+    uint32_t data = VQ_DATA + 0x1000;
+
+    /* read-only, past the end, not whole sectors, unknown type */
+    EXPECT_EQ(blk_req(vq, T_OUT, 0, data, 512, false), S_IOERR);
+    EXPECT_EQ(blk_req(vq, T_IN, SECTORS - 1, data, 1024, true), S_IOERR);
+    EXPECT_EQ(blk_req(vq, T_IN, 0, data, 100, true), S_IOERR);
+    EXPECT_EQ(blk_req(vq, T_BAD, 0, data, 0, false), S_UNSUPP);
+    EXPECT_EQ(vq.reg(REG_STATUS) & NEEDS_RESET, 0);
+
+    /* a chain without a status byte is a device error, not given back */
+    uint16_t used = vq.used(0);
+    vq.add(0, {{VQ_DATA, 16, false}});
+    vq.notify(0);
+    EXPECT_EQ(vq.reg(REG_STATUS) & NEEDS_RESET, NEEDS_RESET);
+    EXPECT_EQ(vq.used(0), used);
+}
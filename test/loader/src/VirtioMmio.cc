@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include "virtio_blk.h"
+#include "VirtQ.h"
+#include <unistd.h>
+
+using namespace ZoraGA;
+
+#define REG_MAGIC         0x000
+#define REG_VERSION       0x004
+#define REG_QUEUE_SEL     0x030
+#define REG_QUEUE_NUM_MAX 0x034
+#define REG_QUEUE_NUM     0x038
+#define REG_STATUS        0x070
+
+#define NEEDS_RESET 64
+
+TEST(VirtioMmio, Registers) {
+    virtio_blk blk;
+    VirtQ vq(&blk, 1, 16);
+    uint16_t half;
+    EXPECT_EQ(vq.reg(REG_MAGIC), 0x74726976);
+    EXPECT_EQ(vq.reg(REG_VERSION), 2);
+    EXPECT_EQ(vq.reg(REG_QUEUE_NUM_MAX), 256);
+    EXPECT_EQ(blk.read(REG_STATUS, &half, 2), RVVM::RV_EDALIGN);
+    EXPECT_EQ(blk.read(VIRTIO_MMIO_SIZE, &half, 2), RVVM::RV_ERANGE);
+
+    /* status 0 resets */
+    vq.start(0);
+    EXPECT_NE(vq.reg(REG_STATUS), 0);
+    vq.reg_write(REG_STATUS, 0);
+    EXPECT_EQ(vq.reg(REG_STATUS), 0);
+}
+
+TEST(VirtioMmio, QueueNum) {
+    virtio_blk blk;
+    VirtQ vq(&blk, 1, 12);
+
+    /* split queue sizes are powers of 2 */
+    vq.start(0);
+    EXPECT_EQ(vq.reg(REG_STATUS) & NEEDS_RESET, NEEDS_RESET);
+    vq.reg_write(REG_STATUS, 0);
+    vq.reg_write(REG_QUEUE_SEL, 0);
+    vq.reg_write(REG_QUEUE_NUM, 16);
+    vq.reg_write(REG_QUEUE_NUM, 1);
+    EXPECT_EQ(vq.reg(REG_STATUS), 0);
+    vq.reg_write(REG_QUEUE_NUM, 3);
+    EXPECT_EQ(vq.reg(REG_STATUS), NEEDS_RESET);
+}
+
+TEST(VirtioMmio, AvailIndex) {
+    char path[] = "/tmp/rvvm_blkXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, 4096), 0);
+    virtio_blk blk;
+    VirtQ vq(&blk, 1, 16);
+    ASSERT_TRUE(blk.open(path, false));
+    vq.start(0);
+
+    /* more chains than the queue holds, a stale head would be served again */
+    *vq.mem(VQ_DATA + 16) = 0xff;
+    vq.add(0, {{VQ_DATA, 16, false}, {VQ_DATA + 16, 1, true}}, false);
+    vq.set_avail(0, 17);
+    vq.notify(0);
+    EXPECT_EQ(vq.reg(REG_STATUS) & NEEDS_RESET, NEEDS_RESET);
+    EXPECT_EQ(vq.used(0), 0);
+    EXPECT_EQ(*vq.mem(VQ_DATA + 16), 0xff);
+    close(fd);
+    unlink(path);
+}
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include "virtio_net.h"
+#include "VirtQ.h"
+#include <chrono>
+#include <thread>
+
+using namespace ZoraGA;
+
+#define REG_DEVICE_ID 0x008
+#define REG_CONFIG    0x100
+
+#define RXQ 0
+#define TXQ 1
+#define QUEUE_NUM 256
+
+#define F_MAC       5
+#define F_EVENT_IDX 29
+
+#define HDR_SIZE     12
+#define HDR_NUM_BUFS 10
+/* a buffer per descriptor, header and frame */
+#define BUF_SIZE     2048
+
+static uint32_t frame_len(uint32_t i)
+{
+    return 60 + (i * 37) % 1454;
+}
+
+static uint8_t frame_byte(uint32_t i, uint32_t j)
+{
+    return (i + j * 13) & 0xff;
+}
+
+/**
+ * @brief Send packets from a device to another, each driven by a queue of the test
+ *
+ * Both rings are kept full, chains of one descriptor are completed in order,
+ * so the buffer of a chain is the one of its head.
+ *
+ * @return uint32_t Packets received whole and in order
+ */
+static uint32_t net_run(net_pipe &pa, net_pipe &pb, uint32_t count)
+{
+    virtio_net a, b;
+    VirtQ qa(&a, 2, QUEUE_NUM), qb(&b, 2, QUEUE_NUM);
+    uint64_t features = (1ULL << F_MAC) | (1ULL << F_EVENT_IDX);
+    qa.start(features);
+    qb.start(features);
+    a.set_pipe(&pa);
+    b.set_pipe(&pb);
+
+    uint32_t sent = 0, received = 0;
+    bool bad = false;
+    for (uint32_t i=0; i<QUEUE_NUM; i++) {
+        qb.add(RXQ, {{VQ_DATA + i * BUF_SIZE, BUF_SIZE, true}});
+    }
+    qb.notify(RXQ);
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!bad && received < count && std::chrono::steady_clock::now() < end) {
+        /* room in the TX ring, for the packets not sent yet */
+        uint16_t tx_used = qa.used(TXQ);
+        bool kick = false;
+        while (sent < count && (uint16_t)(sent - tx_used) < QUEUE_NUM) {
+            uint32_t addr = VQ_DATA + (sent % QUEUE_NUM) * BUF_SIZE;
+            uint8_t *p = qa.mem(addr);
+            memset(p, 0, HDR_SIZE);
+            for (uint32_t j=0; j<frame_len(sent); j++) {
+                p[HDR_SIZE + j] = frame_byte(sent, j);
+            }
+            qa.add(TXQ, {{addr, HDR_SIZE + frame_len(sent), false}});
+            sent++;
+            kick = true;
+        }
+        if (kick) qa.notify(TXQ);
+
+        /* check the packets received, and give their buffers back */
+        uint16_t rx_used = qb.used(RXQ);
+        kick = false;
+        while ((uint16_t)received != rx_used) {
+            uint32_t id, len;
+            qb.used_elem(RXQ, received, id, len);
+            uint8_t *p = qb.mem(VQ_DATA + id * BUF_SIZE);
+            bool ok = id == (received % QUEUE_NUM) && len == HDR_SIZE + frame_len(received) && p[HDR_NUM_BUFS] == 1;
+            for (uint32_t j=0; ok && j<frame_len(received); j++) {
+                ok = p[HDR_SIZE + j] == frame_byte(received, j);
+            }
+            if (!ok) {
+                bad = true;
+                break;
+            }
+            qb.add(RXQ, {{VQ_DATA + id * BUF_SIZE, BUF_SIZE, true}});
+            received++;
+            kick = true;
+        }
+        if (kick) qb.notify(RXQ);
+    }
+
+    a.set_pipe(nullptr);
+    b.set_pipe(nullptr);
+    return received;
+}
+
+TEST(VirtioNet, Config) {
+    virtio_net net;
+    const uint8_t mac[6] = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+    net.set_mac(mac);
+    uint8_t cfg[8];
+    EXPECT_EQ(net.read(REG_CONFIG, cfg, 8), RVVM::RV_EOK);
+    EXPECT_EQ(memcmp(cfg, mac, 6), 0);
+    EXPECT_EQ(cfg[6], 1);
+    uint32_t id;
+    EXPECT_EQ(net.read(REG_DEVICE_ID, &id, 4), RVVM::RV_EOK);
+    EXPECT_EQ(id, 1);
+}
+
+TEST(VirtioNet, SocketRun) {
+    net_socket a, b;
+    ASSERT_TRUE(net_socket::pair(a, b));
+    EXPECT_EQ(net_run(a, b, 50000), 50000);
+}
+
+TEST(VirtioNet, ShmRun) {
+    net_shm a, b;
+    ASSERT_TRUE(net_shm::pair(a, b));
+    EXPECT_EQ(net_run(a, b, 50000), 50000);
+}
+
+/**
+ * @brief Send a frame of the length of i from the peer side of a pipe
+ */
+static void net_send(net_pipe &pipe, uint32_t i)
+{
+    std::vector<uint8_t> frame(frame_len(i));
+    for (uint32_t j=0; j<frame.size(); j++) {
+        frame[j] = frame_byte(i, j);
+    }
+    struct iovec iov = {frame.data(), frame.size()};
+    struct mmsghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_hdr.msg_iov    = &iov;
+    msg.msg_hdr.msg_iovlen = 1;
+    EXPECT_EQ(pipe.send(&msg, 1), 1);
+}
+
+TEST(VirtioNet, Rewind) {
+    net_socket a, b;
+    ASSERT_TRUE(net_socket::pair(a, b));
+    virtio_net net;
+    VirtQ vq(&net, 2, 16);
+    vq.start(1ULL << F_MAC);
+    net.set_pipe(&a);
+
+    /* A and B, C read-only so malformed, D, one packet for them */
+    net_send(b, 0);
+    uint16_t ha = vq.add(RXQ, {{VQ_DATA, BUF_SIZE, true}}, false);
+    uint16_t hb = vq.add(RXQ, {{VQ_DATA + BUF_SIZE, BUF_SIZE, true}}, false);
+    uint16_t hc = vq.add(RXQ, {{VQ_DATA + 2 * BUF_SIZE, BUF_SIZE, false}}, false);
+    uint16_t hd = vq.add(RXQ, {{VQ_DATA + 3 * BUF_SIZE, BUF_SIZE, true}}, false);
+    vq.set_avail(RXQ, vq.avail(RXQ));
+    vq.notify(RXQ);
+
+    /* B, C and D are given back, C is not returned before B */
+    EXPECT_TRUE(vq.wait_used(RXQ, 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(vq.used(RXQ), 1);
+
+    /* then B, C once, and D */
+    net_send(b, 1);
+    EXPECT_TRUE(vq.wait_used(RXQ, 3));
+    net_send(b, 2);
+    EXPECT_TRUE(vq.wait_used(RXQ, 4));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(vq.used(RXQ), 4);
+    net.set_pipe(nullptr);
+
+    uint32_t heads[4] = {ha, hb, hc, hd};
+    uint32_t lens[4]  = {HDR_SIZE + frame_len(0), HDR_SIZE + frame_len(1), 0, HDR_SIZE + frame_len(2)};
+    for (uint16_t i=0; i<4; i++) {
+        uint32_t id, len;
+        vq.used_elem(RXQ, i, id, len);
+        EXPECT_EQ(id, heads[i]);
+        EXPECT_EQ(len, lens[i]);
+    }
+    EXPECT_EQ(vq.mem(VQ_DATA + 3 * BUF_SIZE)[HDR_SIZE], frame_byte(2, 0));
+}
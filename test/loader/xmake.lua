@@ -0,0 +1,10 @@
+add_requires("gtest", "zlib")
+target("test_loader")
+    set_default(false)
+    set_kind("binary")
+    set_targetdir("dist")
+    set_languages("c99","c++17")
+    add_packages("gtest", "zlib")
+    add_files("src/*.cc", "../../rv32_loader/src/*.cc|loader.cc")
+    add_includedirs("include", "../common/include", "../../rv32_loader/include")
+    add_deps("rvvm")
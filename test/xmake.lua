@@ -1 +1,2 @@
-includes("insts")
\ No newline at end of file
+includes("insts")
+includes("loader")
\ No newline at end of file
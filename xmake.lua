@@ -12,4 +12,5 @@ target("rvvm")
     add_syslinks("pthread")
 
 includes("rv32_loader")
+includes("rv32_fuzzer")
 includes("test")
\ No newline at end of file